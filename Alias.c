@@ -0,0 +1,246 @@
+/**
+ * @file Alias.c
+ * @brief Aliases for SnailShell
+ *
+ * An alias replaces the first word of a pipeline stage with other words,
+ * such as "ll" with "ls -l". Aliases are kept in a hash table, so looking
+ * up the first word of every command costs one probe however many aliases
+ * are defined. The text of an alias is split into words once, when it is
+ * defined; parse() adds these words to the stage directly instead of
+ * scanning the text again each time the alias is used.
+ *
+ * Definitions use the unexpanded rest of the line ("alias ll=ls -l | less"),
+ * since the shell has no quoting to group several words into one argument.
+ * Variables and globs in the alias text are expanded when it is used.
+ */
+
+#include "SnailShell.h"
+
+static Table aliases;
+
+/**
+ * @brief Looks up an alias
+ * @param name The alias name
+ * @return Pointer to the Alias, or NULL if no alias has that name
+ */
+Alias * findAlias(const char * name) {
+    TableEntry * entry = tableFind(&aliases, name, strlen(name));
+    return entry != NULL ? entry->value : NULL;
+}
+
+/**
+ * @brief Iterates over the names of the defined aliases
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @return The next alias name, or NULL when all were visited
+ */
+const char * nextAliasName(size_t * cursor) {
+    TableEntry * entry = tableNext(&aliases, cursor);
+    return entry != NULL ? entry->key : NULL;
+}
+
+/**
+ * @brief Releases an alias
+ * @param alias Pointer to the Alias
+ */
+static void freeAlias(Alias * alias) {
+    free(alias->text);
+    free(alias->storage);
+    free(alias->tokens);
+    free(alias);
+}
+
+/**
+ * @brief Checks whether a string is a valid alias name
+ * @param name Start of the candidate name
+ * @param length Length of the candidate name
+ * @return Non-zero if name is non-empty and free of blanks and shell
+ *         metacharacters
+ */
+static int isValidAliasName(const char * name, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (strchr(" \t|<>$/=\\", name[i]) != NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Splits the text of an alias into the words parse() adds for it
+ * @param alias Pointer to the Alias whose text is split
+ *
+ * Stages are separated by a "|" word, which parse() never produces for
+ * ordinary input because lines are split at '|' before words are.
+ */
+static void tokenizeAlias(Alias * alias) {
+    alias->storage = strdup(alias->text);
+    if (alias->storage == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    int capacity = 0;
+    char * stagePtr;
+    char * stage = strtok_r(alias->storage, "|", &stagePtr);
+    while (stage != NULL) {
+        if (alias->tokenCount > 0) {
+            appendWord(&alias->tokens, &alias->tokenCount, &capacity, ALIAS_STAGE_SEPARATOR);
+        }
+
+        char * wordPtr;
+        char * word = strtok_r(stage, " \t", &wordPtr);
+        while (word != NULL) {
+            appendWord(&alias->tokens, &alias->tokenCount, &capacity, word);
+            word = strtok_r(NULL, " \t", &wordPtr);
+        }
+        stage = strtok_r(NULL, "|", &stagePtr);
+    }
+}
+
+/**
+ * @brief Defines or replaces an alias
+ * @param definition The text "name=value" following the alias keyword
+ * @return 0 on success, -1 if the name is invalid
+ */
+int defineAlias(const char * definition) {
+    const char * equalSign = strchr(definition, '=');
+    size_t nameLength = equalSign - definition;
+    if (!isValidAliasName(definition, nameLength)) {
+        printError(ERROR_ALIAS_INVALID, (int) nameLength, definition);
+        return -1;
+    }
+
+    Alias * alias = calloc(1, sizeof(Alias));
+    if (alias == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    alias->text = strdup(equalSign + 1);
+    if (alias->text == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    tokenizeAlias(alias);
+
+    TableEntry * entry = tableInsert(&aliases, definition, nameLength);
+    if (entry->value != NULL) {
+        freeAlias(entry->value);
+    }
+    entry->value = alias;
+    return 0;
+}
+
+/**
+ * @brief Prints an alias in a form that can be read back
+ * @param entry Pointer to the table entry of the alias
+ */
+static void printAlias(TableEntry * entry) {
+    Alias * alias = entry->value;
+    printf("alias %s=%s\n", entry->key, alias->text);
+}
+
+/**
+ * @brief Orders alias table entries by name for qsort()
+ * @param a Pointer to the first TableEntry pointer
+ * @param b Pointer to the second TableEntry pointer
+ * @return Negative, zero or positive as for strcmp()
+ */
+static int compareAliases(const void * a, const void * b) {
+    const TableEntry * first = *(TableEntry * const *) a;
+    const TableEntry * second = *(TableEntry * const *) b;
+    return strcmp(first->key, second->key);
+}
+
+/**
+ * @brief Handles the built-in alias command
+ * @param curr Pointer to the Command structure containing alias arguments
+ * @return 0 on success, -1 if a named alias does not exist
+ *
+ * Usage: alias [name ...]
+ *
+ * Prints the named aliases, or all aliases sorted by name. Definitions
+ * ("alias name=value") are handled by parse() before the line is split.
+ */
+int handleAlias(Command * curr) {
+    if (curr->argCount > 1) {
+        int ret = 0;
+        for (int i = 1; i < curr->argCount; i++) {
+            TableEntry * entry = tableFind(&aliases, curr->args[i], strlen(curr->args[i]));
+            if (entry == NULL) {
+                printError(ERROR_ALIAS_NOT_FOUND, "alias", curr->args[i]);
+                ret = -1;
+            } else {
+                printAlias(entry);
+            }
+        }
+        return ret;
+    }
+
+    if (aliases.count == 0) {
+        return 0;
+    }
+
+    TableEntry ** entries = malloc(sizeof(TableEntry *) * aliases.count);
+    if (entries == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t count = 0;
+    size_t cursor = 0;
+    TableEntry * entry;
+    while ((entry = tableNext(&aliases, &cursor)) != NULL) {
+        entries[count++] = entry;
+    }
+
+    qsort(entries, count, sizeof(TableEntry *), compareAliases);
+    for (size_t i = 0; i < count; i++) {
+        printAlias(entries[i]);
+    }
+    free(entries);
+    return 0;
+}
+
+/**
+ * @brief Handles the built-in unalias command
+ * @param curr Pointer to the Command structure containing unalias arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: unalias -a | name [name ...]
+ *
+ * -a removes every alias.
+ */
+int handleUnalias(Command * curr) {
+    if (curr->argCount < 2) {
+        printError(ERROR_UNALIAS_USAGE);
+        return -1;
+    }
+
+    if (strcmp(curr->args[1], "-a") == 0) {
+        size_t cursor = 0;
+        TableEntry * entry;
+        while ((entry = tableNext(&aliases, &cursor)) != NULL) {
+            freeAlias(entry->value);
+        }
+        tableFree(&aliases);
+        return 0;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < curr->argCount; i++) {
+        TableEntry * entry = tableFind(&aliases, curr->args[i], strlen(curr->args[i]));
+        if (entry == NULL) {
+            printError(ERROR_ALIAS_NOT_FOUND, "unalias", curr->args[i]);
+            ret = -1;
+            continue;
+        }
+
+        freeAlias(entry->value);
+        tableRemove(&aliases, entry);
+    }
+    return ret;
+}
@@ -0,0 +1,201 @@
+/**
+ * @file Append.c
+ * @brief Descriptor cache for append redirections
+ *
+ * Generated scripts often end thousands of lines with ">> same.log", and
+ * every one of them opens and closes the file again. With
+ * "shopt -s appendcache", the shell keeps the files most recently used
+ * with ">>" open and hands the open descriptor to each command instead:
+ * a forked stage dup2()s it onto its standard output, and built-ins and
+ * compound commands do the same inside the shell.
+ *
+ * Cache Behavior:
+ * - Up to APPEND_CACHE_SIZE files, keyed by absolute path, the least
+ *   recently used one being closed to make room
+ * - Descriptors are opened with O_APPEND, so every write still lands at
+ *   the current end of the file, even if another process truncated it
+ * - Each file is watched with inotify; when it is renamed, unlinked or
+ *   its attributes change, its descriptor is closed and the next ">>"
+ *   opens the path again. Without inotify, the path is checked with
+ *   stat() against the cached device and inode on every use
+ * - Disabling the option closes every cached descriptor
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+static AppendTarget targets[APPEND_CACHE_SIZE];
+static int targetCount;
+static unsigned long useCounter;
+static int watchFd = -1;
+static int watchState;
+
+/**
+ * @brief Closes a cached descriptor and removes its entry
+ * @param index Position of the entry in the cache
+ *
+ * The inotify watch is removed unless another entry (the same file under
+ * a different path) shares it.
+ */
+static void dropTarget(int index) {
+    AppendTarget * target = &targets[index];
+    if (target->watch != -1) {
+        int shared = 0;
+        for (int i = 0; i < targetCount; i++) {
+            shared = shared || (i != index && targets[i].watch == target->watch);
+        }
+        if (!shared) {
+            inotify_rm_watch(watchFd, target->watch);
+        }
+    }
+
+    close(target->fd);
+    free(target->path);
+    targets[index] = targets[--targetCount];
+}
+
+/**
+ * @brief Closes every cached descriptor
+ */
+static void dropAllTargets() {
+    while (targetCount > 0) {
+        dropTarget(targetCount - 1);
+    }
+}
+
+/**
+ * @brief Drops the entries of files that were renamed, unlinked or changed
+ *
+ * Reads the pending inotify events without blocking.
+ */
+static void processAppendEvents() {
+    char events[CACHE_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t bytes = read(watchFd, events, sizeof(events));
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return;
+        }
+
+        for (char * cursor = events; cursor < events + bytes; ) {
+            struct inotify_event * event = (struct inotify_event *) cursor;
+            cursor += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                dropAllTargets();
+                continue;
+            }
+            for (int i = targetCount - 1; i >= 0; i--) {
+                if (targets[i].watch == event->wd) {
+                    if (event->mask & IN_IGNORED) {
+                        targets[i].watch = -1;
+                    }
+                    dropTarget(i);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Builds the absolute path a redirection target refers to
+ * @param path The path as written
+ * @param absolute Pointer to the Buffer receiving the absolute path
+ * @return 0 on success, -1 if the working directory is unknown
+ */
+static int absolutePath(const char * path, Buffer * absolute) {
+    if (path[0] != '/') {
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            return -1;
+        }
+        bufferAppend(absolute, cwd, strlen(cwd));
+        bufferAppend(absolute, "/", 1);
+    }
+    bufferAppend(absolute, path, strlen(path));
+    return 0;
+}
+
+/**
+ * @brief Returns an open append descriptor for a redirection target
+ * @param path The file named after ">>"
+ * @return A descriptor opened with O_APPEND that the caller must not close,
+ *         or -1 if the cache is disabled or the file cannot be opened
+ *         (the caller then opens the file itself and reports any error)
+ */
+int findAppendTarget(const char * path) {
+    if (!isOptionEnabled(OPTION_APPENDCACHE)) {
+        if (targetCount > 0) {
+            dropAllTargets();
+        }
+        return -1;
+    }
+
+    if (watchState == 0) {
+        watchFd = moveShellFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+        watchState = 1;
+    }
+    if (watchFd != -1) {
+        processAppendEvents();
+    }
+
+    Buffer absolute;
+    memset(&absolute, 0, sizeof(Buffer));
+    if (absolutePath(path, &absolute) == -1) {
+        free(absolute.data);
+        return -1;
+    }
+
+    for (int i = 0; i < targetCount; i++) {
+        AppendTarget * target = &targets[i];
+        if (strcmp(target->path, absolute.data) != 0) {
+            continue;
+        }
+
+        struct stat info;
+        if (target->watch == -1 && (stat(absolute.data, &info) == -1 || info.st_dev != target->device ||
+                                    info.st_ino != target->inode)) {
+            dropTarget(i);
+            break;
+        }
+
+        target->lastUse = ++useCounter;
+        free(absolute.data);
+        return target->fd;
+    }
+
+    int fd = moveShellFd(open(absolute.data, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666));
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+        if (fd != -1) {
+            close(fd);
+        }
+        free(absolute.data);
+        return -1;
+    }
+
+    if (targetCount == APPEND_CACHE_SIZE) {
+        int oldest = 0;
+        for (int i = 1; i < targetCount; i++) {
+            if (targets[i].lastUse < targets[oldest].lastUse) {
+                oldest = i;
+            }
+        }
+        dropTarget(oldest);
+    }
+
+    AppendTarget * target = &targets[targetCount++];
+    target->path = absolute.data;
+    target->fd = fd;
+    target->device = info.st_dev;
+    target->inode = info.st_ino;
+    target->lastUse = ++useCounter;
+    target->watch = watchFd != -1 ? inotify_add_watch(watchFd, absolute.data, APPEND_WATCH_EVENTS) : -1;
+    return fd;
+}
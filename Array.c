@@ -0,0 +1,552 @@
+/**
+ * @file Array.c
+ * @brief Indexed and associative array variables for SnailShell
+ *
+ * Environment variables can only hold a single string, so arrays are kept
+ * in a separate table owned by the shell. Arrays are looked up by name in an
+ * open-addressing hash table (see Hash.c) and expanded with ${name[...]}.
+ *
+ * Element Storage:
+ * - Indexed arrays are a vector of (pointer, length) slices; unset elements
+ *   have a NULL pointer, so sparse arrays keep their indices
+ * - Associative arrays are an open-addressing table of key/value copies
+ * - Elements added one at a time are individually allocated copies
+ * - Elements loaded in bulk by mapfile point into a single region owned by
+ *   the array, so a million-line file costs one mapping plus one slice per
+ *   line instead of one heap string per line
+ *
+ * Key Functionality:
+ * - Creating, replacing and deleting arrays by name
+ * - Setting, reading and unsetting elements by index or key
+ * - Iterating over set elements in index (or table) order
+ */
+
+#include "SnailShell.h"
+
+#include <sys/mman.h>
+
+static Table arrays;
+
+/**
+ * @brief Checks whether an element points into the array's region
+ * @param array Pointer to the Array
+ * @param element Pointer to the Element
+ * @return Non-zero if the element is a slice of the region rather than a copy
+ */
+static int inRegion(Array * array, Element * element) {
+    return array->region != NULL && element->data >= array->region &&
+        element->data < array->region + array->regionSize;
+}
+
+/**
+ * @brief Frees the value of an indexed element unless it is a region slice
+ * @param array Pointer to the Array
+ * @param element Pointer to the Element
+ */
+static void releaseElement(Array * array, Element * element) {
+    if (element->data != NULL && !inRegion(array, element)) {
+        free(element->data);
+    }
+    element->data = NULL;
+    element->length = 0;
+}
+
+/**
+ * @brief Frees the elements, keys and region of an array
+ * @param array Pointer to the Array
+ */
+static void clearArray(Array * array) {
+    for (size_t i = 0; i < array->count; i++) {
+        releaseElement(array, &array->elements[i]);
+    }
+
+    size_t cursor = 0;
+    TableEntry * entry;
+    while ((entry = tableNext(&array->keys, &cursor)) != NULL) {
+        free(entry->value);
+    }
+    tableFree(&array->keys);
+
+    if (array->region != NULL && munmap(array->region, array->regionSize) == -1) {
+        perror("munmap");
+    }
+
+    free(array->elements);
+    array->elements = NULL;
+    array->count = 0;
+    array->capacity = 0;
+    array->setCount = 0;
+    array->region = NULL;
+    array->regionSize = 0;
+}
+
+/**
+ * @brief Copies a value into a new NUL-terminated heap string
+ * @param data Start of the value
+ * @param length Length of the value
+ * @return The copy
+ */
+static char * copyValue(const char * data, size_t length) {
+    char * copy = malloc(length + 1);
+    if (copy == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/**
+ * @brief Looks up an array by name
+ * @param name The array name
+ * @return Pointer to the Array, or NULL if no array has that name
+ */
+Array * findArray(const char * name) {
+    TableEntry * entry = tableFind(&arrays, name, strlen(name));
+    return entry != NULL ? entry->value : NULL;
+}
+
+/**
+ * @brief Iterates over the names of the defined arrays
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @return The next array name, or NULL when all were visited
+ */
+const char * nextArrayName(size_t * cursor) {
+    TableEntry * entry = tableNext(&arrays, cursor);
+    return entry != NULL ? entry->key : NULL;
+}
+
+/**
+ * @brief Creates an empty array, replacing any array of the same name
+ * @param name The array name
+ * @param type ARRAY_INDEXED or ARRAY_ASSOCIATIVE
+ * @return Pointer to the empty Array
+ *
+ * Memory Management:
+ * - Frees the elements and region of an existing array of the same name
+ * - Handles memory allocation failures by calling exit()
+ */
+Array * createArray(const char * name, int type) {
+    TableEntry * entry = tableInsert(&arrays, name, strlen(name));
+    Array * array = entry->value;
+    if (array != NULL) {
+        clearArray(array);
+        array->type = type;
+        return array;
+    }
+
+    array = calloc(1, sizeof(Array));
+    if (array == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    array->name = entry->key;
+    array->type = type;
+    tableInit(&array->keys);
+    entry->value = array;
+    return array;
+}
+
+/**
+ * @brief Deletes an array
+ * @param name The array name
+ * @return 0 on success, -1 if no array has that name
+ */
+int deleteArray(const char * name) {
+    TableEntry * entry = tableFind(&arrays, name, strlen(name));
+    if (entry == NULL) {
+        return -1;
+    }
+
+    Array * array = entry->value;
+    clearArray(array);
+    free(array);
+    tableRemove(&arrays, entry);
+    return 0;
+}
+
+/**
+ * @brief Reserves room for additional indexed elements
+ * @param array Pointer to the Array
+ * @param additional Number of elements about to be appended
+ */
+void arrayReserve(Array * array, size_t additional) {
+    if (array->count + additional <= array->capacity) {
+        return;
+    }
+
+    size_t capacity = array->capacity == 0 ? 8 : array->capacity;
+    while (capacity < array->count + additional) {
+        capacity *= 2;
+    }
+
+    array->elements = realloc(array->elements, sizeof(Element) * capacity);
+    if (array->elements == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    array->capacity = capacity;
+}
+
+/**
+ * @brief Appends a copy of a value after the highest index
+ * @param array Pointer to the Array
+ * @param data Start of the element value
+ * @param length Length of the element value
+ *
+ * The value is copied, so data does not need to be NUL-terminated.
+ */
+void arrayAppend(Array * array, const char * data, size_t length) {
+    arraySetIndex(array, array->count, data, length);
+}
+
+/**
+ * @brief Hands a memory mapping over to an array as its region
+ * @param array Pointer to the Array (must not own a region yet)
+ * @param region Start of a mapping created with mmap()
+ * @param size Size of the mapping
+ *
+ * The region is unmapped when the array is cleared or replaced.
+ */
+void arraySetRegion(Array * array, char * region, size_t size) {
+    array->region = region;
+    array->regionSize = size;
+}
+
+/**
+ * @brief Appends a slice of the array's region as an element
+ * @param array Pointer to the Array
+ * @param data Start of the element within the region
+ * @param length Length of the element
+ */
+void arrayAppendSlice(Array * array, char * data, size_t length) {
+    arrayReserve(array, 1);
+    array->elements[array->count].data = data;
+    array->elements[array->count].length = length;
+    array->count++;
+    array->setCount++;
+}
+
+/**
+ * @brief Sets an element of an indexed array
+ * @param array Pointer to the Array
+ * @param index Index of the element
+ * @param data Start of the value
+ * @param length Length of the value
+ * @return 0 on success, -1 if index is beyond MAX_ARRAY_INDEX
+ *
+ * Indices past the end leave unset elements in between.
+ */
+int arraySetIndex(Array * array, size_t index, const char * data, size_t length) {
+    if (index >= MAX_ARRAY_INDEX) {
+        printError(ERROR_ARRAY_INDEX, array->name);
+        return -1;
+    }
+
+    if (index >= array->count) {
+        arrayReserve(array, index + 1 - array->count);
+        memset(array->elements + array->count, 0, sizeof(Element) * (index + 1 - array->count));
+        array->count = index + 1;
+    }
+
+    Element * element = &array->elements[index];
+    if (element->data == NULL) {
+        array->setCount++;
+    }
+    releaseElement(array, element);
+    element->data = copyValue(data, length);
+    element->length = length;
+    return 0;
+}
+
+/**
+ * @brief Unsets an element of an indexed array
+ * @param array Pointer to the Array
+ * @param index Index of the element
+ */
+void arrayUnsetIndex(Array * array, size_t index) {
+    if (index >= array->count || array->elements[index].data == NULL) {
+        return;
+    }
+
+    releaseElement(array, &array->elements[index]);
+    array->setCount--;
+    while (array->count > 0 && array->elements[array->count - 1].data == NULL) {
+        array->count--;
+    }
+}
+
+/**
+ * @brief Returns an element of an indexed array
+ * @param array Pointer to the Array
+ * @param index Index of the element
+ * @param data Pointer to store the start of the element
+ * @param length Pointer to store the length of the element
+ * @return 0 on success, -1 if the element is not set
+ */
+int arrayGet(Array * array, size_t index, const char ** data, size_t * length) {
+    if (index >= array->count || array->elements[index].data == NULL) {
+        return -1;
+    }
+
+    *data = array->elements[index].data;
+    *length = array->elements[index].length;
+    return 0;
+}
+
+/**
+ * @brief Sets an element of an associative array
+ * @param array Pointer to the Array
+ * @param key Start of the key
+ * @param keyLength Length of the key
+ * @param data Start of the value
+ * @param length Length of the value
+ */
+void arraySetKey(Array * array, const char * key, size_t keyLength, const char * data, size_t length) {
+    TableEntry * entry = tableInsert(&array->keys, key, keyLength);
+    free(entry->value);
+    entry->value = copyValue(data, length);
+    entry->valueLength = length;
+}
+
+/**
+ * @brief Unsets an element of an associative array
+ * @param array Pointer to the Array
+ * @param key Start of the key
+ * @param keyLength Length of the key
+ */
+void arrayUnsetKey(Array * array, const char * key, size_t keyLength) {
+    TableEntry * entry = tableFind(&array->keys, key, keyLength);
+    if (entry != NULL) {
+        free(entry->value);
+        tableRemove(&array->keys, entry);
+    }
+}
+
+/**
+ * @brief Returns an element of an associative array
+ * @param array Pointer to the Array
+ * @param key Start of the key
+ * @param keyLength Length of the key
+ * @param data Pointer to store the start of the element
+ * @param length Pointer to store the length of the element
+ * @return 0 on success, -1 if the key is not set
+ */
+int arrayGetKey(Array * array, const char * key, size_t keyLength, const char ** data, size_t * length) {
+    TableEntry * entry = tableFind(&array->keys, key, keyLength);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    *data = entry->value;
+    *length = entry->valueLength;
+    return 0;
+}
+
+/**
+ * @brief Returns the number of set elements of an array
+ * @param array Pointer to the Array
+ * @return Number of set elements
+ */
+size_t arrayLength(Array * array) {
+    return array->type == ARRAY_ASSOCIATIVE ? array->keys.count : array->setCount;
+}
+
+/**
+ * @brief Iterates over the set elements of an array
+ * @param array Pointer to the Array
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @param item Pointer to store the next element
+ * @return 0 if an element was stored, -1 when all elements were visited
+ *
+ * Indexed arrays are visited in index order; associative arrays in table
+ * order. For indexed arrays item->key is NULL and item->index is set.
+ */
+int arrayNext(Array * array, size_t * cursor, ArrayItem * item) {
+    if (array->type == ARRAY_ASSOCIATIVE) {
+        TableEntry * entry = tableNext(&array->keys, cursor);
+        if (entry == NULL) {
+            return -1;
+        }
+
+        item->key = entry->key;
+        item->keyLength = entry->keyLength;
+        item->data = entry->value;
+        item->length = entry->valueLength;
+        return 0;
+    }
+
+    while (*cursor < array->count) {
+        size_t index = (*cursor)++;
+        if (array->elements[index].data != NULL) {
+            item->index = index;
+            item->key = NULL;
+            item->keyLength = 0;
+            item->data = array->elements[index].data;
+            item->length = array->elements[index].length;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Prints an array in the format used by declare -p
+ * @param array Pointer to the Array
+ */
+static void printArray(Array * array) {
+    printf("declare -%c %s=(", array->type == ARRAY_ASSOCIATIVE ? 'A' : 'a', array->name);
+
+    size_t cursor = 0;
+    ArrayItem item;
+    const char * separator = "";
+    while (arrayNext(array, &cursor, &item) == 0) {
+        if (item.key != NULL) {
+            printf("%s[%.*s]=\"%.*s\"", separator, (int) item.keyLength, item.key, (int) item.length, item.data);
+        } else {
+            printf("%s[%zu]=\"%.*s\"", separator, item.index, (int) item.length, item.data);
+        }
+        separator = " ";
+    }
+    printf(")\n");
+}
+
+/**
+ * @brief Handles the built-in declare command
+ * @param curr Pointer to the Command structure containing declare arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: declare [-a|-A|-p] [name[=value] ...]
+ *
+ * -a and -A create empty indexed or associative arrays (an existing array
+ * of the requested type is kept). A name=value word is assigned afterwards,
+ * so "declare -A m=([k]=v)" works when the value contains no blanks. -p
+ * prints the named arrays, or every array when no name is given.
+ */
+int handleDeclare(Command * curr) {
+    int type = -1;
+    int print = 0;
+    int i = 1;
+
+    for (; i < curr->argCount && curr->args[i][0] == '-'; i++) {
+        for (const char * option = curr->args[i] + 1; *option != '\0'; option++) {
+            if (*option == 'a') {
+                type = ARRAY_INDEXED;
+            } else if (*option == 'A') {
+                type = ARRAY_ASSOCIATIVE;
+            } else if (*option == 'p') {
+                print = 1;
+            } else {
+                printError(ERROR_DECLARE_USAGE);
+                return -1;
+            }
+        }
+    }
+
+    if (print && i == curr->argCount) {
+        size_t cursor = 0;
+        TableEntry * entry;
+        while ((entry = tableNext(&arrays, &cursor)) != NULL) {
+            printArray(entry->value);
+        }
+        return 0;
+    }
+
+    int ret = 0;
+    for (; i < curr->argCount; i++) {
+        char * equalSign = strchr(curr->args[i], '=');
+        char * name = strndup(curr->args[i], equalSign != NULL ? (size_t) (equalSign - curr->args[i]) : strlen(curr->args[i]));
+        if (name == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+
+        if (!isValidName(name)) {
+            printError(ERROR_VAR_INVALID, name);
+            ret = -1;
+        } else if (print) {
+            Array * array = findArray(name);
+            const char * value = getenv(name);
+            if (array != NULL) {
+                printArray(array);
+            } else if (value != NULL) {
+                printf("declare -x %s=\"%s\"\n", name, value);
+            } else {
+                ret = -1;
+            }
+        } else {
+            Array * array = findArray(name);
+            if (type != -1 && (array == NULL || array->type != type)) {
+                unsetenv(name);
+                createArray(name, type);
+            }
+            if (equalSign != NULL && handleVariableAssignment(curr->args[i], equalSign) == -1) {
+                ret = -1;
+            }
+        }
+        free(name);
+    }
+    return ret;
+}
+
+/**
+ * @brief Handles the built-in unset command
+ * @param curr Pointer to the Command structure containing unset arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: unset name[subscript] ...
+ *
+ * A plain name removes the array or environment variable of that name; a
+ * subscripted name removes a single element. Negative indices count back
+ * from the end of an indexed array.
+ */
+int handleUnset(Command * curr) {
+    int ret = 0;
+
+    for (int i = 1; i < curr->argCount; i++) {
+        char * name = strdup(curr->args[i]);
+        if (name == NULL) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+
+        char * subscript = NULL;
+        char * bracket = strchr(name, '[');
+        size_t length = strlen(name);
+        if (bracket != NULL && name[length - 1] == ']') {
+            *bracket = '\0';
+            name[length - 1] = '\0';
+            subscript = bracket + 1;
+        }
+
+        Array * array = isValidName(name) ? findArray(name) : NULL;
+        if (!isValidName(name)) {
+            printError(ERROR_UNSET_USAGE);
+            ret = -1;
+        } else if (subscript == NULL) {
+            if (deleteArray(name) == -1) {
+                unsetenv(name);
+            }
+        } else if (array == NULL) {
+            if (strcmp(subscript, "0") == 0) {
+                unsetenv(name);
+            }
+        } else if (array->type == ARRAY_ASSOCIATIVE) {
+            arrayUnsetKey(array, subscript, strlen(subscript));
+        } else {
+            char * end;
+            long index = strtol(subscript, &end, 10);
+            if (*subscript == '\0' || *end != '\0' || index + (long) array->count < 0) {
+                printError(ERROR_ARRAY_SUBSCRIPT, subscript);
+                ret = -1;
+            } else {
+                arrayUnsetIndex(array, index < 0 ? (size_t) (index + (long) array->count) : (size_t) index);
+            }
+        }
+        free(name);
+    }
+    return ret;
+}
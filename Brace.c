@@ -0,0 +1,369 @@
+/**
+ * @file Brace.c
+ * @brief Brace expansion and lazily generated ranges for SnailShell
+ *
+ * Brace expansion runs before variable and pathname expansion and turns
+ * "file.{c,h}" into "file.c file.h" and "{1..3}" into "1 2 3". Sequences
+ * are described by a Range, which produces its values one at a time. The
+ * for loop iterates a Range directly when its word list is a single
+ * sequence or a $(seq ...) call, so even "{1..100000000}" runs in constant
+ * memory without building the word list.
+ *
+ * Supported Forms:
+ * - {a,b,c}: Alternatives, possibly empty and nested
+ * - {x..y}, {x..y..step}: Integer sequences, zero-padded when x or y has a
+ *   leading zero
+ * - {a..e}, {a..e..step}: Character sequences
+ * - $(seq [-w] [first [increment]] last): Integer sequences (for loops only)
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+
+/**
+ * @brief Parses a complete integer
+ * @param text Start of the integer
+ * @param length Length of the integer
+ * @param value Pointer to store the value
+ * @return 0 on success, -1 if the text is not an integer
+ */
+static int parseRangeInteger(const char * text, size_t length, long long * value) {
+    if (length == 0 || length >= 32) {
+        return -1;
+    }
+
+    char number[32];
+    memcpy(number, text, length);
+    number[length] = '\0';
+
+    char * end;
+    errno = 0;
+    *value = strtoll(number, &end, 10);
+    return *end == '\0' && errno == 0 && (isdigit((unsigned char) number[0]) || number[0] == '-' || number[0] == '+') ? 0 : -1;
+}
+
+/**
+ * @brief Checks whether a sequence endpoint requests zero padding
+ * @param text Start of the endpoint
+ * @return Non-zero if the endpoint has a leading zero ("01", "-05")
+ */
+static int hasLeadingZero(const char * text) {
+    if (*text == '-' || *text == '+') {
+        text++;
+    }
+    return text[0] == '0' && isdigit((unsigned char) text[1]);
+}
+
+/**
+ * @brief Initializes a range from its endpoints and increment
+ * @param range Pointer to the Range
+ * @param first The first value
+ * @param last The last value
+ * @param step The increment; its sign is adjusted to move towards last
+ *        unless strict is set
+ * @param strict Whether a step pointing away from last yields no values
+ *        (as in seq) instead of being reversed (as in brace sequences)
+ */
+static void initRange(Range * range, long long first, long long last, long long step, int strict) {
+    if (step == 0) {
+        step = 1;
+    }
+    if (!strict) {
+        if (step < 0) {
+            step = -step;
+        }
+        if (first > last) {
+            step = -step;
+        }
+    }
+
+    range->next = first;
+    range->last = last;
+    range->step = step;
+    range->done = (step > 0 && first > last) || (step < 0 && first < last);
+}
+
+/**
+ * @brief Parses the inside of a {x..y[..step]} sequence expression
+ * @param text Start of the text between the braces
+ * @param length Length of that text
+ * @param range Pointer to the Range to initialize
+ * @return 0 on success, -1 if the text is not a sequence expression
+ */
+static int parseSequence(const char * text, size_t length, Range * range) {
+    const char * dots = memmem(text, length, "..", 2);
+    if (dots == NULL) {
+        return -1;
+    }
+
+    const char * second = dots + 2;
+    const char * end = text + length;
+    const char * stepDots = memmem(second, end - second, "..", 2);
+    const char * secondEnd = stepDots != NULL ? stepDots : end;
+
+    long long step = 1;
+    if (stepDots != NULL && parseRangeInteger(stepDots + 2, end - (stepDots + 2), &step) == -1) {
+        return -1;
+    }
+
+    memset(range, 0, sizeof(Range));
+    long long first;
+    long long last;
+    if (parseRangeInteger(text, dots - text, &first) == 0 &&
+        parseRangeInteger(second, secondEnd - second, &last) == 0) {
+        if (hasLeadingZero(text) || hasLeadingZero(second)) {
+            range->width = (int) ((size_t) (dots - text) > (size_t) (secondEnd - second) ? dots - text : secondEnd - second);
+        }
+        initRange(range, first, last, step, 0);
+        return 0;
+    }
+
+    if (dots - text == 1 && secondEnd - second == 1 && !isdigit((unsigned char) text[0]) && !isdigit((unsigned char) second[0])) {
+        range->letters = 1;
+        initRange(range, (unsigned char) text[0], (unsigned char) second[0], step, 0);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Parses a word that consists of a single sequence expression
+ * @param word The word, such as "{1..1000000}"
+ * @param range Pointer to the Range to initialize
+ * @return 0 on success, -1 if the word is anything else
+ */
+int parseRange(const char * word, Range * range) {
+    size_t length = strlen(word);
+    if (length < 6 || word[0] != '{' || word[length - 1] != '}') {
+        return -1;
+    }
+    return parseSequence(word + 1, length - 2, range);
+}
+
+/**
+ * @brief Parses the arguments of a seq call
+ * @param args The expanded arguments following "seq"
+ * @param count Number of arguments
+ * @param range Pointer to the Range to initialize
+ * @return 0 on success, -1 if the arguments are not supported
+ *
+ * Only integer arguments are supported. As in seq, a zero increment is an
+ * error and an increment pointing away from the last value yields nothing.
+ */
+int parseSeq(char ** args, int count, Range * range) {
+    int equalWidth = 0;
+    if (count > 0 && strcmp(args[0], "-w") == 0) {
+        equalWidth = 1;
+        args++;
+        count--;
+    }
+
+    long long values[3] = { 1, 1, 0 };
+    if (count < 1 || count > 3) {
+        return -1;
+    }
+
+    int firstIndex = count == 1 ? 2 : 0;
+    for (int i = 0; i < count; i++) {
+        int slot = count == 2 && i == 1 ? 2 : firstIndex + i;
+        if (parseRangeInteger(args[i], strlen(args[i]), &values[slot]) == -1) {
+            return -1;
+        }
+    }
+    if (values[1] == 0) {
+        return -1;
+    }
+
+    memset(range, 0, sizeof(Range));
+    initRange(range, values[0], values[2], values[1], 1);
+    if (equalWidth) {
+        char first[32];
+        char last[32];
+        int firstWidth = snprintf(first, sizeof(first), "%lld", values[0]);
+        int lastWidth = snprintf(last, sizeof(last), "%lld", values[2]);
+        range->width = firstWidth > lastWidth ? firstWidth : lastWidth;
+    }
+    return 0;
+}
+
+/**
+ * @brief Produces the next value of a range
+ * @param range Pointer to the Range
+ * @param buffer Output buffer (at least 32 bytes)
+ * @param size Size of the output buffer
+ * @return Length of the value written to buffer, or -1 when the range is done
+ */
+int rangeNext(Range * range, char * buffer, size_t size) {
+    if (range->done) {
+        return -1;
+    }
+
+    int length;
+    if (range->letters) {
+        buffer[0] = (char) range->next;
+        buffer[1] = '\0';
+        length = 1;
+    } else if (range->width > 0 && range->next < 0) {
+        length = snprintf(buffer, size, "-%0*lld", range->width - 1, -range->next);
+    } else {
+        length = snprintf(buffer, size, "%0*lld", range->width, range->next);
+    }
+
+    long long remaining = range->step > 0 ? range->last - range->next : range->next - range->last;
+    long long stride = range->step > 0 ? range->step : -range->step;
+    if (remaining < stride) {
+        range->done = 1;
+    } else {
+        range->next += range->step;
+    }
+    return length;
+}
+
+/**
+ * @brief Finds the end of a ${...} reference
+ * @param dollar Pointer to the '$' of "${"
+ * @return Pointer to the '}' closing the reference, or NULL if there is
+ *         none
+ *
+ * Braces nested in the reference, such as a default value, are counted so
+ * that the reference is skipped as a whole.
+ */
+static const char * skipReference(const char * dollar) {
+    int depth = 0;
+    for (const char * p = dollar + 1; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the brace that closes an opening brace
+ * @param open Pointer to the opening '{'
+ * @param comma Pointer to store whether a top-level comma was found
+ * @return Pointer to the matching '}', or NULL if there is none
+ */
+static const char * findClosingBrace(const char * open, int * comma) {
+    int depth = 0;
+    *comma = 0;
+
+    for (const char * p = open; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == '$' && p[1] == '{') {
+            p = skipReference(p);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if (*p == '{') {
+            depth++;
+        } else if (*p == '}') {
+            if (--depth == 0) {
+                return p;
+            }
+        } else if (*p == ',' && depth == 1) {
+            *comma = 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Appends prefix + middle + suffix and expands its remaining braces
+ * @param prefix Start of the text before the brace expression
+ * @param prefixLength Length of that text
+ * @param middle Start of the alternative
+ * @param middleLength Length of the alternative
+ * @param suffix Text after the brace expression
+ * @param words Pointer to the growable word array
+ * @param count Pointer to the number of words
+ * @param capacity Pointer to the capacity of the word array
+ */
+static void expandAlternative(const char * prefix, size_t prefixLength, const char * middle, size_t middleLength,
+                              const char * suffix, char *** words, int * count, int * capacity) {
+    Buffer word;
+    memset(&word, 0, sizeof(Buffer));
+    bufferAppend(&word, prefix, prefixLength);
+    bufferAppend(&word, middle, middleLength);
+    bufferAppend(&word, suffix, strlen(suffix));
+
+    expandBraces(word.data, words, count, capacity);
+    free(word.data);
+}
+
+/**
+ * @brief Performs brace expansion on a word
+ * @param word The word
+ * @param words Pointer to the growable word array receiving the results
+ * @param count Pointer to the number of words, advanced
+ * @param capacity Pointer to the capacity of the word array
+ *
+ * The first brace expression (not part of a ${...} reference) containing a
+ * top-level comma or a valid sequence is expanded, then each result is
+ * expanded again, which handles nested and consecutive expressions. Words
+ * without brace expressions are appended unchanged.
+ */
+void expandBraces(const char * word, char *** words, int * count, int * capacity) {
+    for (const char * open = strchr(word, '{'); open != NULL; open = strchr(open + 1, '{')) {
+        if (open > word && open[-1] == '$') {
+            open = skipReference(open - 1);
+            if (open == NULL) {
+                break;
+            }
+            continue;
+        }
+
+        int comma;
+        const char * close = findClosingBrace(open, &comma);
+        if (close == NULL) {
+            break;
+        }
+
+        size_t prefixLength = open - word;
+        const char * inner = open + 1;
+        size_t innerLength = close - inner;
+
+        if (comma) {
+            int depth = 0;
+            const char * start = inner;
+            for (const char * p = inner; p <= close; p++) {
+                if (*p == '\\' && p < close - 1) {
+                    p++;
+                } else if (*p == '$' && p[1] == '{') {
+                    p = skipReference(p);
+                } else if (*p == '{') {
+                    depth++;
+                } else if (*p == '}' && depth > 0) {
+                    depth--;
+                } else if ((*p == ',' && depth == 0) || p == close) {
+                    expandAlternative(word, prefixLength, start, p - start, close + 1, words, count, capacity);
+                    start = p + 1;
+                }
+            }
+            return;
+        }
+
+        Range range;
+        if (parseSequence(inner, innerLength, &range) == 0) {
+            char value[32];
+            int length;
+            while ((length = rangeNext(&range, value, sizeof(value))) != -1) {
+                expandAlternative(word, prefixLength, value, length, close + 1, words, count, capacity);
+            }
+            return;
+        }
+    }
+
+    char * copy = strdup(word);
+    if (copy == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    appendWord(words, count, capacity, copy);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file Builtins.c
+ * @brief Built-in command table for SnailShell
+ * 
+ * This file maps the names of built-in commands to their handlers. Built-ins
+ * run inside the shell process when they form a pipeline on their own, so
+ * they can change the shell's state (working directory, resource limits,
+ * variables).
+ * Inside a larger pipeline they run in a forked child like any other stage.
+ */
+
+#include "SnailShell.h"
+
+static const Builtin builtins[] = {
+    { "alias", handleAlias },
+    { "cd", handleCD },
+    { "declare", handleDeclare },
+    { "echo", handleEcho },
+    { "exec", handleExec },
+    { "mapfile", handleMapfile },
+    { "printf", handlePrintf },
+    { "read", handleRead },
+    { "readarray", handleMapfile },
+    { "shopt", handleShopt },
+    { "ulimit", handleUlimit },
+    { "unalias", handleUnalias },
+    { "unset", handleUnset },
+    { "walk", handleWalk },
+};
+
+#define NUM_BUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+/**
+ * @brief Looks up a built-in command by name
+ * @param name The command name
+ * @return The handler for the built-in, or NULL if name is not a built-in
+ */
+BuiltinHandler findBuiltin(const char * name) {
+    if (name == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < NUM_BUILTINS; i++) {
+        if (strcmp(builtins[i].name, name) == 0) {
+            return builtins[i].handler;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the name of a built-in command by position
+ * @param index Position in the built-in table
+ * @return The name, or NULL if index is past the end of the table
+ */
+const char * builtinName(size_t index) {
+    return index < NUM_BUILTINS ? builtins[index].name : NULL;
+}
@@ -0,0 +1,176 @@
+/**
+ * @file Case.c
+ * @brief Dispatch tables for the case command of SnailShell
+ *
+ * A case command selects the first arm whose pattern matches a word. Rather
+ * than trying every pattern in order, the arms are compiled once when the
+ * command is read:
+ * - Literal patterns (no wildcards, no '$') become keys of a hash table, so
+ *   any number of them costs a single lookup.
+ * - Glob patterns are compiled once and kept in arm order.
+ * - Patterns referring to variables are kept in arm order as text and
+ *   expanded each time the case runs.
+ *
+ * The literal lookup yields the earliest literal arm that matches. Only the
+ * glob and variable patterns of earlier arms still need to be tried, and in
+ * order, since they may overlap with it; the scan stops at the first match
+ * or at the literal arm, whichever comes first.
+ */
+
+#include "SnailShell.h"
+
+/**
+ * @brief Adds a glob or variable pattern to a dispatch table
+ * @param table Pointer to the CaseTable
+ * @param text The pattern text
+ * @param length Length of the pattern text
+ * @param arm Index of the arm the pattern belongs to
+ */
+static void addCasePattern(CaseTable * table, const char * text, size_t length, int arm) {
+    if (table->patternCount == table->patternCapacity) {
+        table->patternCapacity = table->patternCapacity == 0 ? 8 : table->patternCapacity * 2;
+        table->patterns = realloc(table->patterns, sizeof(CasePattern) * table->patternCapacity);
+        if (table->patterns == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    CasePattern * pattern = &table->patterns[table->patternCount++];
+    pattern->text = strndup(text, length);
+    if (pattern->text == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+    pattern->compiled = strchr(pattern->text, '$') == NULL ? compilePattern(pattern->text) : NULL;
+    pattern->arm = arm;
+}
+
+/**
+ * @brief Adds one alternative of an arm to a dispatch table
+ * @param table Pointer to the CaseTable
+ * @param text The alternative's pattern text
+ * @param length Length of the pattern text
+ * @param arm Index of the arm
+ */
+static void addAlternative(CaseTable * table, const char * text, size_t length, int arm) {
+    char * pattern = strndup(text, length);
+    if (pattern == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    if (strchr(pattern, '$') == NULL && !hasWildcards(pattern)) {
+        Pattern * literal = compilePattern(pattern);
+        TableEntry * entry = tableInsert(&table->literals, literal->literal, literal->minLength);
+        if (entry->value == NULL) {
+            entry->value = table->arms[arm];
+            entry->valueLength = arm;
+        }
+        freePattern(literal);
+    } else {
+        addCasePattern(table, text, length, arm);
+    }
+    free(pattern);
+}
+
+/**
+ * @brief Compiles the arms of a case command into a dispatch table
+ * @param arms List of NODE_ARM nodes
+ * @return Pointer to the new CaseTable, to be released with freeCaseTable()
+ *
+ * Each arm's text holds its alternatives separated by unescaped '|'.
+ */
+CaseTable * compileCase(Node * arms) {
+    CaseTable * table = calloc(1, sizeof(CaseTable));
+    if (table == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    tableInit(&table->literals);
+
+    for (Node * arm = arms; arm != NULL; arm = arm->next) {
+        table->armCount++;
+    }
+    table->arms = malloc(sizeof(Node *) * (table->armCount + 1));
+    if (table->arms == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int index = 0;
+    for (Node * arm = arms; arm != NULL; arm = arm->next, index++) {
+        table->arms[index] = arm;
+
+        const char * start = arm->text;
+        for (const char * p = arm->text;; p++) {
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            } else if (*p == '|' || *p == '\0') {
+                addAlternative(table, start, p - start, index);
+                if (*p == '\0') {
+                    break;
+                }
+                start = p + 1;
+            }
+        }
+    }
+    return table;
+}
+
+/**
+ * @brief Releases a case dispatch table
+ * @param table Pointer to the CaseTable (may be NULL)
+ */
+void freeCaseTable(CaseTable * table) {
+    if (table == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < table->patternCount; i++) {
+        free(table->patterns[i].text);
+        freePattern(table->patterns[i].compiled);
+    }
+    free(table->patterns);
+    tableFree(&table->literals);
+    free(table->arms);
+    free(table);
+}
+
+/**
+ * @brief Finds the first arm of a case command matching a word
+ * @param table Pointer to the CaseTable
+ * @param subject The expanded subject word
+ * @return Pointer to the matching NODE_ARM node, or NULL if none matches
+ *
+ * Variable patterns are expanded and looked up in the pattern cache, so a
+ * pattern stored in a variable is compiled once per distinct value.
+ */
+Node * selectCaseArm(CaseTable * table, const char * subject) {
+    size_t length = strlen(subject);
+    int best = table->armCount;
+
+    TableEntry * entry = tableFind(&table->literals, subject, length);
+    if (entry != NULL) {
+        best = (int) entry->valueLength;
+    }
+
+    for (int i = 0; i < table->patternCount && table->patterns[i].arm < best; i++) {
+        CasePattern * pattern = &table->patterns[i];
+        int matched;
+        if (pattern->compiled != NULL) {
+            matched = matchPattern(pattern->compiled, subject, length);
+        } else {
+            char * text = replace(pattern->text);
+            matched = matchPattern(cachedPattern(text), subject, length);
+            free(text);
+        }
+
+        if (matched) {
+            best = pattern->arm;
+            break;
+        }
+    }
+
+    return best < table->armCount ? table->arms[best] : NULL;
+}
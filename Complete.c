@@ -0,0 +1,489 @@
+/**
+ * @file Complete.c
+ * @brief Tab completion for the SnailShell line editor
+ *
+ * The word before the cursor is completed as:
+ * - a command name, when it is the first word of a pipeline stage
+ *   (built-ins, aliases and the executables found in PATH);
+ * - a variable name, when it starts with '$' (environment variables and
+ *   arrays);
+ * - a path otherwise.
+ *
+ * PATH executables are kept in a trie, built on first use and rebuilt only
+ * when PATH or the modification time of one of its directories changes, so
+ * a completion costs a few stat() calls and a walk below the typed prefix
+ * rather than a scan of every PATH directory.
+ */
+
+#include "SnailShell.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+extern char ** environ;
+
+/**
+ * @struct TrieNode
+ * @brief Node of the executable trie
+ *
+ * Children form a list through sibling, sorted by letter. terminal is set
+ * when the path from the root to the node spells a complete name, and
+ * count is the number of complete names at or below the node.
+ */
+typedef struct TrieNode {
+    int child;
+    int sibling;
+    int count;
+    unsigned char letter;
+    unsigned char terminal;
+} TrieNode;
+
+/**
+ * @struct CommandTrie
+ * @brief Executables of all PATH directories and the state they came from
+ */
+typedef struct CommandTrie {
+    TrieNode * nodes;
+    int count;
+    int capacity;
+    char * path;
+    struct timespec * mtimes;
+    int directoryCount;
+} CommandTrie;
+
+static CommandTrie trie;
+
+/**
+ * @brief Allocates a trie node
+ * @param letter The letter leading to the node
+ * @return Index of the new node
+ */
+static int addTrieNode(unsigned char letter) {
+    if (trie.count == trie.capacity) {
+        trie.capacity = trie.capacity == 0 ? 1024 : trie.capacity * 2;
+        trie.nodes = realloc(trie.nodes, sizeof(TrieNode) * trie.capacity);
+        if (trie.nodes == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    TrieNode * node = &trie.nodes[trie.count];
+    node->child = -1;
+    node->sibling = -1;
+    node->count = 0;
+    node->letter = letter;
+    node->terminal = 0;
+    return trie.count++;
+}
+
+/**
+ * @brief Adds a name to the executable trie
+ * @param name The executable name
+ */
+static void insertTrie(const char * name) {
+    int path[NAME_MAX + 1];
+    int depth = 0;
+    int node = 0;
+    path[depth++] = node;
+    for (const unsigned char * p = (const unsigned char *) name; *p != '\0' && depth <= NAME_MAX; p++) {
+        int previous = -1;
+        int child = trie.nodes[node].child;
+        while (child != -1 && trie.nodes[child].letter < *p) {
+            previous = child;
+            child = trie.nodes[child].sibling;
+        }
+
+        if (child == -1 || trie.nodes[child].letter != *p) {
+            int created = addTrieNode(*p);
+            trie.nodes[created].sibling = child;
+            if (previous == -1) {
+                trie.nodes[node].child = created;
+            } else {
+                trie.nodes[previous].sibling = created;
+            }
+            child = created;
+        }
+        node = child;
+        path[depth++] = node;
+    }
+
+    if (!trie.nodes[node].terminal) {
+        trie.nodes[node].terminal = 1;
+        for (int i = 0; i < depth; i++) {
+            trie.nodes[path[i]].count++;
+        }
+    }
+}
+
+/**
+ * @brief Checks whether the trie still reflects PATH
+ * @param path The current value of PATH
+ * @return Non-zero if PATH or one of its directories changed since the
+ *         trie was built
+ */
+static int isTrieStale(const char * path) {
+    if (trie.path == NULL || strcmp(trie.path, path) != 0) {
+        return 1;
+    }
+
+    char * copy = strdup(path);
+    if (copy == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    int stale = 0;
+    int index = 0;
+    char * tokenPtr;
+    for (char * dir = strtok_r(copy, ":", &tokenPtr); dir != NULL && !stale; dir = strtok_r(NULL, ":", &tokenPtr), index++) {
+        struct stat info;
+        struct timespec mtime = { 0, 0 };
+        if (stat(dir, &info) == 0) {
+            mtime = info.st_mtim;
+        }
+        stale = mtime.tv_sec != trie.mtimes[index].tv_sec || mtime.tv_nsec != trie.mtimes[index].tv_nsec;
+    }
+    free(copy);
+    return stale;
+}
+
+/**
+ * @brief Rebuilds the executable trie from the directories of PATH
+ * @param path The current value of PATH
+ *
+ * Each directory's modification time is recorded before it is read, so a
+ * change made while reading it is picked up by the next completion.
+ */
+static void buildTrie(const char * path) {
+    free(trie.path);
+    free(trie.mtimes);
+    trie.count = 0;
+    addTrieNode('\0');
+
+    trie.path = strdup(path);
+    char * copy = strdup(path);
+    if (trie.path == NULL || copy == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    trie.directoryCount = 1;
+    for (const char * p = path; *p != '\0'; p++) {
+        trie.directoryCount += *p == ':';
+    }
+    trie.mtimes = calloc(trie.directoryCount, sizeof(struct timespec));
+    if (trie.mtimes == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int index = 0;
+    char * tokenPtr;
+    for (char * dir = strtok_r(copy, ":", &tokenPtr); dir != NULL; dir = strtok_r(NULL, ":", &tokenPtr), index++) {
+        int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct stat info;
+        if (fd == -1 || fstat(fd, &info) == -1) {
+            if (fd != -1) {
+                close(fd);
+            }
+            continue;
+        }
+        trie.mtimes[index] = info.st_mtim;
+
+        DIR * stream = fdopendir(fd);
+        if (stream == NULL) {
+            close(fd);
+            continue;
+        }
+
+        struct dirent * entry;
+        while ((entry = readdir(stream)) != NULL) {
+            if (entry->d_name[0] == '.' || entry->d_type == DT_DIR) {
+                continue;
+            }
+            if (faccessat(dirfd(stream), entry->d_name, X_OK, 0) == 0) {
+                insertTrie(entry->d_name);
+            }
+        }
+        closedir(stream);
+    }
+    free(copy);
+}
+
+/**
+ * @brief Adds a candidate to a completion
+ * @param completion Pointer to the Completion
+ * @param text The candidate text
+ * @param length Length of the candidate text
+ */
+static void addCandidate(Completion * completion, const char * text, size_t length) {
+    char * candidate = strndup(text, length);
+    if (candidate == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+    appendWord(&completion->matches, &completion->count, &completion->capacity, candidate);
+}
+
+/**
+ * @brief Adds the first trie names below a node to a completion
+ * @param completion Pointer to the Completion
+ * @param node Index of the node
+ * @param name Buffer holding the name spelled by the path to the node
+ * @param remaining Pointer to the number of names still to add
+ */
+static void collectTrie(Completion * completion, int node, Buffer * name, int * remaining) {
+    if (trie.nodes[node].terminal && *remaining > 0) {
+        addCandidate(completion, name->data, name->length);
+        (*remaining)--;
+    }
+
+    for (int child = trie.nodes[node].child; child != -1 && *remaining > 0; child = trie.nodes[child].sibling) {
+        char letter = (char) trie.nodes[child].letter;
+        bufferAppend(name, &letter, 1);
+        collectTrie(completion, child, name, remaining);
+        name->length--;
+    }
+}
+
+/**
+ * @brief Adds the PATH executables starting with a prefix to a completion
+ * @param completion Pointer to the Completion
+ * @param prefix The typed prefix
+ * @param length Length of the prefix
+ *
+ * Only the first COMPLETION_MAX_LIST names are copied. The others are
+ * counted from the trie, and the prefix they share is found by following
+ * the trie below the typed prefix while it does not branch, so completing
+ * a short prefix stays cheap with tens of thousands of executables.
+ */
+static void completeExecutables(Completion * completion, const char * prefix, size_t length) {
+    const char * path = getenv("PATH");
+    if (path == NULL) {
+        return;
+    }
+    if (isTrieStale(path)) {
+        buildTrie(path);
+    }
+
+    int node = 0;
+    for (size_t i = 0; i < length && node != -1; i++) {
+        int child = trie.nodes[node].child;
+        while (child != -1 && trie.nodes[child].letter < (unsigned char) prefix[i]) {
+            child = trie.nodes[child].sibling;
+        }
+        node = child != -1 && trie.nodes[child].letter == (unsigned char) prefix[i] ? child : -1;
+    }
+    if (node == -1) {
+        return;
+    }
+
+    Buffer name;
+    memset(&name, 0, sizeof(Buffer));
+    bufferAppend(&name, prefix, length);
+    int remaining = COMPLETION_MAX_LIST;
+    collectTrie(completion, node, &name, &remaining);
+    free(name.data);
+
+    int omitted = trie.nodes[node].count - (COMPLETION_MAX_LIST - remaining);
+    if (omitted > 0) {
+        size_t shared = length;
+        while (!trie.nodes[node].terminal && trie.nodes[node].child != -1 &&
+               trie.nodes[trie.nodes[node].child].sibling == -1) {
+            node = trie.nodes[node].child;
+            shared++;
+        }
+        completion->omitted += omitted;
+        completion->sharedLength = shared;
+    }
+}
+
+/**
+ * @brief Adds the files of a directory starting with a prefix to a completion
+ * @param completion Pointer to the Completion
+ * @param word The typed path
+ * @param length Length of the typed path
+ *
+ * Directories are completed with a trailing '/'. Hidden files are only
+ * offered when the typed name starts with '.'.
+ */
+static void completeFiles(Completion * completion, const char * word, size_t length) {
+    const char * slash = memrchr(word, '/', length);
+    size_t dirLength = slash != NULL ? (size_t) (slash - word) + 1 : 0;
+    const char * base = word + dirLength;
+    size_t baseLength = length - dirLength;
+
+    char * dir = dirLength > 0 ? strndup(word, dirLength) : strdup(".");
+    if (dir == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    DIR * stream = opendir(dir);
+    free(dir);
+    if (stream == NULL) {
+        return;
+    }
+
+    Buffer candidate;
+    memset(&candidate, 0, sizeof(Buffer));
+    struct dirent * entry;
+    while ((entry = readdir(stream)) != NULL) {
+        const char * name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+            (name[0] == '.' && (baseLength == 0 || base[0] != '.')) ||
+            strncmp(name, base, baseLength) != 0) {
+            continue;
+        }
+
+        int isDirectory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat info;
+            isDirectory = fstatat(dirfd(stream), name, &info, 0) == 0 && S_ISDIR(info.st_mode);
+        }
+
+        candidate.length = 0;
+        bufferAppend(&candidate, word, dirLength);
+        bufferAppend(&candidate, name, strlen(name));
+        bufferAppend(&candidate, "/", isDirectory);
+        addCandidate(completion, candidate.data, candidate.length);
+    }
+    closedir(stream);
+    free(candidate.data);
+}
+
+/**
+ * @brief Adds the variables starting with a prefix to a completion
+ * @param completion Pointer to the Completion
+ * @param word The typed word, starting with '$' or "${"
+ * @param length Length of the typed word
+ */
+static void completeVariables(Completion * completion, const char * word, size_t length) {
+    size_t sigil = length > 1 && word[1] == '{' ? 2 : 1;
+    const char * prefix = word + sigil;
+    size_t prefixLength = length - sigil;
+
+    Buffer candidate;
+    memset(&candidate, 0, sizeof(Buffer));
+    for (char ** variable = environ; *variable != NULL; variable++) {
+        size_t nameLength = strcspn(*variable, "=");
+        if (nameLength >= prefixLength && strncmp(*variable, prefix, prefixLength) == 0) {
+            candidate.length = 0;
+            bufferAppend(&candidate, word, sigil);
+            bufferAppend(&candidate, *variable, nameLength);
+            bufferAppend(&candidate, "}", sigil == 2);
+            addCandidate(completion, candidate.data, candidate.length);
+        }
+    }
+
+    size_t cursor = 0;
+    const char * name;
+    while ((name = nextArrayName(&cursor)) != NULL) {
+        if (strncmp(name, prefix, prefixLength) == 0) {
+            candidate.length = 0;
+            bufferAppend(&candidate, word, sigil);
+            bufferAppend(&candidate, name, strlen(name));
+            bufferAppend(&candidate, "}", sigil == 2);
+            addCandidate(completion, candidate.data, candidate.length);
+        }
+    }
+    free(candidate.data);
+}
+
+/**
+ * @brief Orders candidate strings for qsort()
+ * @param a Pointer to the first string pointer
+ * @param b Pointer to the second string pointer
+ * @return Negative, zero or positive as for strcmp()
+ */
+static int compareCandidates(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * @brief Finds the completions of the word before the cursor
+ * @param line The line being edited
+ * @param cursor Position of the cursor in the line
+ * @param completion Pointer to the Completion to fill (released with
+ *        freeCompletion())
+ *
+ * The candidates are sorted and free of duplicates; commonLength is the
+ * length of the prefix they all share, including any omitted ones.
+ */
+void findCompletions(const char * line, size_t cursor, Completion * completion) {
+    memset(completion, 0, sizeof(Completion));
+
+    size_t start = cursor;
+    while (start > 0 && strchr(" \t|<>;", line[start - 1]) == NULL) {
+        start--;
+    }
+    size_t before = start;
+    while (before > 0 && (line[before - 1] == ' ' || line[before - 1] == '\t')) {
+        before--;
+    }
+
+    const char * word = line + start;
+    size_t length = cursor - start;
+    completion->wordStart = start;
+
+    if (word[0] == '$') {
+        completeVariables(completion, word, length);
+    } else if ((before == 0 || line[before - 1] == '|' || line[before - 1] == ';') && memchr(word, '/', length) == NULL) {
+        const char * name;
+        for (size_t i = 0; (name = builtinName(i)) != NULL; i++) {
+            if (strncmp(name, word, length) == 0) {
+                addCandidate(completion, name, strlen(name));
+            }
+        }
+        size_t aliasCursor = 0;
+        while ((name = nextAliasName(&aliasCursor)) != NULL) {
+            if (strncmp(name, word, length) == 0) {
+                addCandidate(completion, name, strlen(name));
+            }
+        }
+        completeExecutables(completion, word, length);
+    } else {
+        completeFiles(completion, word, length);
+    }
+
+    if (completion->count == 0) {
+        return;
+    }
+
+    qsort(completion->matches, completion->count, sizeof(char *), compareCandidates);
+    int unique = 1;
+    for (int i = 1; i < completion->count; i++) {
+        if (strcmp(completion->matches[i], completion->matches[unique - 1]) == 0) {
+            free(completion->matches[i]);
+        } else {
+            completion->matches[unique++] = completion->matches[i];
+        }
+    }
+    completion->count = unique;
+    completion->matches[unique] = NULL;
+
+    const char * first = completion->matches[0];
+    const char * last = completion->matches[unique - 1];
+    size_t common = 0;
+    while (first[common] != '\0' && first[common] == last[common]) {
+        common++;
+    }
+    if (completion->omitted > 0 && common > completion->sharedLength) {
+        common = completion->sharedLength;
+    }
+    completion->commonLength = common;
+}
+
+/**
+ * @brief Releases the candidates of a completion
+ * @param completion Pointer to the Completion
+ */
+void freeCompletion(Completion * completion) {
+    for (int i = 0; i < completion->count; i++) {
+        free(completion->matches[i]);
+    }
+    free(completion->matches);
+    memset(completion, 0, sizeof(Completion));
+}
@@ -0,0 +1,427 @@
+/**
+ * @file Conditional.c
+ * @brief The [[ ]] conditional command for SnailShell
+ *
+ * Evaluates conditional expressions inside the shell process, so string,
+ * numeric and file tests no longer fork test, expr or grep. Words are split
+ * at blanks only and expanded without word splitting, so "|", "<" and ">"
+ * are ordinary words here. Operators are recognized before expansion.
+ *
+ * Supported Expressions:
+ * - -z, -n: Empty and non-empty strings
+ * - -e, -f, -d, -h, -L, -p, -S, -r, -w, -x, -s: File tests
+ * - -v: Variable or array is set
+ * - ==, =, !=: Glob pattern match (right side is a pattern)
+ * - =~: Extended regular expression match, captures in BASH_REMATCH
+ * - <, >: String ordering
+ * - -eq, -ne, -lt, -le, -gt, -ge: Integer comparison
+ * - !, &&, ||, ( ): Negation, conjunction, disjunction, grouping
+ *
+ * Glob patterns and regular expressions are compiled once per distinct
+ * text and cached (see Pattern.c).
+ */
+
+#include "SnailShell.h"
+
+#include <sys/stat.h>
+
+/**
+ * @struct Condition
+ * @brief Parser state while evaluating a conditional expression
+ */
+typedef struct Condition {
+    char ** words;
+    int count;
+    int position;
+    int error;
+} Condition;
+
+static int evaluateOr(Condition * condition, int active);
+
+/**
+ * @brief Returns the current word of a condition without consuming it
+ * @param condition Pointer to the Condition
+ * @return The current word, or NULL at the end
+ */
+static const char * peekWord(Condition * condition) {
+    return condition->position < condition->count ? condition->words[condition->position] : NULL;
+}
+
+/**
+ * @brief Checks whether the current word equals a given operator
+ * @param condition Pointer to the Condition
+ * @param word The operator
+ * @return Non-zero if the current word is the operator
+ */
+static int atWord(Condition * condition, const char * word) {
+    const char * current = peekWord(condition);
+    return current != NULL && strcmp(current, word) == 0;
+}
+
+/**
+ * @brief Reports a syntax error at the current word
+ * @param condition Pointer to the Condition
+ * @return 0, so callers can return the result directly
+ */
+static int syntaxError(Condition * condition) {
+    if (!condition->error) {
+        const char * current = peekWord(condition);
+        printError(ERROR_CONDITIONAL_SYNTAX, current != NULL ? current : "]]");
+    }
+    condition->error = 1;
+    return 0;
+}
+
+/**
+ * @brief Consumes an operand and expands its variable references
+ * @param condition Pointer to the Condition
+ * @return Newly allocated expanded operand, or NULL if no operand is left
+ */
+static char * takeOperand(Condition * condition) {
+    const char * word = peekWord(condition);
+    if (word == NULL) {
+        syntaxError(condition);
+        return NULL;
+    }
+
+    condition->position++;
+    return replace(word);
+}
+
+/**
+ * @brief Parses an integer operand of a numeric comparison
+ * @param text The operand
+ * @param value Pointer to store the value
+ * @return 0 on success, -1 if text is not an integer
+ *
+ * An empty operand counts as 0, as in bash.
+ */
+static int parseInteger(const char * text, long long * value) {
+    char * end;
+    *value = strtoll(text, &end, 10);
+    end += strspn(end, " \t");
+    if (*end != '\0') {
+        printError(ERROR_INTEGER_INVALID, text);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Evaluates a unary file, string or variable test
+ * @param operator The operator, such as "-f"
+ * @param operand The expanded operand
+ * @return Non-zero if the test holds
+ */
+static int evaluateUnary(const char * operator, const char * operand) {
+    struct stat info;
+
+    switch (operator[1]) {
+        case 'z':
+            return *operand == '\0';
+        case 'n':
+            return *operand != '\0';
+        case 'v':
+            return getenv(operand) != NULL || findArray(operand) != NULL;
+        case 'r':
+            return access(operand, R_OK) == 0;
+        case 'w':
+            return access(operand, W_OK) == 0;
+        case 'x':
+            return access(operand, X_OK) == 0;
+        case 'h':
+        case 'L':
+            return lstat(operand, &info) == 0 && S_ISLNK(info.st_mode);
+    }
+
+    if (stat(operand, &info) == -1) {
+        return 0;
+    }
+
+    switch (operator[1]) {
+        case 'f':
+            return S_ISREG(info.st_mode);
+        case 'd':
+            return S_ISDIR(info.st_mode);
+        case 'p':
+            return S_ISFIFO(info.st_mode);
+        case 'S':
+            return S_ISSOCK(info.st_mode);
+        case 's':
+            return info.st_size > 0;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @brief Checks whether a word is a unary operator
+ * @param word The word
+ * @return Non-zero if word is a supported unary operator
+ */
+static int isUnaryOperator(const char * word) {
+    return word[0] == '-' && word[1] != '\0' && word[2] == '\0' && strchr("zndefhLpSrwxsv", word[1]) != NULL;
+}
+
+/**
+ * @brief Checks whether a word is a binary operator
+ * @param word The word (may be NULL)
+ * @return Non-zero if word is a supported binary operator
+ */
+static int isBinaryOperator(const char * word) {
+    static const char * operators[] = {
+        "==", "=", "!=", "=~", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+    };
+
+    if (word == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+        if (strcmp(word, operators[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Stores the captures of a successful regular expression match
+ * @param subject The matched string
+ * @param matches The match offsets
+ * @param count Number of entries in matches
+ *
+ * BASH_REMATCH[0] holds the whole match and BASH_REMATCH[n] the n-th
+ * parenthesized group; groups that did not participate are empty.
+ */
+static void storeRematch(const char * subject, regmatch_t * matches, size_t count) {
+    unsetenv(REMATCH_NAME);
+    Array * array = createArray(REMATCH_NAME, ARRAY_INDEXED);
+    for (size_t i = 0; i < count; i++) {
+        if (matches[i].rm_so == -1) {
+            arrayAppend(array, "", 0);
+        } else {
+            arrayAppend(array, subject + matches[i].rm_so, matches[i].rm_eo - matches[i].rm_so);
+        }
+    }
+}
+
+/**
+ * @brief Evaluates a binary comparison
+ * @param condition Pointer to the Condition
+ * @param left The expanded left operand
+ * @param operator The operator
+ * @param right The expanded right operand
+ * @return Non-zero if the comparison holds
+ */
+static int evaluateBinary(Condition * condition, const char * left, const char * operator, const char * right) {
+    if (strcmp(operator, "==") == 0 || strcmp(operator, "=") == 0 || strcmp(operator, "!=") == 0) {
+        int matched = matchPattern(cachedPattern(right), left, strlen(left));
+        return operator[0] == '!' ? !matched : matched;
+    }
+
+    if (strcmp(operator, "=~") == 0) {
+        regex_t * regex = cachedRegex(right);
+        if (regex == NULL) {
+            condition->error = 1;
+            return 0;
+        }
+
+        regmatch_t matches[MAX_REMATCH];
+        size_t count = regex->re_nsub + 1 < MAX_REMATCH ? regex->re_nsub + 1 : MAX_REMATCH;
+        if (regexec(regex, left, count, matches, 0) != 0) {
+            unsetenv(REMATCH_NAME);
+            createArray(REMATCH_NAME, ARRAY_INDEXED);
+            return 0;
+        }
+        storeRematch(left, matches, count);
+        return 1;
+    }
+
+    if (strcmp(operator, "<") == 0) {
+        return strcmp(left, right) < 0;
+    }
+    if (strcmp(operator, ">") == 0) {
+        return strcmp(left, right) > 0;
+    }
+
+    long long a;
+    long long b;
+    if (parseInteger(left, &a) == -1 || parseInteger(right, &b) == -1) {
+        condition->error = 1;
+        return 0;
+    }
+
+    switch (operator[1] << 8 | operator[2]) {
+        case 'e' << 8 | 'q': return a == b;
+        case 'n' << 8 | 'e': return a != b;
+        case 'l' << 8 | 't': return a < b;
+        case 'l' << 8 | 'e': return a <= b;
+        case 'g' << 8 | 't': return a > b;
+        default: return a >= b;
+    }
+}
+
+/**
+ * @brief Evaluates a primary expression
+ * @param condition Pointer to the Condition
+ * @param active Whether the expression is evaluated or only parsed
+ * @return Non-zero if the expression holds
+ *
+ * Inactive expressions (the skipped side of && and ||) are parsed without
+ * expanding operands, running tests or touching BASH_REMATCH.
+ */
+static int evaluatePrimary(Condition * condition, int active) {
+    const char * word = peekWord(condition);
+    if (word == NULL) {
+        return syntaxError(condition);
+    }
+
+    if (strcmp(word, "(") == 0) {
+        condition->position++;
+        int result = evaluateOr(condition, active);
+        if (!atWord(condition, ")")) {
+            return syntaxError(condition);
+        }
+        condition->position++;
+        return result;
+    }
+
+    if (isUnaryOperator(word) && condition->position + 1 < condition->count &&
+        !isBinaryOperator(condition->words[condition->position + 1])) {
+        condition->position++;
+        if (!active) {
+            condition->position++;
+            return 0;
+        }
+
+        char * operand = takeOperand(condition);
+        int result = evaluateUnary(word, operand);
+        free(operand);
+        return result;
+    }
+
+    if (isBinaryOperator(condition->position + 1 < condition->count ? condition->words[condition->position + 1] : NULL)) {
+        if (condition->position + 2 >= condition->count) {
+            condition->position += 2;
+            return syntaxError(condition);
+        }
+        if (!active) {
+            condition->position += 3;
+            return 0;
+        }
+
+        char * left = takeOperand(condition);
+        const char * operator = condition->words[condition->position++];
+        char * right = takeOperand(condition);
+        int result = evaluateBinary(condition, left, operator, right);
+        free(left);
+        free(right);
+        return result;
+    }
+
+    if (strcmp(word, ")") == 0 || strcmp(word, "&&") == 0 || strcmp(word, "||") == 0) {
+        return syntaxError(condition);
+    }
+
+    if (!active) {
+        condition->position++;
+        return 0;
+    }
+
+    char * operand = takeOperand(condition);
+    int result = *operand != '\0';
+    free(operand);
+    return result;
+}
+
+/**
+ * @brief Evaluates a possibly negated expression
+ * @param condition Pointer to the Condition
+ * @param active Whether the expression is evaluated or only parsed
+ * @return Non-zero if the expression holds
+ */
+static int evaluateNot(Condition * condition, int active) {
+    if (atWord(condition, "!")) {
+        condition->position++;
+        return !evaluateNot(condition, active);
+    }
+    return evaluatePrimary(condition, active);
+}
+
+/**
+ * @brief Evaluates expressions joined by &&
+ * @param condition Pointer to the Condition
+ * @param active Whether the expression is evaluated or only parsed
+ * @return Non-zero if every expression holds
+ */
+static int evaluateAnd(Condition * condition, int active) {
+    int result = evaluateNot(condition, active);
+    while (!condition->error && atWord(condition, "&&")) {
+        condition->position++;
+        int right = evaluateNot(condition, active && result);
+        result = result && right;
+    }
+    return result;
+}
+
+/**
+ * @brief Evaluates expressions joined by ||
+ * @param condition Pointer to the Condition
+ * @param active Whether the expression is evaluated or only parsed
+ * @return Non-zero if any expression holds
+ */
+static int evaluateOr(Condition * condition, int active) {
+    int result = evaluateAnd(condition, active);
+    while (!condition->error && atWord(condition, "||")) {
+        condition->position++;
+        int right = evaluateAnd(condition, active && !result);
+        result = result || right;
+    }
+    return result;
+}
+
+/**
+ * @brief Evaluates the expression of a [[ ]] command
+ * @param text The text between "[[" and "]]"
+ * @return 0 if the expression holds, 1 if it does not, 2 on an error
+ *
+ * Memory Management:
+ * - Splits a private copy of text into words
+ * - Expanded operands are freed as soon as they have been compared
+ */
+int evaluateConditional(const char * text) {
+    char * textCopy = strdup(text);
+    if (textCopy == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    char * words[MAX_NUM_ARGS];
+    Condition condition;
+    memset(&condition, 0, sizeof(Condition));
+    condition.words = words;
+
+    char * tokenPtr;
+    char * token = strtok_r(textCopy, " \t", &tokenPtr);
+    while (token != NULL && condition.count < MAX_NUM_ARGS) {
+        words[condition.count++] = token;
+        token = strtok_r(NULL, " \t", &tokenPtr);
+    }
+
+    int result = 0;
+    if (token != NULL) {
+        printError(ERROR_TOO_MANY_ARGS);
+        condition.error = 1;
+    } else {
+        result = evaluateOr(&condition, 1);
+        if (!condition.error && condition.position != condition.count) {
+            syntaxError(&condition);
+        }
+    }
+
+    free(textCopy);
+    if (condition.error) {
+        return 2;
+    }
+    return result ? 0 : 1;
+}
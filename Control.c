@@ -0,0 +1,1179 @@
+/**
+ * @file Control.c
+ * @brief Command lists and compound commands for SnailShell
+ *
+ * This file splits input into commands separated by ';' or newlines and
+ * groups them into compound commands that may span several lines. Simple
+ * commands keep their source text and are parsed with parse() every time
+ * they run, so variables are expanded with their current values.
+ *
+ * Supported Compound Commands:
+ * - while list; do list; done [redirections]
+ * - until list; do list; done [redirections]
+ * - for name in words; do list; done [redirections]
+ * - case word in [(]pattern[|pattern]...) list ;; ... esac [redirections]
+ * - [[ expression ]] (see Conditional.c)
+ * - ( list ) [redirections]
+ * - { list; } [redirections]
+ *
+ * Redirections after "done", "esac", ")" or "}" apply to the whole command
+ * and are set up once in the shell, so every command inside it (including
+ * the read built-in) shares the same open file.
+ *
+ * A for loop over a single sequence such as {1..1000000} or over
+ * $(seq ...) does not build its word list; the values are generated one
+ * per iteration (see Brace.c), so memory use does not depend on the range.
+ * With shopt -s streamglob, a loop over a glob such as *.log inside a
+ * single directory likewise reads the directory in batches while the loop
+ * runs (see Glob.c).
+ *
+ * The patterns of a case command are compiled into a dispatch table when
+ * the command is read, so selecting an arm does not try every pattern in
+ * turn (see Case.c).
+ *
+ * A subshell whose commands are all built-ins with restorable effects runs
+ * in the shell process, with its working directory and variables put back
+ * afterwards; any other subshell runs in a forked child (see Subshell.c).
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+/**
+ * @brief Creates an empty node
+ * @param type The node type
+ * @return Pointer to the new Node
+ */
+static Node * createNode(int type) {
+    Node * node = calloc(1, sizeof(Node));
+    if (node == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    node->type = type;
+    return node;
+}
+
+/**
+ * @brief Frees a list of nodes
+ * @param node Pointer to the first Node of the list
+ */
+void freeNode(Node * node) {
+    while (node != NULL) {
+        Node * next = node->next;
+
+        free(node->text);
+        free(node->name);
+        free(node->input);
+        free(node->output);
+        freeNode(node->condition);
+        freeNode(node->body);
+        freeCaseTable(node->dispatch);
+        free(node);
+
+        node = next;
+    }
+}
+
+/**
+ * @brief Initializes a source of commands
+ * @param source Pointer to the Source to initialize
+ * @param stream The stream commands are read from
+ */
+void initSource(Source * source, FILE * stream) {
+    memset(source, 0, sizeof(Source));
+    source->stream = stream;
+}
+
+/**
+ * @brief Releases the buffers of a source of commands
+ * @param source Pointer to the Source
+ */
+void freeSource(Source * source) {
+    free(source->line);
+    free(source->pushback);
+    source->line = NULL;
+    source->pushback = NULL;
+}
+
+/**
+ * @brief Stores the remainder of a command to be returned next
+ * @param source Pointer to the Source
+ * @param rest Text to push back, ignored if empty
+ */
+static void pushSegment(Source * source, const char * rest) {
+    if (rest == NULL || *rest == '\0') {
+        return;
+    }
+
+    source->pushback = strdup(rest);
+    if (source->pushback == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Splits off the ')' closing an open subshell
+ * @param source Pointer to the Source (pushback must be empty)
+ * @param segment The command text, shortened in place
+ * @return The segment
+ *
+ * Inside a subshell, a ')' that has no matching '(' in the command and is
+ * followed only by redirections or another ')' closes the subshell. The
+ * text before it becomes a command of its own and the ')' with the rest
+ * is pushed back. A segment that already starts with the closing ')' is
+ * split before the next one.
+ */
+static char * splitSubshellEnd(Source * source, char * segment) {
+    if (source->subshells == 0) {
+        return segment;
+    }
+
+    int depth = 0;
+    for (char * p = segment[0] == ')' ? segment + 1 : segment; *p != '\0'; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && depth > 0) {
+            depth--;
+        } else if (*p == ')') {
+            char * after = p + 1 + strspn(p + 1, " \t");
+            if (*after != '\0' && *after != '<' && *after != '>' && *after != ')') {
+                continue;
+            }
+
+            pushSegment(source, p);
+            while (p > segment && (p[-1] == ' ' || p[-1] == '\t')) {
+                p--;
+            }
+            *p = '\0';
+            break;
+        }
+    }
+    return segment;
+}
+
+/**
+ * @brief Returns the next command text of a source
+ * @param source Pointer to the Source
+ * @return Newly allocated command text, or NULL at end of input
+ *
+ * Lines are read on demand and split at ';'. Empty commands are skipped.
+ * The ";;" closing a case arm is returned as a command of its own, and so
+ * is the ')' closing a subshell.
+ * In interactive mode the regular prompt is shown before a new command and
+ * a continuation prompt while a compound command is still open; lines
+ * typed at a terminal are read through the line editor (see Editor.c).
+ */
+static char * nextSegment(Source * source) {
+    if (source->pushback != NULL) {
+        char * segment = source->pushback;
+        source->pushback = NULL;
+        return splitSubshellEnd(source, segment);
+    }
+
+    for (;;) {
+        if (source->cursor == NULL || *source->cursor == '\0') {
+            if (source->stream == stdin && isatty(STDIN_FILENO)) {
+                flushBuiltinOutput();
+                ssize_t length = editLine(source->depth > 0, &source->line, &source->capacity);
+                if (length == -1) {
+                    source->cursor = NULL;
+                    return NULL;
+                }
+                addHistory(source->line);
+                source->cursor = source->line;
+                continue;
+            }
+
+            if (source->stream == stdin) {
+                if (source->depth == 0) {
+                    printPrompt();
+                } else {
+                    printf(CONTINUATION_PROMPT);
+                }
+                flushBuiltinOutput();
+            }
+
+            if (getline(&source->line, &source->capacity, source->stream) == -1) {
+                source->cursor = NULL;
+                return NULL;
+            }
+
+            source->line[strcspn(source->line, "\n")] = '\0';
+            source->cursor = source->line;
+        }
+
+        char * start = source->cursor + strspn(source->cursor, " \t");
+        if (start[0] == ';' && start[1] == ';') {
+            source->cursor = start + 2;
+            char * segment = strdup(";;");
+            if (segment == NULL) {
+                perror("strdup");
+                exit(EXIT_FAILURE);
+            }
+            return segment;
+        }
+
+        size_t length = strcspn(start, ";");
+        if (start[length] == ';' && start[length + 1] == ';') {
+            source->cursor = start + length;
+        } else {
+            source->cursor = start[length] == ';' ? start + length + 1 : start + length;
+        }
+
+        while (length > 0 && (start[length - 1] == ' ' || start[length - 1] == '\t')) {
+            length--;
+        }
+        if (length == 0) {
+            continue;
+        }
+
+        char * segment = strndup(start, length);
+        if (segment == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+        return splitSubshellEnd(source, segment);
+    }
+}
+
+/**
+ * @brief Checks whether a command starts with a reserved word
+ * @param segment The command text
+ * @param word The reserved word
+ * @return Pointer to the text following the word, or NULL if it does not match
+ */
+static char * matchKeyword(char * segment, const char * word) {
+    size_t length = strlen(word);
+    if (strncmp(segment, word, length) != 0) {
+        return NULL;
+    }
+
+    char * rest = segment + length;
+    if (*rest != '\0' && *rest != ' ' && *rest != '\t') {
+        return NULL;
+    }
+    return rest + strspn(rest, " \t");
+}
+
+/**
+ * @brief Checks whether a command starts with a word that closes a list
+ * @param segment The command text
+ * @return Non-zero if the segment starts with "do", "done", ";;", "esac",
+ *         ")" or "}"
+ */
+static int isTerminator(char * segment) {
+    return matchKeyword(segment, "do") != NULL || matchKeyword(segment, "done") != NULL ||
+        matchKeyword(segment, ";;") != NULL || matchKeyword(segment, "esac") != NULL ||
+        matchKeyword(segment, ")") != NULL || matchKeyword(segment, "}") != NULL;
+}
+
+static Node * parseNode(Source * source, char * segment, int * error);
+
+/**
+ * @brief Parses commands up to a terminating reserved word
+ * @param source Pointer to the Source
+ * @param terminator The reserved word closing the list ("do", "done", ";;",
+ *        ")", "}")
+ * @param alternate Reserved word that also closes the list but is left to
+ *        be read by the caller, or NULL
+ * @param rest Pointer to store the text following the terminator (NULL if
+ *        the list was closed by alternate)
+ * @param error Pointer set to 1 on a syntax error
+ * @return List of parsed nodes
+ */
+static Node * parseList(Source * source, const char * terminator, const char * alternate, char ** rest, int * error) {
+    Node * head = NULL;
+    Node * tail = NULL;
+
+    source->depth++;
+    for (;;) {
+        char * segment = nextSegment(source);
+        if (segment == NULL) {
+            printError(ERROR_SYNTAX_EOF, terminator);
+            *error = 1;
+            break;
+        }
+
+        char * after = matchKeyword(segment, terminator);
+        if (after != NULL) {
+            *rest = strdup(after);
+            if (*rest == NULL) {
+                perror("strdup");
+                exit(EXIT_FAILURE);
+            }
+            free(segment);
+            break;
+        }
+
+        if (alternate != NULL && matchKeyword(segment, alternate) != NULL) {
+            pushSegment(source, segment);
+            free(segment);
+            break;
+        }
+
+        if (isTerminator(segment)) {
+            printError(ERROR_SYNTAX_UNEXPECTED, segment);
+            free(segment);
+            *error = 1;
+            break;
+        }
+
+        Node * node = parseNode(source, segment, error);
+        if (*error) {
+            break;
+        }
+
+        if (tail == NULL) {
+            head = node;
+        } else {
+            tail->next = node;
+        }
+        tail = node;
+    }
+    source->depth--;
+
+    return head;
+}
+
+/**
+ * @brief Parses the redirections following the end of a compound command
+ * @param node Pointer to the compound Node
+ * @param text The text following the closing reserved word
+ * @return 0 on success, -1 on a syntax error
+ */
+static int parseCompoundRedirections(Node * node, char * text) {
+    char * tokenPtr;
+    char * token = strtok_r(text, " \t", &tokenPtr);
+    while (token != NULL) {
+        char * target = strtok_r(NULL, " \t", &tokenPtr);
+        if (target == NULL) {
+            printError(ERROR_SYNTAX_UNEXPECTED, token);
+            return -1;
+        }
+
+        char ** slot;
+        if (strcmp(token, "<") == 0) {
+            slot = &node->input;
+        } else if (strcmp(token, ">") == 0 || strcmp(token, ">>") == 0) {
+            slot = &node->output;
+            node->append = token[1] == '>';
+        } else {
+            printError(ERROR_SYNTAX_UNEXPECTED, token);
+            return -1;
+        }
+
+        free(*slot);
+        *slot = strdup(target);
+        if (*slot == NULL) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        token = strtok_r(NULL, " \t", &tokenPtr);
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses a while or until loop
+ * @param source Pointer to the Source
+ * @param type NODE_WHILE or NODE_UNTIL
+ * @param rest Text following the while/until keyword
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the loop Node
+ */
+static Node * parseLoop(Source * source, int type, char * rest, int * error) {
+    Node * node = createNode(type);
+    char * after = NULL;
+
+    pushSegment(source, rest);
+    node->condition = parseList(source, "do", NULL, &after, error);
+    if (*error) {
+        free(after);
+        return node;
+    }
+
+    pushSegment(source, after);
+    free(after);
+    after = NULL;
+
+    node->body = parseList(source, "done", NULL, &after, error);
+    if (!*error && parseCompoundRedirections(node, after) == -1) {
+        *error = 1;
+    }
+
+    free(after);
+    return node;
+}
+
+/**
+ * @brief Parses a for loop
+ * @param source Pointer to the Source
+ * @param rest Text following the for keyword ("name in words")
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the loop Node; its text holds the unexpanded words
+ */
+static Node * parseFor(Source * source, char * rest, int * error) {
+    Node * node = createNode(NODE_FOR);
+    size_t nameLength = strcspn(rest, " \t");
+    node->name = strndup(rest, nameLength);
+    if (node->name == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!isValidName(node->name)) {
+        printError(ERROR_VAR_INVALID, node->name);
+        *error = 1;
+        return node;
+    }
+
+    char * words = rest + nameLength;
+    words += strspn(words, " \t");
+    char * afterIn = matchKeyword(words, "in");
+    if (*words != '\0' && afterIn == NULL) {
+        printError(ERROR_SYNTAX_UNEXPECTED, words);
+        *error = 1;
+        return node;
+    }
+
+    node->text = strdup(afterIn != NULL ? afterIn : "");
+    if (node->text == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    source->depth++;
+    char * segment = nextSegment(source);
+    source->depth--;
+    char * after = segment != NULL ? matchKeyword(segment, "do") : NULL;
+    if (after == NULL) {
+        if (segment == NULL) {
+            printError(ERROR_SYNTAX_EOF, "do");
+        } else {
+            printError(ERROR_SYNTAX_UNEXPECTED, segment);
+        }
+        free(segment);
+        *error = 1;
+        return node;
+    }
+
+    pushSegment(source, after);
+    free(segment);
+    after = NULL;
+
+    node->body = parseList(source, "done", NULL, &after, error);
+    if (!*error && parseCompoundRedirections(node, after) == -1) {
+        *error = 1;
+    }
+
+    free(after);
+    return node;
+}
+
+/**
+ * @brief Finds the ')' closing the patterns of a case arm
+ * @param text The arm text, after an optional '('
+ * @return Pointer to the ')', or NULL if there is none
+ */
+static char * findArmEnd(char * text) {
+    for (char * p = text; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == ')') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses a case command
+ * @param source Pointer to the Source
+ * @param rest Text following the case keyword ("word in ...")
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the case Node; its text holds the unexpanded word
+ *
+ * Each arm starts with its patterns and a ')', optionally preceded by '(',
+ * and runs up to ";;" or up to the "esac" closing the command.
+ */
+static Node * parseCase(Source * source, char * rest, int * error) {
+    Node * node = createNode(NODE_CASE);
+    size_t wordLength = strcspn(rest, " \t");
+    node->text = strndup(rest, wordLength);
+    if (node->text == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    char * afterWord = rest + wordLength;
+    afterWord += strspn(afterWord, " \t");
+    char * afterIn = wordLength > 0 ? matchKeyword(afterWord, "in") : NULL;
+    if (afterIn == NULL) {
+        printError(ERROR_SYNTAX_UNEXPECTED, wordLength > 0 ? afterWord : "case");
+        *error = 1;
+        return node;
+    }
+    pushSegment(source, afterIn);
+
+    Node * tail = NULL;
+    source->depth++;
+    for (;;) {
+        char * segment = nextSegment(source);
+        if (segment == NULL) {
+            printError(ERROR_SYNTAX_EOF, "esac");
+            *error = 1;
+            break;
+        }
+
+        char * after = matchKeyword(segment, "esac");
+        if (after != NULL) {
+            if (parseCompoundRedirections(node, after) == -1) {
+                *error = 1;
+            }
+            free(segment);
+            break;
+        }
+
+        char * patterns = segment[0] == '(' ? segment + 1 : segment;
+        char * end = findArmEnd(patterns);
+        if (isTerminator(segment) || end == NULL || end == patterns) {
+            printError(ERROR_SYNTAX_UNEXPECTED, segment);
+            free(segment);
+            *error = 1;
+            break;
+        }
+
+        Node * arm = createNode(NODE_ARM);
+        arm->text = strndup(patterns, end - patterns);
+        if (arm->text == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+        if (tail == NULL) {
+            node->body = arm;
+        } else {
+            tail->next = arm;
+        }
+        tail = arm;
+
+        char * body = end + 1;
+        pushSegment(source, body + strspn(body, " \t"));
+        free(segment);
+
+        char * afterArm = NULL;
+        arm->body = parseList(source, ";;", "esac", &afterArm, error);
+        if (*error) {
+            free(afterArm);
+            break;
+        }
+        pushSegment(source, afterArm);
+        free(afterArm);
+    }
+    source->depth--;
+
+    if (!*error) {
+        node->dispatch = compileCase(node->body);
+    }
+    return node;
+}
+
+/**
+ * @brief Parses a [[ ]] conditional command
+ * @param rest Text following the opening "[["
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the conditional Node holding the expression text
+ */
+static Node * parseConditional(char * rest, int * error) {
+    Node * node = createNode(NODE_CONDITIONAL);
+    size_t length = strlen(rest);
+
+    if (length < 2 || strcmp(rest + length - 2, "]]") != 0 ||
+        (length > 2 && rest[length - 3] != ' ' && rest[length - 3] != '\t')) {
+        printError(ERROR_SYNTAX_EOF, "]]");
+        *error = 1;
+        return node;
+    }
+
+    node->text = strndup(rest, length - 2);
+    if (node->text == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+    return node;
+}
+
+/**
+ * @brief Parses a ( ) subshell
+ * @param source Pointer to the Source
+ * @param rest Text following the opening '('
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the subshell Node
+ *
+ * The subshell runs up to the ')' that closes it, which nextSegment()
+ * splits off while the subshell is open.
+ */
+static Node * parseSubshell(Source * source, char * rest, int * error) {
+    Node * node = createNode(NODE_SUBSHELL);
+    char * after = NULL;
+
+    source->subshells++;
+    pushSegment(source, rest + strspn(rest, " \t"));
+    node->body = parseList(source, ")", NULL, &after, error);
+    source->subshells--;
+
+    if (!*error && parseCompoundRedirections(node, after) == -1) {
+        *error = 1;
+    }
+    free(after);
+    return node;
+}
+
+/**
+ * @brief Parses a { } group
+ * @param source Pointer to the Source
+ * @param rest Text following the opening "{"
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the group Node
+ *
+ * As in other shells, the closing "}" must start a command, so the last
+ * command of the group is followed by ';' or a newline.
+ */
+static Node * parseGroup(Source * source, char * rest, int * error) {
+    Node * node = createNode(NODE_GROUP);
+    char * after = NULL;
+
+    pushSegment(source, rest);
+    node->body = parseList(source, "}", NULL, &after, error);
+
+    if (!*error && parseCompoundRedirections(node, after) == -1) {
+        *error = 1;
+    }
+    free(after);
+    return node;
+}
+
+/**
+ * @brief Parses a single command, reading further lines for compound commands
+ * @param source Pointer to the Source
+ * @param segment The first command text (ownership is taken)
+ * @param error Pointer set to 1 on a syntax error
+ * @return Pointer to the parsed Node
+ */
+static Node * parseNode(Source * source, char * segment, int * error) {
+    Node * node;
+    char * rest;
+
+    if ((rest = matchKeyword(segment, "while")) != NULL) {
+        node = parseLoop(source, NODE_WHILE, rest, error);
+        free(segment);
+    } else if ((rest = matchKeyword(segment, "until")) != NULL) {
+        node = parseLoop(source, NODE_UNTIL, rest, error);
+        free(segment);
+    } else if ((rest = matchKeyword(segment, "for")) != NULL) {
+        node = parseFor(source, rest, error);
+        free(segment);
+    } else if ((rest = matchKeyword(segment, "case")) != NULL) {
+        node = parseCase(source, rest, error);
+        free(segment);
+    } else if ((rest = matchKeyword(segment, "[[")) != NULL) {
+        node = parseConditional(rest, error);
+        free(segment);
+    } else if ((rest = matchKeyword(segment, "{")) != NULL) {
+        node = parseGroup(source, rest, error);
+        free(segment);
+    } else if (segment[0] == '(') {
+        node = parseSubshell(source, segment + 1, error);
+        free(segment);
+    } else {
+        node = createNode(NODE_SIMPLE);
+        node->text = segment;
+    }
+
+    return node;
+}
+
+/**
+ * @brief Reads the next complete command from a source
+ * @param source Pointer to the Source
+ * @param node Pointer to store the parsed Node (NULL on a syntax error)
+ * @return 0 on success, -1 at end of input
+ *
+ * Compound commands are read in full, across as many lines as needed, so
+ * the returned node can be executed repeatedly without further input.
+ */
+int readNode(Source * source, Node ** node) {
+    *node = NULL;
+
+    char * segment = nextSegment(source);
+    if (segment == NULL) {
+        return -1;
+    }
+
+    if (isTerminator(segment)) {
+        printError(ERROR_SYNTAX_UNEXPECTED, segment);
+        free(segment);
+        return 0;
+    }
+
+    int error = 0;
+    Node * parsed = parseNode(source, segment, &error);
+    if (error) {
+        freeNode(parsed);
+        free(source->pushback);
+        source->pushback = NULL;
+        source->cursor = NULL;
+        return 0;
+    }
+
+    *node = parsed;
+    return 0;
+}
+
+/**
+ * @brief Executes a list of nodes in order
+ * @param node Pointer to the first Node of the list
+ * @return Exit status of the last node executed
+ */
+static int executeList(Node * node) {
+    int status = 0;
+    for (; node != NULL; node = node->next) {
+        status = executeNode(node);
+    }
+    return status;
+}
+
+/**
+ * @brief Applies the redirections of a compound command to the shell
+ * @param node Pointer to the compound Node
+ * @param savedInput Pointer to store the saved standard input (or -1)
+ * @param savedOutput Pointer to store the saved standard output (or -1)
+ * @return 0 on success, -1 if a redirection failed
+ */
+static int redirectNode(Node * node, int * savedInput, int * savedOutput) {
+    *savedInput = -1;
+    *savedOutput = -1;
+
+    if (node->input != NULL) {
+        *savedInput = redirectInShell(node->input, O_RDONLY, STDIN_FILENO);
+        if (*savedInput == -1) {
+            return -1;
+        }
+    }
+
+    if (node->output != NULL) {
+        flushBuiltinOutput();
+        *savedOutput = redirectInShell(node->output, O_WRONLY | O_CREAT | (node->append ? O_APPEND : O_TRUNC), STDOUT_FILENO);
+        if (*savedOutput == -1) {
+            restoreInShell(*savedInput, STDIN_FILENO);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Restores the descriptors saved by redirectNode()
+ * @param savedInput The saved standard input (or -1)
+ * @param savedOutput The saved standard output (or -1)
+ */
+static void restoreNode(int savedInput, int savedOutput) {
+    flushBuiltinOutput();
+    restoreInShell(savedOutput, STDOUT_FILENO);
+    restoreInShell(savedInput, STDIN_FILENO);
+}
+
+/**
+ * @brief Executes a while or until loop
+ * @param node Pointer to the loop Node
+ * @return Exit status of the last body command, or 0 if the body never ran
+ *
+ * The loop's redirections are applied to the shell's descriptors once and
+ * restored after the last iteration.
+ */
+static int executeLoop(Node * node) {
+    int savedInput;
+    int savedOutput;
+    if (redirectNode(node, &savedInput, &savedOutput) == -1) {
+        return 1;
+    }
+
+    int status = 0;
+    for (;;) {
+        int condition = executeList(node->condition);
+        if ((node->type == NODE_WHILE) != (condition == 0)) {
+            break;
+        }
+        status = executeList(node->body);
+    }
+
+    restoreNode(savedInput, savedOutput);
+    return status;
+}
+
+/**
+ * @brief Assigns the current value of a for loop variable
+ * @param name The variable name
+ * @param entry Pointer to the Buffer holding the loop's "name=value" string
+ * @param value The value
+ * @param length Length of the value
+ *
+ * The string is handed to putenv() rather than setenv(), which keeps a
+ * copy of every value ever assigned; reusing one buffer keeps a loop over
+ * millions of values in constant memory. A larger buffer is installed
+ * before the old one is freed, so the environment never points to freed
+ * memory. An array of the same name gets its element 0 assigned instead.
+ */
+static void setLoopVariable(const char * name, Buffer * entry, const char * value, size_t length) {
+    Array * array = findArray(name);
+    if (array != NULL) {
+        arraySetIndex(array, 0, value, length);
+        return;
+    }
+
+    size_t nameLength = strlen(name);
+    Buffer assignment = *entry;
+    if (nameLength + length + 2 > entry->capacity) {
+        memset(&assignment, 0, sizeof(Buffer));
+    }
+
+    assignment.length = 0;
+    bufferAppend(&assignment, name, nameLength);
+    bufferAppend(&assignment, "=", 1);
+    bufferAppend(&assignment, value, length);
+    if (putenv(assignment.data) != 0) {
+        perror("putenv");
+    }
+
+    if (assignment.data != entry->data) {
+        free(entry->data);
+    }
+    *entry = assignment;
+}
+
+/**
+ * @brief Hands a for loop variable back to setenv() when the loop ends
+ * @param name The variable name
+ * @param entry Pointer to the Buffer holding the loop's "name=value" string
+ *
+ * The environment must not keep pointing into the buffer once it is freed.
+ */
+static void releaseLoopVariable(const char * name, Buffer * entry) {
+    const char * value = getenv(name);
+    if (entry->data != NULL && value == entry->data + strlen(name) + 1 && setenv(name, value, 1) == -1) {
+        perror("setenv");
+    }
+    free(entry->data);
+}
+
+/**
+ * @brief Recognizes a for loop word list that can be generated lazily
+ * @param text The unexpanded word list
+ * @param range Pointer to the Range to initialize
+ * @return 0 for a range, -1 for an ordinary word list, -2 on an error
+ *
+ * Lazy word lists are a single sequence expression ({1..N}, {a..z..2}) or a
+ * $(seq ...) call with integer arguments. Variables in the seq arguments
+ * are expanded.
+ */
+static int parseForRange(const char * text, Range * range) {
+    size_t length = strlen(text);
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) {
+        length--;
+    }
+
+    if (strncmp(text, "$(", 2) != 0 || text[length - 1] != ')') {
+        if (strcspn(text, " \t") < length) {
+            return -1;
+        }
+        char * word = strndup(text, length);
+        if (word == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+        int ret = parseRange(word, range);
+        free(word);
+        return ret;
+    }
+
+    char * inner = strndup(text + 2, length - 3);
+    if (inner == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    char * args[MAX_SEQ_ARGS];
+    int count = 0;
+    int ret = 0;
+    char * tokenPtr;
+    char * token = strtok_r(inner, " \t", &tokenPtr);
+    if (token == NULL || strcmp(token, "seq") != 0) {
+        ret = -2;
+    }
+    while (ret == 0 && (token = strtok_r(NULL, " \t", &tokenPtr)) != NULL) {
+        if (count == MAX_SEQ_ARGS) {
+            ret = -2;
+            break;
+        }
+        args[count++] = replace(token);
+    }
+
+    if (ret == 0 && parseSeq(args, count, range) == -1) {
+        ret = -2;
+    }
+    if (ret == -2) {
+        printError(ERROR_FOR_SUBSTITUTION, text);
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(args[i]);
+    }
+    free(inner);
+    return ret;
+}
+
+/**
+ * @brief Iterates a for loop directly over a directory, if possible
+ * @param node Pointer to the loop Node
+ * @param entry Pointer to the Buffer of the loop variable
+ * @param status Pointer to store the exit status of the last body command
+ * @return 0 if the loop ran from a stream, -1 if the words must be expanded
+ *
+ * Used with the streamglob option when the word list is a single glob
+ * whose wildcards are all in the last component. Matches are visited in
+ * directory order as getdents64() returns them. As with a sorted glob, a
+ * pattern that matches nothing runs the body once with the pattern itself.
+ */
+static int streamFor(Node * node, Buffer * entry, int * status) {
+    if (!isOptionEnabled(OPTION_STREAMGLOB) || strcspn(node->text, " \t") != strlen(node->text) ||
+        strchr(node->text, '{') != NULL) {
+        return -1;
+    }
+
+    char * pattern = replace(node->text);
+    GlobStream stream;
+    if (!hasWildcards(pattern) || openGlobStream(pattern, &stream) == -1) {
+        free(pattern);
+        return -1;
+    }
+
+    int matched = 0;
+    const char * path;
+    while ((path = nextGlobStream(&stream)) != NULL) {
+        setLoopVariable(node->name, entry, path, strlen(path));
+        *status = executeList(node->body);
+        matched = 1;
+    }
+
+    if (!matched) {
+        setLoopVariable(node->name, entry, pattern, strlen(pattern));
+        *status = executeList(node->body);
+    }
+
+    closeGlobStream(&stream);
+    free(pattern);
+    return 0;
+}
+
+/**
+ * @brief Executes a for loop
+ * @param node Pointer to the loop Node
+ * @return Exit status of the last body command, or 0 if the body never ran
+ *
+ * Sequences are iterated without materializing them, and so are
+ * single-directory globs when the streamglob option is set. Other word
+ * lists are expanded once, before the first iteration, like any command's
+ * arguments (braces, variables and globs).
+ */
+static int executeFor(Node * node) {
+    int savedInput;
+    int savedOutput;
+    if (redirectNode(node, &savedInput, &savedOutput) == -1) {
+        return 1;
+    }
+
+    int status = 0;
+    Buffer entry;
+    memset(&entry, 0, sizeof(Buffer));
+    Range range;
+    int kind = parseForRange(node->text, &range);
+
+    if (kind == 0) {
+        char value[32];
+        int length;
+        while ((length = rangeNext(&range, value, sizeof(value))) != -1) {
+            setLoopVariable(node->name, &entry, value, length);
+            status = executeList(node->body);
+        }
+    } else if (kind == -1 && streamFor(node, &entry, &status) == -1) {
+        char ** words = NULL;
+        int count = 0;
+        int capacity = 0;
+
+        char * text = strdup(node->text);
+        if (text == NULL) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        char * tokenPtr;
+        for (char * token = strtok_r(text, " \t", &tokenPtr); token != NULL; token = strtok_r(NULL, " \t", &tokenPtr)) {
+            expandArgument(token, &words, &count, &capacity);
+        }
+        free(text);
+        clearGlobCache();
+
+        for (int i = 0; i < count; i++) {
+            setLoopVariable(node->name, &entry, words[i], strlen(words[i]));
+            status = executeList(node->body);
+            free(words[i]);
+        }
+        free(words);
+    } else if (kind == -2) {
+        status = 1;
+    }
+
+    releaseLoopVariable(node->name, &entry);
+    restoreNode(savedInput, savedOutput);
+    return status;
+}
+
+/**
+ * @brief Executes a case command
+ * @param node Pointer to the case Node
+ * @return Exit status of the selected arm's last command, or 0 if no arm
+ *         matches
+ */
+static int executeCase(Node * node) {
+    int savedInput;
+    int savedOutput;
+    if (redirectNode(node, &savedInput, &savedOutput) == -1) {
+        return 1;
+    }
+
+    char * subject = replace(node->text);
+    Node * arm = selectCaseArm(node->dispatch, subject);
+    free(subject);
+
+    int status = arm != NULL ? executeList(arm->body) : 0;
+    restoreNode(savedInput, savedOutput);
+    return status;
+}
+
+/**
+ * @brief Runs the commands of a subshell in a forked child
+ * @param node Pointer to the subshell Node
+ * @return Exit status of the child (128 + signal if it was killed)
+ */
+static int forkSubshell(Node * node) {
+    flushBuiltinOutput();
+    syncReaders();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return 1;
+    }
+
+    if (pid == 0) {
+        int status = executeList(node->body);
+        flushBuiltinOutput();
+        syncReaders();
+        _exit(status);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return 1;
+        }
+    }
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/**
+ * @brief Executes a subshell
+ * @param node Pointer to the subshell Node
+ * @return Exit status of the last command of the subshell
+ *
+ * The subshell's redirections are applied in the shell. If all of its
+ * commands have effects that can be undone (see isRestorable()), they run
+ * in the shell process and the working directory and environment are
+ * restored afterwards; otherwise they run in a forked child.
+ */
+static int executeSubshell(Node * node) {
+    int savedInput;
+    int savedOutput;
+    if (redirectNode(node, &savedInput, &savedOutput) == -1) {
+        return 1;
+    }
+
+    int status;
+    ShellState state;
+    if (isRestorable(node->body) && saveShellState(&state) == 0) {
+        status = executeList(node->body);
+        restoreShellState(&state);
+    } else {
+        status = forkSubshell(node);
+    }
+
+    restoreNode(savedInput, savedOutput);
+    return status;
+}
+
+/**
+ * @brief Executes a { } group
+ * @param node Pointer to the group Node
+ * @return Exit status of the last command of the group
+ *
+ * The commands run in the shell process, so their effects persist. The
+ * group's redirections are opened once for all of them.
+ */
+static int executeGroup(Node * node) {
+    int savedInput;
+    int savedOutput;
+    if (redirectNode(node, &savedInput, &savedOutput) == -1) {
+        return 1;
+    }
+
+    int status = executeList(node->body);
+    restoreNode(savedInput, savedOutput);
+    return status;
+}
+
+/**
+ * @brief Executes a single node
+ * @param node Pointer to the Node
+ * @return Exit status of the node
+ *
+ * Simple commands are parsed at this point so that variable references
+ * pick up the values assigned by earlier commands, such as read in the
+ * condition of a loop.
+ */
+int executeNode(Node * node) {
+    switch (node->type) {
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            return executeLoop(node);
+        case NODE_FOR:
+            return executeFor(node);
+        case NODE_CASE:
+            return executeCase(node);
+        case NODE_CONDITIONAL:
+            return evaluateConditional(node->text);
+        case NODE_SUBSHELL:
+            return executeSubshell(node);
+        case NODE_GROUP:
+            return executeGroup(node);
+        default: {
+            Command * commands = parse(node->text);
+            if (commands == NULL) {
+                return 0;
+            }
+            return execute(commands);
+        }
+    }
+}
@@ -0,0 +1,649 @@
+/**
+ * @file Editor.c
+ * @brief Line editor for interactive SnailShell sessions
+ *
+ * When standard input is a terminal, command lines are read through this
+ * editor instead of getline(). The terminal is switched to raw mode only
+ * while a line is being edited, so commands run with the settings the user
+ * expects.
+ *
+ * Key Bindings:
+ * - Left/Right, Ctrl-B/Ctrl-F: Move by one character
+ * - Home/End, Ctrl-A/Ctrl-E: Move to the start or end of the line
+ * - Backspace, Delete: Delete before or under the cursor
+ * - Ctrl-U/Ctrl-K: Delete to the start or end of the line
+ * - Ctrl-W: Delete the word before the cursor
+ * - Ctrl-L: Clear the screen
+ * - Ctrl-C: Discard the line
+ * - Ctrl-D: End of input on an empty line, otherwise Delete
+ * - Tab: Complete the word before the cursor; a second Tab lists the
+ *   candidates when there are several (see Complete.c)
+ * - Up/Down, Ctrl-P/Ctrl-N: Step through the shared history (see History.c)
+ * - Ctrl-R: Search the history backwards as the query is typed; Ctrl-R
+ *   again finds an older match, Ctrl-G restores the line and any other key
+ *   accepts the match and is applied to it
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+/**
+ * @struct LineEditor
+ * @brief State of the line being edited
+ */
+typedef struct LineEditor {
+    Buffer line;
+    size_t cursor;
+    const char * prompt;
+    size_t promptLength;
+    int lastKey;
+    int browsing;
+    uint64_t historyEnd;
+    uint64_t historyIndex;
+    Buffer saved;
+} LineEditor;
+
+/**
+ * @brief Writes a buffer to the terminal in full
+ * @param data The bytes to write
+ * @param length Number of bytes
+ */
+static void writeTerminal(const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+/**
+ * @brief Redraws the prompt and the line, and places the cursor
+ * @param editor Pointer to the LineEditor
+ *
+ * The whole row is rebuilt in one buffer and written with a single call,
+ * which avoids flicker on slow terminals.
+ */
+static void refreshLine(LineEditor * editor) {
+    Buffer output;
+    memset(&output, 0, sizeof(Buffer));
+    bufferAppend(&output, "\r", 1);
+    bufferAppend(&output, editor->prompt, editor->promptLength);
+    bufferAppend(&output, editor->line.data, editor->line.length);
+    bufferAppend(&output, "\x1b[K\r", 4);
+
+    size_t column = editor->promptLength + editor->cursor;
+    if (column > 0) {
+        char move[32];
+        int length = snprintf(move, sizeof(move), "\x1b[%zuC", column);
+        bufferAppend(&output, move, length);
+    }
+
+    writeTerminal(output.data, output.length);
+    free(output.data);
+}
+
+/**
+ * @brief Inserts text at the cursor
+ * @param editor Pointer to the LineEditor
+ * @param text The text to insert
+ * @param length Length of the text
+ */
+static void insertText(LineEditor * editor, const char * text, size_t length) {
+    size_t tail = editor->line.length - editor->cursor;
+    bufferAppend(&editor->line, text, length);
+    memmove(editor->line.data + editor->cursor + length, editor->line.data + editor->cursor, tail);
+    memcpy(editor->line.data + editor->cursor, text, length);
+    editor->cursor += length;
+}
+
+/**
+ * @brief Deletes a range of the line
+ * @param editor Pointer to the LineEditor
+ * @param start Start of the range
+ * @param end End of the range (exclusive)
+ */
+static void deleteRange(LineEditor * editor, size_t start, size_t end) {
+    memmove(editor->line.data + start, editor->line.data + end, editor->line.length - end + 1);
+    editor->line.length -= end - start;
+    editor->cursor = start;
+}
+
+/**
+ * @brief Prints the candidates of a completion below the line
+ * @param completion Pointer to the Completion
+ *
+ * Candidates are laid out in columns fitting the terminal width; at most
+ * COMPLETION_MAX_LIST of them are shown.
+ */
+static void listCompletions(Completion * completion) {
+    struct winsize size;
+    size_t width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 ? size.ws_col : 80;
+
+    int shown = completion->count < COMPLETION_MAX_LIST ? completion->count : COMPLETION_MAX_LIST;
+    size_t longest = 1;
+    for (int i = 0; i < shown; i++) {
+        size_t length = strlen(completion->matches[i]);
+        if (length > longest) {
+            longest = length;
+        }
+    }
+
+    size_t columns = width / (longest + 2) > 0 ? width / (longest + 2) : 1;
+    size_t rows = (shown + columns - 1) / columns;
+
+    Buffer output;
+    memset(&output, 0, sizeof(Buffer));
+    bufferAppend(&output, "\r\n", 2);
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            size_t index = column * rows + row;
+            if (index >= (size_t) shown) {
+                break;
+            }
+            const char * match = completion->matches[index];
+            size_t length = strlen(match);
+            bufferAppend(&output, match, length);
+            for (size_t pad = length; pad < longest + 2 && column + 1 < columns; pad++) {
+                bufferAppend(&output, " ", 1);
+            }
+        }
+        bufferAppend(&output, "\r\n", 2);
+    }
+
+    if (shown < completion->count + completion->omitted) {
+        char more[64];
+        int length = snprintf(more, sizeof(more), COMPLETION_MORE, completion->count + completion->omitted - shown);
+        bufferAppend(&output, more, length);
+    }
+
+    writeTerminal(output.data, output.length);
+    free(output.data);
+}
+
+/**
+ * @brief Completes the word before the cursor
+ * @param editor Pointer to the LineEditor
+ *
+ * The word is extended by the prefix shared by all candidates; a single
+ * candidate that is not a directory is followed by a space. If nothing
+ * could be added and the previous key was also Tab, the candidates are
+ * listed.
+ */
+static void completeWord(LineEditor * editor) {
+    Completion completion;
+    findCompletions(editor->line.data, editor->cursor, &completion);
+    if (completion.count == 0) {
+        writeTerminal("\a", 1);
+        return;
+    }
+
+    size_t typed = editor->cursor - completion.wordStart;
+    if (completion.commonLength > typed) {
+        insertText(editor, completion.matches[0] + typed, completion.commonLength - typed);
+    }
+
+    const char * only = completion.matches[0];
+    int total = completion.count + completion.omitted;
+    if (total == 1 && only[strlen(only) - 1] != '/') {
+        insertText(editor, " ", 1);
+    } else if (total > 1 && completion.commonLength <= typed && editor->lastKey == '\t') {
+        listCompletions(&completion);
+    }
+
+    freeCompletion(&completion);
+    refreshLine(editor);
+}
+
+/**
+ * @brief Replaces the line with other text and moves the cursor to its end
+ * @param editor Pointer to the LineEditor
+ * @param text The new text
+ * @param length Length of the text
+ */
+static void replaceLine(LineEditor * editor, const char * text, size_t length) {
+    editor->line.length = 0;
+    bufferAppend(&editor->line, text, length);
+    editor->cursor = length;
+}
+
+/**
+ * @brief Replaces the line with an older or newer history entry
+ * @param editor Pointer to the LineEditor
+ * @param direction -1 for an older entry, 1 for a newer one
+ *
+ * The history is opened on the first step, and entries added by other
+ * sessions while the line is edited are not shown. Stepping past the
+ * newest entry brings back the line as it was typed.
+ */
+static void stepHistory(LineEditor * editor, int direction) {
+    if (!editor->browsing) {
+        editor->browsing = 1;
+        editor->historyEnd = historyLength();
+        editor->historyIndex = editor->historyEnd;
+    }
+
+    if (editor->historyIndex == editor->historyEnd) {
+        if (direction > 0) {
+            return;
+        }
+        editor->saved.length = 0;
+        bufferAppend(&editor->saved, editor->line.data, editor->line.length);
+    }
+
+    uint64_t index = editor->historyIndex + direction;
+    if (direction < 0 && editor->historyIndex == 0) {
+        return;
+    }
+    if (index == editor->historyEnd) {
+        editor->historyIndex = index;
+        replaceLine(editor, editor->saved.data, editor->saved.length);
+        return;
+    }
+
+    Buffer entry;
+    memset(&entry, 0, sizeof(Buffer));
+    if (readHistory(index, &entry) == 0) {
+        editor->historyIndex = index;
+        replaceLine(editor, entry.data, entry.length);
+    }
+    free(entry.data);
+}
+
+/**
+ * @brief Draws the search prompt and the current match
+ * @param query The query typed so far
+ * @param match The matching entry
+ * @param failed Non-zero if the query has no match
+ */
+static void refreshSearch(Buffer * query, Buffer * match, int failed) {
+    const char * format = failed ? SEARCH_FAILED_PROMPT : SEARCH_PROMPT;
+    Buffer prompt;
+    memset(&prompt, 0, sizeof(Buffer));
+    prompt.capacity = snprintf(NULL, 0, format, query->data) + 1;
+    prompt.data = malloc(prompt.capacity);
+    if (prompt.data == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    prompt.length = snprintf(prompt.data, prompt.capacity, format, query->data);
+
+    LineEditor view;
+    memset(&view, 0, sizeof(LineEditor));
+    view.line = *match;
+    view.prompt = prompt.data;
+    view.promptLength = prompt.length;
+    char * found = memmem(match->data, match->length, query->data, query->length);
+    view.cursor = found != NULL ? (size_t) (found - match->data) : match->length;
+
+    refreshLine(&view);
+    free(prompt.data);
+}
+
+static int handleKey(LineEditor * editor, char key);
+
+/**
+ * @brief Searches the history backwards as the user types (Ctrl-R)
+ * @param editor Pointer to the LineEditor
+ * @return Result of handleKey() for the key that ended the search
+ *
+ * Each key narrows the query and looks again from the current match, so
+ * the match stays put while it still contains the query. Ctrl-R looks for
+ * an older entry, skipping entries equal to the current match.
+ */
+static int reverseSearch(LineEditor * editor) {
+    Buffer query;
+    Buffer match;
+    Buffer entry;
+    memset(&query, 0, sizeof(Buffer));
+    memset(&match, 0, sizeof(Buffer));
+    memset(&entry, 0, sizeof(Buffer));
+    bufferAppend(&query, "", 0);
+    bufferAppend(&match, editor->line.data, editor->line.length);
+
+    uint64_t end = historyLength();
+    int64_t found = -1;
+    int failed = 0;
+    int result = 0;
+
+    while (1) {
+        refreshSearch(&query, &match, failed);
+
+        char key;
+        ssize_t bytes = read(STDIN_FILENO, &key, 1);
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes != 1) {
+            result = -1;
+            break;
+        }
+
+        uint64_t before;
+        if (key == CTRL_KEY('r')) {
+            before = found >= 0 ? (uint64_t) found : end;
+        } else if (key == 127 || key == CTRL_KEY('h')) {
+            if (query.length > 0) {
+                query.data[--query.length] = '\0';
+            }
+            before = end;
+        } else if ((unsigned char) key >= ' ') {
+            bufferAppend(&query, &key, 1);
+            before = found >= 0 ? (uint64_t) found + 1 : end;
+        } else {
+            if (key == CTRL_KEY('g')) {
+                refreshLine(editor);
+            } else {
+                if (found >= 0) {
+                    replaceLine(editor, match.data, match.length);
+                    editor->browsing = 1;
+                    editor->historyEnd = end;
+                    editor->historyIndex = found;
+                }
+                result = handleKey(editor, key);
+            }
+            break;
+        }
+
+        if (query.length == 0) {
+            failed = 0;
+            continue;
+        }
+
+        int64_t next = before;
+        do {
+            next = searchHistory(query.data, next, &entry);
+        } while (next >= 0 && key == CTRL_KEY('r') && found >= 0 &&
+                 entry.length == match.length && memcmp(entry.data, match.data, match.length) == 0);
+
+        failed = next < 0;
+        if (!failed) {
+            found = next;
+            match.length = 0;
+            bufferAppend(&match, entry.data, entry.length);
+        }
+    }
+
+    free(query.data);
+    free(match.data);
+    free(entry.data);
+    return result;
+}
+
+/**
+ * @brief Reads the rest of an escape sequence and applies it
+ * @param editor Pointer to the LineEditor
+ *
+ * Recognizes the arrow, Home, End and Delete keys in both their CSI and
+ * SS3 forms; other sequences are ignored.
+ */
+static void handleEscape(LineEditor * editor) {
+    char sequence[3];
+    if (read(STDIN_FILENO, sequence, 1) != 1 || read(STDIN_FILENO, sequence + 1, 1) != 1) {
+        return;
+    }
+    if (sequence[0] != '[' && sequence[0] != 'O') {
+        return;
+    }
+
+    char key = sequence[1];
+    if (sequence[0] == '[' && isdigit((unsigned char) key)) {
+        if (read(STDIN_FILENO, sequence + 2, 1) != 1 || sequence[2] != '~') {
+            return;
+        }
+        if (key == '3') {
+            if (editor->cursor < editor->line.length) {
+                deleteRange(editor, editor->cursor, editor->cursor + 1);
+            }
+            refreshLine(editor);
+            return;
+        }
+        key = key == '1' || key == '7' ? 'H' : key == '4' || key == '8' ? 'F' : 0;
+    }
+
+    switch (key) {
+        case 'A':
+            stepHistory(editor, -1);
+            break;
+        case 'B':
+            stepHistory(editor, 1);
+            break;
+        case 'C':
+            if (editor->cursor < editor->line.length) {
+                editor->cursor++;
+            }
+            break;
+        case 'D':
+            if (editor->cursor > 0) {
+                editor->cursor--;
+            }
+            break;
+        case 'H':
+            editor->cursor = 0;
+            break;
+        case 'F':
+            editor->cursor = editor->line.length;
+            break;
+        default:
+            return;
+    }
+    refreshLine(editor);
+}
+
+/**
+ * @brief Applies a key to the line being edited
+ * @param editor Pointer to the LineEditor
+ * @param key The key
+ * @return 1 when the line is complete, -1 at end of input, 0 otherwise
+ */
+static int handleKey(LineEditor * editor, char key) {
+    switch (key) {
+        case '\r':
+        case '\n':
+            return 1;
+        case CTRL_KEY('d'):
+            if (editor->line.length == 0) {
+                return -1;
+            }
+            if (editor->cursor < editor->line.length) {
+                deleteRange(editor, editor->cursor, editor->cursor + 1);
+            }
+            break;
+        case CTRL_KEY('c'):
+            writeTerminal("^C\r\n", 4);
+            editor->line.length = 0;
+            editor->line.data[0] = '\0';
+            editor->cursor = 0;
+            break;
+        case '\t':
+            completeWord(editor);
+            return 0;
+        case 127:
+        case CTRL_KEY('h'):
+            if (editor->cursor > 0) {
+                deleteRange(editor, editor->cursor - 1, editor->cursor);
+            }
+            break;
+        case CTRL_KEY('a'):
+            editor->cursor = 0;
+            break;
+        case CTRL_KEY('e'):
+            editor->cursor = editor->line.length;
+            break;
+        case CTRL_KEY('b'):
+            if (editor->cursor > 0) {
+                editor->cursor--;
+            }
+            break;
+        case CTRL_KEY('f'):
+            if (editor->cursor < editor->line.length) {
+                editor->cursor++;
+            }
+            break;
+        case CTRL_KEY('u'):
+            deleteRange(editor, 0, editor->cursor);
+            break;
+        case CTRL_KEY('k'):
+            deleteRange(editor, editor->cursor, editor->line.length);
+            break;
+        case CTRL_KEY('w'): {
+            size_t start = editor->cursor;
+            while (start > 0 && editor->line.data[start - 1] == ' ') {
+                start--;
+            }
+            while (start > 0 && editor->line.data[start - 1] != ' ') {
+                start--;
+            }
+            deleteRange(editor, start, editor->cursor);
+            break;
+        }
+        case CTRL_KEY('l'):
+            writeTerminal("\x1b[H\x1b[2J", 7);
+            break;
+        case CTRL_KEY('p'):
+            stepHistory(editor, -1);
+            break;
+        case CTRL_KEY('n'):
+            stepHistory(editor, 1);
+            break;
+        case CTRL_KEY('r'):
+            return reverseSearch(editor);
+        case '\x1b':
+            handleEscape(editor);
+            return 0;
+        default:
+            if ((unsigned char) key < ' ') {
+                return 0;
+            }
+            insertText(editor, &key, 1);
+            break;
+    }
+    refreshLine(editor);
+    return 0;
+}
+
+/**
+ * @brief Waits for a key, redrawing the prompt when a background segment
+ *        finishes
+ * @param editor Pointer to the LineEditor
+ * @param prompt Pointer to the Buffer holding the regular prompt, or NULL
+ *        for the continuation prompt
+ * @param key Pointer to store the key
+ * @return 1 if a key was read, 0 if interrupted, -1 at end of input
+ */
+static int readKey(LineEditor * editor, Buffer * prompt, char * key) {
+    int notify = prompt != NULL ? promptNotifyFd() : -1;
+    if (notify != -1) {
+        struct pollfd pollers[2] = {{STDIN_FILENO, POLLIN, 0}, {notify, POLLIN, 0}};
+        if (poll(pollers, 2, -1) == -1) {
+            return errno == EINTR ? 0 : -1;
+        }
+
+        if (pollers[1].revents & POLLIN) {
+            char drain[64];
+            while (read(notify, drain, sizeof(drain)) > 0) {
+            }
+            formatPrompt(prompt, 0);
+            editor->prompt = prompt->data;
+            editor->promptLength = prompt->length;
+            refreshLine(editor);
+        }
+        if (!(pollers[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            return 0;
+        }
+    }
+
+    ssize_t bytes = read(STDIN_FILENO, key, 1);
+    if (bytes == -1 && errno == EINTR) {
+        return 0;
+    }
+    return bytes == 1 ? 1 : -1;
+}
+
+/**
+ * @brief Reads a line from the terminal with editing and completion
+ * @param continuation Non-zero to show CONTINUATION_PROMPT instead of the
+ *        regular prompt
+ * @param line Pointer to the line buffer, reallocated as needed (as in
+ *        getline())
+ * @param capacity Pointer to the capacity of the line buffer
+ * @return Length of the line, or -1 at end of input
+ *
+ * The line is returned without its newline. The regular prompt is redrawn
+ * in place whenever one of its background segments finishes (see
+ * Prompt.c).
+ */
+ssize_t editLine(int continuation, char ** line, size_t * capacity) {
+    struct termios original;
+    if (tcgetattr(STDIN_FILENO, &original) == -1) {
+        perror("tcgetattr");
+        return -1;
+    }
+
+    struct termios raw = original;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1) {
+        perror("tcsetattr");
+        return -1;
+    }
+
+    Buffer prompt;
+    memset(&prompt, 0, sizeof(Buffer));
+    if (continuation) {
+        bufferAppend(&prompt, CONTINUATION_PROMPT, strlen(CONTINUATION_PROMPT));
+    } else {
+        formatPrompt(&prompt, PROMPT_WAIT_MS);
+    }
+
+    LineEditor editor;
+    memset(&editor, 0, sizeof(LineEditor));
+    editor.prompt = prompt.data;
+    editor.promptLength = prompt.length;
+    bufferAppend(&editor.line, "", 0);
+
+    fflush(stdout);
+    refreshLine(&editor);
+
+    int result = 0;
+    while (result == 0) {
+        char key;
+        int status = readKey(&editor, continuation ? NULL : &prompt, &key);
+        if (status == 0) {
+            continue;
+        }
+        if (status == -1) {
+            result = -1;
+            break;
+        }
+
+        result = handleKey(&editor, key);
+        editor.lastKey = key;
+    }
+
+    writeTerminal("\r\n", 2);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &original);
+
+    free(prompt.data);
+    free(editor.saved.data);
+    if (result == -1) {
+        free(editor.line.data);
+        return -1;
+    }
+
+    free(*line);
+    *line = editor.line.data;
+    *capacity = editor.line.capacity;
+    return (ssize_t) editor.line.length;
+}
@@ -0,0 +1,217 @@
+/**
+ * @file Exec.c
+ * @brief The exec built-in for persistent descriptor redirections
+ *
+ * "exec 3>>log" opens a file once on a shell descriptor that stays open
+ * across the commands that follow, which name it with ">&3" instead of
+ * opening the file again. exec only manages descriptors here; it does
+ * not replace the shell with a command.
+ *
+ * Supported Redirections (N defaults to 0 for '<' and 1 for '>'):
+ * - N>file, N>>file, N<file: open a file on descriptor N
+ * - N>&M, N<&M: make N a copy of descriptor M
+ * - N>&M-, N<&M-: move descriptor M to N
+ * - N>&-, N<&-: close descriptor N
+ * - >file, >>file, <file, >&M, <&M as separate words, as for any command
+ *
+ * The target of a file redirection may also be the next word ("3> log").
+ * N and M range from 0 to SHELL_FD_BASE - 1; the shell keeps its own
+ * descriptors above that range (see moveShellFd()).
+ *
+ * Descriptors above 2 are opened close-on-exec, so commands do not
+ * inherit them unless they name them with >&N or <&N. With -i they are
+ * left inheritable instead, for commands that expect to find them open.
+ */
+
+#include "SnailShell.h"
+
+#include <fcntl.h>
+
+/**
+ * @brief Parses a descriptor number of an exec or command redirection
+ * @param text The text to parse
+ * @param length Number of characters to parse
+ * @return The descriptor, or -1 if the text is not a number below
+ *         SHELL_FD_BASE
+ */
+int parseDescriptor(const char * text, size_t length) {
+    if (length == 0) {
+        return -1;
+    }
+
+    int fd = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char) text[i])) {
+            return -1;
+        }
+        fd = fd * 10 + (text[i] - '0');
+        if (fd >= SHELL_FD_BASE) {
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * @brief Gives up the shell's use of a descriptor about to be replaced
+ * @param fd The descriptor
+ *
+ * Writes out pending output and gives back any read-ahead buffered for
+ * the descriptor.
+ */
+static void releaseDescriptor(int fd) {
+    flushBuiltinOutput();
+    releaseReader(fd);
+}
+
+/**
+ * @brief Makes a descriptor a copy of another
+ * @param source The descriptor to copy
+ * @param fd The descriptor to replace
+ * @param inherit Non-zero to leave fd inheritable by commands
+ * @return 0 on success, -1 on failure
+ */
+static int copyDescriptor(int source, int fd, int inherit) {
+    int flags = inherit || fd <= STDERR_FILENO ? 0 : O_CLOEXEC;
+    if (fcntl(source, F_GETFD) == -1) {
+        perror("exec");
+        return -1;
+    }
+
+    releaseDescriptor(fd);
+    if (source == fd) {
+        return fcntl(fd, F_SETFD, flags ? FD_CLOEXEC : 0);
+    }
+    if (dup3(source, fd, flags) == -1) {
+        perror("dup3");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens a file on a descriptor
+ * @param path Path of the file
+ * @param openFlags Flags passed to open()
+ * @param fd The descriptor to replace
+ * @param inherit Non-zero to leave fd inheritable by commands
+ * @return 0 on success, -1 on failure
+ */
+static int openDescriptor(const char * path, int openFlags, int fd, int inherit) {
+    int opened = open(path, openFlags | O_CLOEXEC, 0666);
+    if (opened == -1) {
+        perror("open");
+        return -1;
+    }
+
+    int ret = copyDescriptor(opened, fd, inherit);
+    if (opened != fd) {
+        close(opened);
+    }
+    return ret;
+}
+
+/**
+ * @brief Applies one redirection word of exec
+ * @param word The word, such as "3>>log" or "4<&3-"
+ * @param next The following word (target of "3> log"), or NULL
+ * @param inherit Non-zero to leave descriptors inheritable by commands
+ * @param consumed Pointer set to 1 if next was used as the target
+ * @return 0 on success, -1 on failure
+ */
+static int applyExecWord(const char * word, const char * next, int inherit, int * consumed) {
+    const char * op = word + strspn(word, "0123456789");
+    if (*op != '<' && *op != '>') {
+        printError(ERROR_EXEC_USAGE);
+        return -1;
+    }
+
+    int fd = op == word ? (*op == '<' ? STDIN_FILENO : STDOUT_FILENO) : parseDescriptor(word, op - word);
+    if (fd == -1) {
+        printError(ERROR_EXEC_DESCRIPTOR, word);
+        return -1;
+    }
+
+    if (op[1] == '&') {
+        const char * source = op + 2;
+        if (strcmp(source, "-") == 0) {
+            releaseDescriptor(fd);
+            close(fd);
+            return 0;
+        }
+
+        size_t length = strcspn(source, "-");
+        int move = strcmp(source + length, "-") == 0;
+        int from = move || source[length] == '\0' ? parseDescriptor(source, length) : -1;
+        if (from == -1) {
+            printError(ERROR_EXEC_DESCRIPTOR, word);
+            return -1;
+        }
+        if (copyDescriptor(from, fd, inherit) == -1) {
+            return -1;
+        }
+        if (move && from != fd) {
+            releaseDescriptor(from);
+            close(from);
+        }
+        return 0;
+    }
+
+    int openFlags = O_RDONLY;
+    const char * path = op + 1;
+    if (*op == '>') {
+        openFlags = O_WRONLY | O_CREAT | (op[1] == '>' ? O_APPEND : O_TRUNC);
+        path += op[1] == '>';
+    }
+    if (*path == '\0') {
+        if (next == NULL) {
+            printError(ERROR_EXEC_USAGE);
+            return -1;
+        }
+        path = next;
+        *consumed = 1;
+    }
+    return openDescriptor(path, openFlags, fd, inherit);
+}
+
+/**
+ * @brief Handles the built-in exec command
+ * @param curr Pointer to the Command structure containing exec arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: exec [-i] redirection ...
+ *
+ * Redirections are applied in order and stay in effect for the rest of
+ * the session. Processing stops at the first one that fails.
+ */
+int handleExec(Command * curr) {
+    int inherit = 0;
+    int i = 1;
+    if (i < curr->argCount && strcmp(curr->args[i], "-i") == 0) {
+        inherit = 1;
+        i++;
+    }
+
+    if (curr->inputFd != -1 && copyDescriptor(curr->inputFd, STDIN_FILENO, inherit) == -1) {
+        return -1;
+    }
+    if (curr->input != NULL && openDescriptor(curr->input, O_RDONLY, STDIN_FILENO, inherit) == -1) {
+        return -1;
+    }
+    if (curr->outputFd != -1 && copyDescriptor(curr->outputFd, STDOUT_FILENO, inherit) == -1) {
+        return -1;
+    }
+    if (curr->output != NULL &&
+        openDescriptor(curr->output, O_WRONLY | O_CREAT | (curr->append ? O_APPEND : O_TRUNC), STDOUT_FILENO, inherit) == -1) {
+        return -1;
+    }
+
+    for (; i < curr->argCount; i++) {
+        int consumed = 0;
+        if (applyExecWord(curr->args[i], i + 1 < curr->argCount ? curr->args[i + 1] : NULL, inherit, &consumed) == -1) {
+            return -1;
+        }
+        i += consumed;
+    }
+    return 0;
+}
@@ -0,0 +1,341 @@
+/**
+ * @file Fuse.c
+ * @brief Built-in pipeline stages run as threads over in-memory rings
+ *
+ * A built-in that is a stage of a pipeline normally runs in a forked child
+ * and talks to its neighbours through kernel pipes. With
+ * "shopt -s fusepipes", echo, printf, read and mapfile stages run as
+ * threads of the shell instead. Consecutive fused stages are connected by
+ * a Ring, so data passes between them without system calls; a kernel pipe
+ * is only created where a fused stage meets an external command.
+ *
+ * Fused Stages Behave Like Forked Ones:
+ * - read and mapfile consume their input but assign nothing, as the
+ *   assignments of a forked stage are lost when it exits
+ * - Input is read through a private reader, so the shell's own read-ahead
+ *   is not disturbed (see Reader.c)
+ * - A stage whose reader is gone stops writing; SIGPIPE is blocked in the
+ *   threads, so a closed pipe ends the stage instead of the shell
+ * - Stages with redirections or stage prefixes (pin, nice, ionice, limit)
+ *   still fork, since those change process-wide state
+ *
+ * Rings:
+ * The producer only advances head and the consumer only advances tail, so
+ * neither takes a lock while there is data or space. A side that has to
+ * wait counts itself in waiting and sleeps on a condition variable; the
+ * other side checks waiting after every transfer and only locks to wake
+ * it when it is not zero.
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+static __thread StageIO * activeStage;
+
+/**
+ * @brief Returns the input and output of the fused stage running on this thread
+ * @return Pointer to the StageIO, or NULL outside fused stages
+ */
+StageIO * currentStage() {
+    return activeStage;
+}
+
+/**
+ * @brief Allocates an empty ring
+ * @return Pointer to the new Ring
+ */
+static Ring * createRing() {
+    Ring * ring = calloc(1, sizeof(Ring));
+    if (ring == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    ring->data = malloc(RING_CAPACITY);
+    if (ring->data == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->wake, NULL);
+    return ring;
+}
+
+/**
+ * @brief Frees a ring once both of its stages have finished
+ * @param ring Pointer to the Ring, or NULL
+ */
+static void freeRing(Ring * ring) {
+    if (ring == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->wake);
+    free(ring->data);
+    free(ring);
+}
+
+/**
+ * @brief Wakes the other side of a ring if it sleeps
+ * @param ring Pointer to the Ring
+ *
+ * Called after head, tail or a flag changed. Together with the sequentially
+ * consistent accesses in waitRing(), either the sleeper sees the change
+ * before sleeping or this sees waiting set.
+ */
+static void wakeRing(Ring * ring) {
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->wake);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/**
+ * @brief Sleeps until the other side of a ring changes a position or flag
+ * @param ring Pointer to the Ring
+ * @param position Pointer to the position the other side advances
+ * @param seen Value of that position that made this side wait
+ * @param flag Pointer to the flag the other side sets when it is done
+ */
+static void waitRing(Ring * ring, size_t * position, size_t seen, int * flag) {
+    pthread_mutex_lock(&ring->lock);
+    __atomic_add_fetch(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(position, __ATOMIC_SEQ_CST) == seen && !__atomic_load_n(flag, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&ring->wake, &ring->lock);
+    }
+    __atomic_sub_fetch(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * @brief Writes data into a ring, waiting for space as needed
+ * @param ring Pointer to the Ring
+ * @param data The data
+ * @param length Length of the data
+ * @return 0 on success, -1 if the consumer has finished
+ */
+int ringWrite(Ring * ring, const char * data, size_t length) {
+    size_t head = ring->head;
+    while (length > 0) {
+        size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        size_t space = RING_CAPACITY - (head - tail);
+        if (__atomic_load_n(&ring->abandoned, __ATOMIC_ACQUIRE)) {
+            return -1;
+        }
+        if (space == 0) {
+            waitRing(ring, &ring->tail, tail, &ring->abandoned);
+            continue;
+        }
+
+        size_t count = length < space ? length : space;
+        size_t offset = head % RING_CAPACITY;
+        size_t first = count < RING_CAPACITY - offset ? count : RING_CAPACITY - offset;
+        memcpy(ring->data + offset, data, first);
+        memcpy(ring->data, data + first, count - first);
+
+        head += count;
+        data += count;
+        length -= count;
+        __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+        wakeRing(ring);
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads data from a ring, waiting until some is available
+ * @param ring Pointer to the Ring
+ * @param data Buffer receiving the data
+ * @param length Size of the buffer
+ * @return Number of bytes read, or 0 once the producer has finished and
+ *         everything was read
+ */
+ssize_t ringRead(Ring * ring, char * data, size_t length) {
+    size_t tail = ring->tail;
+    size_t head;
+    while ((head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) == tail) {
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+                return 0;
+            }
+            continue;
+        }
+        waitRing(ring, &ring->head, tail, &ring->closed);
+    }
+
+    size_t count = head - tail < length ? head - tail : length;
+    size_t offset = tail % RING_CAPACITY;
+    size_t first = count < RING_CAPACITY - offset ? count : RING_CAPACITY - offset;
+    memcpy(data, ring->data + offset, first);
+    memcpy(data + first, ring->data, count - first);
+
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_SEQ_CST);
+    wakeRing(ring);
+    return count;
+}
+
+/**
+ * @brief Marks one side of a ring as finished and wakes the other
+ * @param ring Pointer to the Ring
+ * @param flag Pointer to closed (producer) or abandoned (consumer)
+ */
+static void finishRing(Ring * ring, int * flag) {
+    __atomic_store_n(flag, 1, __ATOMIC_SEQ_CST);
+    wakeRing(ring);
+}
+
+/**
+ * @brief Checks whether a pipeline stage can run as a fused stage
+ * @param curr Pointer to the Command structure of the stage
+ * @param handler Handler of the built-in, or NULL for an external command
+ * @return Non-zero if fusepipes is enabled and the stage is echo, printf,
+ *         read or mapfile without redirections or stage prefixes
+ */
+int isFusable(Command * curr, BuiltinHandler handler) {
+    if (!isOptionEnabled(OPTION_FUSEPIPES) ||
+        (handler != handleEcho && handler != handlePrintf && handler != handleRead && handler != handleMapfile)) {
+        return 0;
+    }
+
+    return curr->input == NULL && curr->output == NULL && curr->inputFd == -1 && curr->outputFd == -1 &&
+        curr->pinMode == PIN_NONE && !curr->niceSet && curr->ioClass == IOPRIO_CLASS_NONE && curr->limitMask == 0;
+}
+
+/**
+ * @brief Adds a fused stage to a pipeline and connects its input and output
+ * @param stages Pointer to the list of fused stages of the pipeline
+ * @param curr Pointer to the Command structure of the stage
+ * @param handler Handler of the built-in
+ * @param prevRing Pointer to the ring written by the previous stage (NULL
+ *        if none), replaced by the ring this stage writes
+ * @param prevPipe Pointer to the read end of the pipe from the previous
+ *        stage (-1 if none), replaced by the read end this stage writes
+ *
+ * The output is a ring if the next stage is fused too, a pipe if it is
+ * external and the shell's standard output for the last stage. The stage
+ * takes over the previous pipe's read end and its own write end, which are
+ * made close-on-exec so that commands started later do not keep them open.
+ */
+void addFusedStage(FusedStage ** stages, Command * curr, BuiltinHandler handler, Ring ** prevRing, int * prevPipe) {
+    FusedStage * stage = calloc(1, sizeof(FusedStage));
+    if (stage == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    stage->command = curr;
+    stage->handler = handler;
+    stage->io.input = *prevRing;
+    stage->io.inputFd = *prevRing != NULL ? -1 : *prevPipe != -1 ? *prevPipe : STDIN_FILENO;
+    stage->ownsInput = *prevRing == NULL && *prevPipe != -1;
+    if (stage->ownsInput && fcntl(*prevPipe, F_SETFD, FD_CLOEXEC) == -1) {
+        perror("fcntl");
+    }
+
+    *prevRing = NULL;
+    *prevPipe = -1;
+    stage->io.outputFd = STDOUT_FILENO;
+    if (curr->next != NULL && isFusable(curr->next, findBuiltin(*curr->next->args))) {
+        stage->io.output = *prevRing = createRing();
+        stage->io.outputFd = -1;
+    } else if (curr->next != NULL) {
+        int fd[2];
+        if (pipe2(fd, O_CLOEXEC) == -1) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        stage->io.outputFd = fd[1];
+        stage->ownsOutput = 1;
+        *prevPipe = fd[0];
+    }
+
+    while (*stages != NULL) {
+        stages = &(*stages)->next;
+    }
+    *stages = stage;
+}
+
+/**
+ * @brief Thread body of a fused stage
+ * @param argument Pointer to the FusedStage
+ * @return NULL
+ *
+ * Runs the built-in, writes out its remaining output and tells both
+ * neighbours that the stage is done.
+ */
+static void * runFusedStage(void * argument) {
+    FusedStage * stage = argument;
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+
+    activeStage = &stage->io;
+    stage->status = stage->handler(stage->command) == 0 ? 0 : 1;
+    flushStageOutput(&stage->io);
+    releaseStageReader(&stage->io);
+    activeStage = NULL;
+
+    if (stage->io.input != NULL) {
+        finishRing(stage->io.input, &stage->io.input->abandoned);
+    }
+    if (stage->io.output != NULL) {
+        finishRing(stage->io.output, &stage->io.output->closed);
+    }
+    if (stage->ownsInput) {
+        close(stage->io.inputFd);
+    }
+    if (stage->ownsOutput) {
+        close(stage->io.outputFd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts a thread for every fused stage of a pipeline
+ * @param stages The list of fused stages
+ *
+ * Called once every external stage has been started, so the threads never
+ * run while the shell forks or touches its own readers.
+ */
+void startFusedStages(FusedStage * stages) {
+    if (stages == NULL) {
+        return;
+    }
+
+    flushBuiltinOutput();
+    syncReaders();
+    for (FusedStage * stage = stages; stage != NULL; stage = stage->next) {
+        int error = pthread_create(&stage->thread, NULL, runFusedStage, stage);
+        if (error != 0) {
+            errno = error;
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * @brief Waits for the fused stages of a pipeline and frees them
+ * @param stages The list of fused stages
+ * @param last Pointer to the Command structure of the last stage
+ * @param lastStatus Pointer set to the exit status of the last stage if it
+ *        is fused
+ */
+void joinFusedStages(FusedStage * stages, Command * last, int * lastStatus) {
+    while (stages != NULL) {
+        FusedStage * next = stages->next;
+        pthread_join(stages->thread, NULL);
+        if (stages->command == last) {
+            *lastStatus = stages->status;
+        }
+
+        freeRing(stages->io.input);
+        free(stages);
+        stages = next;
+    }
+}
@@ -0,0 +1,516 @@
+/**
+ * @file Glob.c
+ * @brief Pathname expansion for SnailShell
+ *
+ * Words containing unescaped '*', '?' or '[' are replaced by the sorted
+ * list of matching paths. Each pattern component is compiled once (see
+ * Pattern.c) and matched against directory listings read with
+ * getdents64(). Listings are cached by directory path until the current
+ * command line has been expanded, so "*.c *.h" reads the directory once.
+ *
+ * Matching Rules:
+ * - Wildcards never match '/'; each path component is matched separately
+ * - Names starting with '.' only match components starting with '.'
+ * - "." and ".." are never produced
+ * - A "**" component matches any number of directories, including none;
+ *   as the last component it matches every file and directory below
+ * - A word that matches nothing is left unchanged
+ *
+ * The d_type reported by getdents64() decides whether an entry is a
+ * directory, so intermediate components only fall back to stat() for file
+ * systems that report DT_UNKNOWN and for symbolic links.
+ *
+ * With the streamglob option, for loops iterate the matches of a pattern
+ * whose wildcards are all in its last component directly from getdents64()
+ * batches through a GlobStream, unsorted and without building a list, so
+ * huge directories are walked in constant memory and the loop body starts
+ * immediately.
+ */
+
+#include "SnailShell.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/**
+ * @struct DirListing
+ * @brief Cached names and types of the entries of one directory
+ *
+ * Names are stored back to back, each NUL-terminated, in names; offsets
+ * and types are indexed by entry.
+ */
+typedef struct DirListing {
+    char * names;
+    size_t * offsets;
+    unsigned char * types;
+    size_t count;
+} DirListing;
+
+/**
+ * @struct PathList
+ * @brief Growable list of paths produced while expanding a pattern
+ */
+typedef struct PathList {
+    char ** paths;
+    int count;
+    int capacity;
+} PathList;
+
+static Table dirCache;
+
+/**
+ * @brief Reads the entries of a directory with getdents64()
+ * @param path The directory path
+ * @return Pointer to the new DirListing (empty if the directory cannot be read)
+ *
+ * Memory Management:
+ * - Allocates the listing and its arrays
+ * - Handles memory allocation failures by calling exit()
+ */
+static DirListing * readListing(const char * path) {
+    DirListing * listing = calloc(1, sizeof(DirListing));
+    if (listing == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return listing;
+    }
+
+    Buffer names;
+    memset(&names, 0, sizeof(Buffer));
+    size_t capacity = 0;
+    char buffer[GLOB_DIRENT_BUFFER];
+    long bytes;
+
+    while ((bytes = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0) {
+        for (long position = 0; position < bytes;) {
+            LinuxDirent64 * entry = (LinuxDirent64 *) (buffer + position);
+            position += entry->d_reclen;
+
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            if (listing->count == capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                listing->offsets = realloc(listing->offsets, sizeof(size_t) * capacity);
+                listing->types = realloc(listing->types, capacity);
+                if (listing->offsets == NULL || listing->types == NULL) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            listing->offsets[listing->count] = names.length;
+            listing->types[listing->count] = entry->d_type;
+            listing->count++;
+            bufferAppend(&names, entry->d_name, strlen(entry->d_name) + 1);
+        }
+    }
+
+    if (bytes == -1) {
+        perror("getdents64");
+    }
+    close(fd);
+
+    listing->names = names.data;
+    return listing;
+}
+
+/**
+ * @brief Returns the listing of a directory, reading it on first use
+ * @param path The directory path
+ * @return Pointer to the cached DirListing
+ */
+static DirListing * findListing(const char * path) {
+    TableEntry * entry = tableInsert(&dirCache, path, strlen(path));
+    if (entry->value == NULL) {
+        entry->value = readListing(path);
+    }
+    return entry->value;
+}
+
+/**
+ * @brief Discards the cached directory listings
+ *
+ * Called once a command line has been expanded, so the next line sees
+ * files created in the meantime.
+ */
+void clearGlobCache() {
+    size_t cursor = 0;
+    TableEntry * entry;
+    while ((entry = tableNext(&dirCache, &cursor)) != NULL) {
+        DirListing * listing = entry->value;
+        free(listing->names);
+        free(listing->offsets);
+        free(listing->types);
+        free(listing);
+    }
+    tableFree(&dirCache);
+}
+
+/**
+ * @brief Appends a path to a list
+ * @param list Pointer to the PathList
+ * @param path The path (ownership is taken)
+ */
+static void addPath(PathList * list, char * path) {
+    appendWord(&list->paths, &list->count, &list->capacity, path);
+}
+
+/**
+ * @brief Frees the paths of a list
+ * @param list Pointer to the PathList
+ */
+static void freePaths(PathList * list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    memset(list, 0, sizeof(PathList));
+}
+
+/**
+ * @brief Joins a directory prefix and a name
+ * @param prefix The prefix ("" for the current directory)
+ * @param name The name
+ * @param length Length of the name
+ * @return Newly allocated path
+ */
+static char * joinPath(const char * prefix, const char * name, size_t length) {
+    size_t prefixLength = strlen(prefix);
+    int slash = prefixLength > 0 && prefix[prefixLength - 1] != '/';
+    char * path = malloc(prefixLength + slash + length + 1);
+    if (path == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(path, prefix, prefixLength);
+    if (slash) {
+        path[prefixLength] = '/';
+    }
+    memcpy(path + prefixLength + slash, name, length);
+    path[prefixLength + slash + length] = '\0';
+    return path;
+}
+
+/**
+ * @brief Checks whether a directory entry is a directory
+ * @param type The d_type of the entry
+ * @param path Path of the entry, used when d_type is not conclusive
+ * @return Non-zero if the entry is (or links to) a directory
+ */
+static int isDirectory(unsigned char type, const char * path) {
+    if (type == DT_DIR) {
+        return 1;
+    }
+    if (type != DT_UNKNOWN && type != DT_LNK) {
+        return 0;
+    }
+
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/**
+ * @brief Adds everything below a directory for a "**" component
+ * @param prefix The directory to descend from
+ * @param includeFiles Whether files are added as well as directories
+ * @param output Pointer to the PathList receiving the paths
+ *
+ * Hidden entries are skipped and symbolic links are not descended into.
+ */
+static void addTree(const char * prefix, int includeFiles, PathList * output) {
+    DirListing * listing = findListing(*prefix != '\0' ? prefix : ".");
+    for (size_t i = 0; i < listing->count; i++) {
+        const char * name = listing->names + listing->offsets[i];
+        if (name[0] == '.') {
+            continue;
+        }
+
+        char * path = joinPath(prefix, name, strlen(name));
+        if (listing->types[i] != DT_LNK && isDirectory(listing->types[i], path)) {
+            addPath(output, path);
+            addTree(path, includeFiles, output);
+        } else if (includeFiles) {
+            addPath(output, path);
+        } else {
+            free(path);
+        }
+    }
+}
+
+/**
+ * @brief Expands one pattern component against every prefix of a list
+ * @param input Pointer to the PathList of prefixes
+ * @param component The component text
+ * @param length Length of the component
+ * @param needDirectory Whether only directories may match
+ * @param output Pointer to the PathList receiving the matches
+ */
+static void expandComponent(PathList * input, const char * component, size_t length, int needDirectory, PathList * output) {
+    char * text = strndup(component, length);
+    if (text == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(text, "**") == 0) {
+        for (int i = 0; i < input->count; i++) {
+            if (needDirectory || *input->paths[i] != '\0') {
+                char * self = strdup(input->paths[i]);
+                if (self == NULL) {
+                    perror("strdup");
+                    exit(EXIT_FAILURE);
+                }
+                addPath(output, self);
+            }
+            addTree(input->paths[i], !needDirectory, output);
+        }
+        free(text);
+        return;
+    }
+
+    if (!hasWildcards(text)) {
+        Pattern * literal = compilePattern(text);
+        for (int i = 0; i < input->count; i++) {
+            addPath(output, joinPath(input->paths[i], literal->literal, literal->minLength));
+        }
+        freePattern(literal);
+        free(text);
+        return;
+    }
+
+    Pattern * pattern = cachedPattern(text);
+    int matchHidden = text[0] == '.' || (text[0] == '\\' && text[1] == '.');
+
+    for (int i = 0; i < input->count; i++) {
+        const char * prefix = input->paths[i];
+        DirListing * listing = findListing(*prefix != '\0' ? prefix : ".");
+
+        for (size_t k = 0; k < listing->count; k++) {
+            const char * name = listing->names + listing->offsets[k];
+            size_t nameLength = strlen(name);
+            if ((name[0] == '.' && !matchHidden) || !matchPattern(pattern, name, nameLength)) {
+                continue;
+            }
+
+            char * path = joinPath(prefix, name, nameLength);
+            if (needDirectory && !isDirectory(listing->types[k], path)) {
+                free(path);
+                continue;
+            }
+            addPath(output, path);
+        }
+    }
+    free(text);
+}
+
+/**
+ * @brief Compares two paths for qsort()
+ * @param a Pointer to the first path
+ * @param b Pointer to the second path
+ * @return Negative, zero or positive as for strcmp()
+ */
+static int comparePaths(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * @brief Expands a pathname pattern into the sorted list of matching paths
+ * @param pattern The pattern (a word containing wildcards)
+ * @param words Pointer to the growable word array receiving the paths
+ * @param count Pointer to the number of words, advanced
+ * @param capacity Pointer to the capacity of the word array
+ * @return Number of paths appended (0 if nothing matched)
+ *
+ * Components without wildcards are joined without reading the directory;
+ * a trailing literal component is checked with lstat() at the end. A
+ * trailing '/' restricts matches to directories and is kept in the result.
+ */
+int expandGlob(const char * pattern, char *** words, int * count, int * capacity) {
+    PathList current;
+    memset(&current, 0, sizeof(PathList));
+
+    const char * p = pattern;
+    char * root = strdup(*p == '/' ? "/" : "");
+    if (root == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    addPath(&current, root);
+    p += strspn(p, "/");
+
+    int lastLiteral = 0;
+    int trailingSlash = 0;
+    while (*p != '\0' && current.count > 0) {
+        size_t length = strcspn(p, "/");
+        const char * next = p + length + strspn(p + length, "/");
+        trailingSlash = p[length] == '/';
+
+        char * component = strndup(p, length);
+        if (component == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+        lastLiteral = !hasWildcards(component);
+        free(component);
+
+        PathList matches;
+        memset(&matches, 0, sizeof(PathList));
+        expandComponent(&current, p, length, *next != '\0' || trailingSlash, &matches);
+        freePaths(&current);
+        current = matches;
+        p = next;
+    }
+
+    int added = 0;
+    if (current.count > 0) {
+        qsort(current.paths, current.count, sizeof(char *), comparePaths);
+    }
+
+    for (int i = 0; i < current.count; i++) {
+        struct stat info;
+        if (lastLiteral && lstat(current.paths[i], &info) == -1) {
+            free(current.paths[i]);
+            continue;
+        }
+
+        char * path = current.paths[i];
+        if (trailingSlash) {
+            path = joinPath(current.paths[i], "", 0);
+            free(current.paths[i]);
+        }
+        appendWord(words, count, capacity, path);
+        added++;
+    }
+
+    free(current.paths);
+    return added;
+}
+
+/**
+ * @brief Opens an unsorted stream over the matches of a pattern
+ * @param pattern The pattern (variables already expanded)
+ * @param stream Pointer to the GlobStream to initialize
+ * @return 0 if the stream was opened, -1 if the pattern cannot be streamed
+ *
+ * Only patterns whose wildcards are all in the last component can be
+ * streamed (such as *.msg, optionally after a literal directory and
+ * optionally with a trailing slash to select directories); anything else,
+ * including "**", is expanded with expandGlob(). A directory that cannot
+ * be opened yields an empty stream. Only opened streams need
+ * closeGlobStream().
+ */
+int openGlobStream(const char * pattern, GlobStream * stream) {
+    memset(stream, 0, sizeof(GlobStream));
+
+    size_t length = strlen(pattern);
+    int trailingSlash = length > 1 && pattern[length - 1] == '/';
+    if (trailingSlash) {
+        length--;
+    }
+
+    const char * slash = memrchr(pattern, '/', length);
+    const char * component = slash != NULL ? slash + 1 : pattern;
+    size_t prefixLength = slash != NULL ? (size_t) (slash - pattern) + 1 : 0;
+
+    char * prefix = strndup(pattern, prefixLength);
+    char * last = strndup(component, length - prefixLength);
+    if (prefix == NULL || last == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    if (hasWildcards(prefix) || !hasWildcards(last) || strcmp(last, "**") == 0) {
+        free(prefix);
+        free(last);
+        return -1;
+    }
+
+    stream->pattern = compilePattern(last);
+    stream->matchHidden = last[0] == '.' || (last[0] == '\\' && last[1] == '.');
+    stream->needDirectory = trailingSlash;
+    free(last);
+
+    Pattern * literalPrefix = compilePattern(prefix);
+    bufferAppend(&stream->path, literalPrefix->literal, literalPrefix->minLength);
+    stream->prefixLength = literalPrefix->minLength;
+    freePattern(literalPrefix);
+    free(prefix);
+
+    stream->buffer = malloc(GLOB_DIRENT_BUFFER);
+    if (stream->buffer == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    stream->fd = moveShellFd(open(stream->prefixLength > 0 ? stream->path.data : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    return 0;
+}
+
+/**
+ * @brief Returns the next match of a glob stream
+ * @param stream Pointer to the GlobStream
+ * @return The matching path, valid until the next call, or NULL at the end
+ *
+ * Entries are read with getdents64() one buffer at a time and returned in
+ * directory order. Only directory-only patterns ever call stat(), and only
+ * for entries whose d_type is unknown or a symbolic link.
+ */
+const char * nextGlobStream(GlobStream * stream) {
+    if (stream->fd == -1) {
+        return NULL;
+    }
+
+    for (;;) {
+        if (stream->position >= stream->bytes) {
+            stream->bytes = syscall(SYS_getdents64, stream->fd, stream->buffer, GLOB_DIRENT_BUFFER);
+            stream->position = 0;
+            if (stream->bytes <= 0) {
+                if (stream->bytes == -1) {
+                    perror("getdents64");
+                }
+                return NULL;
+            }
+        }
+
+        LinuxDirent64 * entry = (LinuxDirent64 *) (stream->buffer + stream->position);
+        stream->position += entry->d_reclen;
+
+        const char * name = entry->d_name;
+        size_t nameLength = strlen(name);
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+            (name[0] == '.' && !stream->matchHidden) || !matchPattern(stream->pattern, name, nameLength)) {
+            continue;
+        }
+
+        stream->path.length = stream->prefixLength;
+        bufferAppend(&stream->path, name, nameLength);
+        if (stream->needDirectory) {
+            if (!isDirectory(entry->d_type, stream->path.data)) {
+                continue;
+            }
+            bufferAppend(&stream->path, "/", 1);
+        }
+        return stream->path.data;
+    }
+}
+
+/**
+ * @brief Closes a glob stream
+ * @param stream Pointer to the GlobStream
+ */
+void closeGlobStream(GlobStream * stream) {
+    if (stream->fd != -1) {
+        close(stream->fd);
+    }
+    freePattern(stream->pattern);
+    free(stream->buffer);
+    free(stream->path.data);
+}
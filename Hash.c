@@ -0,0 +1,256 @@
+/**
+ * @file Hash.c
+ * @brief Open-addressing hash table used by SnailShell's variable storage
+ *
+ * Keys are byte strings copied into the table; values are opaque pointers
+ * with an optional length. The table uses linear probing over a separate
+ * array of one-byte tags, so a lookup usually scans a single cache line of
+ * tags and only touches the entry whose tag matches.
+ *
+ * Tag Encoding:
+ * - TAG_EMPTY: Slot has never been used, ends a probe sequence
+ * - TAG_DELETED: Slot held a removed entry, probing continues past it
+ * - 0x80 | top 7 bits of the hash: Slot holds an entry
+ *
+ * The table doubles when live and deleted slots exceed 7/8 of its capacity
+ * and is rebuilt at the same size when most of those slots are deleted.
+ */
+
+#include "SnailShell.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Hashes a byte string
+ * @param key Start of the key
+ * @param length Length of the key
+ * @return 64-bit hash of the key
+ *
+ * Processes eight bytes per step with a multiply and xor-shift, which keeps
+ * hashing cheap for the short keys typical of shell variables.
+ */
+uint64_t hashBytes(const char * key, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ (length * 0xFF51AFD7ED558CCDULL);
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, key + i, sizeof(word));
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 31;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, key + i, length - i);
+    hash = (hash ^ tail) * 0x94D049BB133111EBULL;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/**
+ * @brief Computes the tag stored for a hash
+ * @param hash The 64-bit hash
+ * @return Tag with the high bit set
+ */
+static unsigned char hashTag(uint64_t hash) {
+    return (unsigned char) (0x80 | (hash >> 57));
+}
+
+/**
+ * @brief Initializes an empty table
+ * @param table Pointer to the Table
+ */
+void tableInit(Table * table) {
+    memset(table, 0, sizeof(Table));
+}
+
+/**
+ * @brief Frees a table and its keys
+ * @param table Pointer to the Table
+ *
+ * Values are not freed; callers that own values release them first by
+ * iterating with tableNext().
+ */
+void tableFree(Table * table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->tags[i] & 0x80) {
+            free(table->entries[i].key);
+        }
+    }
+
+    free(table->tags);
+    free(table->entries);
+    tableInit(table);
+}
+
+/**
+ * @brief Finds the slot of a key
+ * @param table Pointer to the Table
+ * @param key Start of the key
+ * @param length Length of the key
+ * @param hash Hash of the key
+ * @param insertAt Pointer to store the slot to insert into if the key is
+ *        missing (first deleted slot on the probe path, else the empty slot)
+ * @return Index of the key's slot, or -1 if the key is not present
+ */
+static long findSlot(Table * table, const char * key, size_t length, uint64_t hash, size_t * insertAt) {
+    size_t mask = table->capacity - 1;
+    size_t index = hash & mask;
+    unsigned char tag = hashTag(hash);
+    long deleted = -1;
+
+    for (;;) {
+        unsigned char current = table->tags[index];
+        if (current == TAG_EMPTY) {
+            *insertAt = deleted != -1 ? (size_t) deleted : index;
+            return -1;
+        }
+
+        if (current == tag) {
+            TableEntry * entry = &table->entries[index];
+            if (entry->keyLength == length && memcmp(entry->key, key, length) == 0) {
+                return (long) index;
+            }
+        } else if (current == TAG_DELETED && deleted == -1) {
+            deleted = (long) index;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+/**
+ * @brief Rebuilds a table with a new capacity
+ * @param table Pointer to the Table
+ * @param capacity New capacity (a power of two)
+ *
+ * Entries are moved without copying their keys; deleted slots are dropped.
+ */
+static void resizeTable(Table * table, size_t capacity) {
+    unsigned char * oldTags = table->tags;
+    TableEntry * oldEntries = table->entries;
+    size_t oldCapacity = table->capacity;
+
+    table->tags = calloc(capacity, sizeof(unsigned char));
+    table->entries = malloc(sizeof(TableEntry) * capacity);
+    if (table->tags == NULL || table->entries == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    table->capacity = capacity;
+    table->used = table->count;
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (!(oldTags[i] & 0x80)) {
+            continue;
+        }
+
+        uint64_t hash = oldEntries[i].hash;
+        size_t index = hash & mask;
+        while (table->tags[index] != TAG_EMPTY) {
+            index = (index + 1) & mask;
+        }
+        table->tags[index] = hashTag(hash);
+        table->entries[index] = oldEntries[i];
+    }
+
+    free(oldTags);
+    free(oldEntries);
+}
+
+/**
+ * @brief Looks up a key
+ * @param table Pointer to the Table
+ * @param key Start of the key
+ * @param length Length of the key
+ * @return Pointer to the entry, or NULL if the key is not present
+ */
+TableEntry * tableFind(Table * table, const char * key, size_t length) {
+    if (table->count == 0) {
+        return NULL;
+    }
+
+    size_t insertAt;
+    long index = findSlot(table, key, length, hashBytes(key, length), &insertAt);
+    return index == -1 ? NULL : &table->entries[index];
+}
+
+/**
+ * @brief Looks up a key, inserting it if it is missing
+ * @param table Pointer to the Table
+ * @param key Start of the key
+ * @param length Length of the key
+ * @return Pointer to the entry; new entries have a NULL value
+ *
+ * The returned pointer is valid until the next insertion.
+ */
+TableEntry * tableInsert(Table * table, const char * key, size_t length) {
+    if ((table->used + 1) * 8 > table->capacity * 7) {
+        size_t capacity = table->capacity == 0 ? TABLE_MIN_CAPACITY : table->capacity;
+        if ((table->count + 1) * 2 > capacity) {
+            capacity *= 2;
+        }
+        resizeTable(table, capacity);
+    }
+
+    uint64_t hash = hashBytes(key, length);
+    size_t insertAt;
+    long index = findSlot(table, key, length, hash, &insertAt);
+    if (index != -1) {
+        return &table->entries[index];
+    }
+
+    TableEntry * entry = &table->entries[insertAt];
+    entry->key = malloc(length + 1);
+    if (entry->key == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(entry->key, key, length);
+    entry->key[length] = '\0';
+    entry->keyLength = length;
+    entry->hash = hash;
+    entry->value = NULL;
+    entry->valueLength = 0;
+
+    if (table->tags[insertAt] == TAG_EMPTY) {
+        table->used++;
+    }
+    table->tags[insertAt] = hashTag(hash);
+    table->count++;
+    return entry;
+}
+
+/**
+ * @brief Removes an entry returned by tableFind() or tableInsert()
+ * @param table Pointer to the Table
+ * @param entry Pointer to the entry to remove
+ *
+ * The key is freed; the value is left to the caller.
+ */
+void tableRemove(Table * table, TableEntry * entry) {
+    size_t index = entry - table->entries;
+    free(entry->key);
+    entry->key = NULL;
+    table->tags[index] = TAG_DELETED;
+    table->count--;
+}
+
+/**
+ * @brief Iterates over the entries of a table
+ * @param table Pointer to the Table
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @return Pointer to the next entry, or NULL when all entries were visited
+ */
+TableEntry * tableNext(Table * table, size_t * cursor) {
+    while (*cursor < table->capacity) {
+        size_t index = (*cursor)++;
+        if (table->tags[index] & 0x80) {
+            return &table->entries[index];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file History.c
+ * @brief Command history shared by all SnailShell sessions
+ *
+ * History lives in a fixed-size file in the home directory that every
+ * interactive session maps into memory. Nothing is read at startup; entries
+ * are looked up in the mapping when the user asks for them.
+ *
+ * File Layout:
+ * - HistoryHeader: counters shared by all sessions
+ * - HISTORY_SLOTS slots of HistorySlot, one per entry, indexed by the
+ *   entry's sequence number modulo HISTORY_SLOTS
+ * - HISTORY_DATA bytes of entry text, written as a ring
+ *
+ * Appending takes no lock: a session reserves a sequence number and a
+ * range of the text ring with atomic additions on the shared counters,
+ * copies the text, fills the slot and publishes it by storing the sequence
+ * number last. A reader accepts a slot only if it carries the expected
+ * sequence number and its text was not overwritten while being copied.
+ *
+ * Each slot also stores a signature of the entry: a bit per trigram and a
+ * bit per letter, hashed into a few machine words. A search computes the
+ * signature of the query and compares text only for entries whose
+ * signature contains it, so scanning a million entries touches little
+ * more than their slots.
+ */
+
+#include "SnailShell.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static HistoryHeader * history;
+static int historyState;
+
+/**
+ * @brief Returns the slot array of the mapped history file
+ * @return Pointer to the first HistorySlot
+ */
+static HistorySlot * historySlots() {
+    return (HistorySlot *) (history + 1);
+}
+
+/**
+ * @brief Returns the text ring of the mapped history file
+ * @return Pointer to the first byte of the ring
+ */
+static char * historyData() {
+    return (char *) (historySlots() + HISTORY_SLOTS);
+}
+
+/**
+ * @brief Maps the history file, creating it if needed
+ * @return 0 if history is available, -1 otherwise
+ *
+ * The file is opened on first use only. Creation and initialization happen
+ * under an exclusive flock() so that sessions starting together agree on
+ * the header; afterwards no lock is taken. If the file cannot be used,
+ * history is silently disabled for the session.
+ */
+static int openHistory() {
+    if (historyState != 0) {
+        return historyState == 1 ? 0 : -1;
+    }
+    historyState = -1;
+
+    const char * home = getenv("HOME");
+    if (home == NULL) {
+        return -1;
+    }
+
+    Buffer path;
+    memset(&path, 0, sizeof(Buffer));
+    bufferAppend(&path, home, strlen(home));
+    bufferAppend(&path, "/", 1);
+    bufferAppend(&path, HISTORY_FILE, strlen(HISTORY_FILE));
+
+    int fd = open(path.data, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    free(path.data);
+    if (fd == -1) {
+        return -1;
+    }
+
+    size_t size = sizeof(HistoryHeader) + sizeof(HistorySlot) * HISTORY_SLOTS + HISTORY_DATA;
+    struct stat info;
+    if (flock(fd, LOCK_EX) == -1 || fstat(fd, &info) == -1 ||
+        ((size_t) info.st_size < size && ftruncate(fd, size) == -1)) {
+        close(fd);
+        return -1;
+    }
+
+    HistoryHeader * header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    if (header->magic != HISTORY_MAGIC) {
+        memset(header, 0, sizeof(HistoryHeader));
+        header->magic = HISTORY_MAGIC;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    history = header;
+    historyState = 1;
+    return 0;
+}
+
+/**
+ * @brief Computes the search signature of a text
+ * @param text The text
+ * @param length Length of the text
+ * @param signature Array of HISTORY_SIGNATURE_WORDS words to fill
+ *
+ * The first words hold one bit per trigram, the last one a bit per
+ * letter, so queries shorter than three characters are filtered too.
+ */
+static void computeSignature(const char * text, size_t length, uint64_t * signature) {
+    memset(signature, 0, sizeof(uint64_t) * HISTORY_SIGNATURE_WORDS);
+    const unsigned char * bytes = (const unsigned char *) text;
+    size_t trigramBits = 64 * (HISTORY_SIGNATURE_WORDS - 1);
+
+    for (size_t i = 0; i < length; i++) {
+        signature[HISTORY_SIGNATURE_WORDS - 1] |= 1ULL << (bytes[i] & 63);
+        if (i + 2 < length) {
+            uint32_t trigram = bytes[i] | bytes[i + 1] << 8 | bytes[i + 2] << 16;
+            uint32_t bit = (trigram * 2654435761U) >> 16;
+            bit %= trigramBits;
+            signature[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+}
+
+/**
+ * @brief Appends a command line to the shared history
+ * @param line The command line
+ *
+ * Lines longer than HISTORY_MAX_ENTRY bytes are not recorded.
+ */
+void addHistory(const char * line) {
+    size_t length = strlen(line);
+    if (length == 0 || length > HISTORY_MAX_ENTRY || openHistory() == -1) {
+        return;
+    }
+
+    uint64_t sequence = __atomic_fetch_add(&history->nextSequence, 1, __ATOMIC_ACQ_REL);
+    uint64_t offset = __atomic_fetch_add(&history->dataHead, length, __ATOMIC_ACQ_REL);
+
+    char * data = historyData();
+    size_t start = offset % HISTORY_DATA;
+    size_t first = length < HISTORY_DATA - start ? length : HISTORY_DATA - start;
+    memcpy(data + start, line, first);
+    memcpy(data, line + first, length - first);
+
+    HistorySlot * slot = &historySlots()[sequence % HISTORY_SLOTS];
+    __atomic_store_n(&slot->sequence, 0, __ATOMIC_RELEASE);
+    slot->offset = offset;
+    slot->length = length;
+    computeSignature(line, length, slot->signature);
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Returns the sequence number the next history entry will get
+ * @return Number of entries ever added, or 0 if history is unavailable
+ */
+uint64_t historyLength() {
+    if (openHistory() == -1) {
+        return 0;
+    }
+    return __atomic_load_n(&history->nextSequence, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Copies a history entry
+ * @param sequence The entry's sequence number
+ * @param entry Pointer to the Buffer receiving the text (cleared first)
+ * @return 0 on success, -1 if the entry was overwritten or is incomplete
+ */
+int readHistory(uint64_t sequence, Buffer * entry) {
+    if (openHistory() == -1) {
+        return -1;
+    }
+
+    HistorySlot * slot = &historySlots()[sequence % HISTORY_SLOTS];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != sequence + 1) {
+        return -1;
+    }
+
+    uint64_t offset = slot->offset;
+    size_t length = slot->length;
+    if (length > HISTORY_MAX_ENTRY) {
+        return -1;
+    }
+
+    const char * data = historyData();
+    size_t start = offset % HISTORY_DATA;
+    size_t first = length < HISTORY_DATA - start ? length : HISTORY_DATA - start;
+    entry->length = 0;
+    bufferAppend(entry, data + start, first);
+    bufferAppend(entry, data, length - first);
+
+    uint64_t head = __atomic_load_n(&history->dataHead, __ATOMIC_ACQUIRE);
+    if (head - offset > HISTORY_DATA || __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != sequence + 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds the newest history entry containing a string
+ * @param query The string to look for
+ * @param before Sequence number to search below (exclusive)
+ * @param entry Pointer to the Buffer receiving the entry's text
+ * @return Sequence number of the entry, or -1 if no older entry matches
+ */
+int64_t searchHistory(const char * query, uint64_t before, Buffer * entry) {
+    if (openHistory() == -1) {
+        return -1;
+    }
+
+    size_t queryLength = strlen(query);
+    uint64_t signature[HISTORY_SIGNATURE_WORDS];
+    computeSignature(query, queryLength, signature);
+
+    uint64_t newest = historyLength();
+    if (before > newest) {
+        before = newest;
+    }
+    uint64_t oldest = newest > HISTORY_SLOTS ? newest - HISTORY_SLOTS : 0;
+
+    HistorySlot * slots = historySlots();
+    for (uint64_t sequence = before; sequence > oldest; sequence--) {
+        HistorySlot * slot = &slots[(sequence - 1) % HISTORY_SLOTS];
+
+        int candidate = 1;
+        for (int i = 0; i < HISTORY_SIGNATURE_WORDS && candidate; i++) {
+            candidate = (slot->signature[i] & signature[i]) == signature[i];
+        }
+        if (!candidate || slot->length < queryLength) {
+            continue;
+        }
+
+        if (readHistory(sequence - 1, entry) == 0 && memmem(entry->data, entry->length, query, queryLength) != NULL) {
+            return (int64_t) (sequence - 1);
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,357 @@
+/**
+ * @file Limits.c
+ * @brief Resource limits for SnailShell and its pipeline stages
+ *
+ * This file implements the ulimit built-in, which changes the limits of the
+ * shell itself (and therefore of every command it starts), and the "limit"
+ * stage prefix, which caps a single pipeline stage by calling setrlimit() in
+ * the child right before execvp(). It also reports stages that were killed
+ * after running into one of their limits.
+ *
+ * Key Functionality:
+ * - Limit specification parsing (mem=2G, cpu=60, nofile=1024, ...)
+ * - ulimit built-in with bash compatible options
+ * - Applying per-stage limits between fork() and execvp()
+ * - Job status reporting for stages terminated by a signal
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+
+/**
+ * @struct LimitInfo
+ * @brief Describes a resource limit supported by ulimit and the limit prefix
+ *
+ * The unit is the multiplier used by the ulimit option (kilobytes for sizes,
+ * as in bash). The limit prefix always takes sizes in bytes with an optional
+ * K/M/G/T suffix.
+ */
+typedef struct LimitInfo {
+    char option;
+    const char * key;
+    int resource;
+    rlim_t unit;
+    int isSize;
+    const char * description;
+} LimitInfo;
+
+static const LimitInfo limitInfos[] = {
+    { 'c', "core", RLIMIT_CORE, 1024, 1, "core file size (kbytes)" },
+    { 'd', "data", RLIMIT_DATA, 1024, 1, "data seg size (kbytes)" },
+    { 'f', "fsize", RLIMIT_FSIZE, 1024, 1, "file size (kbytes)" },
+    { 'l', "memlock", RLIMIT_MEMLOCK, 1024, 1, "max locked memory (kbytes)" },
+    { 'n', "nofile", RLIMIT_NOFILE, 1, 0, "open files" },
+    { 's', "stack", RLIMIT_STACK, 1024, 1, "stack size (kbytes)" },
+    { 't', "cpu", RLIMIT_CPU, 1, 0, "cpu time (seconds)" },
+    { 'u', "nproc", RLIMIT_NPROC, 1, 0, "max user processes" },
+    { 'v', "mem", RLIMIT_AS, 1024, 1, "virtual memory (kbytes)" },
+};
+
+#define NUM_LIMIT_INFOS (sizeof(limitInfos) / sizeof(limitInfos[0]))
+
+/**
+ * @brief Looks up a limit by its ulimit option letter
+ * @param option The option letter (e.g. 'v')
+ * @return Pointer to the LimitInfo, or NULL if unknown
+ */
+static const LimitInfo * findLimitByOption(char option) {
+    for (size_t i = 0; i < NUM_LIMIT_INFOS; i++) {
+        if (limitInfos[i].option == option) {
+            return &limitInfos[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks up a limit by its prefix key
+ * @param key The key name
+ * @param keyLength Length of the key name
+ * @return Pointer to the LimitInfo, or NULL if unknown
+ */
+static const LimitInfo * findLimitByKey(const char * key, size_t keyLength) {
+    for (size_t i = 0; i < NUM_LIMIT_INFOS; i++) {
+        if (strlen(limitInfos[i].key) == keyLength && strncmp(limitInfos[i].key, key, keyLength) == 0) {
+            return &limitInfos[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses a limit value
+ * @param text The value text ("unlimited", "60", "2G", ...)
+ * @param unit Multiplier applied to plain numbers
+ * @param allowSuffix Whether K/M/G/T suffixes are accepted
+ * @param value Pointer to store the resulting limit
+ * @return 0 on success, -1 on failure or if the value does not fit in
+ *         an rlim_t
+ */
+static int parseLimitValue(const char * text, rlim_t unit, int allowSuffix, rlim_t * value) {
+    if (strcmp(text, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return 0;
+    }
+
+    if (!isdigit((unsigned char) *text)) {
+        return -1;
+    }
+
+    char * end;
+    errno = 0;
+    unsigned long long number = strtoull(text, &end, 10);
+    if (errno == ERANGE) {
+        return -1;
+    }
+
+    int scale = 0;
+    if (allowSuffix && *end != '\0' && end[1] == '\0') {
+        switch (toupper((unsigned char) *end)) {
+            case 'T': scale++;
+            /* fall through */
+            case 'G': scale++;
+            /* fall through */
+            case 'M': scale++;
+            /* fall through */
+            case 'K': scale++;
+                end++;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (*end != '\0') {
+        return -1;
+    }
+
+    for (; scale > 0; scale--) {
+        if (number > RLIM_INFINITY / 1024) {
+            return -1;
+        }
+        number *= 1024;
+    }
+    if (number > RLIM_INFINITY / unit) {
+        return -1;
+    }
+
+    *value = (rlim_t) number * unit;
+    return 0;
+}
+
+/**
+ * @brief Formats a limit value for display
+ * @param value The limit value
+ * @param unit Divisor used by the ulimit option
+ * @param buffer Output buffer
+ * @param size Size of the output buffer
+ */
+static void formatLimitValue(rlim_t value, rlim_t unit, char * buffer, size_t size) {
+    if (value == RLIM_INFINITY) {
+        snprintf(buffer, size, "unlimited");
+    } else {
+        snprintf(buffer, size, "%llu", (unsigned long long) (value / unit));
+    }
+}
+
+/**
+ * @brief Parses a "key=value" word of the limit prefix into a command
+ * @param command Pointer to the Command structure
+ * @param spec The "key=value" word
+ * @return 0 on success, -1 if the word is not a valid limit specification
+ *
+ * Size limits take bytes with an optional K/M/G/T suffix; cpu takes seconds
+ * and the remaining limits take plain counts.
+ */
+int parseStageLimit(Command * command, const char * spec) {
+    const char * equalSign = strchr(spec, '=');
+    if (equalSign == NULL) {
+        return -1;
+    }
+
+    const LimitInfo * info = findLimitByKey(spec, equalSign - spec);
+    rlim_t value;
+    if (info == NULL || parseLimitValue(equalSign + 1, 1, info->isSize, &value) == -1) {
+        return -1;
+    }
+
+    command->limits[info->resource] = value;
+    command->limitMask |= 1u << info->resource;
+    return 0;
+}
+
+/**
+ * @brief Applies the resource limits of a stage to the calling process
+ * @param curr Pointer to the Command structure
+ *
+ * Called in the child between fork() and execvp(). Both the soft and the hard
+ * limit are lowered so the command cannot raise them again. The CPU hard
+ * limit is kept one second above the soft limit so the stage receives
+ * SIGXCPU, which can be reported, before the kernel's SIGKILL.
+ */
+void applyStageLimits(Command * curr) {
+    for (int resource = 0; resource < RLIMIT_NLIMITS; resource++) {
+        if (!(curr->limitMask & (1u << resource))) {
+            continue;
+        }
+
+        struct rlimit current;
+        if (getrlimit(resource, &current) == -1) {
+            perror("getrlimit");
+            _exit(EXIT_FAILURE);
+        }
+
+        struct rlimit limit;
+        limit.rlim_cur = curr->limits[resource];
+        limit.rlim_max = curr->limits[resource];
+        if (resource == RLIMIT_CPU && limit.rlim_max != RLIM_INFINITY) {
+            limit.rlim_max++;
+        }
+        if (current.rlim_max != RLIM_INFINITY && (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > current.rlim_max)) {
+            limit.rlim_max = current.rlim_max;
+        }
+        if (limit.rlim_cur > limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+        }
+
+        if (setrlimit(resource, &limit) == -1) {
+            perror("setrlimit");
+            _exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * @brief Reports how a stage terminated if it was killed by a signal
+ * @param curr Pointer to the Command structure of the stage
+ * @param status Wait status returned by waitpid()
+ *
+ * Stages killed by SIGXCPU or SIGXFSZ, or by SIGKILL while under a CPU
+ * limit, are reported as having hit that limit. Stages under a memory limit
+ * that crash are reported as likely out of memory, since exceeding
+ * RLIMIT_AS or RLIMIT_DATA only makes allocations fail. Interrupts and
+ * broken pipes are expected in pipelines and are not reported.
+ */
+void reportStageStatus(Command * curr, int status) {
+    if (!WIFSIGNALED(status)) {
+        return;
+    }
+
+    int signal = WTERMSIG(status);
+    const char * name = curr->args[0];
+    int memoryLimited = curr->limitMask & ((1u << RLIMIT_AS) | (1u << RLIMIT_DATA));
+
+    if (signal == SIGXCPU || (signal == SIGKILL && (curr->limitMask & (1u << RLIMIT_CPU)))) {
+        printError(STATUS_LIMIT, name, "CPU time limit exceeded");
+    } else if (signal == SIGXFSZ) {
+        printError(STATUS_LIMIT, name, "file size limit exceeded");
+    } else if (memoryLimited && (signal == SIGSEGV || signal == SIGABRT || signal == SIGBUS || signal == SIGKILL)) {
+        printError(STATUS_LIMIT, name, "memory limit likely exceeded");
+    } else if (signal != SIGINT && signal != SIGPIPE) {
+        printError(STATUS_SIGNAL, name, strsignal(signal));
+    }
+}
+
+/**
+ * @brief Prints every supported limit for the ulimit -a option
+ * @param hard Whether to print hard instead of soft limits
+ */
+static void printAllLimits(int hard) {
+    char value[32];
+    for (size_t i = 0; i < NUM_LIMIT_INFOS; i++) {
+        struct rlimit limit;
+        if (getrlimit(limitInfos[i].resource, &limit) == -1) {
+            perror("getrlimit");
+            continue;
+        }
+
+        formatLimitValue(hard ? limit.rlim_max : limit.rlim_cur, limitInfos[i].unit, value, sizeof(value));
+        printf("%-32s(-%c) %s\n", limitInfos[i].description, limitInfos[i].option, value);
+    }
+}
+
+/**
+ * @brief Handles the built-in ulimit command
+ * @param curr Pointer to the Command structure containing ulimit arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: ulimit [-H|-S] [-a | -c|-d|-f|-l|-n|-s|-t|-u|-v [value]]
+ *
+ * Without a value the current limit is printed; with a value it is set for
+ * the shell and every command started afterwards. As in bash, -S and -H
+ * select the soft or hard limit, setting changes both when neither is given,
+ * and the default resource is the file size (-f).
+ */
+int handleUlimit(Command * curr) {
+    int soft = 0;
+    int hard = 0;
+    int all = 0;
+    const LimitInfo * info = NULL;
+    const char * valueText = NULL;
+
+    for (int i = 1; i < curr->argCount; i++) {
+        const char * arg = curr->args[i];
+        if (arg[0] != '-' || arg[1] == '\0') {
+            if (valueText != NULL) {
+                printError(ERROR_ULIMIT_USAGE);
+                return -1;
+            }
+            valueText = arg;
+            continue;
+        }
+
+        for (const char * option = arg + 1; *option != '\0'; option++) {
+            if (*option == 'H') {
+                hard = 1;
+            } else if (*option == 'S') {
+                soft = 1;
+            } else if (*option == 'a') {
+                all = 1;
+            } else if ((info = findLimitByOption(*option)) == NULL) {
+                printError(ERROR_ULIMIT_USAGE);
+                return -1;
+            }
+        }
+    }
+
+    if (all) {
+        printAllLimits(hard && !soft);
+        return 0;
+    }
+    if (info == NULL) {
+        info = findLimitByOption('f');
+    }
+
+    struct rlimit limit;
+    if (getrlimit(info->resource, &limit) == -1) {
+        perror("getrlimit");
+        return -1;
+    }
+
+    if (valueText == NULL) {
+        char value[32];
+        formatLimitValue(hard && !soft ? limit.rlim_max : limit.rlim_cur, info->unit, value, sizeof(value));
+        printf("%s\n", value);
+        return 0;
+    }
+
+    rlim_t value;
+    if (parseLimitValue(valueText, info->unit, 0, &value) == -1) {
+        printError(ERROR_LIMIT_INVALID, valueText);
+        return -1;
+    }
+
+    if (soft || !hard) {
+        limit.rlim_cur = value;
+    }
+    if (hard || !soft) {
+        limit.rlim_max = value;
+    }
+
+    if (setrlimit(info->resource, &limit) == -1) {
+        perror("setrlimit");
+        return -1;
+    }
+    return 0;
+}
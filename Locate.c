@@ -0,0 +1,522 @@
+/**
+ * @file Locate.c
+ * @brief Command location cache shared by concurrent shells
+ *
+ * With "shopt -s sharedhash", the shell resolves command names against
+ * PATH itself before forking and the child calls execv() on the result,
+ * instead of letting execvp() try every PATH directory in turn. Results
+ * are kept in a POSIX shared memory segment (one per user) that every
+ * shell with the option maps, so a freshly started shell finds the
+ * commands its neighbours already looked up.
+ *
+ * Table Layout:
+ * - CacheHeader, then CACHE_SLOTS slots of CacheSlot
+ * - A slot's key is a hash of the PATH value and the command name, so
+ *   shells with different PATHs share the segment without conflicts
+ * - Linear probing over at most CACHE_PROBES slots; a key of 0 ends a
+ *   probe sequence and slots are never emptied, only overwritten
+ *
+ * The table takes no lock. A writer claims a slot by making its version
+ * odd with a compare-and-swap and makes it even again when done; a reader
+ * copies the slot and discards the copy if the version was odd or changed
+ * meanwhile. A writer that fails to claim a slot simply skips caching.
+ *
+ * An entry records the modification time of the directory the command
+ * was found in and is used only while that time is unchanged, so
+ * installing or removing a program in that directory takes effect at the
+ * next lookup.
+ *
+ * Where inotify is available, each PATH directory is also watched, and
+ * processCacheEvents() (called by run() between commands) invalidates
+ * exactly the names that were created, removed, renamed or changed mode
+ * in them. A hit then needs no system call at all: it is trusted if it
+ * was written after its directory was last seen unchanged, which is
+ * checked against the directory times recorded when the watches were set
+ * up. Events also catch a program added to an earlier PATH directory than
+ * the cached one, which the time check alone misses.
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @struct WatchedDirectory
+ * @brief PATH directory watched with inotify
+ *
+ * mtime is the directory's modification time when the watch was set up;
+ * entries found in the directory before that time are not trusted.
+ */
+typedef struct WatchedDirectory {
+    char * path;
+    size_t length;
+    int descriptor;
+    int64_t mtime;
+} WatchedDirectory;
+
+static CacheHeader * cache;
+static int cacheState;
+static int watchFd = -1;
+static char * watchedPath;
+static WatchedDirectory * watched;
+static int watchedCount;
+
+/**
+ * @brief Returns the slot array of the mapped cache
+ * @return Pointer to the first CacheSlot
+ */
+static CacheSlot * cacheSlots() {
+    return (CacheSlot *) (cache + 1);
+}
+
+/**
+ * @brief Maps the shared cache segment, creating it if needed
+ * @return 0 if the cache is available, -1 otherwise
+ *
+ * A new segment is zero-filled by ftruncate(), which is a valid empty
+ * table, so concurrent creators need no coordination beyond O_CREAT.
+ * The name is predictable, so a segment that is not owned by this user
+ * or that others can open is refused: its paths would be executed.
+ * If the segment cannot be used, lookups fall back to execvp() for the
+ * rest of the session.
+ */
+static int openCache() {
+    if (cacheState != 0) {
+        return cacheState == 1 ? 0 : -1;
+    }
+    cacheState = -1;
+
+    char name[64];
+    snprintf(name, sizeof(name), CACHE_SHM_NAME, (unsigned) geteuid());
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return -1;
+    }
+
+    size_t size = sizeof(CacheHeader) + sizeof(CacheSlot) * CACHE_SLOTS;
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    if (info.st_uid != geteuid() || (info.st_mode & 077) != 0) {
+        printError(ERROR_CACHE_UNSAFE, name);
+        close(fd);
+        return -1;
+    }
+    if ((size_t) info.st_size < size && ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    CacheHeader * header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    uint64_t expected = 0;
+    __atomic_compare_exchange_n(&header->magic, &expected, CACHE_MAGIC, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != CACHE_MAGIC) {
+        munmap(header, size);
+        return -1;
+    }
+
+    cache = header;
+    cacheState = 1;
+    return 0;
+}
+
+/**
+ * @brief Computes the cache key of a command name under a PATH value
+ * @param path The PATH value
+ * @param name The command name
+ * @return Non-zero key
+ */
+static uint64_t cacheKey(const char * path, const char * name) {
+    uint64_t key = hashBytes(path, strlen(path)) * 0x9E3779B97F4A7C15ULL ^ hashBytes(name, strlen(name));
+    return key != 0 ? key : 1;
+}
+
+/**
+ * @brief Returns the modification time of a file in nanoseconds
+ * @param path Path of the file
+ * @return The modification time, or -1 if it cannot be read
+ */
+static int64_t modificationTime(const char * path) {
+    struct stat info;
+    if (stat(path, &info) == -1) {
+        return -1;
+    }
+    return (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Copies a slot consistently
+ * @param slot Pointer to the shared slot
+ * @param copy Pointer to the CacheSlot receiving the copy
+ * @return 0 if the copy is consistent, -1 if a writer got in the way
+ */
+static int readSlot(CacheSlot * slot, CacheSlot * copy) {
+    uint32_t before = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+        return -1;
+    }
+    memcpy(copy, slot, sizeof(CacheSlot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->version, __ATOMIC_RELAXED) != before) {
+        return -1;
+    }
+    copy->name[CACHE_NAME_MAX - 1] = '\0';
+    copy->path[CACHE_PATH_MAX - 1] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Finds the slot holding a command, or the slot to store it in
+ * @param key The command's cache key
+ * @param name The command name
+ * @param found Pointer set to non-zero if the returned slot holds the
+ *        command
+ * @return Pointer to the slot
+ *
+ * When the probe sequence is full, the command's home slot is returned
+ * for eviction.
+ */
+static CacheSlot * probeCache(uint64_t key, const char * name, int * found) {
+    CacheSlot * slots = cacheSlots();
+    *found = 0;
+    for (int i = 0; i < CACHE_PROBES; i++) {
+        CacheSlot * slot = &slots[(key + i) % CACHE_SLOTS];
+        uint64_t slotKey = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (slotKey == 0) {
+            return slot;
+        }
+
+        CacheSlot copy;
+        if (slotKey == key && readSlot(slot, &copy) == 0 && copy.key == key && strcmp(copy.name, name) == 0) {
+            *found = 1;
+            return slot;
+        }
+    }
+    return &slots[key % CACHE_SLOTS];
+}
+
+/**
+ * @brief Stores a command's location in a slot
+ * @param slot Pointer to the slot
+ * @param key The command's cache key
+ * @param name The command name
+ * @param path Full path of the command
+ * @param mtime Modification time of the command's directory
+ * @return 0 on success, -1 if another writer holds the slot
+ */
+static int writeSlot(CacheSlot * slot, uint64_t key, const char * name, const char * path, int64_t mtime) {
+    uint32_t version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+    if ((version & 1) || !__atomic_compare_exchange_n(&slot->version, &version, version + 1, 0,
+                                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    snprintf(slot->name, CACHE_NAME_MAX, "%s", name);
+    snprintf(slot->path, CACHE_PATH_MAX, "%s", path);
+    slot->mtime = mtime;
+    __atomic_store_n(&slot->key, key, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->version, version + 2, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Searches PATH for an executable
+ * @param path The PATH value
+ * @param name The command name
+ * @param resolved Buffer receiving the full path
+ * @param size Size of resolved
+ * @param mtime Pointer to store the modification time of the directory
+ * @return 0 if found in an absolute PATH directory, -1 otherwise
+ *
+ * The directory's time is read before the file is checked, so a change
+ * made in between invalidates the entry instead of being missed.
+ */
+static int searchPath(const char * path, const char * name, char * resolved, size_t size, int64_t * mtime) {
+    const char * start = path;
+    while (*start != '\0') {
+        const char * end = strchrnul(start, ':');
+        size_t length = end - start;
+        if (length > 0 && start[0] == '/' && length + strlen(name) + 2 <= size) {
+            memcpy(resolved, start, length);
+            resolved[length] = '\0';
+            *mtime = modificationTime(resolved);
+
+            resolved[length] = '/';
+            strcpy(resolved + length + 1, name);
+            struct stat info;
+            if (*mtime != -1 && stat(resolved, &info) == 0 && S_ISREG(info.st_mode) && access(resolved, X_OK) == 0) {
+                return 0;
+            }
+        }
+        start = *end == ':' ? end + 1 : end;
+    }
+    return -1;
+}
+
+/**
+ * @brief Stops watching the PATH directories
+ */
+static void unwatchPath() {
+    if (watchFd != -1) {
+        close(watchFd);
+        watchFd = -1;
+    }
+    for (int i = 0; i < watchedCount; i++) {
+        free(watched[i].path);
+    }
+    free(watched);
+    free(watchedPath);
+    watched = NULL;
+    watchedCount = 0;
+    watchedPath = NULL;
+}
+
+/**
+ * @brief Watches the directories of a PATH value with inotify
+ * @param path The PATH value
+ *
+ * Replaces any previous watches. If inotify cannot be used, nothing is
+ * watched and hits are checked against the directory time instead.
+ * Directories that cannot be watched, such as missing ones, never
+ * validate an entry.
+ */
+static void watchPath(const char * path) {
+    unwatchPath();
+    watchedPath = strdup(path);
+    if (watchedPath == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    watchFd = moveShellFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (watchFd == -1) {
+        return;
+    }
+
+    int capacity = 0;
+    const char * start = path;
+    while (*start != '\0') {
+        const char * end = strchrnul(start, ':');
+        if (end > start && start[0] == '/') {
+            if (watchedCount == capacity) {
+                capacity = capacity == 0 ? 16 : capacity * 2;
+                watched = realloc(watched, sizeof(WatchedDirectory) * capacity);
+                if (watched == NULL) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            WatchedDirectory * directory = &watched[watchedCount++];
+            directory->path = strndup(start, end - start);
+            if (directory->path == NULL) {
+                perror("strndup");
+                exit(EXIT_FAILURE);
+            }
+            directory->length = end - start;
+            directory->descriptor = inotify_add_watch(watchFd, directory->path, CACHE_WATCH_EVENTS);
+            directory->mtime = directory->descriptor != -1 ? modificationTime(directory->path) : INT64_MAX;
+        }
+        start = *end == ':' ? end + 1 : end;
+    }
+}
+
+/**
+ * @brief Finds the watched directory a command path lies in
+ * @param path Full path of the command
+ * @return Pointer to the WatchedDirectory, or NULL if none matches
+ */
+static WatchedDirectory * findWatched(const char * path) {
+    size_t length = strrchr(path, '/') - path;
+    for (int i = 0; i < watchedCount; i++) {
+        if (watched[i].length == length && memcmp(watched[i].path, path, length) == 0) {
+            return &watched[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks whether a cached path is a command in a PATH directory
+ * @param path The PATH value
+ * @param copy Pointer to a consistent copy of the entry
+ * @return Non-zero if the path is an absolute PATH entry followed by '/'
+ *         and the command name
+ */
+static int isInPath(const char * path, CacheSlot * copy) {
+    char * slash = strrchr(copy->path, '/');
+    if (slash == NULL || strcmp(slash + 1, copy->name) != 0) {
+        return 0;
+    }
+
+    size_t length = slash - copy->path;
+    const char * start = path;
+    while (*start != '\0') {
+        const char * end = strchrnul(start, ':');
+        if (start[0] == '/' && (size_t) (end - start) == length && memcmp(start, copy->path, length) == 0) {
+            return 1;
+        }
+        start = *end == ':' ? end + 1 : end;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks whether a cached entry can be used
+ * @param path The PATH value
+ * @param copy Pointer to a consistent copy of the entry
+ * @return Non-zero if the entry still names the right executable
+ *
+ * The entry must lie in one of the current PATH directories, since the
+ * cache is shared and its contents are not trusted on their own. Under
+ * inotify the rest is a comparison with the watched directory's time;
+ * otherwise the directory is stat()ed.
+ */
+static int isEntryValid(const char * path, CacheSlot * copy) {
+    if (!isInPath(path, copy)) {
+        return 0;
+    }
+    if (watchFd != -1) {
+        WatchedDirectory * directory = findWatched(copy->path);
+        return directory != NULL && copy->mtime >= directory->mtime;
+    }
+
+    char * slash = strrchr(copy->path, '/');
+    *slash = '\0';
+    int64_t mtime = modificationTime(copy->path);
+    *slash = '/';
+    return mtime == copy->mtime;
+}
+
+/**
+ * @brief Marks the cache entry of a command name as invalid
+ * @param name The command name
+ *
+ * Unlike a new entry, an invalidation must not be skipped when another
+ * writer holds the slot, so it is retried a bounded number of times.
+ */
+static void invalidateCommand(const char * name) {
+    if (strlen(name) >= CACHE_NAME_MAX) {
+        return;
+    }
+
+    uint64_t key = cacheKey(watchedPath, name);
+    int found;
+    CacheSlot * slot = probeCache(key, name, &found);
+    CacheSlot copy;
+    for (int attempt = 0; found && attempt < CACHE_WRITE_ATTEMPTS; attempt++) {
+        if (readSlot(slot, &copy) == 0) {
+            if (copy.key != key || copy.mtime == -1 || writeSlot(slot, key, name, copy.path, -1) == 0) {
+                return;
+            }
+        }
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Applies the pending changes to the watched PATH directories
+ *
+ * Called between commands, so lookups never pay for reading events. A
+ * change to a file invalidates that name only. If a directory itself is
+ * removed or renamed, nothing found in it is trusted any more; if events
+ * were lost, every directory's time is read again, which invalidates all
+ * entries written before.
+ */
+void processCacheEvents() {
+    if (watchFd == -1) {
+        return;
+    }
+
+    char events[CACHE_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t bytes = read(watchFd, events, sizeof(events));
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return;
+        }
+
+        for (char * cursor = events; cursor < events + bytes; ) {
+            struct inotify_event * event = (struct inotify_event *) cursor;
+            cursor += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (int i = 0; i < watchedCount; i++) {
+                    if (watched[i].descriptor != -1) {
+                        watched[i].mtime = modificationTime(watched[i].path);
+                    }
+                }
+            } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                for (int i = 0; i < watchedCount; i++) {
+                    if (watched[i].descriptor == event->wd) {
+                        watched[i].mtime = INT64_MAX;
+                    }
+                }
+            } else if (event->len > 0) {
+                invalidateCommand(event->name);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Resolves a command name to the executable it runs
+ * @param name The command name
+ * @param resolved Buffer receiving the full path
+ * @param size Size of resolved
+ * @return 0 if resolved holds the executable, -1 if the caller should fall
+ *         back to execvp()
+ *
+ * Does nothing unless the sharedhash option is enabled. Names containing
+ * '/', names and paths too long for a slot, and commands found through a
+ * relative PATH directory are not cached.
+ */
+int locateCommand(const char * name, char * resolved, size_t size) {
+    const char * path = getenv("PATH");
+    if (!isOptionEnabled(OPTION_SHAREDHASH) || path == NULL || strchr(name, '/') != NULL ||
+        strlen(name) >= CACHE_NAME_MAX || openCache() == -1) {
+        return -1;
+    }
+
+    if (watchedPath == NULL || strcmp(watchedPath, path) != 0) {
+        watchPath(path);
+    }
+
+    uint64_t key = cacheKey(path, name);
+    int found;
+    CacheSlot * slot = probeCache(key, name, &found);
+
+    CacheSlot copy;
+    if (found && readSlot(slot, &copy) == 0 && copy.key == key && copy.mtime != -1 && strlen(copy.path) < size &&
+        isEntryValid(path, &copy)) {
+        strcpy(resolved, copy.path);
+        return 0;
+    }
+
+    int64_t mtime;
+    if (searchPath(path, name, resolved, size, &mtime) == -1) {
+        return -1;
+    }
+    if (strlen(resolved) < CACHE_PATH_MAX) {
+        writeSlot(slot, key, name, resolved, mtime);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file Options.c
+ * @brief Shell options for SnailShell
+ *
+ * Options are named on/off switches that change how the shell behaves,
+ * toggled with the shopt built-in as in bash. They are looked up by index,
+ * so checking an option in a hot path costs a single array access.
+ *
+ * Available Options:
+ * - streamglob: for loops over a single-directory glob iterate the
+ *   directory directly, unsorted, instead of expanding a sorted list
+ * - sharedhash: commands are located through a cache shared with other
+ *   shells instead of by execvp() (see Locate.c)
+ * - appendcache: files redirected to with ">>" are kept open between
+ *   commands (see Append.c)
+ * - fusepipes: echo, printf, read and mapfile stages of a pipeline run as
+ *   threads of the shell connected by rings (see Fuse.c)
+ */
+
+#include "SnailShell.h"
+
+static ShellOption options[] = {
+    [OPTION_STREAMGLOB] = { "streamglob", 0 },
+    [OPTION_SHAREDHASH] = { "sharedhash", 0 },
+    [OPTION_APPENDCACHE] = { "appendcache", 0 },
+    [OPTION_FUSEPIPES] = { "fusepipes", 0 },
+};
+
+#define NUM_OPTIONS (sizeof(options) / sizeof(options[0]))
+
+/**
+ * @brief Checks whether a shell option is enabled
+ * @param option Index of the option (OPTION_*)
+ * @return Non-zero if the option is enabled
+ */
+int isOptionEnabled(int option) {
+    return options[option].enabled;
+}
+
+/**
+ * @brief Looks up a shell option by name
+ * @param name The option name
+ * @return Pointer to the ShellOption, or NULL if unknown
+ */
+static ShellOption * findOption(const char * name) {
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        if (strcmp(options[i].name, name) == 0) {
+            return &options[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Handles the built-in shopt command
+ * @param curr Pointer to the Command structure containing shopt arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: shopt [-s|-u] [optname ...]
+ *
+ * -s enables and -u disables the named options. Without -s or -u the named
+ * options (or all options) are printed with their state.
+ */
+int handleShopt(Command * curr) {
+    int state = -1;
+    int i = 1;
+
+    for (; i < curr->argCount && curr->args[i][0] == '-'; i++) {
+        if (strcmp(curr->args[i], "-s") == 0) {
+            state = 1;
+        } else if (strcmp(curr->args[i], "-u") == 0) {
+            state = 0;
+        } else {
+            printError(ERROR_SHOPT_USAGE);
+            return -1;
+        }
+    }
+
+    if (i == curr->argCount) {
+        for (size_t k = 0; k < NUM_OPTIONS; k++) {
+            if (state == -1 || options[k].enabled == state) {
+                printf("%-16s%s\n", options[k].name, options[k].enabled ? "on" : "off");
+            }
+        }
+        return 0;
+    }
+
+    int ret = 0;
+    for (; i < curr->argCount; i++) {
+        ShellOption * option = findOption(curr->args[i]);
+        if (option == NULL) {
+            printError(ERROR_SHOPT_INVALID, curr->args[i]);
+            ret = -1;
+        } else if (state == -1) {
+            printf("%-16s%s\n", option->name, option->enabled ? "on" : "off");
+        } else {
+            option->enabled = state;
+        }
+    }
+    return ret;
+}
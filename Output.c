@@ -0,0 +1,575 @@
+/**
+ * @file Output.c
+ * @brief Buffered built-in output and the echo and printf built-ins
+ *
+ * Built-ins that run inside the shell would otherwise issue one write(2)
+ * per call, so a loop printing a million lines with echo makes a million
+ * system calls. Their output is collected instead in a buffer per
+ * descriptor and written out when the buffer fills, together with the
+ * data that did not fit, in a single writev(2).
+ *
+ * When Buffers Are Flushed (flushBuiltinOutput()):
+ * - After every command read from interactive standard input, so output
+ *   appears before the next prompt
+ * - Before the shell prints a diagnostic (printError()), so errors appear
+ *   after the output that preceded them
+ * - Before the shell forks or starts a command through the spawn helper,
+ *   so external commands write after what the shell printed earlier and
+ *   children do not inherit unwritten data
+ * - Before a descriptor is redirected, restored or replaced by exec
+ * - Before the shell blocks reading input (read, mapfile, the next line)
+ * - Before a built-in that prints through stdio runs, and when the shell
+ *   leaves
+ *
+ * Output written through stdio (by other built-ins) is flushed before
+ * data is added to a buffer, so the two never hold data at the same time
+ * and output keeps its order.
+ *
+ * Pipeline Stages:
+ * A built-in that is a stage of a pipeline runs in a child that exits as
+ * soon as it finishes. There, writes of at least SPLICE_MIN_LENGTH bytes
+ * to a pipe are handed over with vmsplice(2) (see outputSplice()): the
+ * pipe references the memory holding the data instead of copying it.
+ * This is only safe because the child never modifies that memory again,
+ * and the parent's copy of shared pages is copied on its next write.
+ *
+ * Fused stages (see Fuse.c) run as threads of the shell and write their
+ * standard output to their ring, or through a buffer of their own, never
+ * through the buffers above.
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <stdio_ext.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static OutputBuffer outputs[SHELL_FD_BASE];
+static int pendingOutputs;
+static int spliceOutputs;
+
+/**
+ * @brief Writes a list of buffers completely
+ * @param fd The descriptor
+ * @param vector The buffers (modified while writing)
+ * @param count Number of buffers
+ * @param splice Non-zero to hand the buffers to a pipe with vmsplice()
+ * @return 0 on success, -1 on failure
+ *
+ * If vmsplice() is refused, the rest is written with writev().
+ */
+static int writeVector(int fd, struct iovec * vector, int count, int splice) {
+    while (count > 0) {
+        ssize_t written = splice ? vmsplice(fd, vector, count, 0) : writev(fd, vector, count);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (splice) {
+                splice = 0;
+                continue;
+            }
+            if (errno != EPIPE || currentStage() == NULL) {
+                perror("write");
+            }
+            return -1;
+        }
+
+        while (count > 0 && (size_t) written >= vector->iov_len) {
+            written -= vector->iov_len;
+            vector++;
+            count--;
+        }
+        if (count > 0) {
+            vector->iov_base = (char *) vector->iov_base + written;
+            vector->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the content of an output buffer, followed by more data
+ * @param fd The descriptor
+ * @param output Pointer to the OutputBuffer, emptied
+ * @param data Data to write after the buffer, or NULL
+ * @param length Length of data
+ * @return 0 on success, -1 on failure (the buffered data is dropped)
+ */
+static int writeBuffer(int fd, OutputBuffer * output, const char * data, size_t length) {
+    struct iovec vector[2];
+    int count = 0;
+
+    if (output->length > 0) {
+        vector[count].iov_base = output->data;
+        vector[count++].iov_len = output->length;
+        output->length = 0;
+    }
+    if (length > 0) {
+        vector[count].iov_base = (char *) data;
+        vector[count++].iov_len = length;
+    }
+    return writeVector(fd, vector, count, 0);
+}
+
+/**
+ * @brief Adds data to an output buffer, writing the buffer out when full
+ * @param fd The descriptor the buffer belongs to
+ * @param output Pointer to the OutputBuffer
+ * @param data The data
+ * @param length Length of the data
+ * @return 0 on success, -1 if writing failed
+ */
+static int bufferOutput(int fd, OutputBuffer * output, const char * data, size_t length) {
+    if (output->data == NULL) {
+        output->data = malloc(OUTPUT_BUFFER_SIZE);
+        if (output->data == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (output->length + length > OUTPUT_BUFFER_SIZE) {
+        return writeBuffer(fd, output, data, length);
+    }
+
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    return 0;
+}
+
+/**
+ * @brief Writes the buffered output of a descriptor, followed by more data
+ * @param fd The descriptor
+ * @param data Data to write after the buffer, or NULL
+ * @param length Length of data
+ * @return 0 on success, -1 on failure (the buffered data is dropped)
+ */
+static int flushDescriptor(int fd, const char * data, size_t length) {
+    if (outputs[fd].length > 0) {
+        pendingOutputs--;
+    }
+    return writeBuffer(fd, &outputs[fd], data, length);
+}
+
+/**
+ * @brief Writes the output of a fused stage (see Fuse.c)
+ * @param stage Pointer to the StageIO of the stage
+ * @param data The data
+ * @param length Length of the data
+ * @return 0 on success, -1 if the next stage has finished or writing failed
+ *
+ * A ring is written directly, since it already collects the data without
+ * a system call. A descriptor gets the stage's own buffer, as the shell's
+ * buffers belong to the main thread.
+ */
+static int writeStage(StageIO * stage, const char * data, size_t length) {
+    if (stage->output != NULL) {
+        return ringWrite(stage->output, data, length);
+    }
+    return bufferOutput(stage->outputFd, &stage->buffer, data, length);
+}
+
+/**
+ * @brief Writes out and frees the buffered output of a fused stage
+ * @param stage Pointer to the StageIO of the stage
+ */
+void flushStageOutput(StageIO * stage) {
+    if (stage->buffer.length > 0) {
+        writeBuffer(stage->outputFd, &stage->buffer, NULL, 0);
+    }
+    free(stage->buffer.data);
+    stage->buffer.data = NULL;
+}
+
+/**
+ * @brief Writes built-in output to a descriptor through its buffer
+ * @param fd The descriptor
+ * @param data The data
+ * @param length Length of the data
+ * @return 0 on success, -1 if writing failed
+ *
+ * Descriptors outside the range of exec redirections are written directly.
+ * In a fused stage, standard output goes to the stage's ring or descriptor.
+ */
+int outputWrite(int fd, const char * data, size_t length) {
+    StageIO * stage = currentStage();
+    if (stage != NULL && fd == STDOUT_FILENO) {
+        return writeStage(stage, data, length);
+    }
+
+    if (stage == NULL && __fpending(stdout) > 0) {
+        fflush(stdout);
+    }
+    if (fd < 0 || fd >= SHELL_FD_BASE || stage != NULL) {
+        struct iovec vector = { (char *) data, length };
+        return writeVector(fd, &vector, 1, 0);
+    }
+
+    OutputBuffer * output = &outputs[fd];
+    int pending = output->length > 0;
+    int ret = bufferOutput(fd, output, data, length);
+    pendingOutputs += (output->length > 0) - pending;
+    return ret;
+}
+
+/**
+ * @brief Writes output that stays unchanged until the process exits
+ * @param fd The descriptor
+ * @param data The data, which the caller must neither modify nor free
+ *             if 1 is returned
+ * @param length Length of the data
+ * @return 1 if the data was handed to a pipe with vmsplice(), 0 if it was
+ *         written or buffered by outputWrite(), -1 if writing failed
+ *
+ * Splicing is only used after enableOutputSplice(), for at least
+ * SPLICE_MIN_LENGTH bytes going to a pipe. Smaller writes are cheaper to
+ * copy than to map into the pipe.
+ */
+int outputSplice(int fd, const char * data, size_t length) {
+    struct stat info;
+    if (!spliceOutputs || length < SPLICE_MIN_LENGTH || fd < 0 || fd >= SHELL_FD_BASE ||
+        fstat(fd, &info) == -1 || !S_ISFIFO(info.st_mode)) {
+        return outputWrite(fd, data, length);
+    }
+
+    if (__fpending(stdout) > 0) {
+        fflush(stdout);
+    }
+    if (outputs[fd].length > 0 && flushDescriptor(fd, NULL, 0) == -1) {
+        return -1;
+    }
+
+    struct iovec vector = { (char *) data, length };
+    return writeVector(fd, &vector, 1, 1) == 0 ? 1 : -1;
+}
+
+/**
+ * @brief Lets outputSplice() hand data to pipes with vmsplice()
+ *
+ * Called in the child running a built-in pipeline stage, which exits
+ * right after the built-in without touching its memory again.
+ */
+void enableOutputSplice() {
+    spliceOutputs = 1;
+}
+
+/**
+ * @brief Writes out all buffered output, including stdio's standard output
+ */
+void flushBuiltinOutput() {
+    fflush(stdout);
+    for (int fd = 0; fd < SHELL_FD_BASE && pendingOutputs > 0; fd++) {
+        if (outputs[fd].length > 0) {
+            flushDescriptor(fd, NULL, 0);
+        }
+    }
+}
+
+/**
+ * @brief Prints a diagnostic to standard error after pending output
+ * @param format printf() format of the message
+ *
+ * Built-in output written before the error is flushed first, so the two
+ * appear in the order the script produced them. A fused stage has no
+ * buffers of the shell's to flush.
+ */
+void printError(const char * format, ...) {
+    if (currentStage() == NULL) {
+        flushBuiltinOutput();
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+}
+
+/**
+ * @brief Appends a string to a Buffer, interpreting backslash escapes
+ * @param out Pointer to the Buffer
+ * @param text The string
+ * @return 1 if a \c escape asks to stop all further output, 0 otherwise
+ *
+ * Supports \a \b \e \f \n \r \t \v \\, \0nnn (octal) and \c.
+ */
+static int appendEscaped(Buffer * out, const char * text) {
+    for (const char * p = text; *p != '\0'; p++) {
+        if (*p != '\\' || p[1] == '\0') {
+            bufferAppend(out, p, 1);
+            continue;
+        }
+
+        char c;
+        switch (*++p) {
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'e': c = 27; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'v': c = '\v'; break;
+            case '\\': c = '\\'; break;
+            case 'c': return 1;
+            case '0': {
+                int value = 0;
+                for (int i = 0; i < 3 && p[1] >= '0' && p[1] <= '7'; i++) {
+                    value = value * 8 + (*++p - '0');
+                }
+                c = (char) value;
+                break;
+            }
+            default:
+                bufferAppend(out, p - 1, 1);
+                c = *p;
+                break;
+        }
+        bufferAppend(out, &c, 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief Handles the built-in echo command
+ * @param curr Pointer to the Command structure containing echo arguments
+ * @return 0 on success, -1 if writing failed
+ *
+ * Usage: echo [-neE] [arg ...]
+ *
+ * Prints the arguments separated by spaces and followed by a newline.
+ * -n omits the newline, -e interprets backslash escapes and -E (the
+ * default) does not.
+ */
+int handleEcho(Command * curr) {
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+
+    for (; i < curr->argCount && curr->args[i][0] == '-' && curr->args[i][1] != '\0'; i++) {
+        const char * flags = curr->args[i] + 1;
+        if (flags[strspn(flags, "neE")] != '\0') {
+            break;
+        }
+        for (; *flags != '\0'; flags++) {
+            newline = newline && *flags != 'n';
+            escapes = *flags == 'e' ? 1 : *flags == 'E' ? 0 : escapes;
+        }
+    }
+
+    if (!escapes) {
+        int ret = 0;
+        for (int first = i; i < curr->argCount && ret == 0; i++) {
+            if (i > first) {
+                ret = outputWrite(STDOUT_FILENO, " ", 1);
+            }
+            if (ret == 0) {
+                ret = outputSplice(STDOUT_FILENO, curr->args[i], strlen(curr->args[i])) == -1 ? -1 : 0;
+            }
+        }
+        return ret == 0 && newline ? outputWrite(STDOUT_FILENO, "\n", 1) : ret;
+    }
+
+    Buffer text;
+    memset(&text, 0, sizeof(Buffer));
+    bufferAppend(&text, "", 0);
+    int stop = 0;
+    for (int first = i; i < curr->argCount && !stop; i++) {
+        if (i > first) {
+            bufferAppend(&text, " ", 1);
+        }
+        stop = appendEscaped(&text, curr->args[i]);
+    }
+    if (newline && !stop) {
+        bufferAppend(&text, "\n", 1);
+    }
+
+    int ret = outputSplice(STDOUT_FILENO, text.data, text.length);
+    if (ret != 1) {
+        free(text.data);
+    }
+    return ret == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Appends printf-style formatted text to a Buffer
+ * @param out Pointer to the Buffer
+ * @param format The format
+ */
+static void appendFormatted(Buffer * out, const char * format, ...) {
+    char small[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t) length < sizeof(small)) {
+        bufferAppend(out, small, length);
+        return;
+    }
+
+    char * large = malloc(length + 1);
+    if (large == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    va_start(args, format);
+    vsnprintf(large, length + 1, format, args);
+    va_end(args);
+    bufferAppend(out, large, length);
+    free(large);
+}
+
+/**
+ * @brief Formats one conversion of printf
+ * @param out Pointer to the Buffer receiving the text
+ * @param spec The conversion specification without its conversion
+ *        character, such as "%-10" or "%05"
+ * @param conversion The conversion character
+ * @param arg The argument, or NULL if the arguments ran out
+ * @return 0 on success, -1 if a numeric argument was invalid, 1 if a %b
+ *         argument contained \c
+ */
+static int formatConversion(Buffer * out, const char * spec, char conversion, const char * arg) {
+    char format[PRINTF_SPEC_MAX + 4];
+    if (conversion == 's' || conversion == 'b') {
+        int stop = 0;
+        Buffer text;
+        memset(&text, 0, sizeof(Buffer));
+        bufferAppend(&text, "", 0);
+        if (conversion == 'b') {
+            stop = appendEscaped(&text, arg != NULL ? arg : "");
+        } else {
+            bufferAppend(&text, arg != NULL ? arg : "", arg != NULL ? strlen(arg) : 0);
+        }
+        snprintf(format, sizeof(format), "%ss", spec);
+        appendFormatted(out, format, text.data);
+        free(text.data);
+        return stop;
+    }
+
+    if (conversion == 'c') {
+        snprintf(format, sizeof(format), "%sc", spec);
+        appendFormatted(out, format, arg != NULL && arg[0] != '\0' ? arg[0] : '\0');
+        return 0;
+    }
+
+    char * end = NULL;
+    int ret = 0;
+    if (strchr("eEfgG", conversion) != NULL) {
+        double value = arg != NULL ? strtod(arg, &end) : 0;
+        if (arg != NULL && (end == arg || *end != '\0')) {
+            printError(ERROR_PRINTF_NUMBER, arg);
+            ret = -1;
+        }
+        snprintf(format, sizeof(format), "%s%c", spec, conversion);
+        appendFormatted(out, format, value);
+        return ret;
+    }
+
+    long long value = 0;
+    if (arg != NULL) {
+        errno = 0;
+        value = strchr("diu", conversion) != NULL && arg[0] == '-' ? strtoll(arg, &end, 0)
+                                                                    : (long long) strtoull(arg, &end, 0);
+        if (end == arg || *end != '\0' || errno == ERANGE) {
+            printError(ERROR_PRINTF_NUMBER, arg);
+            ret = -1;
+        }
+    }
+    snprintf(format, sizeof(format), "%sll%c", spec, conversion);
+    appendFormatted(out, format, value);
+    return ret;
+}
+
+/**
+ * @brief Handles the built-in printf command
+ * @param curr Pointer to the Command structure containing printf arguments
+ * @return 0 on success, -1 on a usage error, an invalid number or a
+ *         failed write
+ *
+ * Usage: printf format [arg ...]
+ *
+ * The format supports backslash escapes and the conversions %s, %b
+ * (argument with escapes), %c, %d, %i, %u, %o, %x, %X, %e, %E, %f, %g,
+ * %G and %%, with flags, width and precision. The format is reused while
+ * arguments remain; missing arguments count as empty or zero.
+ */
+int handlePrintf(Command * curr) {
+    if (curr->argCount < 2) {
+        printError(ERROR_PRINTF_USAGE);
+        return -1;
+    }
+
+    const char * format = curr->args[1];
+    int argIndex = 2;
+    int ret = 0;
+    int stop = 0;
+
+    Buffer text;
+    memset(&text, 0, sizeof(Buffer));
+    bufferAppend(&text, "", 0);
+
+    do {
+        int used = argIndex;
+        for (const char * p = format; *p != '\0' && !stop; p++) {
+            if (*p == '\\') {
+                size_t length = p[1] == '\0' ? 1 : p[1] == '0' ? 2 + strspn(p + 2, "01234567") : 2;
+                length = length > 5 ? 5 : length;
+                char escape[6];
+                memcpy(escape, p, length);
+                escape[length] = '\0';
+                stop = appendEscaped(&text, escape);
+                p += length - 1;
+                continue;
+            }
+            if (*p != '%') {
+                bufferAppend(&text, p, 1);
+                continue;
+            }
+            if (p[1] == '%') {
+                bufferAppend(&text, "%", 1);
+                p++;
+                continue;
+            }
+
+            size_t length = 1 + strspn(p + 1, "-+ #0");
+            length += strspn(p + length, "0123456789");
+            if (p[length] == '.') {
+                length += 1 + strspn(p + length + 1, "0123456789");
+            }
+            if (p[length] == '\0' || strchr("sbcdiuoxXeEfgG", p[length]) == NULL || length > PRINTF_SPEC_MAX) {
+                printError(ERROR_PRINTF_FORMAT, p);
+                free(text.data);
+                return -1;
+            }
+
+            char spec[PRINTF_SPEC_MAX + 1];
+            memcpy(spec, p, length);
+            spec[length] = '\0';
+            const char * arg = argIndex < curr->argCount ? curr->args[argIndex++] : NULL;
+            int result = formatConversion(&text, spec, p[length], arg);
+            ret = result == -1 ? -1 : ret;
+            stop = result == 1;
+            p += length;
+        }
+
+        if (argIndex == used) {
+            break;
+        }
+    } while (argIndex < curr->argCount && !stop);
+
+    int spliced = outputSplice(STDOUT_FILENO, text.data, text.length);
+    if (spliced == -1) {
+        ret = -1;
+    }
+    if (spliced != 1) {
+        free(text.data);
+    }
+    return ret;
+}
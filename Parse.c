@@ -12,12 +12,251 @@
  * - Pipeline separation (|)
  * - Input/output redirection parsing (<, >, >>)
  * - Environment variable substitution ($VAR)
- * - Variable assignment (VAR=value)
+ * - Array expansion (${a[i]}, ${a[@]}, ${#a[@]}, ${!a[@]})
+ * - Variable assignment (VAR=value, a[i]=value, a=(x y z))
+ * - Brace expansion ({a,b}, {1..10})
+ * - Pathname expansion (*.c, [a-z]?.h, recursive ** components)
+ * - Stage scheduling prefixes (pin, nice, ionice)
  * - Argument validation and error handling
  */
 
 #include "SnailShell.h"
 
+/**
+ * @struct Expansion
+ * @brief State of the expansion of a single argument
+ * 
+ * Expanding ${a[@]} can turn one argument into several words. Completed
+ * words are collected in words; in joined mode (used by replace()) the
+ * elements are instead joined into the current word.
+ */
+typedef struct Expansion {
+    Buffer word;
+    char ** words;
+    int count;
+    int capacity;
+    int joined;
+    int vanish;
+} Expansion;
+
+/**
+ * @brief Appends bytes to a buffer, growing it as needed
+ * @param buffer Pointer to the Buffer
+ * @param data Bytes to append
+ * @param length Number of bytes to append
+ * 
+ * The buffer is always kept NUL-terminated.
+ */
+void bufferAppend(Buffer * buffer, const char * data, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity == 0 ? 64 : buffer->capacity;
+        while (buffer->length + length + 1 > capacity) {
+            capacity *= 2;
+        }
+
+        buffer->data = realloc(buffer->data, capacity);
+        if (buffer->data == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        buffer->capacity = capacity;
+    }
+
+    if (length > 0) {
+        memcpy(buffer->data + buffer->length, data, length);
+    }
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+/**
+ * @brief Appends a word to a growable, NULL-terminated word array
+ * @param words Pointer to the word array
+ * @param count Pointer to the number of words
+ * @param capacity Pointer to the capacity of the array
+ * @param word The word to append (ownership is taken)
+ * 
+ * The array always has room for a terminating NULL after the last word,
+ * so it can be passed to execvp() directly.
+ */
+void appendWord(char *** words, int * count, int * capacity, char * word) {
+    if (*count + 1 >= *capacity) {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        *words = realloc(*words, sizeof(char *) * *capacity);
+        if (*words == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    (*words)[(*count)++] = word;
+    (*words)[*count] = NULL;
+}
+
+/**
+ * @brief Appends an argument to a command
+ * @param command Pointer to the Command structure
+ * @param arg The argument (ownership is taken)
+ */
+void appendArg(Command * command, char * arg) {
+    appendWord(&command->args, &command->argCount, &command->argCapacity, arg);
+}
+
+/**
+ * @brief Checks whether a string is a valid variable name
+ * @param name The candidate name
+ * @return Non-zero if name is non-empty and contains only letters and underscores
+ */
+int isValidName(const char * name) {
+    if (name == NULL || *name == '\0') {
+        return 0;
+    }
+
+    for (int i = 0; name[i] != '\0'; i++) {
+        if (!isalpha(name[i]) && name[i] != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Resolves the subscript of an indexed array
+ * @param array Pointer to the Array
+ * @param subscript The subscript text (variables are expanded)
+ * @param index Pointer to store the resolved index
+ * @return 0 on success, -1 if the subscript is not a valid index
+ * 
+ * Negative subscripts count back from the end of the array.
+ */
+static int resolveIndex(Array * array, const char * subscript, size_t * index) {
+    char * text = replace(subscript);
+    char * end;
+    long value = strtol(text, &end, 10);
+    int valid = *text != '\0' && *end == '\0';
+    free(text);
+
+    if (!valid) {
+        printError(ERROR_ARRAY_SUBSCRIPT, subscript);
+        return -1;
+    }
+
+    if (value < 0) {
+        long count = array != NULL ? (long) array->count : 0;
+        if (value + count < 0) {
+            printError(ERROR_ARRAY_SUBSCRIPT, subscript);
+            return -1;
+        }
+        value += count;
+    }
+
+    *index = (size_t) value;
+    return 0;
+}
+
+/**
+ * @brief Assigns a single array element
+ * @param name The array name
+ * @param subscript The subscript text (variables are expanded)
+ * @param value The value to assign
+ * @return 0 on success, -1 on failure
+ * 
+ * Creates an indexed array if no array of that name exists.
+ */
+static int assignElement(const char * name, const char * subscript, const char * value) {
+    Array * array = findArray(name);
+    if (array == NULL) {
+        array = createArray(name, ARRAY_INDEXED);
+    }
+
+    if (array->type == ARRAY_ASSOCIATIVE) {
+        char * key = replace(subscript);
+        arraySetKey(array, key, strlen(key), value, strlen(value));
+        free(key);
+        return 0;
+    }
+
+    size_t index;
+    if (resolveIndex(array, subscript, &index) == -1) {
+        return -1;
+    }
+    return arraySetIndex(array, index, value, strlen(value));
+}
+
+/**
+ * @brief Assigns a whole array from a parenthesized list
+ * @param name The array name
+ * @param list The text between the parentheses
+ * @return 0 on success, -1 on failure
+ * 
+ * Words are separated by blanks. "[subscript]=value" words set a specific
+ * element; other words are appended after the highest index, and
+ * ${other[@]} copies every element of another array and a glob adds
+ * every matching path. An existing associative array keeps its type,
+ * anything else becomes indexed.
+ *
+ * Every word is expanded before the old value is dropped, so the list may
+ * refer to the variable being assigned, as in a=(${a[@]} 4).
+ */
+static int assignCompound(const char * name, const char * list) {
+    Array * existing = findArray(name);
+    int type = existing != NULL ? existing->type : ARRAY_INDEXED;
+
+    char * listCopy = strdup(list);
+    if (listCopy == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    char ** values = NULL;
+    int valueCount = 0;
+    int valueCapacity = 0;
+    char ** subscripts = NULL;
+    int subscriptCount = 0;
+    int subscriptCapacity = 0;
+
+    int ret = 0;
+    char * tokenPtr;
+    char * token = strtok_r(listCopy, " \t", &tokenPtr);
+    while (token != NULL && ret == 0) {
+        char * close = token[0] == '[' ? strstr(token, "]=") : NULL;
+        if (close != NULL) {
+            *close = '\0';
+            appendWord(&values, &valueCount, &valueCapacity, replace(close + 2));
+            appendWord(&subscripts, &subscriptCount, &subscriptCapacity, token + 1);
+        } else if (type == ARRAY_ASSOCIATIVE) {
+            printError(ERROR_ARRAY_KEY_MISSING, token);
+            ret = -1;
+        } else {
+            expandArgument(token, &values, &valueCount, &valueCapacity);
+            while (subscriptCount < valueCount) {
+                appendWord(&subscripts, &subscriptCount, &subscriptCapacity, NULL);
+            }
+        }
+        token = strtok_r(NULL, " \t", &tokenPtr);
+    }
+
+    if (ret == 0) {
+        unsetenv(name);
+        Array * array = createArray(name, type);
+        for (int i = 0; i < valueCount && ret == 0; i++) {
+            if (subscripts[i] != NULL) {
+                ret = assignElement(name, subscripts[i], values[i]);
+            } else {
+                arrayAppend(array, values[i], strlen(values[i]));
+            }
+        }
+    }
+
+    for (int i = 0; i < valueCount; i++) {
+        free(values[i]);
+    }
+    free(values);
+    free(subscripts);
+    free(listCopy);
+    return ret;
+}
+
 /**
  * @brief Handles environment variable assignment
  * @param currLine The current input line containing the assignment
@@ -27,6 +266,12 @@
  * Parses and validates environment variable assignments in the format VAR=value.
  * Validates that variable names contain only letters and underscores.
  * Sets the environment variable using setenv() and handles memory allocation.
+ * Variable references in the value are expanded first.
+ * 
+ * Array Forms:
+ * - name[subscript]=value: Sets one element (creating an indexed array)
+ * - name=(a b [k]=v): Replaces the whole array
+ * - name=value on an existing array: Sets element 0 (key "0")
  * 
  * Memory Management:
  * - Allocates memory for variable name and value
@@ -41,32 +286,277 @@ int handleVariableAssignment(const char * currLine, char * equalSign) {
         exit(EXIT_FAILURE);
     }
 
-    char * value = strdup(equalSign + 1);
-    if (value == NULL) {
-        perror("strdup");
+    char * subscript = NULL;
+    char * bracket = strchr(name, '[');
+    if (bracket != NULL && nameLength > 0 && name[nameLength - 1] == ']') {
+        *bracket = '\0';
+        name[nameLength - 1] = '\0';
+        subscript = bracket + 1;
+    }
+
+    if (!isValidName(name)) {
+        printError(ERROR_VAR_INVALID, name);
         free(name);
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
-    for (int i = 0; name[i] != '\0'; i++) {
-        if (!isalpha(name[i]) && name[i] != '_') {
-            fprintf(stderr, ERROR_VAR_INVALID, name);
-            free(name);
-            free(value);
-            return -1;
+    const char * valueText = equalSign + 1;
+    size_t valueLength = strlen(valueText);
+    int ret;
+
+    if (subscript == NULL && valueText[0] == '(' && valueLength > 1 && valueText[valueLength - 1] == ')') {
+        char * list = strndup(valueText + 1, valueLength - 2);
+        if (list == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
         }
+        ret = assignCompound(name, list);
+        free(list);
+        free(name);
+        return ret;
     }
 
-    if (setenv(name, value, 1) == -1) {
+    char * value = replace(valueText);
+    if (subscript != NULL) {
+        ret = assignElement(name, subscript, value);
+    } else if (findArray(name) != NULL) {
+        ret = assignElement(name, "0", value);
+    } else if ((ret = setenv(name, value, 1)) == -1) {
         perror("setenv");
-        free(name);
-        free(value);
-        return -1;
     }
 
     free(name);
     free(value);
-    return 0;
+    return ret;
+}
+
+/**
+ * @brief Completes the current word of an expansion
+ * @param expansion Pointer to the Expansion
+ */
+static void finishWord(Expansion * expansion) {
+    char * word = strdup(expansion->word.data != NULL ? expansion->word.data : "");
+    if (word == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    appendWord(&expansion->words, &expansion->count, &expansion->capacity, word);
+
+    expansion->word.length = 0;
+    if (expansion->word.data != NULL) {
+        expansion->word.data[0] = '\0';
+    }
+}
+
+/**
+ * @brief Appends one of several values produced by a reference
+ * @param expansion Pointer to the Expansion
+ * @param first Whether this is the first value of the reference
+ * @param separate Whether values become separate words (the [@] forms)
+ * @param data Start of the value
+ * @param length Length of the value
+ * 
+ * Separate values end the current word, as in "x${a[@]}y" expanding to
+ * "xA", "B", "Cy". Joined values are separated by the first character of
+ * IFS.
+ */
+static void appendValue(Expansion * expansion, int first, int separate, const char * data, size_t length) {
+    if (!first) {
+        if (separate && !expansion->joined) {
+            finishWord(expansion);
+        } else {
+            const char * ifs = getenv("IFS");
+            if (ifs == NULL) {
+                ifs = DEFAULT_IFS;
+            }
+            bufferAppend(&expansion->word, ifs, *ifs != '\0' ? 1 : 0);
+        }
+    }
+    bufferAppend(&expansion->word, data, length);
+}
+
+/**
+ * @brief Appends a number to the current word of an expansion
+ * @param expansion Pointer to the Expansion
+ * @param number The number to append
+ */
+static void appendNumber(Expansion * expansion, size_t number) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%zu", number);
+    bufferAppend(&expansion->word, text, length);
+}
+
+/**
+ * @brief Looks up a single value of an array or scalar variable
+ * @param name The variable name
+ * @param subscript The subscript text, or NULL for the plain name
+ * @param length Pointer to store the length of the value
+ * @return The value (not necessarily NUL-terminated), or NULL if unset
+ * 
+ * A plain name refers to an environment variable, or to element 0 (key
+ * "0") when an array of that name exists.
+ */
+static const char * lookupValue(const char * name, const char * subscript, size_t * length) {
+    const char * value = NULL;
+    Array * array = findArray(name);
+
+    if (array == NULL) {
+        if (subscript == NULL || strcmp(subscript, "0") == 0) {
+            value = getenv(name);
+            if (value != NULL) {
+                *length = strlen(value);
+            }
+        }
+        return value;
+    }
+
+    if (array->type == ARRAY_ASSOCIATIVE) {
+        char * key = replace(subscript != NULL ? subscript : "0");
+        if (arrayGetKey(array, key, strlen(key), &value, length) == -1) {
+            value = NULL;
+        }
+        free(key);
+        return value;
+    }
+
+    size_t index = 0;
+    if (subscript != NULL && resolveIndex(array, subscript, &index) == -1) {
+        return NULL;
+    }
+    if (arrayGet(array, index, &value, length) == -1) {
+        value = NULL;
+    }
+    return value;
+}
+
+/**
+ * @brief Expands a single variable reference into an expansion
+ * @param expr The reference without '$' and braces
+ * @param length Length of the reference
+ * @param expansion Pointer to the Expansion
+ * 
+ * Supported Forms:
+ * - VAR, array[subscript]: Single value
+ * - array[@], array[*]: All values (separate words or joined)
+ * - #VAR, #array[subscript]: Length of a value
+ * - #array[@], #array[*]: Number of set elements
+ * - !array[@], !array[*]: Indices or keys of the set elements
+ */
+static void expandReference(const char * expr, size_t length, Expansion * expansion) {
+    char operator = '\0';
+    if (length > 1 && (expr[0] == '#' || expr[0] == '!')) {
+        operator = expr[0];
+        expr++;
+        length--;
+    }
+
+    size_t nameLength = 0;
+    while (nameLength < length && (isalpha((unsigned char) expr[nameLength]) || expr[nameLength] == '_')) {
+        nameLength++;
+    }
+
+    char * subscript = NULL;
+    if (nameLength + 2 <= length && expr[nameLength] == '[' && expr[length - 1] == ']') {
+        subscript = strndup(expr + nameLength + 1, length - nameLength - 2);
+        if (subscript == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+    } else if (nameLength != length) {
+        printError(ERROR_BAD_SUBSTITUTION, (int) length, expr);
+        return;
+    }
+
+    if (nameLength == 0 || (operator == '!' && subscript == NULL)) {
+        printError(ERROR_BAD_SUBSTITUTION, (int) length, expr);
+        free(subscript);
+        return;
+    }
+
+    char * name = strndup(expr, nameLength);
+    if (name == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    int all = subscript != NULL && (strcmp(subscript, "@") == 0 || strcmp(subscript, "*") == 0);
+    int separate = all && subscript[0] == '@';
+    Array * array = findArray(name);
+
+    if (all && array != NULL && operator != '#') {
+        size_t cursor = 0;
+        ArrayItem item;
+        int first = 1;
+        while (arrayNext(array, &cursor, &item) == 0) {
+            if (operator == '!' && item.key == NULL) {
+                char text[32];
+                int textLength = snprintf(text, sizeof(text), "%zu", item.index);
+                appendValue(expansion, first, separate, text, textLength);
+            } else if (operator == '!') {
+                appendValue(expansion, first, separate, item.key, item.keyLength);
+            } else {
+                appendValue(expansion, first, separate, item.data, item.length);
+            }
+            first = 0;
+        }
+        if (first && separate) {
+            expansion->vanish = 1;
+        }
+    } else if (all && operator == '#') {
+        appendNumber(expansion, array != NULL ? arrayLength(array) : getenv(name) != NULL);
+    } else if (operator == '!') {
+        if (getenv(name) != NULL) {
+            bufferAppend(&expansion->word, "0", 1);
+        }
+    } else {
+        size_t valueLength = 0;
+        const char * value = lookupValue(name, all ? NULL : subscript, &valueLength);
+        if (operator == '#') {
+            appendNumber(expansion, value != NULL ? valueLength : 0);
+        } else if (value != NULL) {
+            bufferAppend(&expansion->word, value, valueLength);
+        }
+    }
+
+    free(name);
+    free(subscript);
+}
+
+/**
+ * @brief Expands every variable reference of an argument
+ * @param arg The argument text
+ * @param expansion Pointer to the Expansion to fill
+ * 
+ * A '$' that does not start a name or a braced reference is kept as is.
+ */
+static void expandText(const char * arg, Expansion * expansion) {
+    const char * p = arg;
+    while (*p != '\0') {
+        const char * dollar = strchr(p, '$');
+        if (dollar == NULL) {
+            bufferAppend(&expansion->word, p, strlen(p));
+            break;
+        }
+
+        bufferAppend(&expansion->word, p, dollar - p);
+        p = dollar;
+
+        if (p[1] == '{' && strchr(p + 2, '}') != NULL) {
+            const char * close = strchr(p + 2, '}');
+            expandReference(p + 2, close - (p + 2), expansion);
+            p = close + 1;
+        } else if (isalpha((unsigned char) p[1]) || p[1] == '_') {
+            size_t nameLength = 1;
+            while (isalpha((unsigned char) p[1 + nameLength]) || p[1 + nameLength] == '_') {
+                nameLength++;
+            }
+            expandReference(p + 1, nameLength, expansion);
+            p += 1 + nameLength;
+        } else {
+            bufferAppend(&expansion->word, p, 1);
+            p++;
+        }
+    }
 }
 
 /**
@@ -74,9 +564,11 @@ int handleVariableAssignment(const char * currLine, char * equalSign) {
  * @param arg The argument string that may contain $VAR references
  * @return New string with variables substituted, or original string if no substitution needed
  * 
- * Performs environment variable substitution. If the argument starts with '$',
- * it extracts the variable name and looks up its value in the environment.
- * Returns the variable's value if found, or an empty string if not found.
+ * Performs environment variable substitution. Every '$' followed by a
+ * variable name or a braced reference is replaced by the variable's value,
+ * or by an empty string if the variable is not found. A '$' that does not
+ * start a reference is kept as is. Multiple values (${a[@]}) are joined
+ * with the first character of IFS.
  * 
  * Memory Management:
  * - Allocates new memory for the substituted string
@@ -84,28 +576,57 @@ int handleVariableAssignment(const char * currLine, char * equalSign) {
  * - Handles memory allocation failures by calling exit()
  */
 char * replace(const char * arg) {
-    char * newArg = NULL;
-    if (arg == NULL || *arg != '$') {
-        newArg = strdup(arg);
-        if (newArg == NULL) {
-            perror("strdup");
-            exit(EXIT_FAILURE);
-        }
-        return newArg;
-    }
+    Expansion expansion;
+    memset(&expansion, 0, sizeof(Expansion));
+    expansion.joined = 1;
+
+    expandText(arg != NULL ? arg : "", &expansion);
+    bufferAppend(&expansion.word, "", 0);
+    return expansion.word.data;
+}
 
-    const char * varName = arg + 1;
-    const char * value = getenv(varName);
-    if (value == NULL) {
-        value = "";
+/**
+ * @brief Expands an argument into one or more words
+ * @param arg The argument text
+ * @param words Pointer to the growable word array receiving the words
+ * @param count Pointer to the number of words, advanced
+ * @param capacity Pointer to the capacity of the word array
+ * 
+ * Brace expressions are expanded first, then variable references in each
+ * resulting word. ${array[@]} produces one word per element; a word
+ * consisting only of such a reference to an empty array produces no word
+ * at all. Every word containing wildcards is finally replaced by the
+ * sorted paths it matches, or kept unchanged if it matches nothing.
+ */
+void expandArgument(const char * arg, char *** words, int * count, int * capacity) {
+    char ** braced = NULL;
+    int bracedCount = 0;
+    int bracedCapacity = 0;
+    expandBraces(arg, &braced, &bracedCount, &bracedCapacity);
+
+    Expansion expansion;
+    memset(&expansion, 0, sizeof(Expansion));
+    for (int i = 0; i < bracedCount; i++) {
+        expandText(braced[i], &expansion);
+        if (expansion.word.length > 0 || !expansion.vanish) {
+            finishWord(&expansion);
+        }
+        expansion.word.length = 0;
+        expansion.vanish = 0;
+        free(braced[i]);
     }
+    free(braced);
+    free(expansion.word.data);
 
-    newArg = strdup(value);
-    if (newArg == NULL) {
-        perror("strdup");
-        exit(EXIT_FAILURE);
+    for (int i = 0; i < expansion.count; i++) {
+        char * word = expansion.words[i];
+        if (hasWildcards(word) && expandGlob(word, words, count, capacity) > 0) {
+            free(word);
+        } else {
+            appendWord(words, count, capacity, word);
+        }
     }
-    return newArg;
+    free(expansion.words);
 }
 
 /**
@@ -115,23 +636,202 @@ char * replace(const char * arg) {
  * Iterates through all arguments in the command and replaces any
  * environment variable references ($VAR) with their actual values.
  * Frees the original argument strings and replaces them with the
- * substituted versions.
+ * substituted versions. Array references such as ${a[@]} and globs such
+ * as *.c may expand one argument into several, so the argument array is
+ * rebuilt. Redirection targets are expanded as well, but not globbed.
  * 
  * Memory Management:
- * - Frees original argument strings after substitution
+ * - Frees original argument strings and array after substitution
  * - Replaces with new substituted strings
  * - Handles NULL arguments gracefully
  */
 void substitute(Command * command) {
-    if (command != NULL) {
-        for (int i = 0; i < command->argCount; i++) {
-            char * newArg = replace(command->args[i]);
-            if (command->args[i] != NULL) {
-                free(command->args[i]);
-            }
-            command->args[i] = newArg;
+    if (command == NULL) {
+        return;
+    }
+
+    char ** words = NULL;
+    int count = 0;
+    int capacity = 0;
+
+    for (int i = 0; i < command->argCount; i++) {
+        if (command->args[i] != NULL) {
+            expandArgument(command->args[i], &words, &count, &capacity);
+            free(command->args[i]);
+        }
+    }
+
+    free(command->args);
+    command->args = words;
+    command->argCount = count;
+    command->argCapacity = capacity;
+
+    char ** targets[] = { &command->input, &command->output };
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        if (*targets[i] != NULL) {
+            char * expanded = replace(*targets[i]);
+            free(*targets[i]);
+            *targets[i] = expanded;
+        }
+    }
+}
+
+/**
+ * @struct PipelineParser
+ * @brief Parser state while the words of a command line are sorted into stages
+ *
+ * stage is the Command receiving words, or NULL before the first word of a
+ * stage. redirect holds an operator still waiting for its target ('<', '>',
+ * or 'a' for ">>"), and checkAlias is set until the first word of a stage.
+ */
+typedef struct PipelineParser {
+    Command * head;
+    Command * tail;
+    Command * stage;
+    int redirect;
+    int checkAlias;
+} PipelineParser;
+
+/**
+ * @brief Returns the stage receiving words, starting a new one if needed
+ * @param parser Pointer to the PipelineParser
+ * @return Pointer to the Command of the current stage
+ */
+static Command * openStage(PipelineParser * parser) {
+    if (parser->stage == NULL) {
+        Command * command = calloc(1, sizeof(Command));
+        if (command == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        command->inputFd = -1;
+        command->outputFd = -1;
+
+        if (parser->head == NULL) {
+            parser->head = command;
+        } else {
+            parser->tail->next = command;
+        }
+        parser->tail = command;
+        parser->stage = command;
+    }
+    return parser->stage;
+}
+
+/**
+ * @brief Completes the current stage
+ * @param parser Pointer to the PipelineParser
+ * @return 0 on success, -1 if the stage is empty or its prefixes are invalid
+ *
+ * Expands the stage's arguments and strips its scheduling prefixes.
+ */
+static int finishStage(PipelineParser * parser) {
+    Command * command = parser->stage;
+    parser->stage = NULL;
+    parser->redirect = 0;
+    parser->checkAlias = 1;
+
+    if (command == NULL) {
+        printError(ERROR_CMD_MISSING);
+        return -1;
+    }
+
+    substitute(command);
+    if (parseStagePrefixes(command) == -1 || command->argCount == 0) {
+        if (command->argCount == 0) {
+            printError(ERROR_CMD_MISSING);
         }
+        return -1;
+    }
+    return 0;
+}
+
+static int addToken(PipelineParser * parser, const char * token);
+
+/**
+ * @brief Replaces the first word of a stage with the words of an alias
+ * @param parser Pointer to the PipelineParser
+ * @param alias Pointer to the Alias
+ * @return 0 on success, -1 on failure
+ *
+ * The alias's words were split when it was defined, so they are added
+ * without scanning its text again. The first of them is checked for
+ * aliases too; the alias itself is skipped while it is being expanded,
+ * which stops "alias ls=ls -F" and alias cycles from recursing.
+ */
+static int expandAlias(PipelineParser * parser, Alias * alias) {
+    int ret = 0;
+    alias->expanding = 1;
+    parser->checkAlias = 1;
+    for (int i = 0; i < alias->tokenCount && ret == 0; i++) {
+        ret = addToken(parser, alias->tokens[i]);
     }
+    alias->expanding = 0;
+    return ret;
+}
+
+/**
+ * @brief Adds a word of a command line to the pipeline being built
+ * @param parser Pointer to the PipelineParser
+ * @param token The word, a redirection operator, or "|" from an alias
+ * @return 0 on success, -1 on failure
+ */
+static int addToken(PipelineParser * parser, const char * token) {
+    if (strcmp(token, "|") == 0) {
+        return finishStage(parser);
+    }
+
+    Command * command = openStage(parser);
+    if (parser->redirect != 0) {
+        *(parser->redirect == '<' ? &command->inputFd : &command->outputFd) = -1;
+        char ** slot = parser->redirect == '<' ? &command->input : &command->output;
+        free(*slot);
+        *slot = strdup(token);
+        if (*slot == NULL) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        if (parser->redirect != '<') {
+            command->append = parser->redirect == 'a';
+        }
+        parser->redirect = 0;
+        return 0;
+    }
+
+    if (strcmp(token, ">") == 0 || strcmp(token, "<") == 0) {
+        parser->redirect = token[0];
+        return 0;
+    }
+    if (strcmp(token, ">>") == 0) {
+        parser->redirect = 'a';
+        return 0;
+    }
+
+    int descriptor;
+    if ((token[0] == '<' || token[0] == '>') && token[1] == '&' &&
+        (descriptor = parseDescriptor(token + 2, strlen(token + 2))) != -1) {
+        char ** slot = token[0] == '<' ? &command->input : &command->output;
+        free(*slot);
+        *slot = NULL;
+        *(token[0] == '<' ? &command->inputFd : &command->outputFd) = descriptor;
+        return 0;
+    }
+
+    if (parser->checkAlias) {
+        parser->checkAlias = 0;
+        Alias * alias = findAlias(token);
+        if (alias != NULL && !alias->expanding) {
+            return expandAlias(parser, alias);
+        }
+    }
+
+    char * arg = strdup(token);
+    if (arg == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    appendArg(command, arg);
+    return 0;
 }
 
 /**
@@ -148,8 +848,14 @@ void substitute(Command * command) {
  * - Parses individual command arguments
  * - Handles input redirection (<)
  * - Handles output redirection (> and >>)
- * - Processes variable assignments (VAR=value)
+ * - Duplicates shell descriptors opened by exec (<&N and >&N)
+ * - Processes variable assignments (VAR=value) when the first word
+ *   contains '=', so arguments such as "--color=auto" are left alone
+ * - Defines aliases (alias name=value) from the unexpanded line
+ * - Expands aliases in the first word of each stage
  * - Performs environment variable substitution
+ * - Strips stage scheduling prefixes (pin, nice, ionice)
+ * - Rejects pipelines containing an empty stage
  * 
  * Memory Management:
  * - Allocates Command structures and argument strings
@@ -158,94 +864,60 @@ void substitute(Command * command) {
  * - Caller is responsible for freeing the returned structure
  */
 Command * parse(const char * currLine) {
-    if (currLine == NULL || strlen(currLine) == 0) {
+    if (currLine == NULL || currLine[strspn(currLine, " \t")] == '\0') {
         return NULL;
     }
 
-    char * equalSign = strchr(currLine, '=');
-    if (equalSign != NULL) {
+    currLine += strspn(currLine, " \t");
+    size_t firstWordLength = strcspn(currLine, " \t");
+    char * equalSign = memchr(currLine, '=', firstWordLength);
+    if (equalSign != NULL && equalSign != currLine) {
         if (handleVariableAssignment(currLine, equalSign) == -1) {
-            fprintf(stderr, "Failed to handle variable assignment\n");
+            printError("Failed to handle variable assignment\n");
         }
         return NULL;
     }
 
+    if (firstWordLength == strlen(ALIAS_KEYWORD) && strncmp(currLine, ALIAS_KEYWORD, firstWordLength) == 0) {
+        const char * definition = currLine + firstWordLength + strspn(currLine + firstWordLength, " \t");
+        if (memchr(definition, '=', strcspn(definition, " \t")) != NULL) {
+            defineAlias(definition);
+            return NULL;
+        }
+    }
+
     char * lineCopy = strdup(currLine);
     if (lineCopy == NULL) {
         perror("strdup");
         exit(EXIT_FAILURE);
     }
 
-    Command * head = NULL;
-    Command * curr = NULL;
+    PipelineParser parser;
+    memset(&parser, 0, sizeof(PipelineParser));
+    parser.checkAlias = 1;
+    int ret = 0;
 
     char * tokenPtr;
     char * token = strtok_r(lineCopy, "|", &tokenPtr);
-    while (token != NULL) {
-        Command * command = malloc(sizeof(Command));
-        if (command == NULL) {
-            perror("malloc");
-            exit(EXIT_FAILURE);
-        }
-
-        memset(command, 0, sizeof(Command));
-        command->argCount = 0;
-
-        if (head == NULL) {
-            head = command;
-        } else {
-            curr->next = command;
-        }
-
-        curr = command;
-
+    while (token != NULL && ret == 0) {
         char * subtokenPtr;
         char * subtoken = strtok_r(token, " \t", &subtokenPtr);
-        while (subtoken != NULL) {
-            if (strcmp(subtoken, ">") == 0) {
-                subtoken = strtok_r(NULL, " \t", &subtokenPtr);
-                if (subtoken != NULL) {
-                    command->output = strdup(subtoken);
-                    if (command->output == NULL) {
-                        perror("strdup");
-                        exit(EXIT_FAILURE);
-                    }
-                    command->append = 0;
-                }
-            } else if (strcmp(subtoken, ">>") == 0) {
-                subtoken = strtok_r(NULL, " \t", &subtokenPtr);
-                if (subtoken != NULL) {
-                    command->output = strdup(subtoken);
-                    if (command->output == NULL) {
-                        perror("strdup");
-                        exit(EXIT_FAILURE);
-                    }
-                    command->append = 1;
-                }
-            } else if (strcmp(subtoken, "<") == 0) {
-                subtoken = strtok_r(NULL, " \t", &subtokenPtr);
-                if (subtoken != NULL) {
-                    command->input = strdup(subtoken);
-                    if (command->input == NULL) {
-                        perror("strdup");
-                        exit(EXIT_FAILURE);
-                    }
-                }
-            } else {
-                command->args[command->argCount] = strdup(subtoken);
-                if (command->args[command->argCount] == NULL) {
-                    perror("strdup");
-                    exit(EXIT_FAILURE);
-                }
-                command->argCount++;
-            }
+        while (subtoken != NULL && ret == 0) {
+            ret = addToken(&parser, subtoken);
             subtoken = strtok_r(NULL, " \t", &subtokenPtr);
         }
-        command->args[command->argCount] = NULL;
-        substitute(command);
+
+        if (ret == 0) {
+            ret = finishStage(&parser);
+        }
         token = strtok_r(NULL, "|", &tokenPtr);
     }
 
     free(lineCopy);
-    return head;
-}
\ No newline at end of file
+    clearGlobCache();
+    if (ret == -1) {
+        freeCommands(parser.head);
+        return NULL;
+    }
+    return parser.head;
+}
@@ -0,0 +1,420 @@
+/**
+ * @file Pattern.c
+ * @brief Compiled glob patterns and regular expressions for SnailShell
+ *
+ * Glob patterns are compiled once into a list of tokens (literal runs,
+ * single-character wildcards, stars and bracket classes stored as 256-bit
+ * sets) and matched without recursion. Patterns without wildcards compile
+ * to a plain literal compared with memcmp().
+ *
+ * Patterns and regular expressions used by [[ ]] are cached by their text,
+ * so a loop that tests the same pattern on every iteration compiles it only
+ * once. The caches are flushed when they grow past MAX_PATTERN_CACHE.
+ *
+ * Glob Syntax:
+ * - *: Any sequence of characters
+ * - ?: Any single character
+ * - [abc], [a-z], [!a-z], [^a-z], [[:alpha:]]: Character classes
+ * - \c: The character c taken literally
+ */
+
+#include "SnailShell.h"
+
+static Table patternCache;
+static Table regexCache;
+
+/**
+ * @struct CharacterClass
+ * @brief Maps a POSIX character class name to its ctype predicate
+ */
+typedef struct CharacterClass {
+    const char * name;
+    int (*predicate)(int);
+} CharacterClass;
+
+static const CharacterClass characterClasses[] = {
+    { "alnum", isalnum },
+    { "alpha", isalpha },
+    { "blank", isblank },
+    { "cntrl", iscntrl },
+    { "digit", isdigit },
+    { "graph", isgraph },
+    { "lower", islower },
+    { "print", isprint },
+    { "punct", ispunct },
+    { "space", isspace },
+    { "upper", isupper },
+    { "xdigit", isxdigit },
+};
+
+#define NUM_CHARACTER_CLASSES (sizeof(characterClasses) / sizeof(characterClasses[0]))
+
+/**
+ * @brief Adds a character to a bracket class set
+ * @param set The 256-bit set
+ * @param c The character
+ */
+static void setAdd(unsigned char * set, unsigned char c) {
+    set[c >> 3] |= (unsigned char) (1 << (c & 7));
+}
+
+/**
+ * @brief Checks whether a character is in a bracket class set
+ * @param set The 256-bit set
+ * @param c The character
+ * @return Non-zero if c is in the set
+ */
+static int setContains(const unsigned char * set, unsigned char c) {
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+/**
+ * @brief Compiles a bracket expression into a set
+ * @param text The pattern text
+ * @param start Index of the opening '['
+ * @param set The 256-bit set to fill
+ * @return Index just past the closing ']', or 0 if the bracket is not closed
+ *
+ * An unclosed bracket is not an error; the caller treats the '[' as a
+ * literal character, as shells do.
+ */
+static size_t compileBracket(const char * text, size_t start, unsigned char * set) {
+    size_t i = start + 1;
+    int negate = text[i] == '!' || text[i] == '^';
+    if (negate) {
+        i++;
+    }
+
+    memset(set, 0, PATTERN_SET_SIZE);
+    int first = 1;
+    while (text[i] != '\0' && (text[i] != ']' || first)) {
+        first = 0;
+
+        if (text[i] == '[' && text[i + 1] == ':') {
+            const char * close = strstr(text + i + 2, ":]");
+            if (close != NULL) {
+                size_t nameLength = close - (text + i + 2);
+                for (size_t k = 0; k < NUM_CHARACTER_CLASSES; k++) {
+                    if (strlen(characterClasses[k].name) == nameLength &&
+                        strncmp(characterClasses[k].name, text + i + 2, nameLength) == 0) {
+                        for (int c = 1; c < 256; c++) {
+                            if (characterClasses[k].predicate(c)) {
+                                setAdd(set, (unsigned char) c);
+                            }
+                        }
+                    }
+                }
+                i = close + 2 - text;
+                continue;
+            }
+        }
+
+        if (text[i] == '\\' && text[i + 1] != '\0') {
+            i++;
+        }
+        unsigned char low = (unsigned char) text[i++];
+        unsigned char high = low;
+        if (text[i] == '-' && text[i + 1] != ']' && text[i + 1] != '\0') {
+            i++;
+            if (text[i] == '\\' && text[i + 1] != '\0') {
+                i++;
+            }
+            high = (unsigned char) text[i++];
+        }
+        for (unsigned c = low; c <= high; c++) {
+            setAdd(set, (unsigned char) c);
+        }
+    }
+
+    if (text[i] != ']') {
+        return 0;
+    }
+
+    if (negate) {
+        for (size_t k = 0; k < PATTERN_SET_SIZE; k++) {
+            set[k] = (unsigned char) ~set[k];
+        }
+    }
+    return i + 1;
+}
+
+/**
+ * @brief Appends a token to a pattern
+ * @param pattern Pointer to the Pattern
+ * @param type The token type
+ * @return Pointer to the new token
+ */
+static PatternToken * addToken(Pattern * pattern, int type) {
+    pattern->tokens = realloc(pattern->tokens, sizeof(PatternToken) * (pattern->count + 1));
+    if (pattern->tokens == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    PatternToken * token = &pattern->tokens[pattern->count++];
+    memset(token, 0, sizeof(PatternToken));
+    token->type = type;
+    return token;
+}
+
+/**
+ * @brief Checks whether a string contains glob wildcards
+ * @param text The string
+ * @return Non-zero if text contains an unescaped '*', '?' or '['
+ */
+int hasWildcards(const char * text) {
+    for (const char * p = text; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == '*' || *p == '?' || *p == '[') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Compiles a glob pattern
+ * @param text The pattern text
+ * @return Pointer to the new Pattern, to be released with freePattern()
+ *
+ * Consecutive literal characters are collected into a single token whose
+ * bytes (with escapes removed) are stored in pattern->literal. Consecutive
+ * stars collapse into one.
+ *
+ * Memory Management:
+ * - Allocates the Pattern, its tokens and its literal bytes
+ * - Handles memory allocation failures by calling exit()
+ */
+Pattern * compilePattern(const char * text) {
+    Pattern * pattern = calloc(1, sizeof(Pattern));
+    if (pattern == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t textLength = strlen(text);
+    pattern->literal = malloc(textLength + 1);
+    if (pattern->literal == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t literalLength = 0;
+    PatternToken * run = NULL;
+    size_t i = 0;
+    while (text[i] != '\0') {
+        if (text[i] == '*') {
+            if (pattern->count == 0 || pattern->tokens[pattern->count - 1].type != PATTERN_STAR) {
+                addToken(pattern, PATTERN_STAR);
+            }
+            run = NULL;
+            i++;
+            continue;
+        }
+
+        if (text[i] == '?') {
+            addToken(pattern, PATTERN_ANY);
+            pattern->minLength++;
+            run = NULL;
+            i++;
+            continue;
+        }
+
+        if (text[i] == '[') {
+            unsigned char set[PATTERN_SET_SIZE];
+            size_t end = compileBracket(text, i, set);
+            if (end != 0) {
+                PatternToken * token = addToken(pattern, PATTERN_CLASS);
+                memcpy(token->set, set, PATTERN_SET_SIZE);
+                pattern->minLength++;
+                run = NULL;
+                i = end;
+                continue;
+            }
+        }
+
+        if (text[i] == '\\' && text[i + 1] != '\0') {
+            i++;
+        }
+        if (run == NULL) {
+            run = addToken(pattern, PATTERN_LITERAL);
+            run->offset = literalLength;
+        }
+        pattern->literal[literalLength++] = text[i++];
+        run->length++;
+        pattern->minLength++;
+    }
+
+    pattern->literal[literalLength] = '\0';
+    pattern->isLiteral = pattern->count == 0 || (pattern->count == 1 && pattern->tokens[0].type == PATTERN_LITERAL);
+    return pattern;
+}
+
+/**
+ * @brief Releases a compiled glob pattern
+ * @param pattern Pointer to the Pattern (may be NULL)
+ */
+void freePattern(Pattern * pattern) {
+    if (pattern == NULL) {
+        return;
+    }
+
+    free(pattern->tokens);
+    free(pattern->literal);
+    free(pattern);
+}
+
+/**
+ * @brief Matches a single fixed-width token at a position
+ * @param pattern Pointer to the Pattern
+ * @param token Pointer to the token (not a star)
+ * @param subject The subject string
+ * @param length Length of the subject
+ * @param position Position in the subject
+ * @return Number of bytes matched, or -1 if the token does not match
+ */
+static long matchToken(const Pattern * pattern, const PatternToken * token, const char * subject, size_t length, size_t position) {
+    switch (token->type) {
+        case PATTERN_LITERAL:
+            if (length - position < token->length ||
+                memcmp(subject + position, pattern->literal + token->offset, token->length) != 0) {
+                return -1;
+            }
+            return (long) token->length;
+        case PATTERN_ANY:
+            return position < length ? 1 : -1;
+        default:
+            return position < length && setContains(token->set, (unsigned char) subject[position]) ? 1 : -1;
+    }
+}
+
+/**
+ * @brief Matches a subject against a compiled glob pattern
+ * @param pattern Pointer to the Pattern
+ * @param subject The subject string
+ * @param length Length of the subject
+ * @return Non-zero if the whole subject matches the pattern
+ *
+ * Uses the classic single-backtrack algorithm: on a mismatch only the most
+ * recent star is extended by one byte, which is sufficient because every
+ * other token matches a fixed number of bytes. Matching is linear in
+ * practice and never recurses.
+ */
+int matchPattern(const Pattern * pattern, const char * subject, size_t length) {
+    if (length < pattern->minLength) {
+        return 0;
+    }
+
+    if (pattern->isLiteral) {
+        return length == pattern->minLength && memcmp(subject, pattern->literal, length) == 0;
+    }
+
+    size_t token = 0;
+    size_t position = 0;
+    size_t starToken = (size_t) -1;
+    size_t starPosition = 0;
+
+    for (;;) {
+        if (token < pattern->count && pattern->tokens[token].type == PATTERN_STAR) {
+            starToken = token++;
+            starPosition = position;
+            if (token == pattern->count) {
+                return 1;
+            }
+            continue;
+        }
+
+        if (token == pattern->count && position == length) {
+            return 1;
+        }
+
+        long matched = token < pattern->count ? matchToken(pattern, &pattern->tokens[token], subject, length, position) : -1;
+        if (matched >= 0) {
+            token++;
+            position += matched;
+            continue;
+        }
+
+        if (starToken == (size_t) -1 || starPosition >= length) {
+            return 0;
+        }
+        token = starToken + 1;
+        position = ++starPosition;
+    }
+}
+
+/**
+ * @brief Returns the compiled form of a glob pattern from the cache
+ * @param text The pattern text
+ * @return Pointer to the cached Pattern, valid until the next call
+ *
+ * The pattern is compiled on first use. The returned pointer must not be
+ * freed and may be invalidated by the next call, which can flush the cache.
+ */
+Pattern * cachedPattern(const char * text) {
+    size_t length = strlen(text);
+    TableEntry * entry = tableFind(&patternCache, text, length);
+    if (entry != NULL) {
+        return entry->value;
+    }
+
+    if (patternCache.count >= MAX_PATTERN_CACHE) {
+        size_t cursor = 0;
+        TableEntry * old;
+        while ((old = tableNext(&patternCache, &cursor)) != NULL) {
+            freePattern(old->value);
+        }
+        tableFree(&patternCache);
+    }
+
+    entry = tableInsert(&patternCache, text, length);
+    entry->value = compilePattern(text);
+    return entry->value;
+}
+
+/**
+ * @brief Returns the compiled form of an extended regular expression
+ * @param text The regular expression
+ * @return Pointer to the cached regex_t, or NULL if the expression is invalid
+ *
+ * Invalid expressions are reported on stderr and are not cached. The
+ * returned pointer must not be freed and may be invalidated by the next
+ * call, which can flush the cache.
+ */
+regex_t * cachedRegex(const char * text) {
+    size_t length = strlen(text);
+    TableEntry * entry = tableFind(&regexCache, text, length);
+    if (entry != NULL) {
+        return entry->value;
+    }
+
+    regex_t * regex = malloc(sizeof(regex_t));
+    if (regex == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int error = regcomp(regex, text, REG_EXTENDED);
+    if (error != 0) {
+        char message[256];
+        regerror(error, regex, message, sizeof(message));
+        printError(ERROR_REGEX_INVALID, text, message);
+        free(regex);
+        return NULL;
+    }
+
+    if (regexCache.count >= MAX_PATTERN_CACHE) {
+        size_t cursor = 0;
+        TableEntry * old;
+        while ((old = tableNext(&regexCache, &cursor)) != NULL) {
+            regfree(old->value);
+            free(old->value);
+        }
+        tableFree(&regexCache);
+    }
+
+    entry = tableInsert(&regexCache, text, length);
+    entry->value = regex;
+    return regex;
+}
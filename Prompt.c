@@ -0,0 +1,532 @@
+/**
+ * @file Prompt.c
+ * @brief Configurable prompt with segments computed in the background
+ *
+ * The prompt is built from the PROMPT variable, or "\w > " when it is unset.
+ * Cheap escapes are expanded on the spot; expensive ones are computed by a
+ * worker thread, so a slow file system or command never delays the prompt.
+ *
+ * Prompt Escapes:
+ * - \w, \W: Current directory, or its last component
+ * - \u, \h: User name and short host name
+ * - \?: Exit status of the last command
+ * - \$: '#' for root, '$' otherwise
+ * - \b: Git branch of the current directory (background)
+ * - \(command): First line printed by command (background)
+ * - \\: A backslash
+ *
+ * Results of background segments are cached per directory and stay valid
+ * until the next command runs. A stale or missing result is shown at once
+ * while the worker recomputes it; formatPrompt() waits a few milliseconds
+ * so that fast segments appear in the first rendering, and the line editor
+ * redraws the prompt in place when the others finish (see
+ * promptNotifyFd()). Commands that exceed PROMPT_TIMEOUT_MS are killed.
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/**
+ * @struct PromptSegment
+ * @brief Cached result of a background segment in one directory
+ *
+ * generation is the command generation the value was computed for, plus
+ * one; 0 means it was never computed.
+ */
+typedef struct PromptSegment {
+    char kind;
+    char * argument;
+    char * directory;
+    char * value;
+    uint64_t generation;
+    int pending;
+} PromptSegment;
+
+static pthread_mutex_t promptLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t promptWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t promptDone = PTHREAD_COND_INITIALIZER;
+static Table segments;
+static PromptSegment ** queue;
+static int queued;
+static int queueCapacity;
+static int pendingSegments;
+static int workerStarted;
+static int notifyPipe[2] = {-1, -1};
+static uint64_t generation;
+static int lastStatus;
+
+/**
+ * @brief Records the exit status of a command and invalidates cached segments
+ * @param status Exit status of the command
+ */
+void recordStatus(int status) {
+    pthread_mutex_lock(&promptLock);
+    lastStatus = status;
+    generation++;
+    pthread_mutex_unlock(&promptLock);
+}
+
+/**
+ * @brief Returns the descriptor that becomes readable when a segment finishes
+ * @return Read end of the notification pipe, or -1 if no segment was queued
+ *
+ * The line editor polls it next to the terminal and calls formatPrompt()
+ * again when it fires. Readers drain it with non-blocking reads.
+ */
+int promptNotifyFd() {
+    return notifyPipe[0];
+}
+
+/**
+ * @brief Reads the Git branch of a directory
+ * @param directory The directory
+ * @return Newly allocated branch name or abbreviated commit, or NULL if
+ *         the directory is not inside a Git work tree
+ *
+ * Looks for .git in the directory and its parents without running git. A
+ * .git file ("gitdir: path", used by work trees and submodules) is
+ * followed to the real Git directory.
+ */
+static char * readBranch(const char * directory) {
+    Buffer path;
+    memset(&path, 0, sizeof(Buffer));
+    bufferAppend(&path, directory, strlen(directory));
+
+    char * branch = NULL;
+    for (;;) {
+        size_t length = path.length;
+        bufferAppend(&path, "/.git", 5);
+
+        struct stat info;
+        if (stat(path.data, &info) == 0) {
+            char head[PATH_MAX];
+            FILE * file = NULL;
+            if (S_ISREG(info.st_mode) && (file = fopen(path.data, "re")) != NULL) {
+                char * gitDir = fgets(head, sizeof(head), file) != NULL && strncmp(head, "gitdir: ", 8) == 0 ? head + 8 : NULL;
+                fclose(file);
+                file = NULL;
+                if (gitDir != NULL) {
+                    gitDir[strcspn(gitDir, "\n")] = '\0';
+                    path.length = gitDir[0] == '/' ? 0 : length + 1;
+                    bufferAppend(&path, gitDir, strlen(gitDir));
+                }
+            }
+            bufferAppend(&path, "/HEAD", 5);
+
+            if ((file = fopen(path.data, "re")) != NULL) {
+                if (fgets(head, sizeof(head), file) != NULL) {
+                    head[strcspn(head, "\n")] = '\0';
+                    const char * ref = strncmp(head, "ref: refs/heads/", 16) == 0 ? head + 16 : NULL;
+                    branch = ref != NULL ? strdup(ref) : strndup(head, 7);
+                }
+                fclose(file);
+            }
+            break;
+        }
+
+        path.length = length;
+        while (path.length > 0 && path.data[path.length - 1] != '/') {
+            path.length--;
+        }
+        if (path.length <= 1) {
+            break;
+        }
+        path.data[--path.length] = '\0';
+    }
+
+    free(path.data);
+    return branch;
+}
+
+/**
+ * @struct SegmentChild
+ * @brief What the child running a \(command) segment needs
+ */
+typedef struct SegmentChild {
+    char ** args;
+    const char * directory;
+    int output;
+} SegmentChild;
+
+/**
+ * @brief Body of the child running a \(command) segment
+ * @param argument Pointer to the SegmentChild
+ * @return Never returns
+ */
+static int runSegmentChild(void * argument) {
+    SegmentChild * child = argument;
+    int null = open("/dev/null", O_RDWR);
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDERR_FILENO);
+    dup2(child->output, STDOUT_FILENO);
+    if (chdir(child->directory) == 0) {
+        execvp(child->args[0], child->args);
+    }
+    _exit(127);
+}
+
+/**
+ * @brief Runs a command and returns the first line it prints
+ * @param command The command, split into words at blanks
+ * @param directory Directory to run it in
+ * @return Newly allocated first line of output, or NULL if the command
+ *         printed nothing or timed out
+ *
+ * The child is created with clone() without an exit signal, which makes it
+ * invisible to waitpid(-1) in the main thread (walk's batch loop) and
+ * lets the worker reap it with __WCLONE.
+ */
+static char * runSegmentCommand(const char * command, const char * directory) {
+    char * words = strdup(command);
+    if (words == NULL) {
+        return NULL;
+    }
+
+    char ** args = NULL;
+    int argCount = 0;
+    int capacity = 0;
+    char * savePtr;
+    for (char * word = strtok_r(words, " \t", &savePtr); word != NULL; word = strtok_r(NULL, " \t", &savePtr)) {
+        appendWord(&args, &argCount, &capacity, word);
+    }
+
+    int fd[2];
+    if (argCount == 0 || pipe2(fd, O_CLOEXEC) == -1) {
+        free(args);
+        free(words);
+        return NULL;
+    }
+
+    SegmentChild child = {args, directory, fd[1]};
+    char * stack = malloc(PROMPT_CHILD_STACK);
+    pid_t pid = stack != NULL ? clone(runSegmentChild, stack + PROMPT_CHILD_STACK, 0, &child) : -1;
+    free(stack);
+    close(fd[1]);
+    free(args);
+    free(words);
+
+    Buffer output;
+    memset(&output, 0, sizeof(Buffer));
+    bufferAppend(&output, "", 0);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int timedOut = pid == -1;
+    while (!timedOut && memchr(output.data, '\n', output.length) == NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        struct pollfd poller = {fd[0], POLLIN, 0};
+        if (elapsed >= PROMPT_TIMEOUT_MS || poll(&poller, 1, PROMPT_TIMEOUT_MS - elapsed) == 0) {
+            timedOut = 1;
+            break;
+        }
+
+        char chunk[256];
+        ssize_t bytes = read(fd[0], chunk, sizeof(chunk));
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            break;
+        }
+        bufferAppend(&output, chunk, bytes);
+    }
+    close(fd[0]);
+
+    if (pid != -1) {
+        if (timedOut) {
+            kill(pid, SIGKILL);
+        }
+        while (waitpid(pid, NULL, __WCLONE) == -1 && errno == EINTR) {
+        }
+    }
+
+    output.data[strcspn(output.data, "\n")] = '\0';
+    if (timedOut || output.data[0] == '\0') {
+        free(output.data);
+        return NULL;
+    }
+    return output.data;
+}
+
+/**
+ * @brief Computes queued segments until the shell exits
+ * @param unused Ignored
+ * @return Never returns
+ */
+static void * promptWorker(void * unused) {
+    (void) unused;
+    pthread_mutex_lock(&promptLock);
+    for (;;) {
+        while (queued == 0) {
+            pthread_cond_wait(&promptWork, &promptLock);
+        }
+
+        PromptSegment * segment = queue[0];
+        memmove(queue, queue + 1, sizeof(PromptSegment *) * --queued);
+        uint64_t computedFor = generation + 1;
+        pthread_mutex_unlock(&promptLock);
+
+        char * value = segment->kind == 'b' ? readBranch(segment->directory)
+                                            : runSegmentCommand(segment->argument, segment->directory);
+
+        pthread_mutex_lock(&promptLock);
+        free(segment->value);
+        segment->value = value;
+        segment->generation = computedFor;
+        segment->pending = 0;
+        pendingSegments--;
+        pthread_cond_broadcast(&promptDone);
+
+        char byte = 1;
+        if (write(notifyPipe[1], &byte, 1) == -1 && errno != EAGAIN) {
+            perror("write");
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts the worker thread and its notification pipe
+ * @return 0 on success, -1 if they could not be created
+ *
+ * Called with promptLock held.
+ */
+static int startWorker() {
+    if (workerStarted) {
+        return workerStarted == 1 ? 0 : -1;
+    }
+    workerStarted = -1;
+
+    if (pipe2(notifyPipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe2");
+        return -1;
+    }
+    notifyPipe[0] = moveShellFd(notifyPipe[0]);
+    notifyPipe[1] = moveShellFd(notifyPipe[1]);
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int error = pthread_create(&thread, &attributes, promptWorker, NULL);
+    pthread_attr_destroy(&attributes);
+    if (error != 0) {
+        errno = error;
+        perror("pthread_create");
+        close(notifyPipe[0]);
+        close(notifyPipe[1]);
+        notifyPipe[0] = notifyPipe[1] = -1;
+        return -1;
+    }
+
+    workerStarted = 1;
+    return 0;
+}
+
+/**
+ * @brief Drops every cached segment that is not being computed
+ *
+ * Called with promptLock held when the cache exceeds PROMPT_CACHE_MAX
+ * entries, which only happens after visiting that many directories.
+ */
+static void trimSegments() {
+    if (pendingSegments > 0) {
+        return;
+    }
+
+    size_t cursor = 0;
+    TableEntry * entry;
+    while ((entry = tableNext(&segments, &cursor)) != NULL) {
+        PromptSegment * segment = entry->value;
+        free(segment->argument);
+        free(segment->directory);
+        free(segment->value);
+        free(segment);
+    }
+    tableFree(&segments);
+}
+
+/**
+ * @brief Appends the cached value of a background segment, queueing it if stale
+ * @param prompt Pointer to the Buffer receiving the prompt
+ * @param kind 'b' for the branch, '(' for a command
+ * @param argument Start of the command for '(' segments
+ * @param length Length of the command
+ * @param directory The current directory
+ * @return 1 if the segment is still being computed, 0 otherwise
+ *
+ * Called with promptLock held.
+ */
+static int appendSegment(Buffer * prompt, char kind, const char * argument, size_t length, const char * directory) {
+    Buffer key;
+    memset(&key, 0, sizeof(Buffer));
+    bufferAppend(&key, &kind, 1);
+    bufferAppend(&key, argument, length);
+    bufferAppend(&key, "\n", 1);
+    bufferAppend(&key, directory, strlen(directory));
+
+    if (segments.count >= PROMPT_CACHE_MAX) {
+        trimSegments();
+    }
+
+    TableEntry * entry = tableInsert(&segments, key.data, key.length);
+    free(key.data);
+    if (entry->value == NULL) {
+        PromptSegment * segment = calloc(1, sizeof(PromptSegment));
+        if (segment == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        segment->kind = kind;
+        segment->argument = strndup(argument, length);
+        segment->directory = strdup(directory);
+        if (segment->argument == NULL || segment->directory == NULL) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        entry->value = segment;
+    }
+
+    PromptSegment * segment = entry->value;
+    if (!segment->pending && segment->generation != generation + 1 && startWorker() == 0) {
+        if (queued == queueCapacity) {
+            queueCapacity = queueCapacity == 0 ? 8 : queueCapacity * 2;
+            queue = realloc(queue, sizeof(PromptSegment *) * queueCapacity);
+            if (queue == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        queue[queued++] = segment;
+        segment->pending = 1;
+        pendingSegments++;
+        pthread_cond_signal(&promptWork);
+    }
+
+    if (segment->value != NULL) {
+        bufferAppend(prompt, segment->value, strlen(segment->value));
+    }
+    return segment->pending;
+}
+
+/**
+ * @brief Expands a prompt format
+ * @param prompt Pointer to the Buffer receiving the prompt (cleared first)
+ * @param format The format
+ * @param directory The current directory
+ * @return Number of background segments still being computed
+ *
+ * Called with promptLock held.
+ */
+static int renderPrompt(Buffer * prompt, const char * format, const char * directory) {
+    static char user[64];
+    static char host[HOST_NAME_MAX + 1];
+    if (user[0] == '\0') {
+        struct passwd * entry = getpwuid(getuid());
+        snprintf(user, sizeof(user), "%s", entry != NULL ? entry->pw_name : "?");
+        if (gethostname(host, sizeof(host)) == 0) {
+            host[strcspn(host, ".")] = '\0';
+        }
+    }
+
+    int pending = 0;
+    prompt->length = 0;
+    bufferAppend(prompt, "", 0);
+    for (const char * c = format; *c != '\0'; c++) {
+        if (*c != '\\' || c[1] == '\0') {
+            bufferAppend(prompt, c, 1);
+            continue;
+        }
+
+        c++;
+        switch (*c) {
+            case 'w':
+                bufferAppend(prompt, directory, strlen(directory));
+                break;
+            case 'W': {
+                const char * last = strrchr(directory, '/');
+                last = last != NULL && last[1] != '\0' ? last + 1 : directory;
+                bufferAppend(prompt, last, strlen(last));
+                break;
+            }
+            case 'u':
+                bufferAppend(prompt, user, strlen(user));
+                break;
+            case 'h':
+                bufferAppend(prompt, host, strlen(host));
+                break;
+            case '?': {
+                char status[16];
+                bufferAppend(prompt, status, snprintf(status, sizeof(status), "%d", lastStatus));
+                break;
+            }
+            case '$':
+                bufferAppend(prompt, geteuid() == 0 ? "#" : "$", 1);
+                break;
+            case 'b':
+                pending += appendSegment(prompt, 'b', "", 0, directory);
+                break;
+            case '(': {
+                const char * end = strchr(c, ')');
+                if (end == NULL) {
+                    bufferAppend(prompt, c - 1, strlen(c - 1));
+                    return pending;
+                }
+                pending += appendSegment(prompt, '(', c + 1, end - c - 1, directory);
+                c = end;
+                break;
+            }
+            default:
+                bufferAppend(prompt, c - 1, 2);
+                break;
+        }
+    }
+    return pending;
+}
+
+/**
+ * @brief Formats the shell prompt
+ * @param prompt Pointer to the Buffer receiving the prompt (cleared first)
+ * @param wait Milliseconds to wait for background segments
+ *
+ * Segments that are still running after the wait show their previous
+ * value, if any. The line editor needs the prompt as text to redraw it.
+ */
+void formatPrompt(Buffer * prompt, int wait) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        exit(EXIT_FAILURE);
+    }
+
+    const char * format = getenv(PROMPT_VARIABLE);
+    if (format == NULL) {
+        format = DEFAULT_PROMPT;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait / 1000;
+    deadline.tv_nsec += (wait % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&promptLock);
+    while (renderPrompt(prompt, format, cwd) > 0 && wait > 0) {
+        if (pthread_cond_timedwait(&promptDone, &promptLock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&promptLock);
+}
@@ -0,0 +1,812 @@
+/**
+ * @file Reader.c
+ * @brief Buffered descriptor reader and the read and mapfile built-ins
+ *
+ * This file implements the read built-in on top of a per-descriptor buffered
+ * reader, so "while read line; do ...; done < file" does not issue one
+ * read(2) per byte. Records are located with memchr(), which glibc
+ * implements with vector instructions.
+ *
+ * Sharing Descriptors With Children:
+ * - Regular files are filled with pread() at the reader's logical offset and
+ *   the kernel offset is left untouched. syncReaders() moves the kernel
+ *   offset back to the logical position right before the shell forks, so
+ *   children see exactly the data the shell has not consumed yet.
+ * - After a sync the next read checks the kernel offset once; if a child
+ *   moved it, the buffer is dropped and reading resumes from there.
+ * - Terminals return at most one line per read(2) and are read in chunks
+ *   for newline-delimited records. Pipes and other descriptors that cannot
+ *   seek are read one byte at a time, since data read ahead could not be
+ *   given back to the commands that share them.
+ *
+ * read Options:
+ * - -r: Backslash is not an escape character
+ * - -d delim: Use the first character of delim instead of newline
+ * - -a name: Assign the fields to the indexed array name
+ * - -u fd: Read from descriptor fd instead of standard input
+ *
+ * The mapfile built-in loads all records of a descriptor into an indexed
+ * array at once, with the elements pointing into one bulk-read region.
+ *
+ * In a fused pipeline stage (see Fuse.c), standard input is the stage's
+ * ring or pipe, read through a private reader, and read and mapfile
+ * assign nothing, as in a forked stage.
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @struct Reader
+ * @brief Read-ahead state of a single file descriptor
+ */
+typedef struct Reader {
+    char * buffer;
+    size_t start;
+    size_t end;
+    off_t position;
+    int mode;
+    int validated;
+    Ring * ring;
+} Reader;
+
+static Reader * readers[MAX_READER_FD];
+
+/**
+ * @brief Creates a reader for a descriptor or ring
+ * @param fd The file descriptor (ignored for a ring)
+ * @param ring The ring of a fused stage, or NULL
+ * @param owned Non-zero if nothing else reads fd, so it may be read ahead
+ * @return Pointer to the new Reader, or NULL if fd is invalid
+ *
+ * The reader records the descriptor's current offset and decides how the
+ * descriptor may be read ahead (see the file comment).
+ */
+static Reader * createReader(int fd, Ring * ring, int owned) {
+    struct stat info;
+    if (ring == NULL && fstat(fd, &info) == -1) {
+        return NULL;
+    }
+
+    Reader * reader = calloc(1, sizeof(Reader));
+    if (reader == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    reader->ring = ring;
+    reader->position = ring != NULL ? -1 : lseek(fd, 0, SEEK_CUR);
+    if (ring != NULL || owned) {
+        reader->mode = READER_PRIVATE;
+    } else if (S_ISREG(info.st_mode) && reader->position != -1) {
+        reader->mode = READER_SEEKABLE;
+    } else if (isatty(fd)) {
+        reader->mode = READER_TERMINAL;
+    } else {
+        reader->mode = READER_UNBUFFERED;
+    }
+
+    if (reader->mode != READER_UNBUFFERED) {
+        reader->buffer = malloc(READER_BUFFER_SIZE);
+        if (reader->buffer == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    reader->validated = 1;
+    return reader;
+}
+
+/**
+ * @brief Returns the reader of a descriptor, attaching one if necessary
+ * @param fd The file descriptor
+ * @return Pointer to the Reader, or NULL if fd is out of range or invalid
+ */
+static Reader * attachReader(int fd) {
+    if (fd < 0 || fd >= MAX_READER_FD) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    if (readers[fd] == NULL) {
+        readers[fd] = createReader(fd, NULL, 0);
+    }
+    return readers[fd];
+}
+
+/**
+ * @brief Returns the private reader of a fused stage's standard input
+ * @param stage Pointer to the StageIO of the stage
+ * @param owned Non-zero if the stage's input descriptor is its own pipe end
+ * @return Pointer to the Reader, or NULL if the descriptor is invalid
+ */
+static Reader * attachStageReader(StageIO * stage, int owned) {
+    if (stage->reader == NULL) {
+        stage->reader = createReader(stage->inputFd, stage->input, owned);
+    }
+    return stage->reader;
+}
+
+/**
+ * @brief Moves the kernel offset of a seekable reader to its logical position
+ * @param fd The file descriptor of the reader
+ * @param reader Pointer to the Reader
+ */
+static void syncReader(int fd, Reader * reader) {
+    if (reader->mode == READER_SEEKABLE && reader->validated) {
+        if (lseek(fd, reader->position, SEEK_SET) == -1) {
+            perror("lseek");
+        }
+        reader->validated = 0;
+    }
+}
+
+/**
+ * @brief Frees the private reader of a fused stage
+ * @param stage Pointer to the StageIO of the stage
+ *
+ * Data read ahead from a pipe or ring is dropped. A regular file is left
+ * at the reader's logical position first, so the stage consumes exactly
+ * what it returned, as a forked stage does before it exits.
+ */
+void releaseStageReader(StageIO * stage) {
+    if (stage->reader != NULL) {
+        syncReader(stage->inputFd, stage->reader);
+        free(stage->reader->buffer);
+        free(stage->reader);
+        stage->reader = NULL;
+    }
+}
+
+/**
+ * @brief Synchronizes every reader with its descriptor
+ *
+ * Called before the shell forks so children observe the logical position of
+ * every seekable descriptor read by the read built-in. Buffers are kept and
+ * revalidated lazily by the next read.
+ */
+void syncReaders() {
+    for (int fd = 0; fd < MAX_READER_FD; fd++) {
+        if (readers[fd] != NULL) {
+            syncReader(fd, readers[fd]);
+        }
+    }
+}
+
+/**
+ * @brief Synchronizes and detaches the reader of a descriptor
+ * @param fd The file descriptor
+ *
+ * Called before the shell replaces a descriptor (for example when applying
+ * a redirection in the shell itself) so buffered data of the old file is
+ * neither lost nor returned for the new one.
+ */
+void releaseReader(int fd) {
+    if (fd < 0 || fd >= MAX_READER_FD || readers[fd] == NULL) {
+        return;
+    }
+
+    syncReader(fd, readers[fd]);
+    free(readers[fd]->buffer);
+    free(readers[fd]);
+    readers[fd] = NULL;
+}
+
+/**
+ * @brief Refills the buffer of a reader
+ * @param fd The file descriptor
+ * @param reader Pointer to the Reader
+ * @return Number of bytes added, 0 at end of file, or -1 on error
+ *
+ * Unconsumed bytes are moved to the front of the buffer before filling.
+ */
+static ssize_t fillReader(int fd, Reader * reader) {
+    size_t pending = reader->end - reader->start;
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, pending);
+        reader->start = 0;
+        reader->end = pending;
+    }
+
+    if (reader->end == READER_BUFFER_SIZE) {
+        return 0;
+    }
+
+    ssize_t count;
+    do {
+        if (reader->mode == READER_SEEKABLE) {
+            count = pread(fd, reader->buffer + reader->end, READER_BUFFER_SIZE - reader->end, reader->position + pending);
+        } else if (reader->ring != NULL) {
+            count = ringRead(reader->ring, reader->buffer + reader->end, READER_BUFFER_SIZE - reader->end);
+        } else {
+            count = read(fd, reader->buffer + reader->end, READER_BUFFER_SIZE - reader->end);
+        }
+    } while (count == -1 && errno == EINTR);
+
+    if (count > 0) {
+        reader->end += count;
+    }
+    return count;
+}
+
+/**
+ * @brief Reads a record from a descriptor one byte at a time
+ * @param fd The file descriptor
+ * @param delimiter The record delimiter
+ * @param record Pointer to the Buffer to fill
+ * @return 1 if the delimiter was found, 0 at end of file, -1 on error
+ */
+static int readUnbuffered(int fd, int delimiter, Buffer * record) {
+    for (;;) {
+        char c;
+        ssize_t count = read(fd, &c, 1);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count == -1) {
+            return -1;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        if (c == delimiter) {
+            return 1;
+        }
+        bufferAppend(record, &c, 1);
+    }
+}
+
+/**
+ * @brief Reads one delimited record from a descriptor
+ * @param fd The file descriptor
+ * @param delimiter The record delimiter
+ * @param record Pointer to the Buffer to fill (delimiter not included)
+ * @return 1 if the delimiter was found, 0 at end of file, -1 on error
+ */
+static int readRecord(int fd, int delimiter, Buffer * record) {
+    StageIO * stage = currentStage();
+    if (stage != NULL && fd != STDIN_FILENO) {
+        return readUnbuffered(fd, delimiter, record);
+    }
+
+    Reader * reader;
+    if (stage != NULL) {
+        reader = attachStageReader(stage, stage->inputFd != STDIN_FILENO);
+        fd = stage->inputFd;
+    } else {
+        reader = attachReader(fd);
+    }
+    if (reader == NULL) {
+        return -1;
+    }
+
+    if (reader->mode == READER_UNBUFFERED || (reader->mode == READER_TERMINAL && delimiter != '\n')) {
+        return readUnbuffered(fd, delimiter, record);
+    }
+
+    if (!reader->validated) {
+        off_t current = lseek(fd, 0, SEEK_CUR);
+        if (current != reader->position) {
+            reader->start = 0;
+            reader->end = 0;
+            reader->position = current;
+        }
+        reader->validated = 1;
+    }
+
+    for (;;) {
+        char * begin = reader->buffer + reader->start;
+        size_t available = reader->end - reader->start;
+        char * found = memchr(begin, delimiter, available);
+
+        if (found != NULL) {
+            size_t length = found - begin;
+            bufferAppend(record, begin, length);
+            reader->start += length + 1;
+            reader->position += length + 1;
+            return 1;
+        }
+
+        if (reader->end == READER_BUFFER_SIZE && reader->start == 0) {
+            bufferAppend(record, begin, available);
+            reader->start = reader->end = 0;
+            reader->position += available;
+        }
+
+        ssize_t count = fillReader(fd, reader);
+        if (count == -1) {
+            return -1;
+        }
+        if (count == 0 && reader->end < READER_BUFFER_SIZE) {
+            available = reader->end - reader->start;
+            bufferAppend(record, reader->buffer + reader->start, available);
+            reader->start = reader->end = 0;
+            reader->position += available;
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Checks whether a character is IFS whitespace
+ * @param c The character
+ * @param ifs The IFS string
+ * @return Non-zero if c is a space, tab or newline contained in IFS
+ */
+static int isIFSWhitespace(char c, const char * ifs) {
+    return (c == ' ' || c == '\t' || c == '\n') && strchr(ifs, c) != NULL;
+}
+
+/**
+ * @brief Removes backslash escapes from a record
+ * @param record Pointer to the Buffer to unescape in place
+ * @param escaped Array receiving 1 for every character that was escaped
+ *
+ * Escaped characters are exempt from IFS splitting. Backslash-newline pairs
+ * have already been handled by the caller as line continuations.
+ */
+static void unescapeRecord(Buffer * record, char * escaped) {
+    size_t out = 0;
+    for (size_t in = 0; in < record->length; in++) {
+        escaped[out] = 0;
+        if (record->data[in] == '\\' && in + 1 < record->length) {
+            in++;
+            escaped[out] = 1;
+        }
+        record->data[out++] = record->data[in];
+    }
+
+    record->length = out;
+    record->data[out] = '\0';
+}
+
+/**
+ * @brief Finds the next IFS field of a record
+ * @param data The record text
+ * @param escaped Escape mask of the record, or NULL
+ * @param length Length of the record
+ * @param ifs The IFS string
+ * @param offset Pointer to the scan position, advanced past the field and its separator
+ * @param fieldStart Pointer to store the start of the field
+ * @param fieldEnd Pointer to store the end of the field
+ * @return 1 if a field was found, 0 if only separators remain
+ *
+ * Implements POSIX field splitting: runs of IFS whitespace separate fields
+ * and are trimmed, while each IFS non-whitespace character (with any
+ * adjacent IFS whitespace) delimits exactly one field.
+ */
+static int nextField(const char * data, const char * escaped, size_t length, const char * ifs,
+                     size_t * offset, size_t * fieldStart, size_t * fieldEnd) {
+    size_t i = *offset;
+    while (i < length && !(escaped && escaped[i]) && isIFSWhitespace(data[i], ifs)) {
+        i++;
+    }
+    if (i >= length) {
+        *offset = i;
+        return 0;
+    }
+
+    *fieldStart = i;
+    while (i < length && ((escaped && escaped[i]) || strchr(ifs, data[i]) == NULL)) {
+        i++;
+    }
+    *fieldEnd = i;
+
+    while (i < length && !(escaped && escaped[i]) && isIFSWhitespace(data[i], ifs)) {
+        i++;
+    }
+    if (i < length && !(escaped && escaped[i]) && strchr(ifs, data[i]) != NULL) {
+        i++;
+    }
+
+    *offset = i;
+    return 1;
+}
+
+/**
+ * @brief Assigns a scalar shell variable
+ * @param name The variable name
+ * @param value Start of the value
+ * @param length Length of the value
+ * @return 0 on success, -1 on failure
+ */
+static int assignValue(const char * name, const char * value, size_t length) {
+    char * copy = strndup(value, length);
+    if (copy == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    int ret = setenv(name, copy, 1);
+    if (ret == -1) {
+        perror("setenv");
+    }
+
+    free(copy);
+    return ret;
+}
+
+/**
+ * @brief Splits a record into variables according to IFS
+ * @param record Pointer to the Buffer holding the record
+ * @param escaped Escape mask of the record, or NULL
+ * @param names Variable names to assign
+ * @param nameCount Number of variable names
+ * @param arrayName Name of the array for -a, or NULL
+ * @return 0 on success, -1 on failure
+ *
+ * With names, every variable but the last receives one field and the last
+ * receives the rest of the record with trailing IFS whitespace removed.
+ * With -a every field becomes an array element.
+ */
+static int assignFields(Buffer * record, const char * escaped, char ** names, int nameCount, const char * arrayName) {
+    const char * ifs = getenv("IFS");
+    if (ifs == NULL) {
+        ifs = DEFAULT_IFS;
+    }
+
+    const char * data = record->data;
+    size_t length = record->length;
+    size_t offset = 0;
+    size_t fieldStart = 0;
+    size_t fieldEnd = 0;
+
+    if (arrayName != NULL) {
+        Array * array = createArray(arrayName, ARRAY_INDEXED);
+        if (array == NULL) {
+            return -1;
+        }
+        if (*ifs == '\0') {
+            arrayAppend(array, data, length);
+            return 0;
+        }
+        while (nextField(data, escaped, length, ifs, &offset, &fieldStart, &fieldEnd)) {
+            arrayAppend(array, data + fieldStart, fieldEnd - fieldStart);
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < nameCount; i++) {
+        if (*ifs == '\0') {
+            if (assignValue(names[i], i == 0 ? data : "", i == 0 ? length : 0) == -1) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (i < nameCount - 1) {
+            if (!nextField(data, escaped, length, ifs, &offset, &fieldStart, &fieldEnd)) {
+                fieldStart = fieldEnd = offset;
+            }
+        } else {
+            while (offset < length && !(escaped && escaped[offset]) && isIFSWhitespace(data[offset], ifs)) {
+                offset++;
+            }
+            fieldStart = offset;
+            fieldEnd = length;
+            while (fieldEnd > fieldStart && !(escaped && escaped[fieldEnd - 1]) && isIFSWhitespace(data[fieldEnd - 1], ifs)) {
+                fieldEnd--;
+            }
+        }
+
+        if (assignValue(names[i], data + fieldStart, fieldEnd - fieldStart) == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Handles the built-in read command
+ * @param curr Pointer to the Command structure containing read arguments
+ * @return 0 if a delimited record was read, -1 at end of file or on error
+ *
+ * Usage: read [-r] [-d delim] [-a array] [-u fd] [name ...]
+ *
+ * Reads one record and splits it into the named variables using IFS (REPLY
+ * when no name is given). At end of file the variables still receive any
+ * partial record, but the command fails so "while read" loops terminate.
+ */
+int handleRead(Command * curr) {
+    int raw = 0;
+    int delimiter = '\n';
+    int fd = STDIN_FILENO;
+    const char * arrayName = NULL;
+    int i = 1;
+
+    for (; i < curr->argCount && curr->args[i][0] == '-'; i++) {
+        const char * option = curr->args[i];
+        if (strcmp(option, "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(option, "-r") == 0) {
+            raw = 1;
+        } else if ((strcmp(option, "-d") == 0 || strcmp(option, "-a") == 0 || strcmp(option, "-u") == 0) && i + 1 < curr->argCount) {
+            const char * value = curr->args[++i];
+            if (option[1] == 'd') {
+                delimiter = (unsigned char) value[0];
+            } else if (option[1] == 'a') {
+                arrayName = value;
+            } else {
+                char * end;
+                fd = (int) strtol(value, &end, 10);
+                if (*value == '\0' || *end != '\0') {
+                    printError(ERROR_READ_USAGE);
+                    return -1;
+                }
+            }
+        } else {
+            printError(ERROR_READ_USAGE);
+            return -1;
+        }
+    }
+
+    char * defaultName = "REPLY";
+    char ** names = curr->args + i;
+    int nameCount = curr->argCount - i;
+    if (nameCount == 0) {
+        names = &defaultName;
+        nameCount = 1;
+    }
+
+    for (int n = 0; n < nameCount; n++) {
+        if (!isValidName(names[n])) {
+            printError(ERROR_VAR_INVALID, names[n]);
+            return -1;
+        }
+    }
+    if (arrayName != NULL && !isValidName(arrayName)) {
+        printError(ERROR_VAR_INVALID, arrayName);
+        return -1;
+    }
+
+    Buffer record = { NULL, 0, 0 };
+    int found;
+    for (;;) {
+        size_t before = record.length;
+        found = readRecord(fd, delimiter, &record);
+        if (found == -1) {
+            perror("read");
+            free(record.data);
+            return -1;
+        }
+
+        if (raw || delimiter != '\n' || !found || record.length == before || record.data[record.length - 1] != '\\') {
+            break;
+        }
+
+        size_t backslashes = 0;
+        while (backslashes < record.length && record.data[record.length - 1 - backslashes] == '\\') {
+            backslashes++;
+        }
+        if (backslashes % 2 == 0) {
+            break;
+        }
+        record.length--;
+    }
+
+    if (record.data == NULL) {
+        bufferAppend(&record, "", 0);
+    }
+
+    char * escaped = NULL;
+    if (!raw) {
+        escaped = malloc(record.length + 1);
+        if (escaped == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        unescapeRecord(&record, escaped);
+    }
+
+    int ret = currentStage() == NULL ? assignFields(&record, escaped, names, nameCount, arrayName) : 0;
+
+    free(escaped);
+    free(record.data);
+    return ret == 0 && found ? 0 : -1;
+}
+
+/**
+ * @brief Reads the rest of a descriptor into an anonymous mapping
+ * @param fd The file descriptor
+ * @param ring The ring to read instead of fd in a fused stage, or NULL
+ * @param delimiter The record delimiter
+ * @param maxRecords Number of records to read from a descriptor that cannot
+ *        seek, or 0 to read until end of file
+ * @param size Pointer to store the number of bytes read
+ * @param capacity Pointer to store the size of the mapping
+ * @return Start of the mapping, or NULL on a read error
+ *
+ * The mapping grows with mremap(), so large inputs are never copied between
+ * heap buffers. Descriptors that cannot seek are read one byte at a time
+ * when only some records are wanted, since extra data could not be given
+ * back.
+ */
+static char * loadRegion(int fd, Ring * ring, int delimiter, size_t maxRecords, size_t * size, size_t * capacity) {
+    *size = 0;
+    *capacity = READER_BUFFER_SIZE;
+
+    struct stat info;
+    if (ring == NULL && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset != -1 && info.st_size > offset) {
+            *capacity = (size_t) (info.st_size - offset) + 1;
+        }
+    }
+
+    char * region = mmap(NULL, *capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t records = 0;
+    for (;;) {
+        if (*size == *capacity) {
+            char * grown = mremap(region, *capacity, *capacity * 2, MREMAP_MAYMOVE);
+            if (grown == MAP_FAILED) {
+                perror("mremap");
+                exit(EXIT_FAILURE);
+            }
+            region = grown;
+            *capacity *= 2;
+        }
+
+        size_t wanted = maxRecords > 0 ? 1 : *capacity - *size;
+        ssize_t count = ring != NULL ? ringRead(ring, region + *size, wanted) : read(fd, region + *size, wanted);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count == -1) {
+            munmap(region, *capacity);
+            return NULL;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        *size += count;
+        if (maxRecords > 0 && region[*size - 1] == delimiter && ++records == maxRecords) {
+            break;
+        }
+    }
+
+    return region;
+}
+
+/**
+ * @brief Handles the built-in mapfile (readarray) command
+ * @param curr Pointer to the Command structure containing mapfile arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Usage: mapfile [-t] [-d delim] [-n count] [-s skip] [-u fd] [array]
+ *
+ * Loads the records of a descriptor into an indexed array (MAPFILE by
+ * default) in one call. The input is read in bulk into a single anonymous
+ * mapping owned by the array and every element is a slice of it, located
+ * with memchr(). The file itself is not mapped, as a file truncated while
+ * the array is alive would turn element accesses into SIGBUS. For regular
+ * files the offset is left right after the last record stored, so "-n"
+ * does not swallow the remaining input.
+ *
+ * Options:
+ * - -t: Remove the delimiter from each element
+ * - -d delim: Use the first character of delim instead of newline
+ * - -n count: Store at most count records (0 means all)
+ * - -s skip: Discard the first skip records
+ * - -u fd: Read from descriptor fd instead of standard input
+ */
+int handleMapfile(Command * curr) {
+    int trim = 0;
+    int delimiter = '\n';
+    int fd = STDIN_FILENO;
+    size_t maxRecords = 0;
+    size_t skip = 0;
+    const char * arrayName = "MAPFILE";
+    int i = 1;
+
+    for (; i < curr->argCount && curr->args[i][0] == '-'; i++) {
+        const char * option = curr->args[i];
+        if (strcmp(option, "-t") == 0) {
+            trim = 1;
+        } else if (strlen(option) == 2 && strchr("dnsu", option[1]) != NULL && i + 1 < curr->argCount) {
+            const char * value = curr->args[++i];
+            if (option[1] == 'd') {
+                delimiter = (unsigned char) value[0];
+                continue;
+            }
+
+            char * end;
+            long number = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || number < 0) {
+                printError(ERROR_MAPFILE_USAGE);
+                return -1;
+            }
+
+            if (option[1] == 'n') {
+                maxRecords = (size_t) number;
+            } else if (option[1] == 's') {
+                skip = (size_t) number;
+            } else {
+                fd = (int) number;
+            }
+        } else {
+            printError(ERROR_MAPFILE_USAGE);
+            return -1;
+        }
+    }
+
+    if (i < curr->argCount) {
+        arrayName = curr->args[i++];
+    }
+    if (i < curr->argCount) {
+        printError(ERROR_MAPFILE_USAGE);
+        return -1;
+    }
+    if (!isValidName(arrayName)) {
+        printError(ERROR_VAR_INVALID, arrayName);
+        return -1;
+    }
+
+    StageIO * stage = currentStage();
+    Ring * ring = NULL;
+    if (stage == NULL) {
+        releaseReader(fd);
+    } else if (fd == STDIN_FILENO) {
+        ring = stage->input;
+        fd = stage->inputFd;
+    }
+
+    off_t start = ring != NULL ? -1 : lseek(fd, 0, SEEK_CUR);
+    size_t byteWiseRecords = start == -1 && ring == NULL && maxRecords > 0 ? skip + maxRecords : 0;
+
+    size_t size;
+    size_t capacity;
+    char * region = loadRegion(fd, ring, delimiter, byteWiseRecords, &size, &capacity);
+    if (region == NULL) {
+        perror("read");
+        return -1;
+    }
+
+    char * end = region + size;
+    char * stored = region;
+    size_t records = 0;
+    for (; stored < end && (maxRecords == 0 || records < skip + maxRecords); records++) {
+        stored = memchr(stored, delimiter, end - stored);
+        stored = stored == NULL ? end : stored + 1;
+    }
+
+    if (stage != NULL) {
+        if (start != -1 && lseek(fd, start + (stored - region), SEEK_SET) == -1) {
+            perror("lseek");
+        }
+        munmap(region, capacity);
+        return 0;
+    }
+
+    Array * array = createArray(arrayName, ARRAY_INDEXED);
+    arraySetRegion(array, region, capacity);
+    arrayReserve(array, records > skip ? records - skip : 0);
+
+    char * p = region;
+    for (size_t record = 0; record < records; record++) {
+        char * found = memchr(p, delimiter, end - p);
+        char * next = found == NULL ? end : found + 1;
+        if (record >= skip) {
+            size_t length = (trim && found != NULL ? found : next) - p;
+            arrayAppendSlice(array, p, length);
+        }
+        p = next;
+    }
+
+    if (start != -1 && lseek(fd, start + (p - region), SEEK_SET) == -1) {
+        perror("lseek");
+    }
+
+    return 0;
+}
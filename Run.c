@@ -11,13 +11,17 @@
  * - Process creation and management (fork/exec)
  * - Pipeline execution and inter-process communication
  * - Input/output redirection handling
- * - Built-in command support (cd)
+ * - Built-in command support (cd, ulimit)
+ * - Stage scheduling attributes and resource limits applied before exec
+ * - Job status reporting
  * - File descriptor management and cleanup
  * - Memory management for command structures
  */
 
 #include "SnailShell.h"
 
+#include <fcntl.h>
+
 /**
  * @brief Safely closes a file descriptor with error handling
  * @param fd File descriptor to close
@@ -84,22 +88,33 @@ int handleCD(Command * curr) {
  * - Connecting stdin to the previous command's output through a pipe
  * 
  * Redirection Priority:
- * - File redirection (<) takes precedence over pipe redirection
- * - Handles file open failures by calling exit()
+ * - A shell descriptor (<&N) takes precedence over a file, and a file
+ *   redirection (<) over pipe redirection
+ * - Handles file open failures by calling _exit()
  * - Manages file descriptor duplication and cleanup
  */
 void handleInputRedirection(Command * curr, int prevPipe) {
+    if (curr->inputFd != -1) {
+        if (dup2(curr->inputFd, STDIN_FILENO) == -1) {
+            perror("dup2");
+            _exit(EXIT_FAILURE);
+        }
+
+        safeClose(prevPipe);
+        return;
+    }
+
     if (curr->input != NULL) {
         FILE * inputFile = fopen(curr->input, "r");
         if (inputFile == NULL) {
             perror("fopen");
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
 
         if (dup2(fileno(inputFile), STDIN_FILENO) == -1) {
             perror("dup2");
             fclose(inputFile);
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
 
         fclose(inputFile);
@@ -110,7 +125,7 @@ void handleInputRedirection(Command * curr, int prevPipe) {
         if (dup2(prevPipe, STDIN_FILENO) == -1) {
             perror("dup2");
             safeClose(prevPipe);
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
 
         safeClose(prevPipe);
@@ -124,6 +139,8 @@ void handleInputRedirection(Command * curr, int prevPipe) {
  * 
  * Configures output redirection for a command by either:
  * - Opening a specified output file and redirecting stdout to it
+ * - Duplicating a shell descriptor named with >&N, or the one cached for
+ *   an append redirection by findAppendTarget()
  * - Connecting stdout to the next command's input through a pipe
  * 
  * Redirection Modes:
@@ -132,25 +149,42 @@ void handleInputRedirection(Command * curr, int prevPipe) {
  * - Pipe mode: Connects to next command in pipeline
  * 
  * File Descriptor Management:
- * - Handles file open failures by calling exit()
+ * - Handles file open failures by calling _exit()
  * - Manages file descriptor duplication and cleanup
  * - Ensures proper pipe connection for pipeline execution
  */
 void handleOutputRedirection(Command * curr, int fd[2]) {
+    if (curr->outputFd != -1) {
+        if (dup2(curr->outputFd, STDOUT_FILENO) == -1) {
+            perror("dup2");
+            _exit(EXIT_FAILURE);
+        }
+
+        if (curr->next != NULL) {
+            safeClose(fd[0]);
+            safeClose(fd[1]);
+        }
+        return;
+    }
+
     if (curr->output != NULL) {
         FILE * outputFile = fopen(curr->output, curr->append ? "a" : "w");
         if (outputFile == NULL) {
             perror("fopen");
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
 
         if (dup2(fileno(outputFile), STDOUT_FILENO) == -1) {
             perror("dup2");
             fclose(outputFile);
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
 
         fclose(outputFile);
+        if (curr->next != NULL) {
+            safeClose(fd[0]);
+            safeClose(fd[1]);
+        }
         return;
     }
 
@@ -159,7 +193,7 @@ void handleOutputRedirection(Command * curr, int fd[2]) {
             perror("dup2");
             safeClose(fd[0]);
             safeClose(fd[1]);
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
 
         safeClose(fd[0]);
@@ -173,22 +207,15 @@ void handleOutputRedirection(Command * curr, int fd[2]) {
  * @param fd Array containing pipe file descriptors [read, write]
  * @param prevPipe Pointer to the previous pipe's read file descriptor
  * 
- * Creates and manages pipes between commands in a pipeline. Handles
- * file descriptor cleanup and ensures proper connection of command
- * pipelines for data flow between processes.
+ * Called in the parent after a stage has been forked. The pipe itself is
+ * created before fork() so the child can inherit both ends; afterwards the
+ * parent no longer needs the write end or the previous stage's read end.
  * 
  * Pipeline Management:
- * - Creates new pipes for multi-command pipelines
  * - Closes unused file descriptors to prevent leaks
  * - Maintains pipe connections between sequential commands
- * - Handles pipe creation failures by calling exit()
  */
 void handlePiping(Command * curr, int fd[2], int * prevPipe) {
-    if (curr->next != NULL && pipe(fd) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-    }
-
     safeClose(*prevPipe);
 
     if (curr->next != NULL) {
@@ -199,29 +226,258 @@ void handlePiping(Command * curr, int fd[2], int * prevPipe) {
     }
 }
 
+/**
+ * @brief Frees a pipeline of commands
+ * @param commands Pointer to the head of the command pipeline
+ * 
+ * Memory Management:
+ * - Frees all allocated Command structures
+ * - Frees all argument strings and redirection paths
+ */
+void freeCommands(Command * commands) {
+    Command * dirty = commands;
+    while (dirty != NULL) {
+        Command * next = dirty->next;
+
+        for (int i = 0; i < dirty->argCount; i++) {
+            safeFree(dirty->args[i]);
+        }
+        safeFree(dirty->args);
+
+        safeFree(dirty->input);
+        safeFree(dirty->output);
+        safeFree(dirty);
+
+        dirty = next;
+    }
+}
+
 /**
  * @brief Displays the shell prompt
  * 
- * Prints the current working directory followed by " > " to indicate
- * the shell is ready for user input. Uses getcwd() to determine the
- * current directory and formats it for display.
+ * Prints the prompt built by formatPrompt() from PROMPT (by default the
+ * current working directory followed by " > ") to indicate the shell is
+ * ready for user input. Background segments get PROMPT_WAIT_MS to finish.
  * 
  * Error Handling:
  * - Reports getcwd() failures via perror()
  * - Calls exit() on critical errors to prevent shell corruption
  */
 void printPrompt() {
-    char cwd[PATH_MAX];
-    if (getcwd(cwd, sizeof(cwd)) == NULL) {
-        perror("getcwd");
-        exit(EXIT_FAILURE);
+    Buffer prompt;
+    memset(&prompt, 0, sizeof(Buffer));
+    formatPrompt(&prompt, PROMPT_WAIT_MS);
+    fputs(prompt.data, stdout);
+    free(prompt.data);
+}
+
+/**
+ * @brief Moves a descriptor the shell keeps open out of the user's range
+ * @param fd The descriptor, or -1
+ * @return The new descriptor (close-on-exec, at least SHELL_FD_BASE), or fd
+ *         unchanged if it could not be moved
+ *
+ * Descriptors below SHELL_FD_BASE belong to the user's exec redirections,
+ * so the shell's own files (the script, sockets, inotify instances) must
+ * not sit there and be replaced by "exec 3>file".
+ */
+int moveShellFd(int fd) {
+    if (fd == -1 || fd >= SHELL_FD_BASE) {
+        return fd;
+    }
+
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+    if (moved == -1) {
+        return fd;
+    }
+    close(fd);
+    return moved;
+}
+
+/**
+ * @brief Replaces a standard descriptor with another inside the shell
+ * @param fd The descriptor to duplicate onto target
+ * @param target Descriptor to replace (STDIN_FILENO or STDOUT_FILENO)
+ * @return Duplicate of the original descriptor for restoring, or -1 on failure
+ *
+ * The saved duplicate is placed above the user's descriptor range.
+ */
+static int replaceInShell(int fd, int target) {
+    releaseReader(target);
+    int saved = fcntl(target, F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+    if (saved == -1 || dup2(fd, target) == -1) {
+        perror("dup2");
+        safeClose(saved);
+        return -1;
+    }
+    return saved;
+}
+
+/**
+ * @brief Replaces a standard descriptor with a file inside the shell
+ * @param path Path of the file to open
+ * @param flags Flags passed to open()
+ * @param target Descriptor to replace (STDIN_FILENO or STDOUT_FILENO)
+ * @return Duplicate of the original descriptor for restoring, or -1 on failure
+ * 
+ * Used for built-ins and compound commands that run in the shell process.
+ * Any read-ahead buffered for the original descriptor is given back first.
+ * Append redirections use the descriptor cache when it is enabled.
+ */
+int redirectInShell(const char * path, int flags, int target) {
+    int cached = flags & O_APPEND ? findAppendTarget(path) : -1;
+    int fileFd = cached != -1 ? cached : open(path, flags, 0666);
+    if (fileFd == -1) {
+        perror("open");
+        return -1;
+    }
+
+    int saved = replaceInShell(fileFd, target);
+    if (cached == -1) {
+        safeClose(fileFd);
+    }
+    return saved;
+}
+
+/**
+ * @brief Restores a standard descriptor saved by redirectInShell()
+ * @param saved Saved duplicate of the original descriptor (-1 for none)
+ * @param target Descriptor to restore
+ */
+void restoreInShell(int saved, int target) {
+    if (saved == -1) {
+        return;
+    }
+
+    releaseReader(target);
+    if (dup2(saved, target) == -1) {
+        perror("dup2");
+    }
+    safeClose(saved);
+}
+
+/**
+ * @brief Checks whether a stage can run as a built-in inside the shell
+ * @param commands Pointer to the head of the command pipeline
+ * @param curr Pointer to the Command structure of the stage
+ * @return 1 if the stage should run in the shell process, 0 otherwise
+ * 
+ * Only a built-in forming the whole pipeline runs in the shell, and only
+ * when it carries no stage prefixes, since those must not apply to the
+ * shell itself.
+ */
+static int runsInShell(Command * commands, Command * curr) {
+    return curr == commands && curr->next == NULL &&
+        curr->pinMode == PIN_NONE && !curr->niceSet &&
+        curr->ioClass == IOPRIO_CLASS_NONE && curr->limitMask == 0;
+}
+
+/**
+ * @brief Runs a built-in command inside the shell process
+ * @param curr Pointer to the Command structure
+ * @param handler Handler of the built-in
+ * @return Exit status of the built-in (0 on success, 1 on failure)
+ * 
+ * Input and output redirections are applied to the shell's own
+ * descriptors for the duration of the built-in and restored afterwards.
+ * exec is the exception: its redirections are meant to persist, so it
+ * applies them itself.
+ *
+ * echo and printf write through the output buffers of Output.c, which
+ * are left unflushed unless their output was redirected. Every other
+ * built-in runs with the buffers flushed, since it may print through
+ * stdio or block reading input.
+ */
+static int runBuiltin(Command * curr, BuiltinHandler handler) {
+    int savedInput = -1;
+    int savedOutput = -1;
+
+    if (handler == handleExec) {
+        return handleExec(curr) == 0 ? 0 : 1;
+    }
+
+    if (curr->inputFd != -1 || curr->input != NULL) {
+        savedInput = curr->inputFd != -1 ? replaceInShell(curr->inputFd, STDIN_FILENO)
+                                         : redirectInShell(curr->input, O_RDONLY, STDIN_FILENO);
+        if (savedInput == -1) {
+            return 1;
+        }
+    }
+
+    if (curr->outputFd != -1 || curr->output != NULL) {
+        flushBuiltinOutput();
+        savedOutput = curr->outputFd != -1 ? replaceInShell(curr->outputFd, STDOUT_FILENO)
+                                           : redirectInShell(curr->output, O_WRONLY | O_CREAT | (curr->append ? O_APPEND : O_TRUNC), STDOUT_FILENO);
+        if (savedOutput == -1) {
+            restoreInShell(savedInput, STDIN_FILENO);
+            return 1;
+        }
+    }
+
+    int buffered = handler == handleEcho || handler == handlePrintf;
+    if (!buffered) {
+        flushBuiltinOutput();
+    }
+    int ret = handler(curr);
+
+    if (!buffered || savedOutput != -1) {
+        flushBuiltinOutput();
+    }
+    restoreInShell(savedOutput, STDOUT_FILENO);
+    restoreInShell(savedInput, STDIN_FILENO);
+    return ret == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Replaces the calling child with an external command
+ * @param args NULL-terminated argument vector
+ * @param resolved Full path found by locateCommand(), or an empty string
+ *
+ * Falls back to execvp() if the located file can no longer be executed.
+ * Returns only if the command could not be started.
+ */
+void execCommand(char ** args, const char * resolved) {
+    if (resolved[0] != '\0') {
+        execv(resolved, args);
+    }
+    execvp(*args, args);
+}
+
+/**
+ * @brief Starts an external command without waiting for it
+ * @param args NULL-terminated argument vector
+ * @return Process ID of the child, or -1 if fork() failed
+ *
+ * The child inherits the shell's descriptors and leaves with _exit() like
+ * the stages started by execute(). Used by built-ins that run commands on
+ * their own, such as walk.
+ */
+pid_t spawnArgs(char ** args) {
+    char resolved[PATH_MAX];
+    if (locateCommand(*args, resolved, sizeof(resolved)) == -1) {
+        resolved[0] = '\0';
+    }
+
+    flushBuiltinOutput();
+    syncReaders();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        execCommand(args, resolved);
+        perror("execvp");
+        _exit(EXIT_FAILURE);
     }
-    printf("%s > ", cwd);
+    return pid;
 }
 
 /**
  * @brief Executes a pipeline of commands
  * @param commands Pointer to the head of the command pipeline
+ * @return Exit status of the last stage (128 + signal if it was killed)
  * 
  * Main execution function that processes a linked list of commands.
  * Handles both built-in commands and external program execution,
@@ -229,78 +485,127 @@ void printPrompt() {
  * 
  * Execution Flow:
  * - Processes commands sequentially in the pipeline
- * - Handles built-in commands (cd) directly
- * - Creates child processes for external commands
+ * - Runs a lone built-in (cd, ulimit) directly in the shell
+ * - Creates child processes for external commands and for built-ins
+ *   that are part of a larger pipeline
  * - Manages input/output redirection for each command
- * - Waits for child processes to complete
+ * - Applies stage scheduling prefixes and resource limits in the child
+ * - Waits for all child processes once the pipeline is running
+ * - Reports stages that were killed, including by a resource limit
  * - Performs comprehensive memory cleanup
  * 
  * Process Management:
- * - Uses fork() to create child processes
- * - Uses execvp() to execute external commands
+ * - Creates each pipe before fork() so both ends are inherited
+ * - Uses fork() to create child processes, or the spawn helper (see
+ *   Spawn.c) for external stages when it was started
+ * - Uses execvp() to execute external commands, or execv() on the path
+ *   found by locateCommand() when the sharedhash option is enabled
+ * - Children leave with _exit() so they never flush or rewind stdio
+ *   streams shared with the shell, such as the script being read
+ * - Starts every stage before waiting so stages run concurrently
  * - Uses waitpid() to wait for child completion
  * - Handles process creation failures by calling exit()
  * 
  * Memory Management:
- * - Frees all allocated Command structures
- * - Frees all argument strings and redirection paths
- * - Ensures no memory leaks after execution
+ * - Frees all allocated Command structures via freeCommands()
  */
-void execute(Command * commands) {
+int execute(Command * commands) {
     Command * curr = commands;
-    int fd[2];
+    int fd[2] = { -1, -1 };
     int prevPipe = -1;
+    Ring * prevRing = NULL;
+    FusedStage * fused = NULL;
+    int lastStatus = 0;
+
+    assignAutoAffinity(commands);
 
     while (curr != NULL) {
-        if (strcmp(*curr->args, "cd") == 0) {
-            if (handleCD(curr) == -1) {
-                fprintf(stderr, "Failed to change directory\n");
-            }
+        BuiltinHandler builtin = findBuiltin(*curr->args);
+        if (builtin != NULL && runsInShell(commands, curr)) {
+            lastStatus = runBuiltin(curr, builtin);
+            curr = curr->next;
+            continue;
+        }
+
+        if (builtin != NULL && isFusable(curr, builtin)) {
+            addFusedStage(&fused, curr, builtin, &prevRing, &prevPipe);
             curr = curr->next;
             continue;
         }
 
-        pid_t pid = fork();
-        if (pid == -1) {
+        if (curr->next != NULL && pipe(fd) == -1) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+
+        char resolved[PATH_MAX];
+        if (builtin != NULL || locateCommand(*curr->args, resolved, sizeof(resolved)) == -1) {
+            resolved[0] = '\0';
+        }
+        if (curr->output != NULL && curr->append) {
+            curr->outputFd = findAppendTarget(curr->output);
+        }
+
+        flushBuiltinOutput();
+        syncReaders();
+        pid_t pid = builtin == NULL ? spawnStage(curr, resolved, prevPipe, fd) : -1;
+        if (pid == -1 && (pid = fork()) == -1) {
             perror("fork");
             exit(EXIT_FAILURE);
         }
 
         if (pid == 0) {
+            if (builtin != NULL) {
+                releaseReader(STDIN_FILENO);
+            }
             handleInputRedirection(curr, prevPipe);
             handleOutputRedirection(curr, fd);
-            execvp(*curr->args, curr->args);
-            perror("execvp");
-            exit(EXIT_FAILURE);
-        } else {
-            handlePiping(curr, fd, &prevPipe);
-
-            int status;
-            if (waitpid(pid, &status, 0) == -1) {
-                perror("waitpid");
-                exit(EXIT_FAILURE);
+            applyStageSchedule(curr);
+            applyStageLimits(curr);
+            if (builtin != NULL) {
+                enableOutputSplice();
+                int ret = builtin(curr);
+                flushBuiltinOutput();
+                syncReaders();
+                _exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
             }
+            execCommand(curr->args, resolved);
+            perror("execvp");
+            _exit(EXIT_FAILURE);
         }
 
+        curr->pid = pid;
+        handlePiping(curr, fd, &prevPipe);
         curr = curr->next;
     }
 
     safeClose(prevPipe);
+    startFusedStages(fused);
 
-    Command * dirty = commands;
-    while (dirty != NULL) {
-        Command * next = dirty->next;
-
-        for (int i = 0; i < dirty->argCount; i++) {
-            safeFree(dirty->args[i]);
+    Command * last = commands;
+    for (curr = commands; curr != NULL; curr = curr->next) {
+        last = curr;
+        if (curr->pid <= 0) {
+            continue;
         }
 
-        safeFree(dirty->input);
-        safeFree(dirty->output);
-        safeFree(dirty);
+        int status;
+        if (waitpid(curr->pid, &status, 0) == -1) {
+            perror("waitpid");
+            exit(EXIT_FAILURE);
+        }
 
-        dirty = next;
+        reportStageStatus(curr, status);
+        if (WIFSIGNALED(status)) {
+            lastStatus = 128 + WTERMSIG(status);
+        } else {
+            lastStatus = WEXITSTATUS(status);
+        }
     }
+    joinFusedStages(fused, last, &lastStatus);
+
+    freeCommands(commands);
+    return lastStatus;
 }
 
 /**
@@ -314,9 +619,9 @@ void execute(Command * commands) {
  * 
  * Loop Behavior:
  * - Displays prompt only in interactive mode (stdin)
- * - Reads commands line by line using getline()
- * - Parses each line into Command structures
- * - Executes parsed commands via execute()
+ * - Reads commands separated by ';' or newlines via readNode()
+ * - Reads compound commands (while/until loops) across several lines
+ * - Executes each complete command via executeNode()
  * - Continues until EOF or error condition
  * 
  * Input Handling:
@@ -331,27 +636,24 @@ void execute(Command * commands) {
  * - Ensures proper cleanup on exit
  */
 int run(FILE * inputStream) {
-    char * currLine = NULL;
-    size_t capacity = 0;
+    Source source;
+    initSource(&source, inputStream);
 
     for (;;) {
-        if (inputStream == stdin) {
-            printPrompt();
-        }
-
-        if (getline(&currLine, &capacity, inputStream) == -1) {
+        Node * node;
+        if (readNode(&source, &node) == -1) {
             break;
         }
 
-        int end = strcspn(currLine, "\n");
-        currLine[end] = '\0';
-
-        Command * commands = parse(currLine);
-        if (commands != NULL) {
-            execute(commands);
+        if (node != NULL) {
+            processCacheEvents();
+            recordStatus(executeNode(node));
+            freeNode(node);
         }
     }
 
-    free(currLine);
+    flushBuiltinOutput();
+    syncReaders();
+    freeSource(&source);
     return 0;
 }
\ No newline at end of file
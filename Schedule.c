@@ -0,0 +1,419 @@
+/**
+ * @file Schedule.c
+ * @brief CPU affinity and scheduling prefixes for pipeline stages
+ *
+ * This file implements the "pin", "nice" and "ionice" stage prefixes and the
+ * prefix parser shared with the "limit" prefix (see Limits.c). The prefixes
+ * are parsed into the Command structure and applied in the child
+ * process between fork() and execvp(), so the shell itself is never affected.
+ *
+ * Key Functionality:
+ * - CPU list parsing ("0-3,6") into CPU sets
+ * - Nice increment and I/O class parsing
+ * - Cache-aware CPU ordering read from /sys/devices/system/cpu
+ * - Automatic placement of adjacent pipeline stages on sibling cores
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <sys/syscall.h>
+
+/**
+ * @struct CPUInfo
+ * @brief Topology keys used to order CPUs by shared caches
+ */
+typedef struct CPUInfo {
+    int cpu;
+    int package;
+    int l3;
+    int l2;
+    int thread;
+    int core;
+} CPUInfo;
+
+static int cpuOrder[MAX_NUM_CPUS];
+static int cpuOrderCount = -1;
+
+/**
+ * @brief Reads the leading integer of a sysfs file
+ * @param path Path of the sysfs attribute
+ * @return The integer value, or -1 if the file is missing or malformed
+ *
+ * Works for both plain integers ("3") and CPU lists ("0-1,8-9"), where the
+ * first CPU of the list serves as an identifier for the sharing group.
+ */
+static int readSysInt(const char * path) {
+    FILE * file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int value;
+    if (fscanf(file, "%d", &value) != 1) {
+        value = -1;
+    }
+
+    fclose(file);
+    return value;
+}
+
+/**
+ * @brief Finds the position of a CPU within its SMT sibling list
+ * @param cpu The CPU number
+ * @return 0 for the first hardware thread of a core, 1 for the second, etc.
+ */
+static int readThreadRank(int cpu) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+
+    FILE * file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char list[256];
+    int rank = 0;
+    if (fgets(list, sizeof(list), file) != NULL) {
+        cpu_set_t siblings;
+        if (parseCPUList(list, &siblings) == 0) {
+            for (int i = 0; i < cpu; i++) {
+                if (CPU_ISSET(i, &siblings)) {
+                    rank++;
+                }
+            }
+        }
+    }
+
+    fclose(file);
+    return rank;
+}
+
+/**
+ * @brief Compares two CPUs by their position in the cache hierarchy
+ * @param a Pointer to the first CPUInfo
+ * @param b Pointer to the second CPUInfo
+ * @return Negative, zero or positive as for qsort()
+ *
+ * CPUs are grouped by package, then L3 and L2 domain. Within a domain the
+ * first hardware thread of every core comes before SMT siblings so that
+ * neighbouring stages land on distinct physical cores sharing a cache.
+ */
+static int compareCPUInfo(const void * a, const void * b) {
+    const CPUInfo * x = a;
+    const CPUInfo * y = b;
+
+    if (x->package != y->package) return x->package - y->package;
+    if (x->l3 != y->l3) return x->l3 - y->l3;
+    if (x->l2 != y->l2) return x->l2 - y->l2;
+    if (x->thread != y->thread) return x->thread - y->thread;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+/**
+ * @brief Builds the cache-ordered list of CPUs available to the shell
+ * @return Number of CPUs in the ordered list
+ *
+ * The topology is read once from sysfs and cached for the lifetime of the
+ * shell. Only CPUs in the shell's own affinity mask are considered. Missing
+ * sysfs attributes degrade gracefully to numeric CPU order.
+ */
+static int loadCPUOrder() {
+    if (cpuOrderCount >= 0) {
+        return cpuOrderCount;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("sched_getaffinity");
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+
+    CPUInfo * infos = malloc(sizeof(CPUInfo) * MAX_NUM_CPUS);
+    if (infos == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int count = 0;
+    char path[PATH_MAX];
+    for (int cpu = 0; cpu < MAX_NUM_CPUS; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+
+        CPUInfo * info = &infos[count++];
+        info->cpu = cpu;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        info->package = readSysInt(path);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index3/shared_cpu_list", cpu);
+        info->l3 = readSysInt(path);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index2/shared_cpu_list", cpu);
+        info->l2 = readSysInt(path);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        info->core = readSysInt(path);
+        info->thread = readThreadRank(cpu);
+    }
+
+    qsort(infos, count, sizeof(CPUInfo), compareCPUInfo);
+    for (int i = 0; i < count; i++) {
+        cpuOrder[i] = infos[i].cpu;
+    }
+
+    free(infos);
+    cpuOrderCount = count;
+    return cpuOrderCount;
+}
+
+/**
+ * @brief Parses a CPU list such as "0-3,6" into a CPU set
+ * @param list The CPU list string
+ * @param set Pointer to the CPU set to fill
+ * @return 0 on success, -1 on failure
+ *
+ * Accepts comma separated CPU numbers and inclusive ranges. Trailing
+ * whitespace (as found in sysfs files) is ignored.
+ */
+int parseCPUList(const char * list, cpu_set_t * set) {
+    CPU_ZERO(set);
+    if (list == NULL || !isdigit((unsigned char) *list)) {
+        return -1;
+    }
+
+    const char * p = list;
+    while (*p != '\0' && !isspace((unsigned char) *p)) {
+        char * end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= MAX_NUM_CPUS) {
+            return -1;
+        }
+
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= MAX_NUM_CPUS) {
+                return -1;
+            }
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0' && !isspace((unsigned char) *end)) {
+            return -1;
+        }
+        p = end;
+    }
+
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Parses an I/O scheduling class for the ionice prefix
+ * @param spec Class specification ("idle", "best-effort[:N]", "realtime[:N]" or 1-3)
+ * @param ioClass Pointer to store the class
+ * @param ioLevel Pointer to store the priority level within the class
+ * @return 0 on success, -1 on failure
+ *
+ * The optional level after the colon ranges from 0 (highest) to 7 (lowest)
+ * and defaults to 4, matching the kernel's default best-effort priority.
+ */
+int parseIOClass(const char * spec, int * ioClass, int * ioLevel) {
+    if (spec == NULL) {
+        return -1;
+    }
+
+    size_t nameLength = strcspn(spec, ":");
+    if (strncmp(spec, "idle", nameLength) == 0 && nameLength == 4) {
+        *ioClass = IOPRIO_CLASS_IDLE;
+    } else if (strncmp(spec, "best-effort", nameLength) == 0 && nameLength == 11) {
+        *ioClass = IOPRIO_CLASS_BE;
+    } else if (strncmp(spec, "realtime", nameLength) == 0 && nameLength == 8) {
+        *ioClass = IOPRIO_CLASS_RT;
+    } else if (nameLength == 1 && spec[0] >= '1' && spec[0] <= '3') {
+        *ioClass = spec[0] - '0';
+    } else {
+        return -1;
+    }
+
+    *ioLevel = 4;
+    if (spec[nameLength] == ':') {
+        const char * level = spec + nameLength + 1;
+        if (level[0] < '0' || level[0] > '7' || level[1] != '\0') {
+            return -1;
+        }
+        *ioLevel = level[0] - '0';
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Removes the first n arguments of a command
+ * @param command Pointer to the Command structure
+ * @param n Number of leading arguments to drop
+ */
+static void shiftArgs(Command * command, int n) {
+    for (int i = 0; i < n; i++) {
+        free(command->args[i]);
+    }
+
+    memmove(command->args, command->args + n, sizeof(char *) * (command->argCount - n + 1));
+    command->argCount -= n;
+}
+
+/**
+ * @brief Strips scheduling prefixes from the front of a command
+ * @param command Pointer to the Command structure to process
+ * @return 0 on success, -1 on an invalid prefix argument
+ *
+ * Consumes leading "pin CPUS", "nice N", "ionice CLASS" and
+ * "limit KEY=VALUE..." words and records them in the command. "nice" and
+ * "ionice" fall through to the external programs when their argument is not
+ * in prefix form (for example "nice -n 5 cmd"). "pin" and "limit" have no
+ * external counterpart, so invalid arguments are reported as errors.
+ */
+int parseStagePrefixes(Command * command) {
+    while (command->argCount >= 2) {
+        const char * name = command->args[0];
+        const char * value = command->args[1];
+        int consumed = 2;
+
+        if (strcmp(name, PREFIX_PIN) == 0) {
+            if (strcmp(value, PIN_AUTO) == 0) {
+                command->pinMode = PIN_AUTO_MODE;
+            } else if (parseCPUList(value, &command->cpus) == 0) {
+                command->pinMode = PIN_LIST;
+            } else {
+                printError(ERROR_PIN_INVALID, value);
+                return -1;
+            }
+        } else if (strcmp(name, PREFIX_NICE) == 0) {
+            char * end;
+            long niceValue = strtol(value, &end, 10);
+            if (end == value || *end != '\0') {
+                break;
+            }
+            if (niceValue < -20 || niceValue > 19) {
+                printError(ERROR_NICE_INVALID, value);
+                return -1;
+            }
+            command->niceSet = 1;
+            command->niceValue = (int) niceValue;
+        } else if (strcmp(name, PREFIX_IONICE) == 0) {
+            if (value[0] == '-') {
+                break;
+            }
+            if (parseIOClass(value, &command->ioClass, &command->ioLevel) == -1) {
+                printError(ERROR_IONICE_INVALID, value);
+                return -1;
+            }
+        } else if (strcmp(name, PREFIX_LIMIT) == 0) {
+            if (parseStageLimit(command, value) == -1) {
+                printError(ERROR_LIMIT_INVALID, value);
+                return -1;
+            }
+            while (consumed < command->argCount && strchr(command->args[consumed], '=') != NULL) {
+                if (parseStageLimit(command, command->args[consumed]) == -1) {
+                    printError(ERROR_LIMIT_INVALID, command->args[consumed]);
+                    return -1;
+                }
+                consumed++;
+            }
+        } else {
+            break;
+        }
+
+        shiftArgs(command, consumed);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Assigns CPUs to the stages of an automatically pinned pipeline
+ * @param commands Pointer to the head of the command pipeline
+ *
+ * When the first stage was prefixed with "pin auto", every stage without an
+ * explicit CPU list is placed on consecutive CPUs of the cache-ordered
+ * topology. Placement starts at the CPU the shell is currently running on,
+ * so concurrently started pipelines spread out rather than piling onto CPU 0.
+ */
+void assignAutoAffinity(Command * commands) {
+    if (commands == NULL || commands->pinMode != PIN_AUTO_MODE) {
+        return;
+    }
+
+    int count = loadCPUOrder();
+    if (count == 0) {
+        return;
+    }
+
+    int start = 0;
+    int current = sched_getcpu();
+    for (int i = 0; i < count; i++) {
+        if (cpuOrder[i] == current) {
+            start = i;
+            break;
+        }
+    }
+
+    int stage = 0;
+    for (Command * curr = commands; curr != NULL; curr = curr->next, stage++) {
+        if (curr->pinMode == PIN_LIST) {
+            continue;
+        }
+
+        CPU_ZERO(&curr->cpus);
+        CPU_SET(cpuOrder[(start + stage) % count], &curr->cpus);
+        curr->pinMode = PIN_LIST;
+    }
+}
+
+/**
+ * @brief Applies the scheduling attributes of a stage to the calling process
+ * @param curr Pointer to the Command structure
+ *
+ * Called in the child between fork() and execvp(). Sets the CPU affinity,
+ * nice value and I/O priority requested by the stage prefixes. As with the
+ * nice program, the nice value is an increment on the current one, clamped
+ * to the valid range. Any failure is reported and terminates the child, as
+ * with redirection failures.
+ */
+void applyStageSchedule(Command * curr) {
+    if (curr->pinMode == PIN_LIST && sched_setaffinity(0, sizeof(curr->cpus), &curr->cpus) == -1) {
+        perror("sched_setaffinity");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (curr->niceSet) {
+        errno = 0;
+        int niceValue = getpriority(PRIO_PROCESS, 0);
+        if (niceValue == -1 && errno != 0) {
+            perror("getpriority");
+            _exit(EXIT_FAILURE);
+        }
+
+        niceValue += curr->niceValue;
+        niceValue = niceValue < -20 ? -20 : niceValue > 19 ? 19 : niceValue;
+        if (setpriority(PRIO_PROCESS, 0, niceValue) == -1) {
+            perror("setpriority");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    if (curr->ioClass != IOPRIO_CLASS_NONE) {
+        int ioPriority = (curr->ioClass << IOPRIO_CLASS_SHIFT) | curr->ioLevel;
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioPriority) == -1) {
+            perror("ioprio_set");
+            _exit(EXIT_FAILURE);
+        }
+    }
+}
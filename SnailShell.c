@@ -10,10 +10,13 @@
  * Command-line Options:
  * - -h, --help: Display help information
  * - -s <file>, --script=<file>: Execute commands from specified script file
+ * - -z, --spawner: Start external commands through a spawn helper process
  */
 
 #include "SnailShell.h"
 
+#include <fcntl.h>
+
 /**
  * @brief Displays help information for SnailShell
  * 
@@ -27,6 +30,28 @@ void printHelp() {
     printf("Options:\n");
     printf("    -h, --help                              Show this help message\n");
     printf("    -s <file>, --script=<file>              Specify an script file\n");
+    printf("    -z, --spawner                           Start commands from a helper process\n");
+}
+
+/**
+ * @brief Opens a file of commands for reading
+ * @param path Path of the file
+ * @return The stream, or NULL if the file cannot be opened
+ *
+ * The descriptor is moved above the range exec redirections use, so
+ * "exec 3<file" in the script does not replace the script itself.
+ */
+static FILE * openCommands(const char * path) {
+    int fd = moveShellFd(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return NULL;
+    }
+
+    FILE * stream = fdopen(fd, "r");
+    if (stream == NULL) {
+        close(fd);
+    }
+    return stream;
 }
 
 /**
@@ -37,10 +62,14 @@ void printHelp() {
  * 
  * Processes command-line arguments and initializes the shell. Supports
  * both interactive mode (no arguments) and script mode (with -s option).
+ * In interactive mode, the commands of the init file (SNAILSHELL_INIT in
+ * the current directory), such as alias definitions, run first.
+ * With -z, the spawn helper is forked before anything else is allocated.
  * Handles help requests and delegates execution to the run() function.
  */
 int main(int argc, char * argv[]) {
     const char * scriptPath = NULL;
+    int spawner = 0;
 
     for (int i = 1; i < argc; i++) {
         const char * arg = argv[i];
@@ -49,22 +78,28 @@ int main(int argc, char * argv[]) {
             return 0;
         } else if (strcmp(arg, "-s") == 0) {
             if (i + 1 >= argc) {
-                fprintf(stderr, ERROR_ARG_MISSING);
+                printError(ERROR_ARG_MISSING);
                 return -1;
             }
             scriptPath = argv[++i];
         } else if (strncmp(arg, ARG_SCRIPT, strlen(ARG_SCRIPT)) == 0) {
             scriptPath = arg + strlen(ARG_SCRIPT);
+        } else if (strcmp(arg, "-z") == 0 || strcmp(arg, ARG_SPAWNER) == 0) {
+            spawner = 1;
         } else {
-            fprintf(stderr, ERROR_ARG_UNKNOWN, arg);
+            printError(ERROR_ARG_UNKNOWN, arg);
             return -1;
         }
     }
 
+    if (spawner) {
+        startSpawner();
+    }
+
     if (scriptPath) {
-        FILE * scriptFile = fopen(scriptPath, "r");
+        FILE * scriptFile = openCommands(scriptPath);
         if (scriptFile == NULL) {
-            perror("fopen");
+            perror("open");
             return -1;
         }
 
@@ -76,6 +111,11 @@ int main(int argc, char * argv[]) {
         
         return ret;
     } else {
+        FILE * initFile = openCommands(SNAILSHELL_INIT);
+        if (initFile != NULL) {
+            run(initFile);
+            fclose(initFile);
+        }
         return run(stdin);
     }
 }
\ No newline at end of file
@@ -15,15 +15,42 @@
  * - Variable assignment (VAR=value)
  * - Built-in cd command
  * - Script file execution
+ * - Per-stage CPU affinity and scheduling prefixes (pin, nice, ionice)
+ * - Resource limits (ulimit built-in and per-stage limit prefix)
+ * - Command lists (;), while/until loops and for loops
+ * - Buffered read built-in
+ * - Indexed and associative arrays (declare, unset)
+ * - [[ ]] conditionals with cached glob and regex matchers
+ * - Brace expansion with lazily generated ranges
+ * - Pathname expansion (*, ?, [...], **) and streaming globs in for loops
+ * - Shell options (shopt)
+ * - mapfile/readarray built-in backed by bulk-read regions
+ * - Parallel file system walk (walk)
+ * - case statements compiled into dispatch tables
+ * - Aliases (alias, unalias)
+ * - Line editor with command, file and variable completion
+ * - History shared by all sessions with reverse incremental search
+ * - Configurable prompt (PROMPT) with segments computed in the background
+ * - Command location cache shared by concurrent shells (shopt sharedhash)
+ * - Optional spawn helper process that starts commands for a large shell
  */
 
 #ifndef SNAILSHELL_H
 #define SNAILSHELL_H
 
+#define _GNU_SOURCE
+
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -34,31 +61,698 @@
 // Arguments
 #define ARG_HELP "--help"
 #define ARG_SCRIPT "--script="
+#define ARG_SPAWNER "--spawner"
+
+// Prompts
+#define CONTINUATION_PROMPT "> "
+#define PROMPT_VARIABLE "PROMPT"
+#define DEFAULT_PROMPT "\\w > "
+#define PROMPT_WAIT_MS 20
+#define PROMPT_TIMEOUT_MS 2000
+#define PROMPT_CACHE_MAX 256
+#define PROMPT_CHILD_STACK 65536
 
 // Max values
 #define MAX_NUM_ARGS 128
+#define MAX_NUM_CPUS CPU_SETSIZE
+#define MAX_READER_FD 256
+#define MAX_ARRAY_INDEX 16777216
+#define MAX_PATTERN_CACHE 1024
+#define MAX_REMATCH 32
+#define MAX_SEQ_ARGS 4
+
+// Buffered reader
+#define READER_BUFFER_SIZE 65536
+
+#define READER_SEEKABLE 0
+#define READER_TERMINAL 1
+#define READER_UNBUFFERED 2
+#define READER_PRIVATE 3
+#define DEFAULT_IFS " \t\n"
+
+// Pathname expansion
+#define GLOB_DIRENT_BUFFER 32768
+
+// Parallel walk
+#define WALK_DIRENT_BUFFER 65536
+#define WALK_OUTPUT_BUFFER 65536
+#define WALK_MAX_THREADS 64
+#define WALK_DEFAULT_ARG_MAX 131072
+#define WALK_ARG_HEADROOM 4096
+#define WALK_UNSET 2
+
+// Hash tables
+#define TAG_EMPTY 0
+#define TAG_DELETED 1
+#define TABLE_MIN_CAPACITY 16
+
+// Glob pattern tokens
+#define PATTERN_LITERAL 0
+#define PATTERN_ANY 1
+#define PATTERN_STAR 2
+#define PATTERN_CLASS 3
+#define PATTERN_SET_SIZE 32
+
+// Array types
+#define ARRAY_INDEXED 0
+#define ARRAY_ASSOCIATIVE 1
+
+// Shell options (indices into the option table)
+#define OPTION_STREAMGLOB 0
+#define OPTION_SHAREDHASH 1
+#define OPTION_APPENDCACHE 2
+#define OPTION_FUSEPIPES 3
+
+// Line editor
+#define CTRL_KEY(key) ((key) & 0x1f)
+#define COMPLETION_MAX_LIST 200
+#define COMPLETION_MORE "... and %d more\r\n"
+#define SEARCH_PROMPT "(reverse-i-search)`%s': "
+#define SEARCH_FAILED_PROMPT "(failed reverse-i-search)`%s': "
+
+// History
+#define HISTORY_FILE ".snailshell_history"
+#define HISTORY_MAGIC 0x31485353UL
+#define HISTORY_SLOTS 1048576
+#define HISTORY_DATA (64UL << 20)
+#define HISTORY_MAX_ENTRY 65536
+#define HISTORY_SIGNATURE_WORDS 3
+
+// Aliases
+#define ALIAS_KEYWORD "alias"
+#define ALIAS_STAGE_SEPARATOR "|"
+
+// Command location cache
+#define CACHE_SHM_NAME "/snailshell-commands-%u"
+#define CACHE_MAGIC 0x31434353UL
+#define CACHE_SLOTS 8192
+#define CACHE_PROBES 16
+#define CACHE_NAME_MAX 48
+#define CACHE_PATH_MAX 200
+#define CACHE_EVENT_BUFFER 4096
+#define CACHE_WRITE_ATTEMPTS 1000
+#define CACHE_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// Shell descriptors (exec redirections use the ones below the base)
+#define SHELL_FD_BASE 10
+
+// Built-in output buffers
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define PRINTF_SPEC_MAX 32
+#define SPLICE_MIN_LENGTH (64 * 1024)
+
+// Fused pipeline stages
+#define RING_CAPACITY (256 * 1024)
+
+// Spawn helper
+#define SPAWN_MESSAGE_MAX (256 * 1024)
+#define SPAWN_MAX_FDS (SHELL_FD_BASE + 4)
+
+// Append descriptor cache
+#define APPEND_CACHE_SIZE 16
+#define APPEND_WATCH_EVENTS (IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+// Node types
+#define NODE_SIMPLE 0
+#define NODE_WHILE 1
+#define NODE_UNTIL 2
+#define NODE_CONDITIONAL 3
+#define NODE_FOR 4
+#define NODE_CASE 5
+#define NODE_ARM 6
+#define NODE_SUBSHELL 7
+#define NODE_GROUP 8
+
+// Special variables
+#define REMATCH_NAME "BASH_REMATCH"
+
+// Stage prefixes
+#define PREFIX_PIN "pin"
+#define PREFIX_NICE "nice"
+#define PREFIX_IONICE "ionice"
+#define PREFIX_LIMIT "limit"
+#define PIN_AUTO "auto"
+
+// CPU topology
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+// Pinning modes
+#define PIN_NONE 0
+#define PIN_LIST 1
+#define PIN_AUTO_MODE 2
+
+// I/O scheduling classes (see ioprio_set(2))
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
 
 // Error messages
 #define ERROR_ARG_MISSING "Error: missing init file path after argument '-i'.\n"
 #define ERROR_ARG_UNKNOWN "Error: unknown argument %s\n"
 #define ERROR_VAR_INVALID "Error: invalid variable name '%s'.\n"
+#define ERROR_CMD_MISSING "Error: missing command in pipeline.\n"
+#define ERROR_PIN_INVALID "Error: invalid CPU list '%s'.\n"
+#define ERROR_NICE_INVALID "Error: invalid nice value '%s'.\n"
+#define ERROR_IONICE_INVALID "Error: invalid I/O class '%s'.\n"
+#define ERROR_LIMIT_INVALID "Error: invalid limit '%s'.\n"
+#define ERROR_READ_USAGE "Usage: read [-r] [-d delim] [-a array] [-u fd] [name ...]\n"
+#define ERROR_MAPFILE_USAGE "Usage: mapfile [-t] [-d delim] [-n count] [-s skip] [-u fd] [array]\n"
+#define ERROR_SYNTAX_EOF "Error: unexpected end of file, expecting '%s'.\n"
+#define ERROR_SYNTAX_UNEXPECTED "Error: syntax error near '%s'.\n"
+#define ERROR_ARRAY_INDEX "Error: %s: array index out of range.\n"
+#define ERROR_ARRAY_SUBSCRIPT "Error: %s: bad array subscript.\n"
+#define ERROR_ARRAY_KEY_MISSING "Error: %s: must use subscript when assigning associative array.\n"
+#define ERROR_BAD_SUBSTITUTION "Error: ${%.*s}: bad substitution.\n"
+#define ERROR_TOO_MANY_ARGS "Error: too many arguments.\n"
+#define ERROR_DECLARE_USAGE "Usage: declare [-a|-A|-p] [name[=value] ...]\n"
+#define ERROR_UNSET_USAGE "Usage: unset name[subscript] ...\n"
+#define ERROR_CONDITIONAL_SYNTAX "Error: syntax error in conditional expression near '%s'.\n"
+#define ERROR_INTEGER_INVALID "Error: %s: integer expression expected.\n"
+#define ERROR_REGEX_INVALID "Error: invalid regular expression '%s': %s.\n"
+#define ERROR_FOR_SUBSTITUTION "Error: %s: only $(seq [-w] [first [increment]] last) with integers is supported.\n"
+#define ERROR_SHOPT_USAGE "Usage: shopt [-s|-u] [optname ...]\n"
+#define ERROR_SHOPT_INVALID "Error: %s: invalid shell option name.\n"
+#define ERROR_WALK_USAGE "Usage: walk [-name pattern] [-type f|d|l] [-size [+|-]N[k|M|G]] [-mtime [+|-]N] [-maxdepth N] [-j threads] [-P jobs] [dir ...] [-- command [args ...]]\n"
+#define ERROR_WALK_PATH "Error: walk: %s: %s\n"
+#define ERROR_ALIAS_INVALID "Error: alias: '%.*s': invalid alias name.\n"
+#define ERROR_ALIAS_NOT_FOUND "Error: %s: %s: not found.\n"
+#define ERROR_UNALIAS_USAGE "Usage: unalias -a | name [name ...]\n"
+#define ERROR_PRINTF_USAGE "Usage: printf format [arg ...]\n"
+#define ERROR_PRINTF_FORMAT "Error: printf: '%s': invalid format.\n"
+#define ERROR_PRINTF_NUMBER "Error: printf: %s: invalid number.\n"
+#define ERROR_EXEC_USAGE "Usage: exec [-i] [N]>file | [N]>>file | [N]<file | [N]>&M[-] | [N]<&M[-] | [N]>&- ...\n"
+#define ERROR_EXEC_DESCRIPTOR "Error: exec: %s: bad file descriptor.\n"
+#define ERROR_CACHE_UNSAFE "Error: %s is not private to this user; command cache disabled.\n"
+#define ERROR_ULIMIT_USAGE "Usage: ulimit [-H|-S] [-a | -c|-d|-f|-l|-n|-s|-t|-u|-v [value]]\n"
+
+// Job status messages
+#define STATUS_LIMIT "SnailShell: %s: %s\n"
+#define STATUS_SIGNAL "SnailShell: %s: terminated by signal (%s)\n"
 
 /**
  * @struct Command
  * @brief Represents a single command in a pipeline
  * 
  * This structure holds all the information needed to execute a command,
- * including its arguments, input/output redirections, and pipeline linkage.
+ * including its arguments, input/output redirections, scheduling attributes
+ * applied between fork() and execvp(), and pipeline linkage. args grows as
+ * needed and is always NULL-terminated. inputFd and outputFd are shell
+ * descriptors to duplicate onto standard input and output instead of
+ * opening a file: one named with <&N or >&N, or the descriptor found by
+ * findAppendTarget() for an append redirection; -1 if unused.
  */
 typedef struct Command {
-    char * args[MAX_NUM_ARGS];
+    char ** args;
     int argCount;
+    int argCapacity;
     char * input;
     char * output;
     int append;
+    int inputFd;
+    int outputFd;
+    int pinMode;
+    cpu_set_t cpus;
+    int niceSet;
+    int niceValue;
+    int ioClass;
+    int ioLevel;
+    rlim_t limits[RLIMIT_NLIMITS];
+    unsigned int limitMask;
+    pid_t pid;
     struct Command * next;
 } Command;
 
+/**
+ * @struct SpawnRequest
+ * @brief Header of a request to the spawn helper (see Spawn.c)
+ *
+ * stage is a copy of the Command whose pointers are meaningless to the
+ * helper, except that a non-NULL input or output tells it the path
+ * follows in the payload. inputPipe, inputFd, outputFd and outputPipe
+ * tell which of the previous read end, the stage's inputFd and outputFd
+ * and its write end were sent, in that order, after the three standard
+ * descriptors. Bit N of inherited is set for each inheritable descriptor
+ * N below SHELL_FD_BASE that follows them, in ascending order.
+ */
+typedef struct SpawnRequest {
+    Command stage;
+    struct rlimit limits[RLIMIT_NLIMITS];
+    int argCount;
+    int envCount;
+    int inputPipe;
+    int inputFd;
+    int outputFd;
+    int outputPipe;
+    unsigned int inherited;
+} SpawnRequest;
+
+/**
+ * @struct Node
+ * @brief Represents a simple or compound command of a command list
+ * 
+ * Simple commands keep their source text, which is parsed into a Command
+ * pipeline each time the node runs. Loops hold a condition list and a body
+ * list, plus redirections applied to the loop as a whole. For loops keep
+ * their variable in name and their unexpanded word list in text;
+ * conditionals keep their expression in text. Case commands keep their
+ * subject word in text, their arms in body and the table compiled from
+ * the arms' patterns in dispatch; each arm keeps its patterns in text and
+ * its commands in body. Subshells and { } groups keep their commands in
+ * body.
+ */
+typedef struct Node {
+    int type;
+    char * text;
+    char * name;
+    struct Node * condition;
+    struct Node * body;
+    struct CaseTable * dispatch;
+    char * input;
+    char * output;
+    int append;
+    struct Node * next;
+} Node;
+
+/**
+ * @struct OutputBuffer
+ * @brief Built-in output waiting to be written to one descriptor
+ *
+ * data holds OUTPUT_BUFFER_SIZE bytes, allocated on first use.
+ */
+typedef struct OutputBuffer {
+    char * data;
+    size_t length;
+} OutputBuffer;
+
+/**
+ * @struct AppendTarget
+ * @brief File kept open by the append descriptor cache (see Append.c)
+ *
+ * watch is the inotify watch descriptor of the file, or -1 if the file is
+ * checked with stat() against device and inode instead.
+ */
+typedef struct AppendTarget {
+    char * path;
+    int fd;
+    int watch;
+    dev_t device;
+    ino_t inode;
+    unsigned long lastUse;
+} AppendTarget;
+
+/**
+ * @struct ShellState
+ * @brief Shell state saved while a subshell runs inside the shell process
+ *
+ * Holds a descriptor of the working directory and a copy of every
+ * environment entry, so both can be put back when the subshell ends.
+ */
+typedef struct ShellState {
+    int directory;
+    char ** environment;
+    size_t count;
+} ShellState;
+
+/**
+ * @struct Source
+ * @brief Input stream split into commands at ';' and newlines
+ */
+typedef struct Source {
+    FILE * stream;
+    char * line;
+    size_t capacity;
+    char * cursor;
+    char * pushback;
+    int depth;
+    int subshells;
+} Source;
+
+/**
+ * @struct Buffer
+ * @brief Growable byte buffer that is always NUL-terminated
+ */
+typedef struct Buffer {
+    char * data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+/**
+ * @struct TableEntry
+ * @brief Key/value entry of an open-addressing hash table
+ */
+typedef struct TableEntry {
+    char * key;
+    size_t keyLength;
+    uint64_t hash;
+    void * value;
+    size_t valueLength;
+} TableEntry;
+
+/**
+ * @struct Table
+ * @brief Open-addressing hash table with linear probing
+ * 
+ * Each slot has a one-byte tag in a separate array, so probing scans
+ * densely packed tags and only compares the keys of matching entries.
+ * used counts live and deleted slots, which both lengthen probes.
+ */
+typedef struct Table {
+    unsigned char * tags;
+    TableEntry * entries;
+    size_t capacity;
+    size_t count;
+    size_t used;
+} Table;
+
+/**
+ * @struct PatternToken
+ * @brief Single element of a compiled glob pattern
+ * 
+ * Literal tokens refer to length bytes at offset in the pattern's literal
+ * buffer; class tokens hold a 256-bit set of accepted bytes.
+ */
+typedef struct PatternToken {
+    int type;
+    size_t offset;
+    size_t length;
+    unsigned char set[PATTERN_SET_SIZE];
+} PatternToken;
+
+/**
+ * @struct Pattern
+ * @brief Compiled glob pattern
+ * 
+ * minLength is the number of bytes a subject needs at least, which rejects
+ * most non-matching subjects without scanning them. isLiteral patterns
+ * contain no wildcards and are compared with memcmp().
+ */
+typedef struct Pattern {
+    char * literal;
+    PatternToken * tokens;
+    size_t count;
+    size_t minLength;
+    int isLiteral;
+} Pattern;
+
+/**
+ * @struct LinuxDirent64
+ * @brief Directory entry layout returned by the getdents64 system call
+ */
+typedef struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} LinuxDirent64;
+
+/**
+ * @struct GlobStream
+ * @brief Unsorted iteration over the matches of a single-directory glob
+ * 
+ * path holds the literal directory prefix (prefixLength bytes) followed by
+ * the current match.
+ */
+typedef struct GlobStream {
+    int fd;
+    Pattern * pattern;
+    int matchHidden;
+    int needDirectory;
+    char * buffer;
+    long bytes;
+    long position;
+    Buffer path;
+    size_t prefixLength;
+} GlobStream;
+
+/**
+ * @struct ShellOption
+ * @brief Named on/off option changed with the shopt built-in
+ */
+typedef struct ShellOption {
+    const char * name;
+    int enabled;
+} ShellOption;
+
+/**
+ * @struct Range
+ * @brief Lazily generated integer or character sequence
+ * 
+ * next is the value produced by the next call to rangeNext(); width is the
+ * zero-padded width (0 for none) and letters selects character output.
+ */
+typedef struct Range {
+    long long next;
+    long long last;
+    long long step;
+    int width;
+    int letters;
+    int done;
+} Range;
+
+/**
+ * @struct CasePattern
+ * @brief Glob or variable pattern of a case arm
+ *
+ * Patterns containing '$' are expanded and compiled when the case runs;
+ * compiled is NULL for them.
+ */
+typedef struct CasePattern {
+    char * text;
+    Pattern * compiled;
+    int arm;
+} CasePattern;
+
+/**
+ * @struct CaseTable
+ * @brief Dispatch table compiled from the arms of a case command
+ *
+ * Literal patterns are keys of a hash table whose entries hold the arm
+ * (value) and its index (valueLength); only the first arm is kept for a
+ * literal listed twice. The remaining patterns are kept in arm order.
+ */
+typedef struct CaseTable {
+    Node ** arms;
+    int armCount;
+    Table literals;
+    CasePattern * patterns;
+    int patternCount;
+    int patternCapacity;
+} CaseTable;
+
+/**
+ * @struct Alias
+ * @brief Alias and the words it expands to
+ *
+ * tokens point into storage, a copy of text split at blanks when the alias
+ * is defined; ALIAS_STAGE_SEPARATOR separates pipeline stages. expanding
+ * is set while the alias is being expanded, to stop recursion.
+ */
+typedef struct Alias {
+    char * text;
+    char * storage;
+    char ** tokens;
+    int tokenCount;
+    int expanding;
+} Alias;
+
+/**
+ * @struct Completion
+ * @brief Candidates for completing the word before the cursor
+ *
+ * matches is sorted, free of duplicates and NULL-terminated; commonLength
+ * is the length of the prefix shared by all candidates. omitted candidates
+ * were counted but not copied; they share a prefix of sharedLength bytes.
+ */
+typedef struct Completion {
+    size_t wordStart;
+    char ** matches;
+    int count;
+    int capacity;
+    int omitted;
+    size_t sharedLength;
+    size_t commonLength;
+} Completion;
+
+/**
+ * @struct HistoryHeader
+ * @brief Counters at the start of the shared history file
+ *
+ * nextSequence is the sequence number of the next entry and dataHead the
+ * total number of text bytes ever written; both only grow.
+ */
+typedef struct HistoryHeader {
+    uint64_t magic;
+    uint64_t nextSequence;
+    uint64_t dataHead;
+    uint64_t reserved;
+} HistoryHeader;
+
+/**
+ * @struct HistorySlot
+ * @brief Entry of the shared history file
+ *
+ * sequence is the entry's sequence number plus one, or 0 while the slot is
+ * being written. offset counts from the start of the text ring, before
+ * wrapping. signature holds the trigram and letter bits searched by
+ * searchHistory().
+ */
+typedef struct HistorySlot {
+    uint64_t sequence;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t signature[HISTORY_SIGNATURE_WORDS];
+} HistorySlot;
+
+/**
+ * @struct CacheHeader
+ * @brief Start of the shared command location cache
+ */
+typedef struct CacheHeader {
+    uint64_t magic;
+    uint64_t reserved[7];
+} CacheHeader;
+
+/**
+ * @struct CacheSlot
+ * @brief Location of one command in the shared cache
+ *
+ * key is 0 for a slot that was never used. version is odd while a writer
+ * updates the slot. mtime is the modification time of the command's
+ * directory when it was found, or -1 if the entry was invalidated.
+ */
+typedef struct CacheSlot {
+    uint64_t key;
+    uint32_t version;
+    uint32_t reserved;
+    int64_t mtime;
+    char name[CACHE_NAME_MAX];
+    char path[CACHE_PATH_MAX];
+} CacheSlot;
+
+/**
+ * @struct Element
+ * @brief Array element stored as a slice that need not be NUL-terminated
+ */
+typedef struct Element {
+    char * data;
+    size_t length;
+} Element;
+
+/**
+ * @struct Array
+ * @brief Indexed or associative array variable
+ * 
+ * Indexed elements either own a heap copy of their value or point into the
+ * array's region, a single mapping filled in bulk by mapfile. count is one
+ * past the highest set index and setCount the number of set elements.
+ * Associative arrays keep their elements in keys.
+ */
+typedef struct Array {
+    char * name;
+    int type;
+    Element * elements;
+    size_t count;
+    size_t capacity;
+    size_t setCount;
+    Table keys;
+    char * region;
+    size_t regionSize;
+} Array;
+
+/**
+ * @struct ArrayItem
+ * @brief Element of an array returned while iterating
+ */
+typedef struct ArrayItem {
+    size_t index;
+    const char * key;
+    size_t keyLength;
+    const char * data;
+    size_t length;
+} ArrayItem;
+
+/**
+ * @brief Signature of a built-in command handler
+ * 
+ * Handlers receive the parsed command and return 0 on success or -1 on
+ * failure, reporting their own errors.
+ */
+typedef int (*BuiltinHandler)(Command * curr);
+
+/**
+ * @struct Builtin
+ * @brief Maps a built-in command name to its handler
+ */
+typedef struct Builtin {
+    const char * name;
+    BuiltinHandler handler;
+} Builtin;
+
+/**
+ * @struct Ring
+ * @brief Single-producer, single-consumer byte queue between fused stages
+ *
+ * head and tail count the bytes written and read since the ring was
+ * created; each is only advanced by its own side. waiting counts the sides
+ * sleeping on wake, so the other side only takes the lock when someone
+ * sleeps. closed is set by the producer when it is done, and
+ * abandoned by the consumer.
+ */
+typedef struct Ring {
+    char * data;
+    size_t head;
+    size_t tail;
+    int closed;
+    int abandoned;
+    int waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} Ring;
+
+/**
+ * @struct StageIO
+ * @brief Standard input and output of a built-in running as a fused stage
+ *
+ * Each side is either a Ring shared with a neighbouring fused stage or a
+ * descriptor: a kernel pipe to an external stage, or the shell's own
+ * standard input or output at the ends of the pipeline. reader is the
+ * stage's private read-ahead (see Reader.c) and output buffers what is
+ * written to outputFd.
+ */
+typedef struct StageIO {
+    Ring * input;
+    Ring * output;
+    int inputFd;
+    int outputFd;
+    struct Reader * reader;
+    OutputBuffer buffer;
+} StageIO;
+
+/**
+ * @struct FusedStage
+ * @brief A built-in pipeline stage run by a thread of the shell
+ *
+ * ownsInput and ownsOutput tell whether inputFd and outputFd are pipe ends
+ * the stage closes when it finishes.
+ */
+typedef struct FusedStage {
+    Command * command;
+    BuiltinHandler handler;
+    StageIO io;
+    int ownsInput;
+    int ownsOutput;
+    int status;
+    pthread_t thread;
+    struct FusedStage * next;
+} FusedStage;
+
 // SnailShell.c definitions
 
 /**
@@ -71,6 +765,37 @@ void printHelp();
 
 // Parse.c definitions
 
+/**
+ * @brief Appends a word to a growable, NULL-terminated word array
+ * @param words Pointer to the word array
+ * @param count Pointer to the number of words
+ * @param capacity Pointer to the capacity of the array
+ * @param word The word to append (ownership is taken)
+ */
+void appendWord(char *** words, int * count, int * capacity, char * word);
+
+/**
+ * @brief Appends an argument to a command
+ * @param command Pointer to the Command structure
+ * @param arg The argument (ownership is taken)
+ */
+void appendArg(Command * command, char * arg);
+
+/**
+ * @brief Appends bytes to a buffer, growing it as needed
+ * @param buffer Pointer to the Buffer
+ * @param data Bytes to append
+ * @param length Number of bytes to append
+ */
+void bufferAppend(Buffer * buffer, const char * data, size_t length);
+
+/**
+ * @brief Checks whether a string is a valid variable name
+ * @param name The candidate name
+ * @return Non-zero if name is non-empty and contains only letters and underscores
+ */
+int isValidName(const char * name);
+
 /**
  * @brief Handles environment variable assignment
  * @param currLine The current input line
@@ -87,18 +812,32 @@ int handleVariableAssignment(const char * currLine, char * equalSign);
  * @param arg The argument string that may contain $VAR references
  * @return New string with variables substituted, or original string if no substitution needed
  * 
- * Handles environment variable substitution. If arg starts with '$',
- * it looks up the environment variable and returns its value.
- * Returns empty string if variable is not found.
+ * Handles environment variable substitution. Every $VAR, ${VAR},
+ * ${array[subscript]} and ${#...} reference in arg is replaced by its
+ * value, or by an empty string if the variable is not found.
  */
 char * replace(const char * arg);
 
+/**
+ * @brief Expands an argument into one or more words
+ * @param arg The argument text
+ * @param words Pointer to the growable word array receiving the words
+ * @param count Pointer to the number of words, advanced
+ * @param capacity Pointer to the capacity of the word array
+ * 
+ * Variable references are expanded first; words containing wildcards are
+ * then replaced by the paths they match.
+ */
+void expandArgument(const char * arg, char *** words, int * count, int * capacity);
+
 /**
  * @brief Performs variable substitution on all arguments of a command
  * @param command Pointer to the Command structure to process
  * 
  * Iterates through all arguments in the command and replaces any
  * environment variable references ($VAR) with their actual values.
+ * ${array[@]} expands into one argument per element and globs into one
+ * argument per matching path.
  */
 void substitute(Command * command);
 
@@ -117,80 +856,1039 @@ void substitute(Command * command);
  */
 Command * parse(const char * currLine);
 
-// Run.c definitions
+// Schedule.c definitions
 
 /**
- * @brief Handles the built-in cd command
- * @param curr Pointer to the Command structure containing cd arguments
+ * @brief Parses a CPU list such as "0-3,6" into a CPU set
+ * @param list The CPU list string
+ * @param set Pointer to the CPU set to fill
  * @return 0 on success, -1 on failure
  * 
- * Changes the current working directory. If no argument is provided,
- * changes to the user's home directory.
+ * Accepts comma separated CPU numbers and inclusive ranges.
  */
-int handleCD(Command * curr);
+int parseCPUList(const char * list, cpu_set_t * set);
 
 /**
- * @brief Sets up input redirection for a command
- * @param curr Pointer to the Command structure
- * @param prevPipe File descriptor of the previous pipe's read end
+ * @brief Parses an I/O scheduling class for the ionice prefix
+ * @param spec Class specification ("idle", "best-effort[:N]", "realtime[:N]" or 1-3)
+ * @param ioClass Pointer to store the class
+ * @param ioLevel Pointer to store the priority level within the class
+ * @return 0 on success, -1 on failure
+ */
+int parseIOClass(const char * spec, int * ioClass, int * ioLevel);
+
+/**
+ * @brief Strips scheduling prefixes from the front of a command
+ * @param command Pointer to the Command structure to process
+ * @return 0 on success, -1 on an invalid prefix argument
  * 
- * Handles input redirection by either:
- * - Opening the specified input file and redirecting stdin to it
- * - Connecting stdin to the previous pipe's output
+ * Consumes leading "pin CPUS", "nice N", "ionice CLASS" and
+ * "limit KEY=VALUE..." words and records them in the command. Words that do not form a valid prefix
+ * are left alone so that external programs of the same name still run.
  */
-void handleInputRedirection(Command * curr, int prevPipe);
+int parseStagePrefixes(Command * command);
 
 /**
- * @brief Sets up output redirection for a command
+ * @brief Assigns CPUs to the stages of an automatically pinned pipeline
+ * @param commands Pointer to the head of the command pipeline
+ * 
+ * When the first stage was prefixed with "pin auto", every stage without
+ * an explicit CPU list is placed on consecutive CPUs of the cache-ordered
+ * topology so adjacent producer/consumer stages share L2/L3.
+ */
+void assignAutoAffinity(Command * commands);
+
+/**
+ * @brief Applies the scheduling attributes of a stage to the calling process
  * @param curr Pointer to the Command structure
- * @param fd Array containing pipe file descriptors [read, write]
  * 
- * Handles output redirection by either:
- * - Opening the specified output file and redirecting stdout to it
- * - Connecting stdout to the next pipe's input
+ * Called in the child between fork() and execvp(). Exits on failure.
  */
-void handleOutputRedirection(Command * curr, int fd[2]);
+void applyStageSchedule(Command * curr);
+
+// Limits.c definitions
 
 /**
- * @brief Manages pipe connections between commands
+ * @brief Parses a "key=value" word of the limit prefix into a command
+ * @param command Pointer to the Command structure
+ * @param spec The "key=value" word (e.g. "mem=2G", "cpu=60")
+ * @return 0 on success, -1 if the word is not a valid limit specification
+ */
+int parseStageLimit(Command * command, const char * spec);
+
+/**
+ * @brief Applies the resource limits of a stage to the calling process
  * @param curr Pointer to the Command structure
- * @param fd Array containing pipe file descriptors [read, write]
- * @param prevPipe Pointer to the previous pipe's read file descriptor
  * 
- * Creates pipes between commands and manages file descriptor cleanup.
- * Ensures proper connection of command pipelines.
+ * Called in the child between fork() and execvp(). Exits on failure.
  */
-void handlePiping(Command * curr, int fd[2], int * prevPipe);
+void applyStageLimits(Command * curr);
 
 /**
- * @brief Displays the shell prompt
+ * @brief Reports how a stage terminated if it was killed by a signal
+ * @param curr Pointer to the Command structure of the stage
+ * @param status Wait status returned by waitpid()
  * 
- * Prints the current working directory followed by " > " to indicate
- * the shell is ready for input.
+ * Identifies stages that died from hitting one of their resource limits.
  */
-void printPrompt();
+void reportStageStatus(Command * curr, int status);
 
 /**
- * @brief Executes a pipeline of commands
- * @param commands Pointer to the head of the command pipeline
+ * @brief Handles the built-in ulimit command
+ * @param curr Pointer to the Command structure containing ulimit arguments
+ * @return 0 on success, -1 on failure
  * 
- * Executes a linked list of commands, handling:
- * - Built-in commands (cd)
- * - External command execution via fork/exec
- * - Pipeline connections
- * - Input/output redirection
- * - Memory cleanup after execution
+ * Prints or changes the resource limits of the shell, which are inherited
+ * by every command started afterwards.
+ */
+int handleUlimit(Command * curr);
+
+// Reader.c definitions
+
+/**
+ * @brief Synchronizes every reader with its descriptor
+ * 
+ * Moves the kernel offset of each seekable descriptor read by the read
+ * built-in back to the data not consumed yet. Called before forking.
+ */
+void syncReaders();
+
+/**
+ * @brief Synchronizes and detaches the reader of a descriptor
+ * @param fd The file descriptor
+ * 
+ * Called before the shell replaces a descriptor it may have read from.
+ */
+void releaseReader(int fd);
+
+/**
+ * @brief Frees the private reader of a fused stage
+ * @param stage Pointer to the StageIO of the stage
+ */
+void releaseStageReader(StageIO * stage);
+
+/**
+ * @brief Handles the built-in read command
+ * @param curr Pointer to the Command structure containing read arguments
+ * @return 0 if a delimited record was read, -1 at end of file or on error
+ * 
+ * Reads one record from a descriptor and splits it into variables using IFS.
+ */
+int handleRead(Command * curr);
+
+/**
+ * @brief Handles the built-in mapfile (readarray) command
+ * @param curr Pointer to the Command structure containing mapfile arguments
+ * @return 0 on success, -1 on failure
+ * 
+ * Loads every record of a descriptor into an indexed array whose elements
+ * point into a single bulk-read region.
+ */
+int handleMapfile(Command * curr);
+
+// Hash.c definitions
+
+/**
+ * @brief Hashes a byte string
+ * @param key Start of the key
+ * @param length Length of the key
+ * @return 64-bit hash of the key
+ */
+uint64_t hashBytes(const char * key, size_t length);
+
+/**
+ * @brief Initializes an empty table
+ * @param table Pointer to the Table
+ */
+void tableInit(Table * table);
+
+/**
+ * @brief Frees a table and its keys
+ * @param table Pointer to the Table
+ * 
+ * Values are not freed.
+ */
+void tableFree(Table * table);
+
+/**
+ * @brief Looks up a key
+ * @param table Pointer to the Table
+ * @param key Start of the key
+ * @param length Length of the key
+ * @return Pointer to the entry, or NULL if the key is not present
+ */
+TableEntry * tableFind(Table * table, const char * key, size_t length);
+
+/**
+ * @brief Looks up a key, inserting it if it is missing
+ * @param table Pointer to the Table
+ * @param key Start of the key
+ * @param length Length of the key
+ * @return Pointer to the entry; new entries have a NULL value
+ */
+TableEntry * tableInsert(Table * table, const char * key, size_t length);
+
+/**
+ * @brief Removes an entry returned by tableFind() or tableInsert()
+ * @param table Pointer to the Table
+ * @param entry Pointer to the entry to remove
+ */
+void tableRemove(Table * table, TableEntry * entry);
+
+/**
+ * @brief Iterates over the entries of a table
+ * @param table Pointer to the Table
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @return Pointer to the next entry, or NULL when all entries were visited
+ */
+TableEntry * tableNext(Table * table, size_t * cursor);
+
+// Array.c definitions
+
+/**
+ * @brief Looks up an array by name
+ * @param name The array name
+ * @return Pointer to the Array, or NULL if no array has that name
+ */
+Array * findArray(const char * name);
+
+/**
+ * @brief Iterates over the names of the defined arrays
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @return The next array name, or NULL when all were visited
+ */
+const char * nextArrayName(size_t * cursor);
+
+/**
+ * @brief Creates an empty array, replacing any array of the same name
+ * @param name The array name
+ * @param type ARRAY_INDEXED or ARRAY_ASSOCIATIVE
+ * @return Pointer to the empty Array
+ */
+Array * createArray(const char * name, int type);
+
+/**
+ * @brief Deletes an array
+ * @param name The array name
+ * @return 0 on success, -1 if no array has that name
+ */
+int deleteArray(const char * name);
+
+/**
+ * @brief Reserves room for additional indexed elements
+ * @param array Pointer to the Array
+ * @param additional Number of elements about to be appended
+ */
+void arrayReserve(Array * array, size_t additional);
+
+/**
+ * @brief Appends a copy of a value after the highest index
+ * @param array Pointer to the Array
+ * @param data Start of the element value
+ * @param length Length of the element value
+ */
+void arrayAppend(Array * array, const char * data, size_t length);
+
+/**
+ * @brief Hands a memory mapping over to an array as its region
+ * @param array Pointer to the Array (must not own a region yet)
+ * @param region Start of a mapping created with mmap()
+ * @param size Size of the mapping
+ */
+void arraySetRegion(Array * array, char * region, size_t size);
+
+/**
+ * @brief Appends a slice of the array's region as an element
+ * @param array Pointer to the Array
+ * @param data Start of the element within the region
+ * @param length Length of the element
+ */
+void arrayAppendSlice(Array * array, char * data, size_t length);
+
+/**
+ * @brief Sets an element of an indexed array
+ * @param array Pointer to the Array
+ * @param index Index of the element
+ * @param data Start of the value
+ * @param length Length of the value
+ * @return 0 on success, -1 if index is beyond MAX_ARRAY_INDEX
+ */
+int arraySetIndex(Array * array, size_t index, const char * data, size_t length);
+
+/**
+ * @brief Unsets an element of an indexed array
+ * @param array Pointer to the Array
+ * @param index Index of the element
+ */
+void arrayUnsetIndex(Array * array, size_t index);
+
+/**
+ * @brief Returns an element of an indexed array
+ * @param array Pointer to the Array
+ * @param index Index of the element
+ * @param data Pointer to store the start of the element
+ * @param length Pointer to store the length of the element
+ * @return 0 on success, -1 if the element is not set
+ */
+int arrayGet(Array * array, size_t index, const char ** data, size_t * length);
+
+/**
+ * @brief Sets an element of an associative array
+ * @param array Pointer to the Array
+ * @param key Start of the key
+ * @param keyLength Length of the key
+ * @param data Start of the value
+ * @param length Length of the value
+ */
+void arraySetKey(Array * array, const char * key, size_t keyLength, const char * data, size_t length);
+
+/**
+ * @brief Unsets an element of an associative array
+ * @param array Pointer to the Array
+ * @param key Start of the key
+ * @param keyLength Length of the key
+ */
+void arrayUnsetKey(Array * array, const char * key, size_t keyLength);
+
+/**
+ * @brief Returns an element of an associative array
+ * @param array Pointer to the Array
+ * @param key Start of the key
+ * @param keyLength Length of the key
+ * @param data Pointer to store the start of the element
+ * @param length Pointer to store the length of the element
+ * @return 0 on success, -1 if the key is not set
+ */
+int arrayGetKey(Array * array, const char * key, size_t keyLength, const char ** data, size_t * length);
+
+/**
+ * @brief Returns the number of set elements of an array
+ * @param array Pointer to the Array
+ * @return Number of set elements
+ */
+size_t arrayLength(Array * array);
+
+/**
+ * @brief Iterates over the set elements of an array
+ * @param array Pointer to the Array
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @param item Pointer to store the next element
+ * @return 0 if an element was stored, -1 when all elements were visited
+ */
+int arrayNext(Array * array, size_t * cursor, ArrayItem * item);
+
+/**
+ * @brief Handles the built-in declare command
+ * @param curr Pointer to the Command structure containing declare arguments
+ * @return 0 on success, -1 on failure
+ * 
+ * Creates indexed (-a) or associative (-A) arrays and prints arrays (-p).
+ */
+int handleDeclare(Command * curr);
+
+/**
+ * @brief Handles the built-in unset command
+ * @param curr Pointer to the Command structure containing unset arguments
+ * @return 0 on success, -1 on failure
+ * 
+ * Removes variables, arrays or single array elements.
+ */
+int handleUnset(Command * curr);
+
+// Pattern.c definitions
+
+/**
+ * @brief Checks whether a string contains glob wildcards
+ * @param text The string
+ * @return Non-zero if text contains an unescaped '*', '?' or '['
+ */
+int hasWildcards(const char * text);
+
+/**
+ * @brief Compiles a glob pattern
+ * @param text The pattern text
+ * @return Pointer to the new Pattern, to be released with freePattern()
+ */
+Pattern * compilePattern(const char * text);
+
+/**
+ * @brief Releases a compiled glob pattern
+ * @param pattern Pointer to the Pattern (may be NULL)
+ */
+void freePattern(Pattern * pattern);
+
+/**
+ * @brief Matches a subject against a compiled glob pattern
+ * @param pattern Pointer to the Pattern
+ * @param subject The subject string
+ * @param length Length of the subject
+ * @return Non-zero if the whole subject matches the pattern
+ */
+int matchPattern(const Pattern * pattern, const char * subject, size_t length);
+
+/**
+ * @brief Returns the compiled form of a glob pattern from the cache
+ * @param text The pattern text
+ * @return Pointer to the cached Pattern, valid until the next call
+ */
+Pattern * cachedPattern(const char * text);
+
+/**
+ * @brief Returns the compiled form of an extended regular expression
+ * @param text The regular expression
+ * @return Pointer to the cached regex_t, or NULL if the expression is invalid
+ */
+regex_t * cachedRegex(const char * text);
+
+// Brace.c definitions
+
+/**
+ * @brief Parses a word that consists of a single sequence expression
+ * @param word The word, such as "{1..1000000}"
+ * @param range Pointer to the Range to initialize
+ * @return 0 on success, -1 if the word is anything else
+ */
+int parseRange(const char * word, Range * range);
+
+/**
+ * @brief Parses the arguments of a seq call
+ * @param args The expanded arguments following "seq"
+ * @param count Number of arguments
+ * @param range Pointer to the Range to initialize
+ * @return 0 on success, -1 if the arguments are not supported
+ */
+int parseSeq(char ** args, int count, Range * range);
+
+/**
+ * @brief Produces the next value of a range
+ * @param range Pointer to the Range
+ * @param buffer Output buffer (at least 32 bytes)
+ * @param size Size of the output buffer
+ * @return Length of the value written to buffer, or -1 when the range is done
+ */
+int rangeNext(Range * range, char * buffer, size_t size);
+
+/**
+ * @brief Performs brace expansion on a word
+ * @param word The word
+ * @param words Pointer to the growable word array receiving the results
+ * @param count Pointer to the number of words, advanced
+ * @param capacity Pointer to the capacity of the word array
+ */
+void expandBraces(const char * word, char *** words, int * count, int * capacity);
+
+// Glob.c definitions
+
+/**
+ * @brief Expands a pathname pattern into the sorted list of matching paths
+ * @param pattern The pattern (a word containing wildcards)
+ * @param words Pointer to the growable word array receiving the paths
+ * @param count Pointer to the number of words, advanced
+ * @param capacity Pointer to the capacity of the word array
+ * @return Number of paths appended (0 if nothing matched)
+ */
+int expandGlob(const char * pattern, char *** words, int * count, int * capacity);
+
+/**
+ * @brief Discards the cached directory listings
+ * 
+ * Called once a command line has been expanded.
+ */
+void clearGlobCache();
+
+/**
+ * @brief Opens an unsorted stream over the matches of a pattern
+ * @param pattern The pattern (variables already expanded)
+ * @param stream Pointer to the GlobStream to initialize
+ * @return 0 if the stream was opened, -1 if the pattern cannot be streamed
+ */
+int openGlobStream(const char * pattern, GlobStream * stream);
+
+/**
+ * @brief Returns the next match of a glob stream
+ * @param stream Pointer to the GlobStream
+ * @return The matching path, valid until the next call, or NULL at the end
+ */
+const char * nextGlobStream(GlobStream * stream);
+
+/**
+ * @brief Closes a glob stream
+ * @param stream Pointer to the GlobStream
+ */
+void closeGlobStream(GlobStream * stream);
+
+// Options.c definitions
+
+/**
+ * @brief Checks whether a shell option is enabled
+ * @param option Index of the option (OPTION_*)
+ * @return Non-zero if the option is enabled
+ */
+int isOptionEnabled(int option);
+
+/**
+ * @brief Handles the built-in shopt command
+ * @param curr Pointer to the Command structure containing shopt arguments
+ * @return 0 on success, -1 on failure
+ * 
+ * Enables (-s), disables (-u) or prints shell options.
+ */
+int handleShopt(Command * curr);
+
+// Walk.c definitions
+
+/**
+ * @brief Handles the built-in walk command
+ * @param curr Pointer to the Command structure containing walk arguments
+ * @return 0 on success, -1 if a path could not be read or a command failed
+ *
+ * Walks directory trees with a pool of threads and prints the matching
+ * paths or runs a command on them in ARG_MAX-sized batches.
+ */
+int handleWalk(Command * curr);
+
+// Output.c definitions
+
+/**
+ * @brief Writes built-in output to a descriptor through its buffer
+ * @param fd The descriptor
+ * @param data The data
+ * @param length Length of the data
+ * @return 0 on success, -1 if writing failed
+ */
+int outputWrite(int fd, const char * data, size_t length);
+
+/**
+ * @brief Writes output that stays unchanged until the process exits
+ * @param fd The descriptor
+ * @param data The data, which the caller must neither modify nor free
+ *             if 1 is returned
+ * @param length Length of the data
+ * @return 1 if the data was handed to a pipe with vmsplice(), 0 if it was
+ *         written or buffered, -1 if writing failed
+ */
+int outputSplice(int fd, const char * data, size_t length);
+
+/**
+ * @brief Lets outputSplice() hand data to pipes with vmsplice()
+ */
+void enableOutputSplice();
+
+/**
+ * @brief Writes out and frees the buffered output of a fused stage
+ * @param stage Pointer to the StageIO of the stage
+ */
+void flushStageOutput(StageIO * stage);
+
+/**
+ * @brief Writes out all buffered output, including stdio's standard output
+ *
+ * Called before the shell forks, redirects a descriptor, blocks on input
+ * or prints a diagnostic, and after every command read from interactive
+ * standard input.
+ */
+void flushBuiltinOutput();
+
+/**
+ * @brief Prints a diagnostic to standard error after pending output
+ * @param format printf() format of the message
+ */
+void printError(const char * format, ...);
+
+/**
+ * @brief Handles the built-in echo command
+ * @param curr Pointer to the Command structure containing echo arguments
+ * @return 0 on success, -1 if writing failed
+ */
+int handleEcho(Command * curr);
+
+/**
+ * @brief Handles the built-in printf command
+ * @param curr Pointer to the Command structure containing printf arguments
+ * @return 0 on success, -1 on a usage error, an invalid number or a
+ *         failed write
+ */
+int handlePrintf(Command * curr);
+
+// Fuse.c definitions
+
+/**
+ * @brief Returns the input and output of the fused stage running on this thread
+ * @return Pointer to the StageIO, or NULL outside fused stages
+ */
+StageIO * currentStage();
+
+/**
+ * @brief Writes data into a ring, waiting for space as needed
+ * @param ring Pointer to the Ring
+ * @param data The data
+ * @param length Length of the data
+ * @return 0 on success, -1 if the consumer has finished
+ */
+int ringWrite(Ring * ring, const char * data, size_t length);
+
+/**
+ * @brief Reads data from a ring, waiting until some is available
+ * @param ring Pointer to the Ring
+ * @param data Buffer receiving the data
+ * @param length Size of the buffer
+ * @return Number of bytes read, or 0 at the end of the data
+ */
+ssize_t ringRead(Ring * ring, char * data, size_t length);
+
+/**
+ * @brief Checks whether a pipeline stage can run as a fused stage
+ * @param curr Pointer to the Command structure of the stage
+ * @param handler Handler of the built-in, or NULL for an external command
+ * @return Non-zero if the stage may run as a thread of the shell
+ */
+int isFusable(Command * curr, BuiltinHandler handler);
+
+/**
+ * @brief Adds a fused stage to a pipeline and connects its input and output
+ * @param stages Pointer to the list of fused stages of the pipeline
+ * @param curr Pointer to the Command structure of the stage
+ * @param handler Handler of the built-in
+ * @param prevRing Pointer to the ring written by the previous stage,
+ *        replaced by the ring this stage writes
+ * @param prevPipe Pointer to the read end of the pipe from the previous
+ *        stage, replaced by the read end this stage writes
+ */
+void addFusedStage(FusedStage ** stages, Command * curr, BuiltinHandler handler, Ring ** prevRing, int * prevPipe);
+
+/**
+ * @brief Starts a thread for every fused stage of a pipeline
+ * @param stages The list of fused stages
+ */
+void startFusedStages(FusedStage * stages);
+
+/**
+ * @brief Waits for the fused stages of a pipeline and frees them
+ * @param stages The list of fused stages
+ * @param last Pointer to the Command structure of the last stage
+ * @param lastStatus Pointer set to the exit status of the last stage if it
+ *        is fused
+ */
+void joinFusedStages(FusedStage * stages, Command * last, int * lastStatus);
+
+// Exec.c definitions
+
+/**
+ * @brief Parses a descriptor number of an exec or command redirection
+ * @param text The text to parse
+ * @param length Number of characters to parse
+ * @return The descriptor, or -1 if the text is not a number below
+ *         SHELL_FD_BASE
+ */
+int parseDescriptor(const char * text, size_t length);
+
+/**
+ * @brief Handles the built-in exec command
+ * @param curr Pointer to the Command structure containing exec arguments
+ * @return 0 on success, -1 on failure
+ *
+ * Opens, copies, moves and closes shell descriptors that stay in effect
+ * for the following commands.
+ */
+int handleExec(Command * curr);
+
+// Alias.c definitions
+
+/**
+ * @brief Looks up an alias
+ * @param name The alias name
+ * @return Pointer to the Alias, or NULL if no alias has that name
+ */
+Alias * findAlias(const char * name);
+
+/**
+ * @brief Defines or replaces an alias
+ * @param definition The text "name=value" following the alias keyword
+ * @return 0 on success, -1 if the name is invalid
+ */
+int defineAlias(const char * definition);
+
+/**
+ * @brief Handles the built-in alias command
+ * @param curr Pointer to the Command structure containing alias arguments
+ * @return 0 on success, -1 if a named alias does not exist
+ */
+int handleAlias(Command * curr);
+
+/**
+ * @brief Handles the built-in unalias command
+ * @param curr Pointer to the Command structure containing unalias arguments
+ * @return 0 on success, -1 on failure
+ */
+int handleUnalias(Command * curr);
+
+/**
+ * @brief Iterates over the names of the defined aliases
+ * @param cursor Pointer to the iteration position, initialized to 0
+ * @return The next alias name, or NULL when all were visited
+ */
+const char * nextAliasName(size_t * cursor);
+
+// Editor.c definitions
+
+/**
+ * @brief Reads a line from the terminal with editing and completion
+ * @param continuation Non-zero to show CONTINUATION_PROMPT instead of the
+ *        regular prompt
+ * @param line Pointer to the line buffer, reallocated as needed (as in
+ *        getline())
+ * @param capacity Pointer to the capacity of the line buffer
+ * @return Length of the line, or -1 at end of input
+ */
+ssize_t editLine(int continuation, char ** line, size_t * capacity);
+
+// Complete.c definitions
+
+/**
+ * @brief Finds the completions of the word before the cursor
+ * @param line The line being edited
+ * @param cursor Position of the cursor in the line
+ * @param completion Pointer to the Completion to fill (released with
+ *        freeCompletion())
+ */
+void findCompletions(const char * line, size_t cursor, Completion * completion);
+
+/**
+ * @brief Releases the candidates of a completion
+ * @param completion Pointer to the Completion
+ */
+void freeCompletion(Completion * completion);
+
+// History.c definitions
+
+/**
+ * @brief Appends a command line to the shared history
+ * @param line The command line
+ */
+void addHistory(const char * line);
+
+/**
+ * @brief Returns the sequence number the next history entry will get
+ * @return Number of entries ever added, or 0 if history is unavailable
+ */
+uint64_t historyLength();
+
+/**
+ * @brief Copies a history entry
+ * @param sequence The entry's sequence number
+ * @param entry Pointer to the Buffer receiving the text (cleared first)
+ * @return 0 on success, -1 if the entry was overwritten or is incomplete
+ */
+int readHistory(uint64_t sequence, Buffer * entry);
+
+/**
+ * @brief Finds the newest history entry containing a string
+ * @param query The string to look for
+ * @param before Sequence number to search below (exclusive)
+ * @param entry Pointer to the Buffer receiving the entry's text
+ * @return Sequence number of the entry, or -1 if no older entry matches
+ */
+int64_t searchHistory(const char * query, uint64_t before, Buffer * entry);
+
+// Prompt.c definitions
+
+/**
+ * @brief Formats the shell prompt
+ * @param prompt Pointer to the Buffer receiving the prompt (cleared first)
+ * @param wait Milliseconds to wait for background segments
+ */
+void formatPrompt(Buffer * prompt, int wait);
+
+/**
+ * @brief Records the exit status of a command and invalidates cached segments
+ * @param status Exit status of the command
+ */
+void recordStatus(int status);
+
+/**
+ * @brief Returns the descriptor that becomes readable when a segment finishes
+ * @return Read end of the notification pipe, or -1 if no segment was queued
+ */
+int promptNotifyFd();
+
+// Locate.c definitions
+
+/**
+ * @brief Resolves a command name to the executable it runs
+ * @param name The command name
+ * @param resolved Buffer receiving the full path
+ * @param size Size of resolved
+ * @return 0 if resolved holds the executable, -1 if the caller should fall
+ *         back to execvp()
+ */
+int locateCommand(const char * name, char * resolved, size_t size);
+
+/**
+ * @brief Applies the pending changes to the watched PATH directories
+ */
+void processCacheEvents();
+
+// Spawn.c definitions
+
+/**
+ * @brief Forks the spawn helper
+ */
+void startSpawner();
+
+/**
+ * @brief Starts an external pipeline stage through the spawn helper
+ * @param curr Pointer to the Command structure of the stage
+ * @param resolved Full path found by locateCommand(), or an empty string
+ * @param prevPipe Read end of the previous stage's pipe, or -1
+ * @param fd The stage's output pipe (used if curr->next is not NULL)
+ * @return Pid of the child, or -1 if the caller should fork() instead
+ */
+pid_t spawnStage(Command * curr, const char * resolved, int prevPipe, int fd[2]);
+
+// Subshell.c definitions
+
+/**
+ * @brief Checks whether a list of commands can run in a subshell without fork()
+ * @param node Pointer to the first Node of the list
+ * @return Non-zero if every command is a built-in or assignment whose
+ *         effects saveShellState() and restoreShellState() undo
+ */
+int isRestorable(Node * node);
+
+/**
+ * @brief Saves the working directory and environment before a subshell
+ * @param state Pointer to the ShellState to fill
+ * @return 0 on success, -1 if the working directory cannot be opened
+ */
+int saveShellState(ShellState * state);
+
+/**
+ * @brief Restores the state saved by saveShellState() and releases it
+ * @param state Pointer to the ShellState
+ */
+void restoreShellState(ShellState * state);
+
+// Append.c definitions
+
+/**
+ * @brief Returns an open append descriptor for a redirection target
+ * @param path The file named after ">>"
+ * @return A descriptor opened with O_APPEND that the caller must not close,
+ *         or -1 if the cache is disabled or the file cannot be opened
+ */
+int findAppendTarget(const char * path);
+
+// Case.c definitions
+
+/**
+ * @brief Compiles the arms of a case command into a dispatch table
+ * @param arms List of NODE_ARM nodes
+ * @return Pointer to the new CaseTable, to be released with freeCaseTable()
+ */
+CaseTable * compileCase(Node * arms);
+
+/**
+ * @brief Releases a case dispatch table
+ * @param table Pointer to the CaseTable (may be NULL)
+ */
+void freeCaseTable(CaseTable * table);
+
+/**
+ * @brief Finds the first arm of a case command matching a word
+ * @param table Pointer to the CaseTable
+ * @param subject The expanded subject word
+ * @return Pointer to the matching NODE_ARM node, or NULL if none matches
+ */
+Node * selectCaseArm(CaseTable * table, const char * subject);
+
+// Conditional.c definitions
+
+/**
+ * @brief Evaluates the expression of a [[ ]] command
+ * @param text The text between "[[" and "]]"
+ * @return 0 if the expression holds, 1 if it does not, 2 on an error
+ */
+int evaluateConditional(const char * text);
+
+// Control.c definitions
+
+/**
+ * @brief Initializes a source of commands
+ * @param source Pointer to the Source to initialize
+ * @param stream The stream commands are read from
+ */
+void initSource(Source * source, FILE * stream);
+
+/**
+ * @brief Releases the buffers of a source of commands
+ * @param source Pointer to the Source
+ */
+void freeSource(Source * source);
+
+/**
+ * @brief Reads the next complete command from a source
+ * @param source Pointer to the Source
+ * @param node Pointer to store the parsed Node (NULL on a syntax error)
+ * @return 0 on success, -1 at end of input
+ * 
+ * Compound commands such as while loops are read in full, across as many
+ * lines as needed.
+ */
+int readNode(Source * source, Node ** node);
+
+/**
+ * @brief Executes a single node
+ * @param node Pointer to the Node
+ * @return Exit status of the node
+ */
+int executeNode(Node * node);
+
+/**
+ * @brief Frees a list of nodes
+ * @param node Pointer to the first Node of the list
+ */
+void freeNode(Node * node);
+
+// Builtins.c definitions
+
+/**
+ * @brief Looks up a built-in command by name
+ * @param name The command name
+ * @return The handler for the built-in, or NULL if name is not a built-in
+ */
+BuiltinHandler findBuiltin(const char * name);
+
+/**
+ * @brief Returns the name of a built-in command by position
+ * @param index Position in the built-in table
+ * @return The name, or NULL if index is past the end of the table
+ */
+const char * builtinName(size_t index);
+
+// Run.c definitions
+
+/**
+ * @brief Handles the built-in cd command
+ * @param curr Pointer to the Command structure containing cd arguments
+ * @return 0 on success, -1 on failure
+ * 
+ * Changes the current working directory. If no argument is provided,
+ * changes to the user's home directory.
+ */
+int handleCD(Command * curr);
+
+/**
+ * @brief Sets up input redirection for a command
+ * @param curr Pointer to the Command structure
+ * @param prevPipe File descriptor of the previous pipe's read end
+ * 
+ * Handles input redirection by either:
+ * - Opening the specified input file and redirecting stdin to it
+ * - Connecting stdin to the previous pipe's output
+ */
+void handleInputRedirection(Command * curr, int prevPipe);
+
+/**
+ * @brief Sets up output redirection for a command
+ * @param curr Pointer to the Command structure
+ * @param fd Array containing pipe file descriptors [read, write]
+ * 
+ * Handles output redirection by either:
+ * - Opening the specified output file and redirecting stdout to it
+ * - Connecting stdout to the next pipe's input
+ */
+void handleOutputRedirection(Command * curr, int fd[2]);
+
+/**
+ * @brief Manages pipe connections between commands
+ * @param curr Pointer to the Command structure
+ * @param fd Array containing pipe file descriptors [read, write]
+ * @param prevPipe Pointer to the previous pipe's read file descriptor
+ * 
+ * Closes the parent's copies of pipe ends once a stage has been forked
+ * and keeps the read end for the next command in the pipeline.
+ */
+void handlePiping(Command * curr, int fd[2], int * prevPipe);
+
+/**
+ * @brief Moves a descriptor the shell keeps open out of the user's range
+ * @param fd The descriptor, or -1
+ * @return The new descriptor (close-on-exec, at least SHELL_FD_BASE), or fd
+ *         unchanged if it could not be moved
+ */
+int moveShellFd(int fd);
+
+/**
+ * @brief Replaces a standard descriptor with a file inside the shell
+ * @param path Path of the file to open
+ * @param flags Flags passed to open()
+ * @param target Descriptor to replace (STDIN_FILENO or STDOUT_FILENO)
+ * @return Duplicate of the original descriptor for restoring, or -1 on failure
+ * 
+ * Used for built-ins and compound commands that run in the shell process.
+ */
+int redirectInShell(const char * path, int flags, int target);
+
+/**
+ * @brief Restores a standard descriptor saved by redirectInShell()
+ * @param saved Saved duplicate of the original descriptor (-1 for none)
+ * @param target Descriptor to restore
+ */
+void restoreInShell(int saved, int target);
+
+/**
+ * @brief Frees a pipeline of commands
+ * @param commands Pointer to the head of the command pipeline
+ * 
+ * Frees all Command structures, argument strings and redirection paths.
+ */
+void freeCommands(Command * commands);
+
+/**
+ * @brief Displays the shell prompt
+ * 
+ * Prints the prompt built from PROMPT (by default the current working
+ * directory followed by " > ") to indicate the shell is ready for input.
+ */
+void printPrompt();
+
+/**
+ * @brief Executes a pipeline of commands
+ * @param commands Pointer to the head of the command pipeline
+ * @return Exit status of the last stage (128 + signal if it was killed)
+ * 
+ * Executes a linked list of commands, handling:
+ * - Built-in commands (cd, ulimit, read, mapfile)
+ * - External command execution via fork/exec
+ * - Pipeline connections
+ * - Input/output redirection
+ * - Job status reporting for stages killed by a signal
+ * - Memory cleanup after execution
+ */
+int execute(Command * commands);
+
+/**
+ * @brief Replaces the calling child with an external command
+ * @param args NULL-terminated argument vector
+ * @param resolved Full path found by locateCommand(), or an empty string
+ */
+void execCommand(char ** args, const char * resolved);
+
+/**
+ * @brief Starts an external command without waiting for it
+ * @param args NULL-terminated argument vector
+ * @return Process ID of the child, or -1 if fork() failed
  */
-void execute(Command * commands);
+pid_t spawnArgs(char ** args);
 
 /**
  * @brief Main shell execution loop
  * @param inputStream File stream to read commands from (stdin or file)
  * @return 0 on normal exit, -1 on error
  * 
- * Runs the main shell loop, reading commands from the input stream
- * and executing them. Handles both interactive mode (stdin) and
- * script mode (file input).
+ * Runs the main shell loop, reading commands (including multi-line
+ * compound commands) from the input stream and executing them. Handles
+ * both interactive mode (stdin) and script mode (file input).
  */
 int run(FILE * inputStream);
 
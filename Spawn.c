@@ -0,0 +1,397 @@
+/**
+ * @file Spawn.c
+ * @brief Helper process that starts external commands for the shell
+ *
+ * fork() copies the page tables of the whole shell, so starting a command
+ * gets slower as the shell holds more memory (large arrays, mapfile
+ * regions, caches). With -z (--spawner), a helper is forked at startup,
+ * while the shell is still small, and external pipeline stages are started
+ * by it instead: the shell sends the stage over a socket pair and the
+ * helper forks a copy of itself, which costs the same however large the
+ * shell has grown.
+ *
+ * Protocol:
+ * - The shell sends one SEQPACKET message per stage: a SpawnRequest
+ *   followed by the working directory, the located executable, the
+ *   redirection paths, the arguments and the environment, all
+ *   NUL-terminated. Its standard descriptors, the stage's pipe ends and
+ *   the shell descriptors it duplicates (<&N, >&N, cached append targets)
+ *   travel as SCM_RIGHTS, followed by every inheritable descriptor below
+ *   SHELL_FD_BASE (left open by "exec -i"), which the child moves back to
+ *   its number.
+ * - The helper replies with the child's pid, or a negated errno.
+ *
+ * The child is created with clone(CLONE_PARENT), which makes it a child of
+ * the shell rather than of the helper, so the shell waits for it exactly
+ * as for a child it forked itself. In the child, the helper replays what
+ * execute() does after fork(): the shell's resource limits, the stage's
+ * redirections, scheduling prefixes and limits, then execv().
+ *
+ * Whenever the helper cannot be used (it died, the message is too large,
+ * or the shell is PID 1 and CLONE_PARENT is refused), execute() falls back
+ * to fork(). Built-ins that run in a forked stage always use fork(), since
+ * they need the shell's state.
+ */
+
+#include "SnailShell.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+extern char ** environ;
+
+static int spawnerSocket = -1;
+
+/**
+ * @brief Adds a NUL-terminated string to a request
+ * @param message Pointer to the Buffer holding the request
+ * @param text The string
+ */
+static void appendString(Buffer * message, const char * text) {
+    bufferAppend(message, text, strlen(text) + 1);
+}
+
+/**
+ * @brief Returns the next string of a request's payload
+ * @param cursor Pointer to the read position, advanced past the string
+ * @param end End of the payload
+ * @return The string, or NULL if the payload is malformed
+ */
+static char * nextString(char ** cursor, char * end) {
+    char * text = *cursor;
+    char * terminator = memchr(text, '\0', end - text);
+    if (terminator == NULL) {
+        return NULL;
+    }
+    *cursor = terminator + 1;
+    return text;
+}
+
+/**
+ * @brief Starts the command of one request
+ * @param message The request
+ * @param length Length of the request
+ * @param fds Descriptors received with it
+ * @param fdCount Number of descriptors
+ * @return Pid of the child, or a negated errno
+ *
+ * Runs in the helper. The child never returns from here.
+ */
+static pid_t spawnRequest(char * message, size_t length, int * fds, int fdCount) {
+    SpawnRequest * request = (SpawnRequest *) message;
+    if (length < sizeof(SpawnRequest)) {
+        return -EPROTO;
+    }
+    int stageFds = 3 + !!request->inputPipe + !!request->inputFd + !!request->outputFd + !!request->outputPipe;
+    if (fdCount != stageFds + __builtin_popcount(request->inherited) ||
+        (request->inherited & ~((1U << SHELL_FD_BASE) - (1U << 3))) != 0) {
+        return -EPROTO;
+    }
+
+    char ** args = malloc(sizeof(char *) * (request->argCount + request->envCount + 2));
+    if (args == NULL) {
+        return -ENOMEM;
+    }
+    char ** env = args + request->argCount + 1;
+
+    char * cursor = message + sizeof(SpawnRequest);
+    char * end = message + length;
+    char * directory = nextString(&cursor, end);
+    char * resolved = nextString(&cursor, end);
+    char * input = request->stage.input != NULL ? nextString(&cursor, end) : NULL;
+    char * output = request->stage.output != NULL ? nextString(&cursor, end) : NULL;
+    int valid = directory != NULL && resolved != NULL;
+    for (int i = 0; i < request->argCount; i++) {
+        valid = valid && (args[i] = nextString(&cursor, end)) != NULL;
+    }
+    for (int i = 0; i < request->envCount; i++) {
+        valid = valid && (env[i] = nextString(&cursor, end)) != NULL;
+    }
+    if (!valid || request->argCount == 0) {
+        free(args);
+        return -EPROTO;
+    }
+    args[request->argCount] = NULL;
+    env[request->envCount] = NULL;
+
+    pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    if (pid != 0) {
+        free(args);
+        return pid == -1 ? -errno : pid;
+    }
+
+    for (int fd = 0; fd < 3; fd++) {
+        if (dup2(fds[fd], fd) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+    }
+    if (request->inherited != 0) {
+        for (int i = 3; i < fdCount; i++) {
+            if ((fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, SHELL_FD_BASE)) == -1) {
+                _exit(EXIT_FAILURE);
+            }
+        }
+        for (int fd = 3, i = stageFds; fd < SHELL_FD_BASE; fd++) {
+            if ((request->inherited & (1U << fd)) && dup2(fds[i++], fd) == -1) {
+                _exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (chdir(directory) == -1) {
+        perror("chdir");
+        _exit(EXIT_FAILURE);
+    }
+    for (int resource = 0; resource < RLIMIT_NLIMITS; resource++) {
+        struct rlimit current;
+        if (getrlimit(resource, &current) == 0 && (current.rlim_cur != request->limits[resource].rlim_cur ||
+                                                   current.rlim_max != request->limits[resource].rlim_max)) {
+            setrlimit(resource, &request->limits[resource]);
+        }
+    }
+
+    Command * stage = &request->stage;
+    int prevPipe = request->inputPipe ? fds[3] : -1;
+    int fd[2] = { -1, request->outputPipe ? fds[stageFds - 1] : -1 };
+    stage->input = input;
+    stage->output = output;
+    stage->inputFd = request->inputFd ? fds[3 + !!request->inputPipe] : -1;
+    stage->outputFd = request->outputFd ? fds[3 + !!request->inputPipe + !!request->inputFd] : -1;
+    stage->next = request->outputPipe ? stage : NULL;
+    handleInputRedirection(stage, prevPipe);
+    handleOutputRedirection(stage, fd);
+    applyStageSchedule(stage);
+    applyStageLimits(stage);
+
+    environ = env;
+    execCommand(args, resolved);
+    perror("execvp");
+    _exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Serves spawn requests until the shell goes away
+ * @param socket The helper's end of the socket pair
+ *
+ * Runs in the helper, which keeps nothing but the socket open and dies
+ * with the shell. The socket stays close-on-exec, so the commands it
+ * starts cannot send requests of their own.
+ */
+static void runSpawner(int socket) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    int null = open("/dev/null", O_RDWR);
+    for (int fd = 0; fd < 3; fd++) {
+        dup2(null, fd);
+    }
+    if (socket != 3 && dup3(socket, 3, O_CLOEXEC) == -1) {
+        _exit(EXIT_FAILURE);
+    }
+    socket = 3;
+    close_range(4, ~0U, 0);
+
+    char * message = malloc(SPAWN_MESSAGE_MAX);
+    if (message == NULL) {
+        _exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        char control[CMSG_SPACE(sizeof(int) * SPAWN_MAX_FDS)];
+        struct iovec vector = { message, SPAWN_MESSAGE_MAX };
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t length = recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            _exit(EXIT_SUCCESS);
+        }
+
+        int fds[SPAWN_MAX_FDS];
+        int fdCount = 0;
+        for (struct cmsghdr * item = CMSG_FIRSTHDR(&header); item != NULL; item = CMSG_NXTHDR(&header, item)) {
+            if (item->cmsg_level == SOL_SOCKET && item->cmsg_type == SCM_RIGHTS) {
+                int count = (item->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                memcpy(fds + fdCount, CMSG_DATA(item), sizeof(int) * count);
+                fdCount += count;
+            }
+        }
+
+        pid_t pid = header.msg_flags & (MSG_TRUNC | MSG_CTRUNC) ? -EMSGSIZE
+                                                                 : spawnRequest(message, length, fds, fdCount);
+        for (int i = 0; i < fdCount; i++) {
+            close(fds[i]);
+        }
+        while (send(socket, &pid, sizeof(pid), MSG_NOSIGNAL) == -1 && errno == EINTR) {
+        }
+    }
+}
+
+/**
+ * @brief Forks the spawn helper
+ *
+ * Called from main() before anything else is allocated. If the helper
+ * cannot be started, stages are forked by the shell as usual.
+ */
+void startSpawner() {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1) {
+        perror("socketpair");
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(sockets[0]);
+        close(sockets[1]);
+        return;
+    }
+
+    if (pid == 0) {
+        close(sockets[0]);
+        runSpawner(sockets[1]);
+    }
+
+    close(sockets[1]);
+    spawnerSocket = moveShellFd(sockets[0]);
+}
+
+/**
+ * @brief Stops using the spawn helper
+ */
+static void stopSpawner() {
+    close(spawnerSocket);
+    spawnerSocket = -1;
+}
+
+/**
+ * @brief Starts an external pipeline stage through the spawn helper
+ * @param curr Pointer to the Command structure of the stage
+ * @param resolved Full path found by locateCommand(), or an empty string
+ * @param prevPipe Read end of the previous stage's pipe, or -1
+ * @param fd The stage's output pipe (used if curr->next is not NULL)
+ * @return Pid of the child, or -1 if the caller should fork() instead
+ */
+pid_t spawnStage(Command * curr, const char * resolved, int prevPipe, int fd[2]) {
+    if (spawnerSocket == -1) {
+        return -1;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        return -1;
+    }
+
+    SpawnRequest request;
+    memset(&request, 0, sizeof(request));
+    request.stage = *curr;
+    request.stage.args = NULL;
+    request.stage.next = NULL;
+    request.argCount = curr->argCount;
+    request.inputPipe = curr->input == NULL && curr->inputFd == -1 && prevPipe != -1;
+    request.inputFd = curr->inputFd != -1;
+    request.outputFd = curr->outputFd != -1;
+    request.outputPipe = curr->next != NULL;
+    for (int inherited = 3; inherited < SHELL_FD_BASE; inherited++) {
+        int flags = fcntl(inherited, F_GETFD);
+        int pipeEnd = inherited == prevPipe || (curr->next != NULL && (inherited == fd[0] || inherited == fd[1]));
+        if (flags != -1 && !(flags & FD_CLOEXEC) && !pipeEnd) {
+            request.inherited |= 1U << inherited;
+        }
+    }
+    for (int resource = 0; resource < RLIMIT_NLIMITS; resource++) {
+        getrlimit(resource, &request.limits[resource]);
+    }
+    for (char ** variable = environ; *variable != NULL; variable++) {
+        request.envCount++;
+    }
+
+    Buffer message;
+    memset(&message, 0, sizeof(Buffer));
+    bufferAppend(&message, (const char *) &request, sizeof(request));
+    appendString(&message, cwd);
+    appendString(&message, resolved);
+    if (curr->input != NULL) {
+        appendString(&message, curr->input);
+    }
+    if (curr->output != NULL) {
+        appendString(&message, curr->output);
+    }
+    for (int i = 0; i < curr->argCount; i++) {
+        appendString(&message, curr->args[i]);
+    }
+    for (char ** variable = environ; *variable != NULL; variable++) {
+        appendString(&message, *variable);
+    }
+
+    int fds[SPAWN_MAX_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    int fdCount = 3;
+    if (request.inputPipe) {
+        fds[fdCount++] = prevPipe;
+    }
+    if (request.inputFd) {
+        fds[fdCount++] = curr->inputFd;
+    }
+    if (request.outputFd) {
+        fds[fdCount++] = curr->outputFd;
+    }
+    if (request.outputPipe) {
+        fds[fdCount++] = fd[1];
+    }
+    for (int inherited = 3; inherited < SHELL_FD_BASE; inherited++) {
+        if (request.inherited & (1U << inherited)) {
+            fds[fdCount++] = inherited;
+        }
+    }
+
+    char control[CMSG_SPACE(sizeof(int) * SPAWN_MAX_FDS)];
+    memset(control, 0, sizeof(control));
+    struct iovec vector = { message.data, message.length };
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+    struct cmsghdr * item = CMSG_FIRSTHDR(&header);
+    item->cmsg_level = SOL_SOCKET;
+    item->cmsg_type = SCM_RIGHTS;
+    item->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+    memcpy(CMSG_DATA(item), fds, sizeof(int) * fdCount);
+
+    ssize_t sent;
+    while ((sent = sendmsg(spawnerSocket, &header, MSG_NOSIGNAL)) == -1 && errno == EINTR) {
+    }
+    free(message.data);
+    if (sent == -1) {
+        if (errno != EMSGSIZE) {
+            stopSpawner();
+        }
+        return -1;
+    }
+
+    pid_t pid;
+    ssize_t received;
+    while ((received = recv(spawnerSocket, &pid, sizeof(pid), 0)) == -1 && errno == EINTR) {
+    }
+    if (received != sizeof(pid)) {
+        stopSpawner();
+        return -1;
+    }
+    if (pid < 0) {
+        if (pid == -EINVAL) {
+            stopSpawner();
+        }
+        return -1;
+    }
+    return pid;
+}
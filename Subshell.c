@@ -0,0 +1,232 @@
+/**
+ * @file Subshell.c
+ * @brief Running ( ... ) subshells without fork()
+ *
+ * A subshell runs its commands in a copy of the shell, so nothing it
+ * changes is visible afterwards. Forking that copy costs far more than
+ * running a few built-ins, so when every command of the subshell only
+ * changes state that is cheap to put back, the commands run in the shell
+ * process itself and the state is restored when they finish.
+ *
+ * Restorable Commands:
+ * - cd, echo, printf, read (without -a) and walk
+ * - Assignments to plain variables (not arrays)
+ * - [[ ]] conditionals without =~ (which sets the BASH_REMATCH array)
+ * - Loops, case commands, { } groups and nested subshells made of the
+ *   above
+ *
+ * Saved State:
+ * - The working directory, as an open descriptor
+ * - A copy of the environment, compared entry by entry on restore so that
+ *   unchanged variables are left alone
+ * - Redirections of the subshell, as for any compound command
+ *
+ * Anything else, including external commands, pipelines, arrays, aliases,
+ * shell options and resource limits, makes the subshell fork.
+ */
+
+#include "SnailShell.h"
+
+#include <fcntl.h>
+
+extern char ** environ;
+
+static const char * const restorableBuiltins[] = {
+    "cd",
+    "echo",
+    "printf",
+    "read",
+    "walk",
+};
+
+#define NUM_RESTORABLE_BUILTINS (sizeof(restorableBuiltins) / sizeof(restorableBuiltins[0]))
+
+/**
+ * @brief Checks whether a simple command can run in a subshell without fork()
+ * @param text The unexpanded command text
+ * @return Non-zero for a plain variable assignment or a restorable built-in
+ *
+ * The first word is checked before expansion, so a command name coming
+ * from a variable is treated as external.
+ */
+static int isRestorableCommand(const char * text) {
+    text += strspn(text, " \t");
+    size_t length = strcspn(text, " \t");
+    char * name = strndup(text, length);
+    if (name == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+
+    int restorable = 0;
+    char * equalSign = strchr(name, '=');
+    if (equalSign != NULL && equalSign != name) {
+        *equalSign = '\0';
+        restorable = isValidName(name) && findArray(name) == NULL && equalSign[1] != '(';
+        free(name);
+        return restorable;
+    }
+
+    if (strchr(text, '|') == NULL && strchr(name, '$') == NULL && findAlias(name) == NULL) {
+        for (size_t i = 0; i < NUM_RESTORABLE_BUILTINS && !restorable; i++) {
+            restorable = strcmp(name, restorableBuiltins[i]) == 0;
+        }
+    }
+
+    if (restorable && strcmp(name, "read") == 0) {
+        const char * word = text + length;
+        while (*(word += strspn(word, " \t")) != '\0') {
+            size_t wordLength = strcspn(word, " \t");
+            if (word[0] == '-' && memchr(word, 'a', wordLength) != NULL) {
+                restorable = 0;
+            }
+            word += wordLength;
+        }
+    }
+
+    free(name);
+    return restorable;
+}
+
+/**
+ * @brief Checks whether a list of commands can run in a subshell without fork()
+ * @param node Pointer to the first Node of the list
+ * @return Non-zero if every command is a built-in or assignment whose
+ *         effects saveShellState() and restoreShellState() undo
+ */
+int isRestorable(Node * node) {
+    for (; node != NULL; node = node->next) {
+        int restorable;
+        switch (node->type) {
+            case NODE_SIMPLE:
+                restorable = isRestorableCommand(node->text);
+                break;
+            case NODE_CONDITIONAL:
+                restorable = strstr(node->text, "=~") == NULL;
+                break;
+            case NODE_WHILE:
+            case NODE_UNTIL:
+                restorable = isRestorable(node->condition) && isRestorable(node->body);
+                break;
+            case NODE_FOR:
+                restorable = findArray(node->name) == NULL && isRestorable(node->body);
+                break;
+            case NODE_CASE:
+            case NODE_ARM:
+            case NODE_SUBSHELL:
+            case NODE_GROUP:
+                restorable = isRestorable(node->body);
+                break;
+            default:
+                restorable = 0;
+                break;
+        }
+
+        if (!restorable) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Saves the working directory and environment before a subshell
+ * @param state Pointer to the ShellState to fill
+ * @return 0 on success, -1 if the working directory cannot be opened
+ */
+int saveShellState(ShellState * state) {
+    state->directory = moveShellFd(open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (state->directory == -1) {
+        return -1;
+    }
+
+    size_t size = 0;
+    for (state->count = 0; environ[state->count] != NULL; state->count++) {
+        size += strlen(environ[state->count]) + 1;
+    }
+
+    state->environment = malloc(sizeof(char *) * (state->count + 1) + size);
+    if (state->environment == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char * copy = (char *) (state->environment + state->count + 1);
+    for (size_t i = 0; i < state->count; i++) {
+        size_t length = strlen(environ[i]) + 1;
+        memcpy(copy, environ[i], length);
+        state->environment[i] = copy;
+        copy += length;
+    }
+    state->environment[state->count] = NULL;
+    return 0;
+}
+
+/**
+ * @brief Finds a saved environment entry by variable name
+ * @param state Pointer to the ShellState
+ * @param first Index of the first saved entry to search
+ * @param name Start of the name
+ * @param length Length of the name
+ * @return The saved "name=value" entry, or NULL if the variable was not set
+ */
+static const char * findSavedVariable(ShellState * state, size_t first, const char * name, size_t length) {
+    for (size_t i = first; i < state->count; i++) {
+        if (strncmp(state->environment[i], name, length) == 0 && state->environment[i][length] == '=') {
+            return state->environment[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Restores the state saved by saveShellState() and releases it
+ * @param state Pointer to the ShellState
+ *
+ * Entries of the environment that still match the saved copy in order are
+ * skipped, since setenv() keeps a changed variable in place and adds new
+ * ones at the end. After them, variables set by the subshell are removed
+ * and variables it changed or removed are set back to their saved values.
+ */
+void restoreShellState(ShellState * state) {
+    if (fchdir(state->directory) == -1) {
+        perror("fchdir");
+    }
+    close(state->directory);
+
+    size_t same = 0;
+    while (same < state->count && environ[same] != NULL && strcmp(environ[same], state->environment[same]) == 0) {
+        same++;
+    }
+
+    size_t i = same;
+    while (environ[i] != NULL) {
+        size_t length = strcspn(environ[i], "=");
+        if (findSavedVariable(state, same, environ[i], length) != NULL) {
+            i++;
+            continue;
+        }
+
+        char * name = strndup(environ[i], length);
+        if (name == NULL) {
+            perror("strndup");
+            exit(EXIT_FAILURE);
+        }
+        if (unsetenv(name) == -1) {
+            i++;
+        }
+        free(name);
+    }
+
+    for (i = same; i < state->count; i++) {
+        char * entry = state->environment[i];
+        char * equalSign = strchr(entry, '=');
+        if (equalSign != NULL) {
+            *equalSign = '\0';
+            const char * current = getenv(entry);
+            if (current == NULL || strcmp(current, equalSign + 1) != 0) {
+                setenv(entry, equalSign + 1, 1);
+            }
+        }
+    }
+    free(state->environment);
+}
@@ -0,0 +1,869 @@
+/**
+ * @file Walk.c
+ * @brief Parallel file system walk built-in for SnailShell
+ *
+ * walk replaces the common "find ... -exec" pattern. Directory trees are
+ * traversed by a pool of threads, each owning a double-ended queue of
+ * directories: a thread takes work from the tail of its own queue (depth
+ * first, which keeps few directories open) and steals from the head of
+ * the other queues when it runs out. Directories are opened with openat()
+ * relative to their already open parent and read with getdents64(), so
+ * most entries are classified by d_type without calling stat().
+ *
+ * Matching paths are either printed or collected into batches that fill
+ * the argument list of a command up to the ARG_MAX limit. Batches are
+ * started by the shell's main thread while the walk continues, with at
+ * most a given number of commands running at once.
+ *
+ * Usage: walk [-name pattern] [-type f|d|l] [-size [+|-]N[k|M|G]]
+ *             [-mtime [+|-]N] [-maxdepth N] [-j threads] [-P jobs]
+ *             [dir ...] [-- command [args ...]]
+ *
+ * Output order depends on thread scheduling, as with any parallel walk.
+ * Symbolic links are reported but never followed.
+ */
+
+#include "SnailShell.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+extern char ** environ;
+
+/**
+ * @struct DirHandle
+ * @brief Open directory shared by the work items of its subdirectories
+ *
+ * The descriptor is closed when the last reference is released.
+ */
+typedef struct DirHandle {
+    int fd;
+    int references;
+} DirHandle;
+
+/**
+ * @struct WalkItem
+ * @brief Directory waiting to be read
+ *
+ * The directory is opened relative to parent (or to the working directory
+ * for roots) using the name at path + nameOffset.
+ */
+typedef struct WalkItem {
+    DirHandle * parent;
+    char * path;
+    size_t nameOffset;
+    int depth;
+} WalkItem;
+
+/**
+ * @struct WalkQueue
+ * @brief Ring buffer of directories owned by one thread
+ */
+typedef struct WalkQueue {
+    pthread_mutex_t lock;
+    WalkItem * items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} WalkQueue;
+
+/**
+ * @struct WalkBatch
+ * @brief Paths collected for one run of the command
+ */
+typedef struct WalkBatch {
+    char ** paths;
+    int count;
+    int capacity;
+    size_t bytes;
+    struct WalkBatch * next;
+} WalkBatch;
+
+/**
+ * @struct WalkOptions
+ * @brief Parsed arguments of the walk built-in
+ *
+ * Signs are -1, 0 or 1 for "-N", "N" and "+N". The command is a slice of
+ * the built-in's own arguments.
+ */
+typedef struct WalkOptions {
+    Pattern * name;
+    char type;
+    int sizeSign;
+    long long size;
+    int mtimeSign;
+    long long mtimeDays;
+    int maxDepth;
+    int threads;
+    int jobs;
+    char ** roots;
+    int rootCount;
+    char ** command;
+    int commandCount;
+    size_t batchLimit;
+    time_t now;
+} WalkOptions;
+
+/**
+ * @struct Walk
+ * @brief State shared by the threads of a walk
+ *
+ * pending counts directories queued or being read; the walk is over when
+ * it drops to zero. idle counts threads waiting for work on wake.
+ */
+typedef struct Walk {
+    WalkOptions options;
+    WalkQueue * queues;
+    long pending;
+    int idle;
+    int failed;
+    int activeWorkers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t batchReady;
+    pthread_mutex_t outputLock;
+    WalkBatch * batches;
+    WalkBatch ** batchTail;
+} Walk;
+
+/**
+ * @struct Worker
+ * @brief Per-thread state of a walk
+ */
+typedef struct Worker {
+    Walk * walk;
+    int index;
+    pthread_t thread;
+    char * buffer;
+    Buffer path;
+    Buffer output;
+    WalkBatch * batch;
+} Worker;
+
+/**
+ * @brief Releases a reference to an open directory
+ * @param handle Pointer to the DirHandle (may be NULL)
+ */
+static void releaseHandle(DirHandle * handle) {
+    if (handle != NULL && __atomic_sub_fetch(&handle->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(handle->fd);
+        free(handle);
+    }
+}
+
+/**
+ * @brief Adds a directory to the tail of a queue
+ * @param walk Pointer to the Walk
+ * @param queue Pointer to the WalkQueue
+ * @param item The directory to add
+ *
+ * Wakes an idle thread, if any, so it can steal the new work.
+ */
+static void pushItem(Walk * walk, WalkQueue * queue, WalkItem item) {
+    __atomic_add_fetch(&walk->pending, 1, __ATOMIC_ACQ_REL);
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity == 0 ? 64 : queue->capacity * 2;
+        WalkItem * items = malloc(sizeof(WalkItem) * capacity);
+        if (items == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < queue->count; i++) {
+            items[i] = queue->items[(queue->head + i) % queue->capacity];
+        }
+        free(queue->items);
+        queue->items = items;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (__atomic_load_n(&walk->idle, __ATOMIC_ACQUIRE) > 0) {
+        pthread_mutex_lock(&walk->lock);
+        pthread_cond_signal(&walk->wake);
+        pthread_mutex_unlock(&walk->lock);
+    }
+}
+
+/**
+ * @brief Takes a directory from a queue
+ * @param queue Pointer to the WalkQueue
+ * @param steal Whether to take the oldest item (stealing) or the newest
+ * @param item Pointer to store the directory
+ * @return 1 if a directory was taken, 0 if the queue was empty
+ */
+static int takeItem(WalkQueue * queue, int steal, WalkItem * item) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+
+    if (steal) {
+        *item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+    } else {
+        *item = queue->items[(queue->head + queue->count - 1) % queue->capacity];
+    }
+    queue->count--;
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+/**
+ * @brief Finds work for a thread, stealing from the others if needed
+ * @param worker Pointer to the Worker
+ * @param item Pointer to store the directory
+ * @return 1 if a directory was found, 0 if no queue had one
+ */
+static int findItem(Worker * worker, WalkItem * item) {
+    Walk * walk = worker->walk;
+    if (takeItem(&walk->queues[worker->index], 0, item)) {
+        return 1;
+    }
+
+    int threads = walk->options.threads;
+    for (int i = 1; i < threads; i++) {
+        if (takeItem(&walk->queues[(worker->index + i) % threads], 1, item)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the buffered output of a thread
+ * @param worker Pointer to the Worker
+ *
+ * Output is written in whole lines under a lock so that lines of different
+ * threads never interleave.
+ */
+static void flushOutput(Worker * worker) {
+    if (worker->output.length == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&worker->walk->outputLock);
+    size_t written = 0;
+    while (written < worker->output.length) {
+        ssize_t bytes = write(STDOUT_FILENO, worker->output.data + written, worker->output.length - written);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += bytes;
+    }
+    pthread_mutex_unlock(&worker->walk->outputLock);
+    worker->output.length = 0;
+}
+
+/**
+ * @brief Hands a thread's current batch to the main thread
+ * @param worker Pointer to the Worker
+ */
+static void submitBatch(Worker * worker) {
+    WalkBatch * batch = worker->batch;
+    if (batch == NULL) {
+        return;
+    }
+
+    worker->batch = NULL;
+    Walk * walk = worker->walk;
+    pthread_mutex_lock(&walk->lock);
+    *walk->batchTail = batch;
+    walk->batchTail = &batch->next;
+    pthread_cond_signal(&walk->batchReady);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/**
+ * @brief Emits a matching path
+ * @param worker Pointer to the Worker
+ * @param path The path
+ * @param length Length of the path
+ *
+ * Without a command the path is buffered for output. With a command it is
+ * added to the thread's batch, which is submitted first if the path would
+ * no longer fit into the argument list.
+ */
+static void emitPath(Worker * worker, const char * path, size_t length) {
+    WalkOptions * options = &worker->walk->options;
+    if (options->commandCount == 0) {
+        bufferAppend(&worker->output, path, length);
+        bufferAppend(&worker->output, "\n", 1);
+        if (worker->output.length >= WALK_OUTPUT_BUFFER) {
+            flushOutput(worker);
+        }
+        return;
+    }
+
+    size_t bytes = length + 1 + sizeof(char *);
+    if (worker->batch != NULL && worker->batch->bytes + bytes > options->batchLimit) {
+        submitBatch(worker);
+    }
+    if (worker->batch == NULL) {
+        worker->batch = calloc(1, sizeof(WalkBatch));
+        if (worker->batch == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char * copy = strndup(path, length);
+    if (copy == NULL) {
+        perror("strndup");
+        exit(EXIT_FAILURE);
+    }
+    appendWord(&worker->batch->paths, &worker->batch->count, &worker->batch->capacity, copy);
+    worker->batch->bytes += bytes;
+}
+
+/**
+ * @brief Compares a value against a find-style numeric test
+ * @param value The value
+ * @param sign -1 for "less than", 1 for "greater than", 0 for "equal"
+ * @param limit The limit
+ * @return Non-zero if the test holds
+ */
+static int compareLimit(long long value, int sign, long long limit) {
+    return sign < 0 ? value < limit : sign > 0 ? value > limit : value == limit;
+}
+
+/**
+ * @brief Converts a file mode to a d_type value
+ * @param mode The st_mode of a file
+ * @return DT_DIR, DT_REG, DT_LNK or DT_UNKNOWN
+ */
+static unsigned char modeType(mode_t mode) {
+    return S_ISDIR(mode) ? DT_DIR : S_ISREG(mode) ? DT_REG : S_ISLNK(mode) ? DT_LNK : DT_UNKNOWN;
+}
+
+/**
+ * @brief Returns the -type letter of a directory entry
+ * @param type The d_type of the entry
+ * @return 'f', 'd', 'l' or '?'
+ */
+static char entryType(unsigned char type) {
+    return type == DT_REG ? 'f' : type == DT_DIR ? 'd' : type == DT_LNK ? 'l' : '?';
+}
+
+/**
+ * @brief Applies the filters of a walk to an entry
+ * @param options Pointer to the WalkOptions
+ * @param dirfd Descriptor of the directory containing the entry
+ * @param name Name of the entry
+ * @param type Pointer to the d_type of the entry, resolved if unknown
+ * @return Non-zero if the entry passes every filter
+ *
+ * Cheap tests run first: the name, then the type from d_type. stat() is
+ * only called for size and time filters or when d_type is unknown.
+ */
+static int matchEntry(WalkOptions * options, int dirfd, const char * name, unsigned char * type) {
+    if (options->name != NULL && !matchPattern(options->name, name, strlen(name))) {
+        return 0;
+    }
+
+    struct stat info;
+    int needStat = *type == DT_UNKNOWN || options->sizeSign != WALK_UNSET || options->mtimeSign != WALK_UNSET;
+    if (needStat) {
+        if (fstatat(dirfd, name, &info, AT_SYMLINK_NOFOLLOW) == -1) {
+            return 0;
+        }
+        if (*type == DT_UNKNOWN) {
+            *type = modeType(info.st_mode);
+        }
+    }
+
+    if (options->type != '\0' && entryType(*type) != options->type) {
+        return 0;
+    }
+    if (options->sizeSign != WALK_UNSET && !compareLimit(info.st_size, options->sizeSign, options->size)) {
+        return 0;
+    }
+    if (options->mtimeSign != WALK_UNSET &&
+        !compareLimit((options->now - info.st_mtime) / 86400, options->mtimeSign, options->mtimeDays)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads one directory, emitting matches and queueing subdirectories
+ * @param worker Pointer to the Worker
+ * @param item The directory
+ */
+static void readDirectory(Worker * worker, WalkItem * item) {
+    Walk * walk = worker->walk;
+    WalkOptions * options = &walk->options;
+
+    int fd = openat(item->parent != NULL ? item->parent->fd : AT_FDCWD, item->path + item->nameOffset,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    releaseHandle(item->parent);
+    if (fd == -1) {
+        printError(ERROR_WALK_PATH, item->path, strerror(errno));
+        __atomic_store_n(&walk->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    DirHandle * handle = malloc(sizeof(DirHandle));
+    if (handle == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    handle->fd = fd;
+    handle->references = 1;
+
+    size_t pathLength = strlen(item->path);
+    int slash = pathLength > 0 && item->path[pathLength - 1] != '/';
+    worker->path.length = 0;
+    bufferAppend(&worker->path, item->path, pathLength);
+    bufferAppend(&worker->path, "/", slash);
+    size_t prefixLength = worker->path.length;
+    long bytes;
+
+    while ((bytes = syscall(SYS_getdents64, fd, worker->buffer, WALK_DIRENT_BUFFER)) > 0) {
+        for (long position = 0; position < bytes;) {
+            LinuxDirent64 * entry = (LinuxDirent64 *) (worker->buffer + position);
+            position += entry->d_reclen;
+
+            const char * name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+
+            worker->path.length = prefixLength;
+            bufferAppend(&worker->path, name, strlen(name));
+
+            unsigned char type = entry->d_type;
+            if (matchEntry(options, fd, name, &type)) {
+                emitPath(worker, worker->path.data, worker->path.length);
+            }
+
+            if (type == DT_UNKNOWN) {
+                struct stat info;
+                if (fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode)) {
+                    type = DT_DIR;
+                }
+            }
+
+            if (type == DT_DIR && item->depth + 1 < options->maxDepth) {
+                char * path = strdup(worker->path.data);
+                if (path == NULL) {
+                    perror("strdup");
+                    exit(EXIT_FAILURE);
+                }
+                __atomic_add_fetch(&handle->references, 1, __ATOMIC_ACQ_REL);
+                WalkItem child = { handle, path, prefixLength, item->depth + 1 };
+                pushItem(walk, &walk->queues[worker->index], child);
+            }
+        }
+    }
+
+    if (bytes == -1) {
+        printError(ERROR_WALK_PATH, item->path, strerror(errno));
+        __atomic_store_n(&walk->failed, 1, __ATOMIC_RELAXED);
+    }
+    releaseHandle(handle);
+}
+
+/**
+ * @brief Main loop of a walk thread
+ * @param argument Pointer to the Worker
+ * @return NULL
+ *
+ * Threads with nothing to do sleep until new directories are queued or
+ * the walk is over. Before exiting, each thread writes its buffered output
+ * and submits its last batch.
+ */
+static void * runWorker(void * argument) {
+    Worker * worker = argument;
+    Walk * walk = worker->walk;
+
+    for (;;) {
+        WalkItem item;
+        if (!findItem(worker, &item)) {
+            pthread_mutex_lock(&walk->lock);
+            __atomic_add_fetch(&walk->idle, 1, __ATOMIC_ACQ_REL);
+            int found;
+            while (!(found = findItem(worker, &item)) && __atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE) > 0) {
+                pthread_cond_wait(&walk->wake, &walk->lock);
+            }
+            __atomic_sub_fetch(&walk->idle, 1, __ATOMIC_ACQ_REL);
+            pthread_mutex_unlock(&walk->lock);
+            if (!found) {
+                break;
+            }
+        }
+
+        readDirectory(worker, &item);
+        free(item.path);
+
+        if (__atomic_sub_fetch(&walk->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+            pthread_mutex_lock(&walk->lock);
+            pthread_cond_broadcast(&walk->wake);
+            pthread_mutex_unlock(&walk->lock);
+        }
+    }
+
+    flushOutput(worker);
+    submitBatch(worker);
+
+    pthread_mutex_lock(&walk->lock);
+    walk->activeWorkers--;
+    pthread_cond_signal(&walk->batchReady);
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+/**
+ * @brief Parses a find-style numeric argument
+ * @param text The argument ("+N", "-N" or "N", with an optional suffix)
+ * @param allowSuffix Whether k/M/G size suffixes are accepted
+ * @param sign Pointer to store -1, 0 or 1
+ * @param value Pointer to store the number
+ * @return 0 on success, -1 on failure
+ */
+static int parseWalkNumber(const char * text, int allowSuffix, int * sign, long long * value) {
+    *sign = *text == '+' ? 1 : *text == '-' ? -1 : 0;
+    if (*sign != 0) {
+        text++;
+    }
+    if (!isdigit((unsigned char) *text)) {
+        return -1;
+    }
+
+    char * end;
+    *value = strtoll(text, &end, 10);
+    if (allowSuffix && *end != '\0' && end[1] == '\0') {
+        switch (*end) {
+            case 'G': *value *= 1024;
+            /* fall through */
+            case 'M': *value *= 1024;
+            /* fall through */
+            case 'k': *value *= 1024;
+                end++;
+                break;
+            default:
+                return -1;
+        }
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+/**
+ * @brief Computes how many bytes of paths fit into one command line
+ * @param options Pointer to the WalkOptions
+ * @return Byte budget for the paths of one batch
+ *
+ * ARG_MAX covers the argument and environment strings and their pointers;
+ * the environment, the command's own arguments and some headroom are
+ * subtracted.
+ */
+static size_t computeBatchLimit(WalkOptions * options) {
+    long argMax = sysconf(_SC_ARG_MAX);
+    if (argMax <= 0) {
+        argMax = WALK_DEFAULT_ARG_MAX;
+    }
+
+    size_t used = WALK_ARG_HEADROOM;
+    for (char ** variable = environ; *variable != NULL; variable++) {
+        used += strlen(*variable) + 1 + sizeof(char *);
+    }
+    for (int i = 0; i < options->commandCount; i++) {
+        used += strlen(options->command[i]) + 1 + sizeof(char *);
+    }
+
+    return (size_t) argMax > used + WALK_ARG_HEADROOM ? (size_t) argMax - used : WALK_ARG_HEADROOM;
+}
+
+/**
+ * @brief Parses the arguments of the walk built-in
+ * @param curr Pointer to the Command structure containing walk arguments
+ * @param options Pointer to the WalkOptions to fill
+ * @return 0 on success, -1 on failure
+ */
+static int parseWalkOptions(Command * curr, WalkOptions * options) {
+    memset(options, 0, sizeof(WalkOptions));
+    options->sizeSign = WALK_UNSET;
+    options->mtimeSign = WALK_UNSET;
+    options->maxDepth = INT_MAX;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options->threads = cpus > 0 ? (int) cpus : 1;
+    options->jobs = options->threads;
+
+    int i = 1;
+    for (; i < curr->argCount; i++) {
+        const char * arg = curr->args[i];
+        const char * value = i + 1 < curr->argCount ? curr->args[i + 1] : NULL;
+
+        if (strcmp(arg, "--") == 0) {
+            options->command = curr->args + i + 1;
+            options->commandCount = curr->argCount - i - 1;
+            if (options->commandCount == 0) {
+                return -1;
+            }
+            break;
+        }
+
+        if (arg[0] != '-' || arg[1] == '\0') {
+            if (options->roots == NULL) {
+                options->roots = curr->args + i;
+            }
+            if (options->roots + options->rootCount != curr->args + i) {
+                return -1;
+            }
+            options->rootCount++;
+            continue;
+        }
+
+        if (value == NULL) {
+            return -1;
+        }
+        i++;
+
+        long long number;
+        if (strcmp(arg, "-name") == 0) {
+            freePattern(options->name);
+            options->name = compilePattern(value);
+        } else if (strcmp(arg, "-type") == 0) {
+            if (strlen(value) != 1 || strchr("fdl", value[0]) == NULL) {
+                return -1;
+            }
+            options->type = value[0];
+        } else if (strcmp(arg, "-size") == 0) {
+            if (parseWalkNumber(value, 1, &options->sizeSign, &options->size) == -1) {
+                return -1;
+            }
+        } else if (strcmp(arg, "-mtime") == 0) {
+            if (parseWalkNumber(value, 0, &options->mtimeSign, &options->mtimeDays) == -1) {
+                return -1;
+            }
+        } else {
+            int sign;
+            if (parseWalkNumber(value, 0, &sign, &number) == -1 || sign != 0 || number > INT_MAX) {
+                return -1;
+            }
+            if (strcmp(arg, "-maxdepth") == 0) {
+                options->maxDepth = (int) number;
+            } else if (strcmp(arg, "-j") == 0 && number > 0) {
+                options->threads = (int) number;
+            } else if (strcmp(arg, "-P") == 0 && number > 0) {
+                options->jobs = (int) number;
+            } else {
+                return -1;
+            }
+        }
+    }
+
+    if (options->threads > WALK_MAX_THREADS) {
+        options->threads = WALK_MAX_THREADS;
+    }
+    options->batchLimit = computeBatchLimit(options);
+    options->now = time(NULL);
+    return 0;
+}
+
+/**
+ * @brief Runs the command for one batch of paths
+ * @param options Pointer to the WalkOptions
+ * @param batch Pointer to the WalkBatch (freed)
+ * @return Process ID of the command
+ */
+static pid_t startBatch(WalkOptions * options, WalkBatch * batch) {
+    char ** args = NULL;
+    int count = 0;
+    int capacity = 0;
+    for (int i = 0; i < options->commandCount; i++) {
+        appendWord(&args, &count, &capacity, options->command[i]);
+    }
+    for (int i = 0; i < batch->count; i++) {
+        appendWord(&args, &count, &capacity, batch->paths[i]);
+    }
+
+    pid_t pid = spawnArgs(args);
+
+    for (int i = 0; i < batch->count; i++) {
+        free(batch->paths[i]);
+    }
+    free(batch->paths);
+    free(batch);
+    free(args);
+    return pid;
+}
+
+/**
+ * @brief Waits for one running batch command
+ * @return 0 if it succeeded, 1 otherwise
+ */
+static int waitBatch() {
+    int status;
+    while (waitpid(-1, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return 1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Evaluates a root of the walk and queues it
+ * @param walk Pointer to the Walk
+ * @param worker Pointer to the Worker used to emit the root itself
+ * @param root The root path
+ * @param queue Index of the queue receiving the root
+ */
+static void addRoot(Walk * walk, Worker * worker, const char * root, int queue) {
+    struct stat info;
+    if (fstatat(AT_FDCWD, root, &info, AT_SYMLINK_NOFOLLOW) == -1) {
+        printError(ERROR_WALK_PATH, root, strerror(errno));
+        walk->failed = 1;
+        return;
+    }
+
+    const char * slash = strrchr(root, '/');
+    const char * name = slash != NULL && slash[1] != '\0' ? slash + 1 : root;
+    unsigned char type = modeType(info.st_mode);
+
+    Pattern * namePattern = walk->options.name;
+    if (namePattern == NULL || matchPattern(namePattern, name, strlen(name))) {
+        walk->options.name = NULL;
+        if (matchEntry(&walk->options, AT_FDCWD, root, &type)) {
+            emitPath(worker, root, strlen(root));
+        }
+        walk->options.name = namePattern;
+    }
+
+    if (type == DT_DIR && walk->options.maxDepth > 0) {
+        char * path = strdup(root);
+        if (path == NULL) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        WalkItem item = { NULL, path, 0, 0 };
+        pushItem(walk, &walk->queues[queue], item);
+    }
+}
+
+/**
+ * @brief Handles the built-in walk command
+ * @param curr Pointer to the Command structure containing walk arguments
+ * @return 0 on success, -1 if a path could not be read or a command failed
+ *
+ * The calling thread starts the worker threads and, when a command is
+ * given, runs the batches they submit, keeping at most -P commands running.
+ */
+int handleWalk(Command * curr) {
+    Walk walk;
+    memset(&walk, 0, sizeof(Walk));
+    if (parseWalkOptions(curr, &walk.options) == -1) {
+        printError(ERROR_WALK_USAGE);
+        freePattern(walk.options.name);
+        return -1;
+    }
+
+    WalkOptions * options = &walk.options;
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_mutex_init(&walk.outputLock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+    pthread_cond_init(&walk.batchReady, NULL);
+    walk.batchTail = &walk.batches;
+
+    walk.queues = calloc(options->threads, sizeof(WalkQueue));
+    Worker * workers = calloc(options->threads, sizeof(Worker));
+    if (walk.queues == NULL || workers == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < options->threads; i++) {
+        pthread_mutex_init(&walk.queues[i].lock, NULL);
+        workers[i].walk = &walk;
+        workers[i].index = i;
+        workers[i].buffer = malloc(WALK_DIRENT_BUFFER);
+        if (workers[i].buffer == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    fflush(stdout);
+    if (options->rootCount == 0) {
+        addRoot(&walk, &workers[0], ".", 0);
+    }
+    for (int i = 0; i < options->rootCount; i++) {
+        addRoot(&walk, &workers[0], options->roots[i], i % options->threads);
+    }
+
+    walk.activeWorkers = options->threads;
+    for (int i = 0; i < options->threads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int running = 0;
+    int failed = 0;
+    for (;;) {
+        pthread_mutex_lock(&walk.lock);
+        while (walk.batches == NULL && walk.activeWorkers > 0) {
+            pthread_cond_wait(&walk.batchReady, &walk.lock);
+        }
+        WalkBatch * batch = walk.batches;
+        if (batch != NULL) {
+            walk.batches = batch->next;
+            if (walk.batches == NULL) {
+                walk.batchTail = &walk.batches;
+            }
+        }
+        pthread_mutex_unlock(&walk.lock);
+
+        if (batch == NULL) {
+            break;
+        }
+        if (running == options->jobs) {
+            failed |= waitBatch();
+            running--;
+        }
+        if (startBatch(options, batch) != -1) {
+            running++;
+        } else {
+            failed = 1;
+        }
+    }
+
+    for (; running > 0; running--) {
+        failed |= waitBatch();
+    }
+
+    for (int i = 0; i < options->threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&walk.queues[i].lock);
+        free(walk.queues[i].items);
+        free(workers[i].buffer);
+        free(workers[i].path.data);
+        free(workers[i].output.data);
+    }
+
+    pthread_mutex_destroy(&walk.lock);
+    pthread_mutex_destroy(&walk.outputLock);
+    pthread_cond_destroy(&walk.wake);
+    pthread_cond_destroy(&walk.batchReady);
+    freePattern(options->name);
+    free(walk.queues);
+    free(workers);
+    return failed || walk.failed ? -1 : 0;
+}